@@ -421,8 +421,8 @@ namespace file_io_utils
 		}
 	}
 
-  template<class t_value>
-  bool load_file_to_vector(const std::string& path_to_file, std::vector<t_value>& res)
+  template<class t_value, class t_allocator>
+  bool load_file_to_vector(const std::string& path_to_file, std::vector<t_value, t_allocator>& res)
   {
       try
       {
@@ -30,11 +30,16 @@
 #ifndef __WINH_OBJ_H__
 #define __WINH_OBJ_H__
 
+#include <atomic>
 #include <condition_variable>
+#include <map>
 #include <mutex>
+#include <stdexcept>
+#include <thread>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 
 
@@ -155,6 +160,154 @@ namespace epee
   };
 
 
+  /************************************************************************/
+  /* reader/writer lock, reentrant in both modes:                         */
+  /*  - shared lock taken by exclusive owner is just a nested exclusive   */
+  /*  - upgrading shared to exclusive is not supported (throws)           */
+  /************************************************************************/
+  class recursive_shared_critical_section
+  {
+    boost::shared_mutex m_section;
+    std::atomic<std::thread::id> m_exclusive_owner;
+    size_t m_exclusive_recursion;                             // accessed by exclusive owner only
+    std::map<std::thread::id, size_t> m_shared_recursion;     // thread id -> shared recursion depth
+    std::mutex m_shared_recursion_lock;
+
+  public:
+    recursive_shared_critical_section() : m_exclusive_owner(std::thread::id()), m_exclusive_recursion(0)
+    {}
+
+    //to make copy fake!
+    recursive_shared_critical_section(const recursive_shared_critical_section&) : m_exclusive_owner(std::thread::id()), m_exclusive_recursion(0)
+    {}
+
+    // to make copy fake
+    recursive_shared_critical_section& operator=(const recursive_shared_critical_section&)
+    {
+      return *this;
+    }
+
+    void lock()
+    {
+      if (m_exclusive_owner.load() == std::this_thread::get_id())
+      {
+        ++m_exclusive_recursion;
+        return;
+      }
+      if (get_shared_recursion())
+        throw std::logic_error("recursive_shared_critical_section: upgrading shared lock to exclusive is not supported");
+      m_section.lock();
+      m_exclusive_owner = std::this_thread::get_id();
+      m_exclusive_recursion = 1;
+    }
+
+    bool try_lock()
+    {
+      if (m_exclusive_owner.load() == std::this_thread::get_id())
+      {
+        ++m_exclusive_recursion;
+        return true;
+      }
+      if (get_shared_recursion() || !m_section.try_lock())
+        return false;
+      m_exclusive_owner = std::this_thread::get_id();
+      m_exclusive_recursion = 1;
+      return true;
+    }
+
+    void unlock()
+    {
+      if (--m_exclusive_recursion == 0)
+      {
+        m_exclusive_owner = std::thread::id();
+        m_section.unlock();
+      }
+    }
+
+    void lock_shared()
+    {
+      if (m_exclusive_owner.load() == std::this_thread::get_id())
+      {
+        ++m_exclusive_recursion;
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> guard(m_shared_recursion_lock);
+        size_t& recursion = m_shared_recursion[std::this_thread::get_id()];
+        if (recursion++)
+          return;
+      }
+      try
+      {
+        m_section.lock_shared();
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> guard(m_shared_recursion_lock);
+        m_shared_recursion.erase(std::this_thread::get_id());
+        throw;
+      }
+    }
+
+    void unlock_shared()
+    {
+      if (m_exclusive_owner.load() == std::this_thread::get_id())
+      {
+        unlock();
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> guard(m_shared_recursion_lock);
+        auto it = m_shared_recursion.find(std::this_thread::get_id());
+        if (it == m_shared_recursion.end())
+          return;
+        if (--it->second)
+          return;
+        m_shared_recursion.erase(it);
+      }
+      m_section.unlock_shared();
+    }
+
+  private:
+    size_t get_shared_recursion()
+    {
+      std::lock_guard<std::mutex> guard(m_shared_recursion_lock);
+      auto it = m_shared_recursion.find(std::this_thread::get_id());
+      return it == m_shared_recursion.end() ? 0 : it->second;
+    }
+  };
+
+
+  template<class t_lock>
+  class shared_critical_region_t
+  {
+    t_lock&	m_locker;
+    bool m_unlocked;
+
+    shared_critical_region_t(const shared_critical_region_t&) {}
+
+  public:
+    shared_critical_region_t(t_lock& cs): m_locker(cs), m_unlocked(false)
+    {
+      m_locker.lock_shared();
+    }
+
+    ~shared_critical_region_t()
+    {
+      unlock();
+    }
+
+    void unlock()
+    {
+      if (!m_unlocked)
+      {
+        m_locker.unlock_shared();
+        m_unlocked = true;
+      }
+    }
+  };
+
+
 #if defined(WINDWOS_PLATFORM)
   class shared_critical_section
   {
@@ -234,6 +387,7 @@ namespace epee
 #define  EXCLUSIVE_CRITICAL_REGION_BEGIN(x) { EXCLUSIVE_CRITICAL_REGION_LOCAL(x)
 
 #define  CRITICAL_REGION_LOCAL(x) epee::critical_region_t<decltype(x)>   critical_region_var(x)
+#define  SHARED_RECURSIVE_CRITICAL_REGION_LOCAL(x) epee::shared_critical_region_t<decltype(x)>   critical_region_var(x)
 #define  CRITICAL_REGION_BEGIN(x) { epee::critical_region_t<decltype(x)>   critical_region_var(x)
 #define  CRITICAL_REGION_LOCAL1(x) epee::critical_region_t<decltype(x)>   critical_region_var1(x)
 #define  CRITICAL_REGION_BEGIN1(x) { epee::critical_region_t<decltype(x)>   critical_region_var1(x)
@@ -5,6 +5,7 @@
 
 #include <set>
 #include <memory>
+#include <type_traits>
 #include "misc_language.h"
 #include "misc_log_ex.h"
 #include "currency_core/currency_format_utils.h"
@@ -45,8 +46,11 @@ namespace db
     virtual bool begin_transaction(bool read_only_access = false) = 0;
     virtual bool commit_transaction() = 0;
     virtual void abort_transaction() = 0;
+    virtual bool has_active_transaction() const = 0;
 
     virtual bool get(const table_id tid, const char* key_data, size_t key_size, std::string& out_buffer) = 0;
+    // zero-copy read: value_data points directly to the DB storage and stays valid only until the current transaction of the calling thread ends
+    virtual bool get_view(const table_id tid, const char* key_data, size_t key_size, const char*& value_data, size_t& value_size) = 0;
     virtual bool set(const table_id tid, const char* key_data, size_t key_size, const char* value_data, size_t value_size) = 0;
     virtual bool erase(const table_id tid, const char* key_data, size_t key_size) = 0;
 
@@ -164,17 +168,59 @@ namespace db
       return m_db_adapter_ptr->erase(tid, key_data, key_size);
     }
 
-    template<class tkey_pod_t, class t_object>
-    bool get_serializable_object(const table_id tid, const tkey_pod_t& tkey, t_object& obj) const
+    // calls cb(value_data, value_size) for a view on the stored value without copying it
+    // the view is valid only inside the callback; a local read-only transaction is used if there is no active one
+    template<class tkey_pod_t, class callback_t>
+    bool visit_value(const table_id tid, const tkey_pod_t& tkey, callback_t cb) const
     {
-      std::string buffer;
       size_t key_size = 0;
       const char* key_data = tkey_to_pointer(tkey, key_size);
 
-      if (!m_db_adapter_ptr->get(tid, key_data, key_size, buffer))
+      bool local_transaction = !m_db_adapter_ptr->has_active_transaction();
+      if (local_transaction)
+      {
+        bool r = m_db_adapter_ptr->begin_transaction(true);
+        if (!r)
+          m_db_adapter_ptr->abort_transaction(); //pops stack entry that adapter pushed anyway
+        CHECK_AND_ASSERT_MES(r, false, "begin_transaction failed");
+      }
+      auto local_tx_committer = epee::misc_utils::create_scope_leave_handler([&]() {
+        if (local_transaction)
+          m_db_adapter_ptr->commit_transaction();
+      });
+
+      const char* value_data = nullptr;
+      size_t value_size = 0;
+      if (!m_db_adapter_ptr->get_view(tid, key_data, key_size, value_data, value_size))
         return false;
 
-      return currency::t_unserializable_object_from_blob(obj, buffer);
+      return cb(value_data, value_size);
+    }
+
+    // returns a view on the stored value, valid only until the current transaction of the calling thread ends
+    template<class tkey_pod_t>
+    bool get_view(const table_id tid, const tkey_pod_t& tkey, const char*& value_data, size_t& value_size) const
+    {
+      CHECK_AND_ASSERT_MES(m_db_adapter_ptr->has_active_transaction(), false, "get_view called without an active transaction");
+      size_t key_size = 0;
+      const char* key_data = tkey_to_pointer(tkey, key_size);
+      return m_db_adapter_ptr->get_view(tid, key_data, key_size, value_data, value_size);
+    }
+
+    template<class tkey_pod_t>
+    bool has_value(const table_id tid, const tkey_pod_t& tkey) const
+    {
+      return visit_value(tid, tkey, [](const char*, size_t) { return true; });
+    }
+
+    template<class tkey_pod_t, class t_object>
+    bool get_serializable_object(const table_id tid, const tkey_pod_t& tkey, t_object& obj) const
+    {
+      return visit_value(tid, tkey, [&obj](const char* value_data, size_t value_size)
+      {
+        std::string buffer(value_data, value_size);
+        return currency::t_unserializable_object_from_blob(obj, buffer);
+      });
     }
 
     template<class tkey_pod_t, class t_object>
@@ -188,22 +234,28 @@ namespace db
       return m_db_adapter_ptr->set(tid, key_data, key_size, buffer.data(), buffer.size());
     }
 
-    template<class tkey_pod_t, class t_object_pod_t>
-    bool get_pod_object(const table_id tid, const tkey_pod_t& tkey, t_object_pod_t& obj) const
+    template<class tkey_pod_t>
+    bool set_raw_value(const table_id tid, const tkey_pod_t& tkey, const char* value_data, size_t value_size)
     {
-      static_assert(std::is_pod<t_object_pod_t>::value, "POD type expected");
-
-      std::string buffer;
       size_t key_size = 0;
       const char* key_data = tkey_to_pointer(tkey, key_size);
+      return m_db_adapter_ptr->set(tid, key_data, key_size, value_data, value_size);
+    }
 
-      if (!m_db_adapter_ptr->get(tid, key_data, key_size, buffer))
-        return false;
-
-      CHECK_AND_ASSERT_MES(sizeof(t_object_pod_t) == buffer.size(), false, "get " << buffer.size() << " bytes of data, while " << sizeof(t_object_pod_t) << " bytes is expected as sizeof(t_object_pod_t)");
+    template<class tkey_pod_t, class t_object_pod_t>
+    bool get_pod_object(const table_id tid, const tkey_pod_t& tkey, t_object_pod_t& obj) const
+    {
+      static_assert(std::is_pod<t_object_pod_t>::value, "POD type expected");
 
-      obj = *reinterpret_cast<const t_object_pod_t*>(buffer.data());
-      return true;
+      return visit_value(tid, tkey, [&obj](const char* value_data, size_t value_size)
+      {
+        CHECK_AND_ASSERT_MES(sizeof(t_object_pod_t) == value_size, false, "get " << value_size << " bytes of data, while " << sizeof(t_object_pod_t) << " bytes is expected as sizeof(t_object_pod_t)");
+        //value in mapped db page may be unaligned
+        typename std::aligned_storage<sizeof(t_object_pod_t), alignof(t_object_pod_t)>::type aligned_value;
+        memcpy(&aligned_value, value_data, sizeof(t_object_pod_t));
+        obj = *reinterpret_cast<const t_object_pod_t*>(&aligned_value);
+        return true;
+      });
     }
 
     template<class tkey_pod_t, class t_object_pod_t>
@@ -245,6 +297,42 @@ namespace db
   }; // db_bridge_base
 
 
+  // keeps a read-only transaction open for the object's lifetime, unless the calling thread already has an active one
+  // (lmdb doesn't allow nested read-only transactions, so everything inside the scope shares a single snapshot)
+  class read_only_transaction_scope
+  {
+  public:
+    explicit read_only_transaction_scope(const db_bridge_base& dbb)
+      : m_db_adapter_ptr(dbb.get_adapter())
+      , m_began_transaction(false)
+      , m_owns_transaction(false)
+    {
+      if (!m_db_adapter_ptr->has_active_transaction())
+      {
+        m_began_transaction = true;
+        m_owns_transaction = m_db_adapter_ptr->begin_transaction(true);
+      }
+    }
+
+    ~read_only_transaction_scope()
+    {
+      //adapter keeps stack entry of this thread even if begin failed, it has to be popped anyway
+      if (m_owns_transaction)
+        m_db_adapter_ptr->commit_transaction();
+      else if (m_began_transaction)
+        m_db_adapter_ptr->abort_transaction();
+    }
+
+  private:
+    read_only_transaction_scope(const read_only_transaction_scope&);
+    read_only_transaction_scope& operator=(const read_only_transaction_scope&);
+
+    std::shared_ptr<i_db_adapter> m_db_adapter_ptr;
+    bool m_began_transaction;
+    bool m_owns_transaction;
+  };
+
+
   class pod_object_value_helper
   {
   public:
@@ -268,6 +356,13 @@ namespace db
       return nullptr;
     }
 
+    template<class key_t, class value_t>
+    static bool get_value(const table_id tid, const db_bridge_base& dbb, const key_t& k, value_t& v)
+    {
+      static_assert(std::is_pod<value_t>::value, "POD type expected");
+      return dbb.get_pod_object(tid, k, v);
+    }
+
     template<class key_t, class value_t>
     static void set(const table_id tid, db_bridge_base& dbb, const key_t& k, const value_t& v)
     {
@@ -296,6 +391,12 @@ namespace db
       return nullptr;
     }
 
+    template<class key_t, class value_t>
+    static bool get_value(const table_id tid, const db_bridge_base& dbb, const key_t& k, value_t& v)
+    {
+      return dbb.get_serializable_object(tid, k, v);
+    }
+
     template<class key_t, class value_t>
     static void set(const table_id tid, db_bridge_base& dbb, const key_t& k, const value_t& v)
     {
@@ -303,6 +404,37 @@ namespace db
     }
   };
 
+  // values are canonical blobs, stored as is: reading them gives bytes ready to be sent over the wire
+  class raw_blob_value_helper
+  {
+  public:
+    template<class key_t, class value_t>
+    static std::shared_ptr<const value_t> get(const table_id tid, db_bridge_base& dbb, const key_t& k)
+    {
+      std::shared_ptr<value_t> result = std::make_shared<value_t>();
+      if (get_value(tid, dbb, k, *result.get()))
+        return result;
+
+      return nullptr;
+    }
+
+    template<class key_t, class value_t>
+    static bool get_value(const table_id tid, const db_bridge_base& dbb, const key_t& k, value_t& v)
+    {
+      return dbb.visit_value(tid, k, [&v](const char* value_data, size_t value_size)
+      {
+        v.assign(value_data, value_size);
+        return true;
+      });
+    }
+
+    template<class key_t, class value_t>
+    static void set(const table_id tid, db_bridge_base& dbb, const key_t& k, const value_t& v)
+    {
+      dbb.set_raw_value(tid, k, v.data(), v.size());
+    }
+  };
+
   template<bool value_type_is_serializable>
   class value_type_helper_selector;
 
@@ -452,6 +584,12 @@ namespace db
       return value_type_helper_selector<value_type_is_serializable>::template get<key_t, value_t>(m_tid, m_dbb, key);
     }
 
+    // reads the value into v without allocating a shared_ptr
+    bool get(const key_t& key, value_t& v) const
+    {
+      return value_type_helper_selector<value_type_is_serializable>::template get_value<key_t, value_t>(m_tid, m_dbb, key, v);
+    }
+
     std::shared_ptr<const value_t> find(const key_t& key) const
     {
       return get(key);
@@ -475,6 +613,12 @@ namespace db
       return object_value_helper_t::template get<explicit_key_t, explicit_value_t>(m_tid, m_dbb, key);
     }
 
+    template<class explicit_key_t, class explicit_value_t, class object_value_helper_t>
+    bool explicit_get(const explicit_key_t& key, explicit_value_t& v) const
+    {
+      return object_value_helper_t::template get_value<explicit_key_t, explicit_value_t>(m_tid, m_dbb, key, v);
+    }
+
     size_t size() const
     {
       return m_exclusive_runner.run<size_t>([this](bool exclusive_mode)
@@ -495,7 +639,7 @@ namespace db
 
     uint64_t count(const key_t& k) const
     {
-      if (get(k))
+      if (m_dbb.has_value(m_tid, k))
         return 1;
       else
         return 0;
@@ -584,9 +728,9 @@ namespace db
 
     operator value_t() const 
     {
-      std::shared_ptr<const value_t> value_ptr = m_accessor.template explicit_get<key_t, value_t, value_type_helper_selector<value_type_is_serializable> >(m_key);
-      if (value_ptr.get())
-        return *value_ptr.get();
+      value_t v = AUTO_VAL_INIT(v);
+      if (m_accessor.template explicit_get<key_t, value_t, value_type_helper_selector<value_type_is_serializable> >(m_key, v))
+        return v;
 
       return AUTO_VAL_INIT(value_t());
     }
@@ -622,9 +766,9 @@ namespace db
 
     operator value_t() const 
     {
-      std::shared_ptr<const value_t> value_ptr = m_accessor.template explicit_get<key_t, value_t, value_type_helper_selector<value_type_is_serializable> >(m_key);
-      if (value_ptr.get())
-        return *value_ptr.get();
+      value_t v = AUTO_VAL_INIT(v);
+      if (m_accessor.template explicit_get<key_t, value_t, value_type_helper_selector<value_type_is_serializable> >(m_key, v))
+        return v;
 
       return AUTO_VAL_INIT(value_t());
     }
@@ -675,6 +819,23 @@ namespace db
       return super::get(ck);
     }
 
+    // reads the item into v without heap allocations (for POD values)
+    bool get_subitem(const array_key_t& array_key, size_t i, value_t& v) const
+    {
+      size_t count = get_item_size(array_key);
+      CHECK_AND_ASSERT_THROW_MES(i < count, "array key " << array_key << ": item index " << i << " exceeds elements count == " << count);
+      complex_key<array_key_t, size_t> ck{ array_key, i };
+      return super::get(ck, v);
+    }
+
+    void set_subitem(const array_key_t& array_key, size_t i, const value_t& v)
+    {
+      size_t count = get_item_size(array_key);
+      CHECK_AND_ASSERT_THROW_MES(i < count, "array key " << array_key << ": item index " << i << " exceeds elements count == " << count);
+      complex_key<array_key_t, size_t> ck{ array_key, i };
+      super::set(ck, v);
+    }
+
     void push_back_item(const array_key_t& array_key, const value_t& v)
     {
       auto counter = get_counter_accessor(array_key);
@@ -802,6 +963,36 @@ namespace db
 
   }; // class array_accessor
 
+  template<class key_t>
+  class key_to_blob_accessor : public key_value_accessor_base<key_t, std::string, true>
+  {
+  public:
+    typedef key_value_accessor_base<key_t, std::string, true> super;
+
+    key_to_blob_accessor(db_bridge_base& dbb)
+      : super(dbb)
+    {}
+
+    void set_blob(const key_t& k, const std::string& blob)
+    {
+      super::template explicit_set<key_t, std::string, raw_blob_value_helper>(k, blob);
+    }
+
+    bool get_blob(const key_t& k, std::string& blob) const
+    {
+      return super::template explicit_get<key_t, std::string, raw_blob_value_helper>(k, blob);
+    }
+
+    // base version deserializes value, which is not applicable to raw blobs
+    bool erase_validate(const key_t& k)
+    {
+      if (!super::count(k))
+        return false;
+      super::erase(k);
+      return true;
+    }
+  }; // class key_to_blob_accessor
+
   template<class value_t, bool value_type_is_serializable>
   class array_accessor_adapter_to_native : public array_accessor<value_t, value_type_is_serializable>
   {
@@ -279,6 +279,11 @@ namespace db
     mdb_txn_abort(txn);
   }
   
+  bool lmdb_adapter::has_active_transaction() const
+  {
+    return m_p_impl->has_active_transaction();
+  }
+
   bool lmdb_adapter::get(const table_id tid, const char* key_data, size_t key_size, std::string& out_buffer)
   {
     int r = 0;
@@ -305,6 +310,27 @@ namespace db
     return true;
   }
 
+  bool lmdb_adapter::get_view(const table_id tid, const char* key_data, size_t key_size, const char*& value_data, size_t& value_size)
+  {
+    // the returned pointer refers to the memory map and is valid only within the current transaction, so a local one makes no sense here
+    CHECK_AND_ASSERT_MES(m_p_impl->has_active_transaction(), false, "get_view requires an active transaction");
+
+    MDB_val key = AUTO_VAL_INIT(key);
+    MDB_val data = AUTO_VAL_INIT(data);
+    key.mv_data = const_cast<char*>(key_data);
+    key.mv_size = key_size;
+
+    int r = mdb_get(m_p_impl->get_current_transaction(), static_cast<MDB_dbi>(tid), &key, &data);
+    if (r == MDB_NOTFOUND)
+      return false;
+
+    CHECK_DB_CALL_RESULT(r, false, "mdb_get failed");
+
+    value_data = reinterpret_cast<const char*>(data.mv_data);
+    value_size = data.mv_size;
+    return true;
+  }
+
   bool lmdb_adapter::set(const table_id tid, const char* key_data, size_t key_size, const char* value_data, size_t value_size)
   {
     int r = 0;
@@ -27,7 +27,9 @@ namespace db
     virtual bool begin_transaction(bool read_only_access = false) override;
     virtual bool commit_transaction() override;
     virtual void abort_transaction() override;
+    virtual bool has_active_transaction() const override;
     virtual bool get(const table_id tid, const char* key_data, size_t key_size, std::string& out_buffer) override;
+    virtual bool get_view(const table_id tid, const char* key_data, size_t key_size, const char*& value_data, size_t& value_size) override;
     virtual bool set(const table_id tid, const char* key_data, size_t key_size, const char* value_data, size_t value_size) override;
     virtual bool erase(const table_id tid, const char* key_data, size_t key_size) override;
     virtual bool visit_table(const table_id tid, i_db_visitor* visitor) override;
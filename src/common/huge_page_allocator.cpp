@@ -0,0 +1,146 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <atomic>
+#include <cstdlib>
+
+#include "huge_page_allocator.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace tools
+{
+  namespace
+  {
+    std::atomic<int> g_huge_pages_mode(huge_pages_off);
+
+    size_t round_up_to_huge_page(size_t size)
+    {
+      return (size + HUGE_PAGE_SIZE - 1) & ~static_cast<size_t>(HUGE_PAGE_SIZE - 1);
+    }
+  }
+  //------------------------------------------------------------------
+  void set_huge_pages_mode(huge_pages_mode mode)
+  {
+    g_huge_pages_mode = mode;
+  }
+  //------------------------------------------------------------------
+  huge_pages_mode get_huge_pages_mode()
+  {
+    return static_cast<huge_pages_mode>(g_huge_pages_mode.load());
+  }
+  //------------------------------------------------------------------
+  bool huge_pages_mode_from_string(const std::string& str, huge_pages_mode& mode)
+  {
+    if (str == "off")
+      mode = huge_pages_off;
+    else if (str == "transparent")
+      mode = huge_pages_transparent;
+    else if (str == "explicit")
+      mode = huge_pages_explicit;
+    else
+      return false;
+    return true;
+  }
+  //------------------------------------------------------------------
+  const char* huge_pages_mode_to_string(huge_pages_mode mode)
+  {
+    switch (mode)
+    {
+    case huge_pages_transparent: return "transparent";
+    case huge_pages_explicit:    return "explicit";
+    default:                     return "off";
+    }
+  }
+  //------------------------------------------------------------------
+  void* huge_pages_alloc(size_t size)
+  {
+    if (size < HUGE_PAGE_SIZE)
+    {
+      void* p = malloc(size ? size : 1);
+      if (!p)
+        throw std::bad_alloc();
+      return p;
+    }
+
+    huge_pages_mode mode = get_huge_pages_mode();
+    size_t len = round_up_to_huge_page(size);
+    void* p = NULL;
+#ifdef WIN32
+    if (mode == huge_pages_explicit)
+    {
+      //needs SeLockMemoryPrivilege, silently falls back to regular pages without it
+      SIZE_T large_page = GetLargePageMinimum();
+      if (large_page && len % large_page == 0)
+        p = VirtualAlloc(NULL, len, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    }
+    if (!p)
+      p = VirtualAlloc(NULL, len, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!p)
+      throw std::bad_alloc();
+#else
+#if defined(MAP_HUGETLB)
+    if (mode == huge_pages_explicit)
+    {
+      p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p == MAP_FAILED)
+        p = NULL;
+    }
+#endif
+    if (!p)
+    {
+      p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED)
+        throw std::bad_alloc();
+#if defined(MADV_HUGEPAGE)
+      if (mode != huge_pages_off)
+        madvise(p, len, MADV_HUGEPAGE);
+#endif
+    }
+#endif
+    return p;
+  }
+  //------------------------------------------------------------------
+  void huge_pages_free(void* p, size_t size)
+  {
+    if (!p)
+      return;
+    if (size < HUGE_PAGE_SIZE)
+    {
+      free(p);
+      return;
+    }
+#ifdef WIN32
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    munmap(p, round_up_to_huge_page(size));
+#endif
+  }
+  //------------------------------------------------------------------
+  unsigned get_current_numa_node()
+  {
+#ifdef WIN32
+    //_WIN32_WINNT is 0x0600, so *Ex (processor group aware) versions are not available; processor is numbered within its group
+    UCHAR node = 0;
+    if (GetNumaProcessorNode(static_cast<UCHAR>(GetCurrentProcessorNumber()), &node))
+      return node;
+    return 0;
+#elif defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+      return node;
+    return 0;
+#else
+    return 0;
+#endif
+  }
+}
@@ -0,0 +1,60 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <string>
+
+#define HUGE_PAGE_SIZE                                  (2 * 1024 * 1024)
+
+namespace tools
+{
+  //memory mode for big, randomly accessed buffers (scratchpad): hashing does a lot of random 32-byte reads,
+  //so with 4k pages it is bound by TLB misses
+  enum huge_pages_mode
+  {
+    huge_pages_off = 0,        //regular pages
+    huge_pages_transparent,    //madvise(MADV_HUGEPAGE), kernel backs the buffer with transparent huge pages when it can
+    huge_pages_explicit        //MAP_HUGETLB / MEM_LARGE_PAGES, falls back to transparent if reserved huge pages not available
+  };
+
+  void set_huge_pages_mode(huge_pages_mode mode);
+  huge_pages_mode get_huge_pages_mode();
+  bool huge_pages_mode_from_string(const std::string& str, huge_pages_mode& mode);
+  const char* huge_pages_mode_to_string(huge_pages_mode mode);
+
+  //buffers smaller than HUGE_PAGE_SIZE go to regular heap, bigger ones are mapped according to current mode
+  void* huge_pages_alloc(size_t size);
+  void huge_pages_free(void* p, size_t size);
+
+  //numa node of the cpu current thread is running on (0 if unknown)
+  unsigned get_current_numa_node();
+
+  template<class T>
+  class huge_page_allocator
+  {
+  public:
+    typedef T value_type;
+
+    huge_page_allocator() {}
+    template<class U>
+    huge_page_allocator(const huge_page_allocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+      return static_cast<T*>(huge_pages_alloc(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n)
+    {
+      huge_pages_free(p, n * sizeof(T));
+    }
+
+    template<class U>
+    bool operator==(const huge_page_allocator<U>&) const { return true; }
+    template<class U>
+    bool operator!=(const huge_page_allocator<U>&) const { return false; }
+  };
+}
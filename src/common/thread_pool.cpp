@@ -0,0 +1,128 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+#include "thread_pool.h"
+
+namespace tools
+{
+  struct thread_pool::job
+  {
+    job(size_t count_, const std::function<void(size_t)>& f_) : f(&f_), count(count_), next(0), done(0)
+    {}
+    const std::function<void(size_t)>* f;
+    size_t count;
+    std::atomic<size_t> next;                                  //first item not taken yet
+    std::atomic<size_t> done;
+    std::mutex lock;
+    std::condition_variable done_cv;
+    std::exception_ptr error;
+  };
+  //------------------------------------------------------------------
+  thread_pool& thread_pool::instance()
+  {
+    static thread_pool pool;
+    return pool;
+  }
+  //------------------------------------------------------------------
+  thread_pool::thread_pool() : m_stop(false)
+  {
+    size_t threads_count = std::max(std::thread::hardware_concurrency(), 1u);
+    m_workers.reserve(threads_count - 1);
+    for (size_t i = 1; i < threads_count; ++i)
+      m_workers.push_back(std::thread(&thread_pool::worker_thread, this));
+  }
+  //------------------------------------------------------------------
+  thread_pool::~thread_pool()
+  {
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      m_stop = true;
+    }
+    m_cv.notify_all();
+    for (auto& w : m_workers)
+      w.join();
+  }
+  //------------------------------------------------------------------
+  void thread_pool::parallel_for(size_t count, const std::function<void(size_t)>& f)
+  {
+    if (count == 0)
+      return;
+    if (count == 1 || m_workers.empty())
+    {
+      for (size_t i = 0; i != count; ++i)
+        f(i);
+      return;
+    }
+
+    std::shared_ptr<job> j = std::make_shared<job>(count, f);
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      m_jobs.push_back(j);
+    }
+    m_cv.notify_all();
+
+    run_job(*j);
+    {
+      //items taken by workers may still be running
+      std::unique_lock<std::mutex> lk(j->lock);
+      j->done_cv.wait(lk, [&](){ return j->done == j->count; });
+    }
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      auto it = std::find(m_jobs.begin(), m_jobs.end(), j);
+      if (it != m_jobs.end())
+        m_jobs.erase(it);
+    }
+    if (j->error)
+      std::rethrow_exception(j->error);
+  }
+  //------------------------------------------------------------------
+  void thread_pool::run_job(job& j)
+  {
+    for (size_t i = j.next++; i < j.count; i = j.next++)
+    {
+      try
+      {
+        (*j.f)(i);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lk(j.lock);
+        if (!j.error)
+          j.error = std::current_exception();
+      }
+      if (++j.done == j.count)
+      {
+        std::lock_guard<std::mutex> lk(j.lock);
+        j.done_cv.notify_all();
+      }
+    }
+  }
+  //------------------------------------------------------------------
+  void thread_pool::worker_thread()
+  {
+    while (true)
+    {
+      std::shared_ptr<job> j;
+      {
+        std::unique_lock<std::mutex> lk(m_lock);
+        m_cv.wait(lk, [&](){ return m_stop || !m_jobs.empty(); });
+        if (m_stop)
+          return;
+        j = m_jobs.front();
+        if (j->next >= j->count)
+        {
+          //all items are taken, owner waits for the running ones
+          m_jobs.pop_front();
+          continue;
+        }
+      }
+      run_job(*j);
+    }
+  }
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tools
+{
+  /************************************************************************/
+  /* Process-wide set of worker threads for cpu bound verification work   */
+  /* (ring signatures, tx parsing). Threads are created once, on first    */
+  /* use, instead of on every block or transaction.                       */
+  /************************************************************************/
+  class thread_pool
+  {
+  public:
+    static thread_pool& instance();
+
+    //worker threads plus calling thread
+    size_t get_threads_count() const { return m_workers.size() + 1; }
+
+    //calls f(i) for every i in [0, count) and returns when all calls are done. Calling thread takes part in
+    //the work and finishes it alone if all workers are busy, so nested calls (from inside f) can't deadlock.
+    //count == 1 runs on the calling thread only. Exception thrown by f is rethrown here.
+    void parallel_for(size_t count, const std::function<void(size_t)>& f);
+
+  private:
+    struct job;
+
+    thread_pool();
+    ~thread_pool();
+    thread_pool(const thread_pool&);
+    thread_pool& operator=(const thread_pool&);
+
+    void worker_thread();
+    static void run_job(job& j);
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    std::deque<std::shared_ptr<job> > m_jobs;                  //front one is helped by idle workers until all its items are taken
+    bool m_stop;
+  };
+}
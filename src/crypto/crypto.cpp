@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <alloca.h>
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -10,6 +11,8 @@
 #include <cstring>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include "common/varint.h"
 #include "warnings.h"
@@ -395,4 +398,92 @@ POP_WARNINGS
     sc_sub(&h, &h, &sum);
     return sc_isnonzero(&h) == 0;
   }
+
+  namespace {
+    // per public key data, shared by all ring members of the batch using this key
+    struct rs_batch_pub {
+      ge_dsmp pub_pre;  // P, 3P, ..., 15P
+      ge_dsmp hp_pre;   // Hp(P), 3Hp(P), ..., 15Hp(P)
+    };
+
+    struct rs_batch_pub_hasher {
+      size_t operator()(const public_key &pub) const {
+        return reinterpret_cast<const size_t &>(pub);
+      }
+    };
+  }
+
+  bool crypto_ops::check_ring_signatures_batch(const ring_signature_batch_entry *entries, size_t count,
+    bool *results) {
+    std::unordered_map<public_key, size_t, rs_batch_pub_hasher> pub_indexes;
+    std::vector<rs_batch_pub> pubs_pre;
+    std::vector<bool> pub_valid;
+    bool all_valid = true;
+
+    //decompress and precompute every distinct public key once
+    for (size_t e = 0; e < count; e++) {
+      for (size_t i = 0; i < entries[e].pubs_count; i++) {
+        const public_key &pub = *entries[e].pubs[i];
+        if (pub_indexes.count(pub))
+          continue;
+        pub_indexes[pub] = pubs_pre.size();
+        pubs_pre.push_back(rs_batch_pub());
+        ge_p3 tmp3;
+        if (ge_frombytes_vartime(&tmp3, &pub) != 0) {
+          pub_valid.push_back(false);
+          continue;
+        }
+        ge_dsm_precomp(pubs_pre.back().pub_pre, &tmp3);
+        hash_to_ec(pub, tmp3);
+        ge_dsm_precomp(pubs_pre.back().hp_pre, &tmp3);
+        pub_valid.push_back(true);
+      }
+    }
+
+    //one heap buffer for the biggest ring: alloca in this loop would keep every entry's buffer on stack until return
+    size_t max_pubs_count = 0;
+    for (size_t e = 0; e < count; e++)
+      max_pubs_count = std::max(max_pubs_count, entries[e].pubs_count);
+    std::vector<char> comm_buf(rs_comm_size(max_pubs_count));
+    rs_comm *const buf = reinterpret_cast<rs_comm *>(comm_buf.data());
+
+    for (size_t e = 0; e < count; e++) {
+      const ring_signature_batch_entry &en = entries[e];
+      const signature *sig = en.sig;
+      bool valid = true;
+      size_t i;
+      ge_p3 image_unp;
+      ge_dsmp image_pre;
+      ec_scalar sum, h;
+      if (ge_frombytes_vartime(&image_unp, &*en.image) != 0) {
+        valid = false;
+      } else {
+        ge_dsm_precomp(image_pre, &image_unp);
+        sc_0(&sum);
+        buf->h = *en.prefix_hash;
+        for (i = 0; i < en.pubs_count; i++) {
+          ge_p2 tmp2;
+          size_t pi = pub_indexes[*en.pubs[i]];
+          if (sc_check(&sig[i].c) != 0 || sc_check(&sig[i].r) != 0 || !pub_valid[pi]) {
+            valid = false;
+            break;
+          }
+          ge_double_scalarmult_base_precomp_vartime(&tmp2, &sig[i].c, pubs_pre[pi].pub_pre, &sig[i].r);
+          ge_tobytes(&buf->ab[i].a, &tmp2);
+          ge_double_scalarmult_precomp2_vartime(&tmp2, &sig[i].r, pubs_pre[pi].hp_pre, &sig[i].c, image_pre);
+          ge_tobytes(&buf->ab[i].b, &tmp2);
+          sc_add(&sum, &sum, &sig[i].c);
+        }
+        if (valid) {
+          hash_to_scalar(buf, rs_comm_size(en.pubs_count), h);
+          sc_sub(&h, &h, &sum);
+          valid = sc_isnonzero(&h) == 0;
+        }
+      }
+      if (results)
+        results[e] = valid;
+      all_valid = all_valid && valid;
+    }
+    return all_valid;
+  }
 }
@@ -61,6 +61,16 @@ namespace crypto {
     sizeof(key_derivation) == 32 && sizeof(key_image) == 32 &&
     sizeof(signature) == 64, "Invalid structure size");
 
+  /* One ring signature to be checked by check_ring_signatures_batch().
+   */
+  struct ring_signature_batch_entry {
+    const hash *prefix_hash;
+    const key_image *image;
+    const public_key *const *pubs;
+    std::size_t pubs_count;
+    const signature *sig;
+  };
+
   class crypto_ops {
     crypto_ops();
     crypto_ops(const crypto_ops &);
@@ -97,6 +107,8 @@ namespace crypto {
       const public_key *const *, std::size_t, const signature *);
     friend bool check_ring_signature(const hash &, const key_image &,
       const public_key *const *, std::size_t, const signature *);
+    static bool check_ring_signatures_batch(const ring_signature_batch_entry *, std::size_t, bool *);
+    friend bool check_ring_signatures_batch(const ring_signature_batch_entry *, std::size_t, bool *);
     friend bool validate_key_image(const key_image& ki);
     static bool validate_key_image(const key_image& ki);
 
@@ -196,6 +208,14 @@ namespace crypto {
     return crypto_ops::check_ring_signature(prefix_hash, image, pubs, pubs_count, sig);
   }
 
+  /* Checks several ring signatures at once. Public keys that appear in more than one ring (or more than once in a ring)
+   * are decompressed, hashed to a point and precomputed only once for the whole batch.
+   * results (optional) receives the outcome for each entry; returns true only if all signatures are valid.
+   */
+  inline bool check_ring_signatures_batch(const ring_signature_batch_entry *entries, std::size_t count, bool *results) {
+    return crypto_ops::check_ring_signatures_batch(entries, count, results);
+  }
+
   /* Variants with vector<const public_key *> parameters.
    */
   inline void generate_ring_signature(const hash &prefix_hash, const key_image &image,
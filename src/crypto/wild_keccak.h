@@ -189,5 +189,11 @@ inline
   public:
     static void keccakf(uint64_t st[25], int rounds);
   };
+
+  //batch analog of wild_keccak_dbl<mul_f> with scratchpad accessor scratchpad[index % scratchpad_size]
+  //(zero mixin if scratchpad_size == 0) for count inputs of the same length (i.e. same blob with different nonces).
+  //inputs are hashed in simd lanes, kernel (2/4/8 lanes) is selected at runtime by cpu features
+  void wild_keccak_dbl_multi(const uint8_t* const* in, size_t inlen, hash* md, size_t count, const hash* scratchpad, uint64_t scratchpad_size);
+  size_t wild_keccak_multi_lanes();
 }
 
@@ -0,0 +1,290 @@
+// Copyright (c) 2014-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Multi-lane wild keccak: N independent states (same blob with different nonces) are kept
+// lane-interleaved (st[word][lane]), so every step of the permutation is a loop over lanes
+// that compiler turns into AVX2/AVX-512 vector code in target-specific clones below.
+// Scratchpad addresses of all lanes are computed and prefetched before any of them is read,
+// so random memory accesses of different nonces overlap instead of being serialized.
+
+#include <string.h>
+#include "wild_keccak.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WK_MULTI_X86_DISPATCH
+#define WK_FORCE_INLINE inline __attribute__((always_inline))
+#define WK_PREFETCH(p) __builtin_prefetch(p)
+#elif defined(_MSC_VER)
+#include <xmmintrin.h>
+#define WK_FORCE_INLINE __forceinline
+#define WK_PREFETCH(p) _mm_prefetch(reinterpret_cast<const char*>(p), _MM_HINT_T0)
+#else
+#define WK_FORCE_INLINE inline
+#define WK_PREFETCH(p)
+#endif
+
+#define WK_RSIZ   136 //rate for 256-bit output, same as in wild_keccak()
+#define WK_RSIZW  (WK_RSIZ / 8)
+
+namespace crypto
+{
+  namespace
+  {
+    const int wk_rotc[24] =
+    {
+      1,  3,  6,  10, 15, 21, 28, 36, 45, 55, 2,  14,
+      27, 41, 56, 8,  25, 43, 62, 18, 39, 61, 20, 44
+    };
+
+    const int wk_piln[24] =
+    {
+      10, 7,  11, 17, 18, 3, 5,  16, 8,  21, 24, 4,
+      15, 23, 19, 13, 12, 2, 20, 14, 22, 9,  6,  1
+    };
+
+    // one round of mul_f::keccakf(st, 1) (note: single round call always uses first round constant)
+    template<size_t N>
+    WK_FORCE_INLINE void keccakf_mul_round_multi(uint64_t st[25][N])
+    {
+      uint64_t bc[5][N];
+      uint64_t t[N];
+
+      // Theta
+      for (size_t i = 0; i < 5; i++)
+        for (size_t l = 0; l < N; l++)
+          bc[i][l] = st[i][l] ^ st[i + 5][l] ^ st[i + 10][l] * st[i + 15][l] * st[i + 20][l];
+
+      for (size_t i = 0; i < 5; i++)
+      {
+        for (size_t l = 0; l < N; l++)
+          t[l] = bc[(i + 4) % 5][l] ^ ROTL64(bc[(i + 1) % 5][l], 1);
+        for (size_t j = 0; j < 25; j += 5)
+          for (size_t l = 0; l < N; l++)
+            st[j + i][l] ^= t[l];
+      }
+
+      // Rho Pi
+      for (size_t l = 0; l < N; l++)
+        t[l] = st[1][l];
+      for (size_t i = 0; i < 24; i++)
+      {
+        const int j = wk_piln[i];
+        const int r = wk_rotc[i];
+        for (size_t l = 0; l < N; l++)
+        {
+          uint64_t b0 = st[j][l];
+          st[j][l] = ROTL64(t[l], r);
+          t[l] = b0;
+        }
+      }
+
+      //  Chi
+      for (size_t j = 0; j < 25; j += 5)
+      {
+        for (size_t i = 0; i < 5; i++)
+          for (size_t l = 0; l < N; l++)
+            bc[i][l] = st[j + i][l];
+        for (size_t i = 0; i < 5; i++)
+          for (size_t l = 0; l < N; l++)
+            st[j + i][l] ^= (~bc[(i + 1) % 5][l]) & bc[(i + 2) % 5][l];
+      }
+
+      //  Iota
+      for (size_t l = 0; l < N; l++)
+        st[0][l] ^= 0x0000000000000001ULL;
+    }
+
+    // x % d for invariant d without division instruction (Granlund-Montgomery, "Division by Invariant Integers
+    // using Multiplication", fig. 4.1): 24 modulo per round per lane otherwise dominate the whole hash
+    struct fast_mod
+    {
+      uint64_t d;
+      uint64_t m;
+      int sh;
+
+      explicit fast_mod(uint64_t d_) : d(d_), m(0), sh(0)
+      {
+#ifdef __SIZEOF_INT128__
+        if (d < 2)
+          return;
+        int l = 64;
+        while (l > 0 && ((d - 1) >> (l - 1)) == 0)
+          --l;                                                  //l = ceil(log2(d))
+        unsigned __int128 two_l = (unsigned __int128)1 << l;
+        m = static_cast<uint64_t>((((unsigned __int128)1 << 64) * (two_l - d)) / d + 1);
+        sh = l - 1;
+#endif
+      }
+
+      WK_FORCE_INLINE uint64_t operator()(uint64_t x) const
+      {
+#ifdef __SIZEOF_INT128__
+        if (d < 2)
+          return 0;
+        uint64_t t = static_cast<uint64_t>(((unsigned __int128)m * x) >> 64);
+        uint64_t q = (t + ((x - t) >> 1)) >> sh;
+        return x - q * d;
+#else
+        return x % d;
+#endif
+      }
+    };
+
+    // same as mixin callback in get_blob_longhash: mix[i*4 .. i*4+3] = xor of 4 scratchpad entries selected by st[i*4 .. i*4+3]
+    template<size_t N>
+    WK_FORCE_INLINE void apply_mixin_multi(uint64_t st[25][N], const hash* scr, const fast_mod& scr_sz)
+    {
+      if (!scr_sz.d)
+        return; //zero mixin
+
+      const uint64_t* p[KK_MIXIN_SIZE][N];
+      for (size_t k = 0; k < KK_MIXIN_SIZE; k++)
+        for (size_t l = 0; l < N; l++)
+        {
+          p[k][l] = reinterpret_cast<const uint64_t*>(&scr[scr_sz(st[k][l])]);
+          WK_PREFETCH(p[k][l]);
+        }
+
+      for (size_t i = 0; i < KK_MIXIN_SIZE / 4; i++)
+        for (size_t w = 0; w < 4; w++)
+          for (size_t l = 0; l < N; l++)
+            st[i * 4 + w][l] ^= p[i * 4][l][w] ^ p[i * 4 + 1][l][w] ^ p[i * 4 + 2][l][w] ^ p[i * 4 + 3][l][w];
+    }
+
+    template<size_t N>
+    WK_FORCE_INLINE void wild_rounds_multi(uint64_t st[25][N], const hash* scr, const fast_mod& scr_sz)
+    {
+      for (size_t ll = 0; ll != KECCAK_ROUNDS; ll++)
+      {
+        if (ll != 0)
+          apply_mixin_multi<N>(st, scr, scr_sz);
+        keccakf_mul_round_multi<N>(st);
+      }
+    }
+
+    // N lanes of wild_keccak<mul_f>(in[l], inlen, md[l], 32, ...), all inputs have same length
+    template<size_t N>
+    WK_FORCE_INLINE void wild_keccak_multi(const uint8_t* const* in, size_t inlen, uint8_t md[N][32], const hash* scr, const fast_mod& scr_sz)
+    {
+      uint64_t st[25][N];
+      memset(st, 0, sizeof(st));
+
+      size_t offset = 0;
+      for (; inlen - offset >= WK_RSIZ; offset += WK_RSIZ)
+      {
+        for (size_t i = 0; i < WK_RSIZW; i++)
+          for (size_t l = 0; l < N; l++)
+          {
+            uint64_t w;
+            memcpy(&w, in[l] + offset + i * 8, sizeof(w));
+            st[i][l] ^= w;
+          }
+        wild_rounds_multi<N>(st, scr, scr_sz);
+      }
+
+      // last block and padding
+      size_t rest = inlen - offset;
+      for (size_t l = 0; l < N; l++)
+      {
+        uint64_t temp[WK_RSIZW];
+        uint8_t* ptemp = reinterpret_cast<uint8_t*>(temp);
+        memcpy(ptemp, in[l] + offset, rest);
+        ptemp[rest] = 1;
+        memset(ptemp + rest + 1, 0, WK_RSIZ - rest - 1);
+        ptemp[WK_RSIZ - 1] |= 0x80;
+        for (size_t i = 0; i < WK_RSIZW; i++)
+          st[i][l] ^= temp[i];
+      }
+      wild_rounds_multi<N>(st, scr, scr_sz);
+
+      for (size_t l = 0; l < N; l++)
+        for (size_t i = 0; i < 4; i++)
+          memcpy(&md[l][i * 8], &st[i][l], sizeof(uint64_t));
+    }
+
+    template<size_t N>
+    WK_FORCE_INLINE void wild_keccak_dbl_multi_n(const uint8_t* const* in, size_t inlen, hash* md, const hash* scr, uint64_t scr_sz)
+    {
+      uint8_t res[N][32];
+      fast_mod scr_mod(scr_sz);
+      wild_keccak_multi<N>(in, inlen, res, scr, scr_mod);
+      const uint8_t* second_in[N];
+      for (size_t l = 0; l < N; l++)
+        second_in[l] = res[l];
+      wild_keccak_multi<N>(second_in, 32, res, scr, scr_mod);
+      for (size_t l = 0; l < N; l++)
+        memcpy(&md[l], res[l], sizeof(hash));
+    }
+
+    typedef void (*wild_keccak_multi_kernel)(const uint8_t* const* in, size_t inlen, hash* md, const hash* scr, uint64_t scr_sz);
+
+    void wild_keccak_dbl_multi_generic(const uint8_t* const* in, size_t inlen, hash* md, const hash* scr, uint64_t scr_sz)
+    {
+      wild_keccak_dbl_multi_n<2>(in, inlen, md, scr, scr_sz);
+    }
+
+#ifdef WK_MULTI_X86_DISPATCH
+    __attribute__((target("avx2")))
+    void wild_keccak_dbl_multi_avx2(const uint8_t* const* in, size_t inlen, hash* md, const hash* scr, uint64_t scr_sz)
+    {
+      wild_keccak_dbl_multi_n<4>(in, inlen, md, scr, scr_sz);
+    }
+
+    __attribute__((target("avx512f,avx512dq")))
+    void wild_keccak_dbl_multi_avx512(const uint8_t* const* in, size_t inlen, hash* md, const hash* scr, uint64_t scr_sz)
+    {
+      wild_keccak_dbl_multi_n<8>(in, inlen, md, scr, scr_sz);
+    }
+#endif
+
+    struct wild_keccak_multi_dispatch
+    {
+      wild_keccak_multi_kernel kernel;
+      size_t lanes;
+
+      wild_keccak_multi_dispatch() : kernel(&wild_keccak_dbl_multi_generic), lanes(2)
+      {
+#ifdef WK_MULTI_X86_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+        {
+          kernel = &wild_keccak_dbl_multi_avx512;
+          lanes = 8;
+        }
+        else if (__builtin_cpu_supports("avx2"))
+        {
+          kernel = &wild_keccak_dbl_multi_avx2;
+          lanes = 4;
+        }
+#endif
+      }
+    };
+
+    const wild_keccak_multi_dispatch& get_dispatch()
+    {
+      static const wild_keccak_multi_dispatch d;
+      return d;
+    }
+  }
+  //------------------------------------------------------------------
+  size_t wild_keccak_multi_lanes()
+  {
+    return get_dispatch().lanes;
+  }
+  //------------------------------------------------------------------
+  void wild_keccak_dbl_multi(const uint8_t* const* in, size_t inlen, hash* md, size_t count, const hash* scr, uint64_t scr_sz)
+  {
+    const wild_keccak_multi_dispatch& d = get_dispatch();
+    const uint8_t* lane_in[8];
+    hash lane_md[8];
+    for (size_t i = 0; i < count; i += d.lanes)
+    {
+      size_t n = count - i < d.lanes ? count - i : d.lanes;
+      for (size_t l = 0; l < d.lanes; l++)
+        lane_in[l] = in[i + (l < n ? l : n - 1)]; //tail: repeat last input in unused lanes
+      d.kernel(lane_in, inlen, lane_md, scr, scr_sz);
+      memcpy(&md[i], lane_md, n * sizeof(hash));
+    }
+  }
+}
@@ -62,12 +62,21 @@
 
 #define BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT          10000  //by default, blocks ids count in synchronizing
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT              200    //by default, blocks count in blocks downloading
+#define BLOCKS_SYNCHRONIZING_MIN_SPAN                  20     //smallest span of blocks requested from one peer
+#define BLOCKS_SYNCHRONIZING_MAX_AHEAD                  (BLOCKS_SYNCHRONIZING_DEFAULT_COUNT*20) //how far above blockchain top blocks can be downloaded
+#define BLOCKS_SYNCHRONIZING_SPAN_TARGET_TIME           5000   //ms, span size is adjusted to let peer deliver it in about this time
+#define BLOCKS_SYNCHRONIZING_SPAN_TIMEOUT               30000  //ms, after this not delivered span can be requested from other peer
 #define CURRENCY_PROTOCOL_HOP_RELAX_COUNT               3      //value of hop, after which we use only announce of new block
 
 
 #define CURRENCY_ALT_BLOCK_LIVETIME_COUNT               (720*7)//one week
 #define CURRENCY_MEMPOOL_TX_LIVETIME                    86400 //seconds, one day
 #define CURRENCY_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME     (CURRENCY_ALT_BLOCK_LIVETIME_COUNT*DIFFICULTY_TARGET) //seconds, one week
+#define CURRENCY_MEMPOOL_DEFAULT_MAX_MEMORY             (512*1024*1024) //bytes, estimated memory used by pool entries
+#define CURRENCY_MEMPOOL_DEFAULT_MAX_COUNT              100000
+#define CURRENCY_MEMPOOL_FEE_FLOOR_RELEASE_PERCENT      75     //eviction fee floor is dropped when pool gets below this part of its limits
+#define CURRENCY_MEMPOOL_SNAPSHOT_FLUSH_INTERVAL        60     //seconds, pool changes are appended to snapshot file this often
+#define CURRENCY_MEMPOOL_SNAPSHOT_COMPACTION_RATIO      2      //snapshot file is rewritten when it gets this times bigger than pool data in it
 
 
 #ifndef TESTNET
@@ -79,6 +88,7 @@
 #endif
 
 #define COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT           1000
+#define CURRENCY_ADDENDUM_CACHE_SIZE                    720    //recent per-block scratchpad addendums kept in memory for remote miners
 
 #define P2P_LOCAL_WHITE_PEERLIST_LIMIT                  1000
 #define P2P_LOCAL_GRAY_PEERLIST_LIMIT                   5000
@@ -131,7 +141,8 @@
 #define CURRENCY_NAME_SHORT                             CURRENCY_NAME_SHORT_BASE"_testnet"
 #endif
 
-#define CURRENCY_POOLDATA_FILENAME                      "poolstate.bin"
+#define CURRENCY_POOLDATA_FILENAME                      "poolstate.bin"  //boost archive of older versions, loaded once if present
+#define CURRENCY_POOLDATA_SNAPSHOT_FILENAME             "poolstate.dat"
 //#define CURRENCY_BLOCKCHAINDATA_FILENAME                "blockchain.bin"
 //#define CURRENCY_BLOCKCHAINDATA_TEMP_FILENAME           "blockchain.bin.tmp"
 #define CURRENCY_BLOCKCHAINDATA_FOLDERNAME              "blockchain"
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
@@ -21,6 +22,8 @@
 #include "profile_tools.h"
 #include "file_io_utils.h"
 #include "common/boost_serialization_helper.h"
+#include "common/command_line.h"
+#include "common/thread_pool.h"
 #include "warnings.h"
 #include "crypto/hash.h"
 #include "miner_common.h"
@@ -33,6 +36,9 @@ using namespace currency;
 #define BLOCKCHAIN_CONTAINER_SPENT_KEYS       "spent_keys"
 #define BLOCKCHAIN_CONTAINER_BLOCKS           "blocks"
 #define BLOCKCHAIN_CONTAINER_OUTPUTS          "outputs"
+#define BLOCKCHAIN_CONTAINER_OUTPUT_KEYS      "output_keys"
+#define BLOCKCHAIN_CONTAINER_MIXABLE_OUTS     "mixable_outs"
+#define BLOCKCHAIN_CONTAINER_MIXABLE_OUTS_POS "mixable_outs_pos"
 #define BLOCKCHAIN_CONTAINER_MULTISIG_OUTS    "multisig_outs"
 #define BLOCKCHAIN_CONTAINER_INVALID_BLOCKS   "invalid_blocks"
 #define BLOCKCHAIN_CONTAINER_TRANSACTIONS     "transactions"
@@ -41,13 +47,15 @@ using namespace currency;
 #define BLOCKCHAIN_CONTAINER_ADDR_TO_ALIAS    "addr_to_alias"
 #define BLOCKCHAIN_CONTAINER_SCRATCHPAD       "scratchpad"
 #define BLOCKCHAIN_CONTAINER_BLOCKS_INDEX     "blocks_index"
+#define BLOCKCHAIN_CONTAINER_BLOCK_BLOBS      "block_blobs"
+#define BLOCKCHAIN_CONTAINER_TRANSACTION_BLOBS "transaction_blobs"
 
 #define BLOCKCHAIN_OPTIONS_ID_CURRENT_BLOCK_CUMUL_SZ_LIMIT          0
 #define BLOCKCHAIN_OPTIONS_ID_CURRENT_PRUNED_RS_HEIGHT              1
 #define BLOCKCHAIN_OPTIONS_ID_LAST_WORKED_VERSION                   2
 #define BLOCKCHAIN_OPTIONS_ID_STORAGE_MAJOR_COMPABILITY_VERSION     3 //mismatch here means full resync
 
-#define BLOCKCHAIN_STORAGE_MAJOR_COMPABILITY_VERSION                1
+#define BLOCKCHAIN_STORAGE_MAJOR_COMPABILITY_VERSION                4
 
 
 DISABLE_VS_WARNINGS(4267)
@@ -60,8 +68,13 @@ blockchain_storage::blockchain_storage(tx_memory_pool& tx_pool) : m_lmdb_adapter
                                                                  m_db_blocks(m_db),
                                                                  m_db_blocks_index(m_db),
                                                                  m_db_transactions(m_db),
+                                                                 m_db_block_blobs(m_db),
+                                                                 m_db_transaction_blobs(m_db),
                                                                  m_db_spent_keys(m_db),
                                                                  m_db_outputs(m_db),
+                                                                 m_db_output_keys(m_db),
+                                                                 m_db_mixable_outputs(m_db),
+                                                                 m_db_mixable_outputs_positions(m_db),
                                                                  m_db_solo_options(m_db),
                                                                  m_db_aliases(m_db),
                                                                  m_db_addr_to_alias(m_db), 
@@ -76,7 +89,8 @@ blockchain_storage::blockchain_storage(tx_memory_pool& tx_pool) : m_lmdb_adapter
                                                                  m_donations_account(AUTO_VAL_INIT(m_donations_account)), 
                                                                  m_royalty_account(AUTO_VAL_INIT(m_royalty_account)),
                                                                  m_is_blockchain_storing(false), 
-                                                                 m_locker_file(0)
+                                                                 m_locker_file(0),
+                                                                 m_addendum_cache(CURRENCY_ADDENDUM_CACHE_SIZE)
 {
   bool r = get_donation_accounts(m_donations_account, m_royalty_account);
   CHECK_AND_ASSERT_THROW_MES(r, "failed to load donation accounts");
@@ -84,19 +98,19 @@ blockchain_storage::blockchain_storage(tx_memory_pool& tx_pool) : m_lmdb_adapter
 //------------------------------------------------------------------
 bool blockchain_storage::have_tx(const crypto::hash &id)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  return m_db_transactions.find(id) != m_db_transactions.end();
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
+  return m_db_transactions.count(id) != 0;
 }
 //------------------------------------------------------------------
 bool blockchain_storage::have_tx_keyimg_as_spent(const crypto::key_image &key_im)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  return  m_db_spent_keys.find(key_im) != m_db_spent_keys.end();
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
+  return m_db_spent_keys.count(key_im) != 0;
 }
 //------------------------------------------------------------------
 std::shared_ptr<transaction> blockchain_storage::get_tx(const crypto::hash &id)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   auto it = m_db_transactions.find(id);
   if (it == m_db_transactions.end())
     return std::shared_ptr<transaction>(nullptr);
@@ -106,7 +120,7 @@ std::shared_ptr<transaction> blockchain_storage::get_tx(const crypto::hash &id)
 //------------------------------------------------------------------
 uint64_t blockchain_storage::get_current_blockchain_height()
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   return m_db_blocks.size();
 }
 // ------------------------------------------------------------------
@@ -123,9 +137,15 @@ uint64_t blockchain_storage::get_current_blockchain_height()
 //   }
 // }
 //------------------------------------------------------------------
+namespace
+{
+  const command_line::arg_descriptor<std::string> arg_scratchpad_huge_pages = { "scratchpad-huge-pages", "Memory mode for in-memory scratchpad copies: off, transparent (THP madvise) or explicit (reserved huge pages, falls back to transparent)", "off" };
+}
+//------------------------------------------------------------------
 void blockchain_storage::init_options(boost::program_options::options_description& desc)
 {
   db::lmdb_adapter::init_options(desc);
+  command_line::add_arg(desc, arg_scratchpad_huge_pages);
 }
 //------------------------------------------------------------------
 bool blockchain_storage::init(const boost::program_options::variables_map& vm, const std::string& config_folder)
@@ -148,10 +168,20 @@ bool blockchain_storage::init(const boost::program_options::variables_map& vm, c
   CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
   res = m_db_transactions.init(BLOCKCHAIN_CONTAINER_TRANSACTIONS);
   CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
+  res = m_db_block_blobs.init(BLOCKCHAIN_CONTAINER_BLOCK_BLOBS);
+  CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
+  res = m_db_transaction_blobs.init(BLOCKCHAIN_CONTAINER_TRANSACTION_BLOBS);
+  CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
   res = m_db_spent_keys.init(BLOCKCHAIN_CONTAINER_SPENT_KEYS);
   CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
   res = m_db_outputs.init(BLOCKCHAIN_CONTAINER_OUTPUTS);
   CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
+  res = m_db_output_keys.init(BLOCKCHAIN_CONTAINER_OUTPUT_KEYS);
+  CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
+  res = m_db_mixable_outputs.init(BLOCKCHAIN_CONTAINER_MIXABLE_OUTS);
+  CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
+  res = m_db_mixable_outputs_positions.init(BLOCKCHAIN_CONTAINER_MIXABLE_OUTS_POS);
+  CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
   res = m_db_solo_options.init(BLOCKCHAIN_CONTAINER_SOLO_OPTIONS);
   CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
   res = m_db_aliases.init(BLOCKCHAIN_CONTAINER_ALIASES);
@@ -161,6 +191,12 @@ bool blockchain_storage::init(const boost::program_options::variables_map& vm, c
   res = m_db_scratchpad_internal.init(BLOCKCHAIN_CONTAINER_SCRATCHPAD);
   CHECK_AND_ASSERT_MES(res, false, "Unable to init db container");
 
+  tools::huge_pages_mode hp_mode = tools::huge_pages_off;
+  res = tools::huge_pages_mode_from_string(command_line::get_arg(vm, arg_scratchpad_huge_pages), hp_mode);
+  CHECK_AND_ASSERT_MES(res, false, "Invalid scratchpad-huge-pages option value: \"" << command_line::get_arg(vm, arg_scratchpad_huge_pages) << "\"");
+  tools::set_huge_pages_mode(hp_mode);
+  LOG_PRINT_L0("Scratchpad huge pages mode: " << tools::huge_pages_mode_to_string(hp_mode));
+
   res = m_scratchpad_wr.init(config_folder);
   CHECK_AND_ASSERT_MES(res, false, "Unable to init scratchpad wrapper");
 
@@ -219,16 +255,21 @@ bool blockchain_storage::pop_block_from_blockchain()
   auto vptr = m_db_blocks[h];
   CHECK_AND_ASSERT_MES(vptr.get(), false, "pop_block_from_blockchain: can't pop from blockchain");
   block_extended_info bei = *vptr;
+  crypto::hash id = bei.get_id();
   
   bool r = m_scratchpad_wr.pop_block_scratchpad_data(bei.bl);
-  CHECK_AND_ASSERT_MES(r, false, "Failed to pop_block_scratchpad_data for block " << get_block_hash(bei.bl) << " on height " << h);
+  CHECK_AND_ASSERT_MES(r, false, "Failed to pop_block_scratchpad_data for block " << id << " on height " << h);
 
   r = purge_block_data_from_blockchain(bei.bl, bei.bl.tx_hashes.size());
-  CHECK_AND_ASSERT_MES(r, false, "Failed to purge_block_data_from_blockchain for block " << get_block_hash(bei.bl) << " on height " << h);
+  CHECK_AND_ASSERT_MES(r, false, "Failed to purge_block_data_from_blockchain for block " << id << " on height " << h);
 
   //remove from index
-  r = m_db_blocks_index.erase_validate(get_block_hash(bei.bl));
+  r = m_db_blocks_index.erase_validate(id);
   CHECK_AND_ASSERT_MES(r, false, "pop_block_from_blockchain: block id not found in m_blocks_index while trying to delete it");
+  r = m_db_block_blobs.erase_validate(h);
+  CHECK_AND_ASSERT_MES(r, false, "pop_block_from_blockchain: block blob not found for height " << h);
+
+  m_addendum_cache.pop(h);
 
   //pop block from core
   m_db_blocks.pop_back();
@@ -291,6 +332,7 @@ bool blockchain_storage::prune_ring_signatures(uint64_t height, uint64_t& transa
     lolcal_chain_entry.tx.signatures.clear();
     //reassign to db
     m_db_transactions.set(h, lolcal_chain_entry);
+    m_db_transaction_blobs.set_blob(h, tx_to_blob(lolcal_chain_entry.tx));
     ++transactions_pruned;
   }
   return true;
@@ -338,14 +380,20 @@ bool blockchain_storage::clear()
   m_db_blocks.clear();
   m_db_blocks_index.clear();
   m_db_transactions.clear();
+  m_db_block_blobs.clear();
+  m_db_transaction_blobs.clear();
   m_db_spent_keys.clear();
   m_db_solo_options.clear();
   initialize_db_solo_options_values();
   m_db_outputs.clear();
+  m_db_output_keys.clear();
+  m_db_mixable_outputs.clear();
+  m_db_mixable_outputs_positions.clear();
   m_invalid_blocks.clear(); 
   m_db_aliases.clear();
   m_db_addr_to_alias.clear();
   m_scratchpad_wr.clear();
+  m_addendum_cache.clear();
   m_db.commit_transaction();
   return true;
 }
@@ -366,11 +414,83 @@ bool blockchain_storage::reset_and_set_genesis_block(const block& b)
 //------------------------------------------------------------------
 bool blockchain_storage::copy_scratchpad(std::vector<crypto::hash>& scr)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
+  const scratchpad_vector& s = m_scratchpad_wr.get_scratchpad();
+  scr.assign(s.begin(), s.end());
+  return true;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::copy_scratchpad(scratchpad_vector& scr, crypto::hash& top_id, uint64_t& top_height)
+{
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
+  top_id = get_top_block_id(top_height);
   scr = m_scratchpad_wr.get_scratchpad();
   return true;
 }
 //------------------------------------------------------------------
+bool blockchain_storage::make_addendum_entry(const block& b, const crypto::hash& id, uint64_t height, block_addendum_entry_ptr& res)
+{
+  std::shared_ptr<block_addendum_entry> e = std::make_shared<block_addendum_entry>();
+  e->height = height;
+  e->id = id;
+  e->prev_id = b.prev_id;
+  bool r = get_block_scratchpad_addendum(b, e->addendum);
+  CHECK_AND_ASSERT_MES(r, false, "Failed to get_block_scratchpad_addendum for block " << id);
+  addendum_to_hexstr(e->addendum, e->addendum_hex);
+  res = e;
+  return true;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::push_addendum_cache_entry(const block& b, const crypto::hash& id, uint64_t height)
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  block_addendum_entry_ptr e;
+  if (!make_addendum_entry(b, id, height, e))
+    return false;
+
+  m_addendum_cache.push(e);
+  return true;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::get_addendums_since(uint64_t height, const crypto::hash& id, std::list<block_addendum_entry_ptr>& res)
+{
+  crypto::hash top_id = null_hash;
+  uint64_t top_height = 0;
+  return get_addendums_since(height, id, res, top_id, top_height);
+}
+//------------------------------------------------------------------
+bool blockchain_storage::get_addendums_since(uint64_t height, const crypto::hash& id, std::list<block_addendum_entry_ptr>& res, crypto::hash& top_id, uint64_t& top_height)
+{
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
+  top_id = get_top_block_id(top_height);
+  CHECK_AND_ASSERT_MES(height <= top_height, false, "wrong height parameter passed: " << height);
+
+  uint64_t start_height = height + 1;
+  if (get_block_id_by_height(height) != id)
+  {
+    //probably split
+    CHECK_AND_ASSERT_MES(height > 0, false, "wrong height passed");
+    start_height = height;
+  }
+  if (start_height > top_height)
+    return true;
+
+  //fast path: served from cache, built once when block was added
+  if (m_addendum_cache.get_since(start_height, top_id, res))
+    return true;
+
+  //miner lags behind the cache (or cache is not warmed up yet)
+  for (uint64_t i = start_height; i <= top_height; i++)
+  {
+    const block& b = m_db_blocks[i]->bl;
+    block_addendum_entry_ptr e;
+    if (!make_addendum_entry(b, get_block_hash(b), i, e))
+      return false;
+    res.push_back(e);
+  }
+  return true;
+}
+//------------------------------------------------------------------
 // bool blockchain_storage::set_scratchpad(const std::vector<crypto::hash>& scr)
 // {
 //   CRITICAL_REGION_LOCAL(m_blockchain_lock);
@@ -386,7 +506,7 @@ bool blockchain_storage::copy_scratchpad_as_blob(std::string& dst)
 {
 
   //TODO here:
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   std::vector<crypto::hash> scr;
   copy_scratchpad(scr);
 
@@ -458,7 +578,7 @@ bool blockchain_storage::purge_transaction_from_blockchain(const crypto::hash& t
   if (!is_coinbase(tx))
   {
     currency::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-    bool r = m_tx_pool.add_tx(tx, tvc, true);
+    bool r = m_tx_pool.add_tx(tx, tx_id, tvc, true);
     CHECK_AND_ASSERT_MES(r, false, "purge_block_data_from_blockchain: failed to add transaction to transaction pool");
   }
 
@@ -466,6 +586,8 @@ bool blockchain_storage::purge_transaction_from_blockchain(const crypto::hash& t
   CHECK_AND_ASSERT_MES(res, false, "Failed to pop_transaction_from_global_index");
   bool res_erase = m_db_transactions.erase_validate(tx_id);
   CHECK_AND_ASSERT_MES(res_erase, false, "Failed to m_transactions.erase with id = " << tx_id);
+  res_erase = m_db_transaction_blobs.erase_validate(tx_id);
+  CHECK_AND_ASSERT_MES(res_erase, false, "Failed to m_db_transaction_blobs.erase with id = " << tx_id);
 
   LOG_PRINT_L1("Removed transaction from blockchain history:" << tx_id << ENDL);
   return res;
@@ -488,25 +610,25 @@ bool blockchain_storage::purge_block_data_from_blockchain(const block& bl, size_
 //------------------------------------------------------------------
 crypto::hash blockchain_storage::get_top_block_id(uint64_t& height)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   height = get_current_blockchain_height()-1;
   return get_top_block_id();
 }
 //------------------------------------------------------------------
 crypto::hash blockchain_storage::get_top_block_id()
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   crypto::hash id = null_hash;
   if(m_db_blocks.size())
   {
-    get_block_hash(m_db_blocks.back()->bl, id);
+    id = m_db_blocks.back()->get_id();
   }
   return id;
 }
 //------------------------------------------------------------------
 bool blockchain_storage::get_top_block(block& b)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   CHECK_AND_ASSERT_MES(m_db_blocks.size(), false, "Wrong blockchain state, m_blocks.size()=0!");
   auto val_ptr = m_db_blocks.back();
   CHECK_AND_ASSERT_MES(val_ptr.get(), false, "m_blocks.back() returned null");
@@ -516,7 +638,7 @@ bool blockchain_storage::get_top_block(block& b)
 //------------------------------------------------------------------
 bool blockchain_storage::get_short_chain_history(std::list<crypto::hash>& ids)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   size_t i = 0;
   size_t current_multiplier = 1;
   size_t sz = m_db_blocks.size();
@@ -526,7 +648,7 @@ bool blockchain_storage::get_short_chain_history(std::list<crypto::hash>& ids)
   bool genesis_included = false;
   while (current_back_offset < sz)
   {
-    ids.push_back(get_block_hash(m_db_blocks[sz - current_back_offset]->bl));
+    ids.push_back(m_db_blocks[sz - current_back_offset]->get_id());
     if (sz - current_back_offset == 0)
       genesis_included = true;
     if (i < 10)
@@ -540,22 +662,22 @@ bool blockchain_storage::get_short_chain_history(std::list<crypto::hash>& ids)
     ++i;
   }
   if (!genesis_included)
-    ids.push_back(get_block_hash(m_db_blocks[0]->bl));
+    ids.push_back(m_db_blocks[0]->get_id());
 
   return true;
 }
 //------------------------------------------------------------------
 crypto::hash blockchain_storage::get_block_id_by_height(uint64_t height)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   if (height >= m_db_blocks.size())
     return null_hash;
 
-  return get_block_hash(m_db_blocks[height]->bl);
+  return m_db_blocks[height]->get_id();
 }
 //------------------------------------------------------------------
 bool blockchain_storage::get_block_by_hash(const crypto::hash &h, block &blk) {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
 
   // try to find block in main chain
   auto it = m_db_blocks_index.find(h);
@@ -578,7 +700,7 @@ bool blockchain_storage::get_block_by_hash(const crypto::hash &h, block &blk) {
 //------------------------------------------------------------------
 bool blockchain_storage::get_block_extended_info_by_hash(const crypto::hash &h, block_extended_info &blk) const
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
 
   // try to find block in main chain
   auto vptr = m_db_blocks_index.find(h);
@@ -600,7 +722,7 @@ bool blockchain_storage::get_block_extended_info_by_hash(const crypto::hash &h,
 //------------------------------------------------------------------
 bool blockchain_storage::get_block_extended_info_by_height(uint64_t h, block_extended_info &blk) const
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
 
   if (h >= m_db_blocks.size())
     return false;
@@ -611,7 +733,7 @@ bool blockchain_storage::get_block_extended_info_by_height(uint64_t h, block_ext
 //------------------------------------------------------------------
 bool blockchain_storage::get_block_by_height(uint64_t h, block &blk)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   if (h >= m_db_blocks.size())
     return false;
   blk = m_db_blocks[h]->bl;
@@ -722,7 +844,7 @@ bool blockchain_storage::switch_to_alternative_blockchain(std::list<blocks_ext_b
 //------------------------------------------------------------------
 wide_difficulty_type blockchain_storage::get_difficulty_for_next_block()
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   std::vector<uint64_t> timestamps;
   std::vector<wide_difficulty_type> commulative_difficulties;
   size_t offset = m_db_blocks.size() - std::min(m_db_blocks.size(), static_cast<size_t>(DIFFICULTY_BLOCKS_COUNT));
@@ -744,7 +866,7 @@ wide_difficulty_type blockchain_storage::get_next_difficulty_for_alternative_cha
   std::vector<wide_difficulty_type> commulative_difficulties;
   if (alt_chain.size()< DIFFICULTY_BLOCKS_COUNT)
   {
-    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    BLOCKCHAIN_SHARED_REGION_LOCAL();
     size_t main_chain_stop_offset = alt_chain.size() ? alt_chain.front()->second.height : bei.height;
     size_t main_chain_count = DIFFICULTY_BLOCKS_COUNT - std::min(static_cast<size_t>(DIFFICULTY_BLOCKS_COUNT), alt_chain.size());
     main_chain_count = std::min(main_chain_count, main_chain_stop_offset);
@@ -851,7 +973,7 @@ bool blockchain_storage::lookfor_donation(const transaction& tx, uint64_t& donat
 bool blockchain_storage::get_required_donations_value_for_next_block(uint64_t& don_am)
 {
   TRY_ENTRY();
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   uint64_t sz = get_current_blockchain_height();
   if (sz < CURRENCY_DONATIONS_INTERVAL || sz%CURRENCY_DONATIONS_INTERVAL)
   {
@@ -870,7 +992,7 @@ bool blockchain_storage::get_required_donations_value_for_next_block(uint64_t& d
 //------------------------------------------------------------------
 bool blockchain_storage::validate_donations_value(uint64_t donation, uint64_t royalty)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   uint64_t expected_don_total = 0;
   if (!get_required_donations_value_for_next_block(expected_don_total))
     return false;
@@ -887,7 +1009,7 @@ bool blockchain_storage::validate_donations_value(uint64_t donation, uint64_t ro
 //------------------------------------------------------------------
 bool blockchain_storage::validate_miner_transaction(const block& b, size_t cumulative_block_size, uint64_t fee, uint64_t& base_reward, uint64_t already_generated_coins, uint64_t already_donated_coins, uint64_t& donation_total)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   //validate reward
   uint64_t money_in_use = 0;
   uint64_t royalty = 0;
@@ -940,7 +1062,7 @@ bool blockchain_storage::validate_miner_transaction(const block& b, size_t cumul
 //------------------------------------------------------------------
 bool blockchain_storage::get_backward_blocks_sizes(size_t from_height, std::vector<size_t>& sz, size_t count)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   CHECK_AND_ASSERT_MES(from_height < m_db_blocks.size(), false, "Internal error: get_backward_blocks_sizes called with from_height=" << from_height << ", blockchain height = " << m_db_blocks.size());
 
   size_t start_offset = (from_height + 1) - std::min((from_height + 1), count);
@@ -952,7 +1074,7 @@ bool blockchain_storage::get_backward_blocks_sizes(size_t from_height, std::vect
 //------------------------------------------------------------------
 bool blockchain_storage::get_last_n_blocks_sizes(std::vector<size_t>& sz, size_t count)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   if (!m_db_blocks.size())
     return true;
   return get_backward_blocks_sizes(m_db_blocks.size() - 1, sz, count);
@@ -965,7 +1087,7 @@ uint64_t blockchain_storage::get_current_comulative_blocksize_limit()
 //------------------------------------------------------------------
 uint64_t blockchain_storage::get_already_generated_coins(crypto::hash &hash, uint64_t &count)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   auto it = m_db_blocks_index.find(hash);
   if (m_db_blocks_index.end() != it) {
     count = m_db_blocks[*it]->already_generated_coins;
@@ -976,7 +1098,7 @@ uint64_t blockchain_storage::get_already_generated_coins(crypto::hash &hash, uin
 //------------------------------------------------------------------
 uint64_t blockchain_storage::get_already_donated_coins(crypto::hash &hash, uint64_t &count)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   auto it = m_db_blocks_index.find(hash);
   if (m_db_blocks_index.end() != it) {
     count = m_db_blocks[*it]->already_donated_coins;
@@ -987,7 +1109,7 @@ uint64_t blockchain_storage::get_already_donated_coins(crypto::hash &hash, uint6
 //------------------------------------------------------------------
 bool blockchain_storage::get_block_containing_tx(const crypto::hash &txId, crypto::hash &blockId, uint64_t &blockHeight)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   auto it = m_db_transactions.find(txId);
   if (!it) {
     return false;
@@ -1006,7 +1128,7 @@ bool blockchain_storage::create_block_template(block& b, const account_public_ad
   uint64_t already_donated_coins;
   uint64_t donation_amount_for_this_block = 0;
 
-  CRITICAL_REGION_BEGIN(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_BEGIN();
   b.major_version = CURRENT_BLOCK_MAJOR_VERSION;
   b.minor_version = CURRENT_BLOCK_MINOR_VERSION;
   b.prev_id = get_top_block_id();
@@ -1131,7 +1253,7 @@ bool blockchain_storage::complete_timestamps_vector(uint64_t start_top_height, s
   if (timestamps.size() >= BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW)
     return true;
 
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   size_t need_elements = BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW - timestamps.size();
   CHECK_AND_ASSERT_MES(start_top_height < m_db_blocks.size(), false, "internal error: passed start_height = " << start_top_height << " not less then m_blocks.size()=" << m_db_blocks.size());
   size_t stop_offset = start_top_height > need_elements ? start_top_height - need_elements : 0;
@@ -1182,7 +1304,7 @@ bool blockchain_storage::handle_alternative_block(const block& b, const crypto::
       //make sure that it has right connection to main chain
       CHECK_AND_ASSERT_MES(m_db_blocks.size() > alt_chain.front()->second.height, false, "main blockchain wrong height");
       crypto::hash h = null_hash;
-      get_block_hash(m_db_blocks[alt_chain.front()->second.height - 1]->bl, h);
+      h = m_db_blocks[alt_chain.front()->second.height - 1]->get_id();
       CHECK_AND_ASSERT_MES(h == alt_chain.front()->second.bl.prev_id, false, "alternative chain have wrong connection to main chain");
       complete_timestamps_vector(alt_chain.front()->second.height - 1, timestamps);
       //build alternative scratchpad
@@ -1214,6 +1336,7 @@ bool blockchain_storage::handle_alternative_block(const block& b, const crypto::
 
     block_extended_info bei = boost::value_initialized<block_extended_info>();
     bei.bl = b;
+    bei.id = id;
     bei.height = alt_chain.size() ? it_prev->second.height + 1 : *it_main_prev + 1;
     uint64_t connection_height = alt_chain.size() ? alt_chain.front()->second.height : bei.height;
     CHECK_AND_ASSERT_MES(connection_height, false, "INTERNAL ERROR: Wrong connection_height==0 in handle_alternative_block");
@@ -1348,7 +1471,7 @@ bool blockchain_storage::handle_alternative_block(const block& b, const crypto::
 //------------------------------------------------------------------
 bool blockchain_storage::get_blocks(uint64_t start_offset, size_t count, std::list<block>& blocks, std::list<transaction>& txs)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   if (start_offset >= m_db_blocks.size())
     return false;
   for (size_t i = start_offset; i < start_offset + count && i < m_db_blocks.size(); i++)
@@ -1364,7 +1487,7 @@ bool blockchain_storage::get_blocks(uint64_t start_offset, size_t count, std::li
 //------------------------------------------------------------------
 bool blockchain_storage::get_blocks(uint64_t start_offset, size_t count, std::list<block>& blocks)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   if (start_offset >= m_db_blocks.size())
     return false;
 
@@ -1373,42 +1496,59 @@ bool blockchain_storage::get_blocks(uint64_t start_offset, size_t count, std::li
   return true;
 }
 //------------------------------------------------------------------
+bool blockchain_storage::get_block_complete_entry(uint64_t height, block_complete_entry& bce, std::list<crypto::hash>& missed_txs)
+{
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
+  block_blob_entry bbe = AUTO_VAL_INIT(bbe);
+  if (!m_db_block_blobs.get(height, bbe))
+    return false;
+  bce.block.swap(bbe.blob);
+  for (const auto& tx_id : bbe.tx_hashes)
+  {
+    bce.txs.push_back(blobdata());
+    if (!m_db_transaction_blobs.get_blob(tx_id, bce.txs.back()))
+    {
+      bce.txs.pop_back();
+      missed_txs.push_back(tx_id);
+    }
+  }
+  return true;
+}
+//------------------------------------------------------------------
 bool blockchain_storage::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   rsp.current_blockchain_height = get_current_blockchain_height();
-  std::list<block> blocks;
-  get_blocks(arg.blocks, blocks, rsp.missed_ids);
-
-  BOOST_FOREACH(const auto& bl, blocks)
+  //blobs are served as stored, without parsing and re-serializing objects
+  BOOST_FOREACH(const auto& bl_id, arg.blocks)
   {
-    std::list<crypto::hash> missed_tx_id;
-    std::list<transaction> txs;
-    get_transactions(bl.tx_hashes, txs, rsp.missed_ids);
-    CHECK_AND_ASSERT_MES(!missed_tx_id.size(), false, "Internal error: have missed missed_tx_id.size()=" << missed_tx_id.size()
-      << ENDL << "for block id = " << get_block_hash(bl));
+    uint64_t height = 0;
+    if (!m_db_blocks_index.get(bl_id, height))
+    {
+      rsp.missed_ids.push_back(bl_id);
+      continue;
+    }
     rsp.blocks.push_back(block_complete_entry());
-    block_complete_entry& e = rsp.blocks.back();
-    //pack block
-    e.block = t_serializable_object_to_blob(bl);
-    //pack transactions
-    BOOST_FOREACH(transaction& tx, txs)
-      e.txs.push_back(t_serializable_object_to_blob(tx));
-
+    std::list<crypto::hash> missed_txs;
+    bool r = get_block_complete_entry(height, rsp.blocks.back(), missed_txs);
+    CHECK_AND_ASSERT_MES(r && !missed_txs.size(), false, "Internal error: block blob or " << missed_txs.size() << " tx blobs missed for block id = " << bl_id);
   }
   //get another transactions, if need
-  std::list<transaction> txs;
-  get_transactions(arg.txs, txs, rsp.missed_ids);
-  //pack aside transactions
-  BOOST_FOREACH(const auto& tx, txs)
-    rsp.txs.push_back(t_serializable_object_to_blob(tx));
-
+  BOOST_FOREACH(const auto& tx_id, arg.txs)
+  {
+    rsp.txs.push_back(blobdata());
+    if (!m_db_transaction_blobs.get_blob(tx_id, rsp.txs.back()))
+    {
+      rsp.txs.pop_back();
+      rsp.missed_ids.push_back(tx_id);
+    }
+  }
   return true;
 }
 //------------------------------------------------------------------
 bool blockchain_storage::get_transactions_daily_stat(uint64_t& daily_cnt, uint64_t& daily_volume)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   daily_cnt = daily_volume = 0;
   for (size_t i = (m_db_blocks.size() > CURRENCY_BLOCK_PER_DAY ? m_db_blocks.size() - CURRENCY_BLOCK_PER_DAY : 0); i != m_db_blocks.size(); i++)
   {
@@ -1430,7 +1570,7 @@ bool blockchain_storage::get_transactions_daily_stat(uint64_t& daily_cnt, uint64
 bool blockchain_storage::check_keyimages(const std::list<crypto::key_image>& images, std::list<bool>& images_stat)
 {
   //true - unspent, false - spent
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   for (auto& ki : images)
   {
     images_stat.push_back(m_db_spent_keys.count(ki) ? false : true);
@@ -1440,7 +1580,7 @@ bool blockchain_storage::check_keyimages(const std::list<crypto::key_image>& ima
 //------------------------------------------------------------------
 uint64_t blockchain_storage::get_current_hashrate(size_t aprox_count)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   if (m_db_blocks.size() <= aprox_count)
     return 0;
 
@@ -1451,12 +1591,12 @@ uint64_t blockchain_storage::get_current_hashrate(size_t aprox_count)
 //------------------------------------------------------------------
 bool blockchain_storage::extport_scratchpad_to_file(const std::string& path)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   export_scratchpad_file_header fh;
   memset(&fh, 0, sizeof(fh));
-  const std::vector<crypto::hash>& scr_vector = m_scratchpad_wr.get_scratchpad();
+  const scratchpad_vector& scr_vector = m_scratchpad_wr.get_scratchpad();
 
-  fh.current_hi.prevhash = currency::get_block_hash(m_db_blocks.back()->bl);
+  fh.current_hi.prevhash = m_db_blocks.back()->get_id();
   fh.current_hi.height = m_db_blocks.size() - 1;
   fh.scratchpad_size = scr_vector.size() * 4;
 
@@ -1494,7 +1634,7 @@ bool blockchain_storage::extport_scratchpad_to_file(const std::string& path)
 //------------------------------------------------------------------
 bool blockchain_storage::get_alternative_blocks(std::list<block>& blocks)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
 
   BOOST_FOREACH(const auto& alt_bl, m_alternative_chains)
   {
@@ -1505,35 +1645,23 @@ bool blockchain_storage::get_alternative_blocks(std::list<block>& blocks)
 //------------------------------------------------------------------
 size_t blockchain_storage::get_alternative_blocks_count()
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   return m_alternative_chains.size();
 }
 //------------------------------------------------------------------
 bool blockchain_storage::add_out_to_get_random_outs(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, uint64_t amount, size_t i, uint64_t mix_count, bool use_only_forced_to_mix)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  auto out_ptr = m_db_outputs.get_subitem(amount, i);
-  auto tx_ptr = m_db_transactions.find(out_ptr->first);
-  CHECK_AND_ASSERT_MES(tx_ptr, false, "internal error: transaction with id " << out_ptr->first << ENDL <<
-    ", used in mounts global index for amount=" << amount << ": i=" << i << "not found in transactions index");
-  CHECK_AND_ASSERT_MES(tx_ptr->tx.vout.size() > out_ptr->second, false, "internal error: in global outs index, transaction out index="
-    << out_ptr->second << " more than transaction outputs = " << tx_ptr->tx.vout.size() << ", for tx id = " << out_ptr->first);
-
-  const transaction& tx = tx_ptr->tx;
-  CHECK_AND_ASSERT_MES(tx.vout[out_ptr->second].target.type() == typeid(txout_to_key), false, "unknown tx out type");
-
-  CHECK_AND_ASSERT_MES(tx_ptr->m_spent_flags.size() == tx.vout.size(), false, "internal error");
-
-  //do not use outputs that obviously spent for mixins
-  if (tx_ptr->m_spent_flags[out_ptr->second])
-    return false;
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
+  //spent and forced-no-mix outputs never get into m_db_mixable_outputs, so everything needed here is in output_key_entry
+  output_key_entry out_entry = AUTO_VAL_INIT(out_entry);
+  CHECK_AND_ASSERT_MES(m_db_output_keys.get_subitem(amount, i, out_entry), false, "internal error: failed to get output key entry for amount=" << amount << ": i=" << i);
 
   //check if transaction is unlocked
-  if (!is_tx_spendtime_unlocked(tx.unlock_time))
+  if (!is_tx_spendtime_unlocked(out_entry.unlock_time))
     return false;
 
   //use appropriate mix_attr out 
-  uint8_t mix_attr = boost::get<txout_to_key>(tx.vout[out_ptr->second].target).mix_attr;
+  uint8_t mix_attr = out_entry.mix_attr;
 
   if (mix_attr == CURRENCY_TO_KEY_OUT_FORCED_NO_MIX)
     return false; //COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS call means that ring signature will have more than one entry.
@@ -1545,14 +1673,50 @@ bool blockchain_storage::add_out_to_get_random_outs(COMMAND_RPC_GET_RANDOM_OUTPU
 
   COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry& oen = *result_outs.outs.insert(result_outs.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry());
   oen.global_amount_index = i;
-  oen.out_key = boost::get<txout_to_key>(tx.vout[out_ptr->second].target).key;
+  oen.out_key = out_entry.key;
   return true;
 }
 //------------------------------------------------------------------
-size_t blockchain_storage::find_end_of_allowed_index(uint64_t amount)
+bool blockchain_storage::add_mixable_output(uint64_t amount, uint64_t global_index)
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  uint64_t sz = m_db_outputs.get_item_size(amount);
+  db::complex_key<uint64_t, uint64_t> pk = { amount, global_index };
+  if (m_db_mixable_outputs_positions.count(pk))
+    return true; //already there
+
+  m_db_mixable_outputs.push_back_item(amount, global_index);
+  m_db_mixable_outputs_positions.set(pk, m_db_mixable_outputs.get_item_size(amount) - 1);
+  return true;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::remove_mixable_output(uint64_t amount, uint64_t global_index)
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db::complex_key<uint64_t, uint64_t> pk = { amount, global_index };
+  uint64_t pos = 0;
+  if (!m_db_mixable_outputs_positions.get(pk, pos))
+    return true; //not mixable (spent or forced no-mix)
+
+  uint64_t sz = m_db_mixable_outputs.get_item_size(amount);
+  CHECK_AND_ASSERT_MES(pos < sz, false, "mixable outputs index consistency broken: position " << pos << " for amount " << amount << ", global index " << global_index << " exceeds size " << sz);
+  if (pos != sz - 1)
+  {
+    //move the last element into the vacated slot, order is irrelevant for random sampling
+    uint64_t last_gi = 0;
+    CHECK_AND_ASSERT_MES(m_db_mixable_outputs.get_subitem(amount, sz - 1, last_gi), false, "mixable outputs index consistency broken: failed to get back item for amount " << amount);
+    m_db_mixable_outputs.set_subitem(amount, pos, last_gi);
+    db::complex_key<uint64_t, uint64_t> last_pk = { amount, last_gi };
+    m_db_mixable_outputs_positions.set(last_pk, pos);
+  }
+  m_db_mixable_outputs.pop_back_item(amount);
+  m_db_mixable_outputs_positions.erase(pk);
+  return true;
+}
+//------------------------------------------------------------------
+size_t blockchain_storage::find_end_of_allowed_index(uint64_t amount)
+{
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
+  uint64_t sz = m_db_output_keys.get_item_size(amount);
 
   if (!sz)
     return 0;
@@ -1560,10 +1724,9 @@ size_t blockchain_storage::find_end_of_allowed_index(uint64_t amount)
   do
   {
     --i;
-    auto out_ptr = m_db_outputs.get_subitem(amount, i);
-    auto tx_ptr = m_db_transactions.find(out_ptr->first);
-    CHECK_AND_ASSERT_MES(tx_ptr, 0, "internal error: failed to find transaction from outputs index with tx_id=" << out_ptr->first);
-    if (tx_ptr->m_keeper_block_height + CURRENCY_MINED_MONEY_UNLOCK_WINDOW <= get_current_blockchain_height())
+    output_key_entry out_entry = AUTO_VAL_INIT(out_entry);
+    CHECK_AND_ASSERT_MES(m_db_output_keys.get_subitem(amount, i, out_entry), 0, "internal error: failed to get output key entry for amount=" << amount << ": i=" << i);
+    if (out_entry.keeper_block_height + CURRENCY_MINED_MONEY_UNLOCK_WINDOW <= get_current_blockchain_height())
       return i + 1;
   } while (i != 0);
   return 0;
@@ -1571,12 +1734,12 @@ size_t blockchain_storage::find_end_of_allowed_index(uint64_t amount)
 //------------------------------------------------------------------
 bool blockchain_storage::get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& req, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& res)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   BOOST_FOREACH(uint64_t amount, req.amounts)
   {
     COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs = *res.outs.insert(res.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount());
     result_outs.amount = amount;
-    uint64_t outs_container_size = m_db_outputs.get_item_size(amount);
+    uint64_t outs_container_size = m_db_output_keys.get_item_size(amount);
     if (!outs_container_size)
     {
       LOG_ERROR("COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS: not outs for amount " << amount << ", wallet should use some real outs when it lookup for some mix, so, at least one out for this amount should exist");
@@ -1586,32 +1749,43 @@ bool blockchain_storage::get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDO
     //lets find upper bound of not fresh outs
     size_t up_index_limit = find_end_of_allowed_index(amount);
     CHECK_AND_ASSERT_MES(up_index_limit <= outs_container_size, false, "internal error: find_end_of_allowed_index returned wrong index=" << up_index_limit << ", with amount_outs.size = " << outs_container_size);
-    if (up_index_limit >= req.outs_count)
+    //sample from unspent, mixable outputs only, so spent ones don't burn attempts
+    uint64_t mixable_count = m_db_mixable_outputs.get_item_size(amount);
+    if (mixable_count >= req.outs_count)
     {
       std::set<size_t> used;
       size_t try_count = 0;
-      for (uint64_t j = 0; j != req.outs_count && try_count < up_index_limit;)
+      for (uint64_t j = 0; j != req.outs_count && try_count < mixable_count;)
       {
-        size_t i = crypto::rand<size_t>() % up_index_limit;
-        if (used.count(i))
+        size_t pos = crypto::rand<size_t>() % mixable_count;
+        if (used.count(pos))
           continue;
-        bool added = add_out_to_get_random_outs(result_outs, amount, i, req.outs_count, req.use_forced_mix_outs);
-        used.insert(i);
-        if (added)
-          ++j;
+        used.insert(pos);
         ++try_count;
+        uint64_t i = 0;
+        CHECK_AND_ASSERT_MES(m_db_mixable_outputs.get_subitem(amount, pos, i), false, "internal error: failed to get mixable output for amount=" << amount << ": pos=" << pos);
+        if (i >= up_index_limit)
+          continue;
+        if (add_out_to_get_random_outs(result_outs, amount, i, req.outs_count, req.use_forced_mix_outs))
+          ++j;
       }
       if (result_outs.outs.size() < req.outs_count)
       {
-        LOG_PRINT_RED_L0("Not enough inputs for amount " << amount << ", needed " << req.outs_count << ", added " << result_outs.outs.size() << " good outs from " << up_index_limit << " unlocked of " << outs_container_size << " total");
+        LOG_PRINT_RED_L0("Not enough inputs for amount " << amount << ", needed " << req.outs_count << ", added " << result_outs.outs.size() << " good outs from " << mixable_count << " mixable, " << up_index_limit << " unlocked of " << outs_container_size << " total");
       }
     }
     else
     {
       size_t added = 0;
-      for (size_t i = 0; i != up_index_limit; i++)
+      for (size_t pos = 0; pos != mixable_count; pos++)
+      {
+        uint64_t i = 0;
+        CHECK_AND_ASSERT_MES(m_db_mixable_outputs.get_subitem(amount, pos, i), false, "internal error: failed to get mixable output for amount=" << amount << ": pos=" << pos);
+        if (i >= up_index_limit)
+          continue;
         added += add_out_to_get_random_outs(result_outs, amount, i, req.outs_count, req.use_forced_mix_outs) ? 1 : 0;
-      LOG_PRINT_RED_L0("Not enough inputs for amount " << amount << ", needed " << req.outs_count << ", added " << added << " good outs from " << up_index_limit << " unlocked of " << outs_container_size << " total - respond with all good outs");
+      }
+      LOG_PRINT_RED_L0("Not enough inputs for amount " << amount << ", needed " << req.outs_count << ", added " << added << " good outs from " << mixable_count << " mixable, " << up_index_limit << " unlocked of " << outs_container_size << " total - respond with all good outs");
     }
   }
   return true;
@@ -1623,8 +1797,20 @@ bool blockchain_storage::update_spent_tx_flags_for_input(uint64_t amount, uint64
   uint64_t outs_count = m_db_outputs.get_item_size(amount);
   CHECK_AND_ASSERT_MES(outs_count, false, "Amount " << amount << " have not found during update_spent_tx_flags_for_input()");
   CHECK_AND_ASSERT_MES(global_index < outs_count, false, "Global index" << global_index << " for amount " << amount << " bigger value than amount's vector size()=" << outs_count);
-  auto out_ptr = m_db_outputs.get_subitem(amount, global_index);
-  return update_spent_tx_flags_for_input(out_ptr->first, out_ptr->second, spent);
+  outputs_container::t_value_type out_entry = AUTO_VAL_INIT(out_entry);
+  CHECK_AND_ASSERT_MES(m_db_outputs.get_subitem(amount, global_index, out_entry), false, "Failed to get output entry for amount " << amount << ", global index " << global_index);
+  if (spent)
+  {
+    CHECK_AND_ASSERT_MES(remove_mixable_output(amount, global_index), false, "Failed to remove mixable output for amount " << amount << ", global index " << global_index);
+  }
+  else
+  {
+    output_key_entry oke = AUTO_VAL_INIT(oke);
+    CHECK_AND_ASSERT_MES(m_db_output_keys.get_subitem(amount, global_index, oke), false, "Failed to get output key entry for amount " << amount << ", global index " << global_index);
+    if (oke.mix_attr != CURRENCY_TO_KEY_OUT_FORCED_NO_MIX)
+      add_mixable_output(amount, global_index);
+  }
+  return update_spent_tx_flags_for_input(out_entry.first, out_entry.second, spent);
 }
 //------------------------------------------------------------------
 bool blockchain_storage::update_spent_tx_flags_for_input(const crypto::hash& tx_id, size_t n, bool spent)
@@ -1669,7 +1855,7 @@ bool blockchain_storage::update_spent_tx_flags_for_input(const crypto::hash& tx_
 //------------------------------------------------------------------
 bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, uint64_t& starter_offset)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
 
   if (!qblock_ids.size() /*|| !req.m_total_height*/)
   {
@@ -1677,10 +1863,10 @@ bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash
     return false;
   }
   //check genesis match
-  if (qblock_ids.back() != get_block_hash(m_db_blocks[0]->bl))
+  if (qblock_ids.back() != m_db_blocks[0]->get_id())
   {
     LOG_ERROR("Client sent wrong NOTIFY_REQUEST_CHAIN: genesis block missmatch: " << ENDL << "id: "
-      << qblock_ids.back() << ", " << ENDL << "expected: " << get_block_hash(m_db_blocks[0]->bl)
+      << qblock_ids.back() << ", " << ENDL << "expected: " << m_db_blocks[0]->get_id()
       << "," << ENDL << " dropping connection");
     return false;
   }
@@ -1716,7 +1902,7 @@ bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash
 //------------------------------------------------------------------
 wide_difficulty_type blockchain_storage::block_difficulty(size_t i)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   CHECK_AND_ASSERT_MES(i < m_db_blocks.size(), false, "wrong block index i = " << i << " at blockchain_storage::block_difficulty()");
   if (i == 0)
     return m_db_blocks[i]->cumulative_difficulty;
@@ -1727,7 +1913,7 @@ wide_difficulty_type blockchain_storage::block_difficulty(size_t i)
 void blockchain_storage::print_blockchain(uint64_t start_index, uint64_t end_index)
 {
   std::stringstream ss;
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   if (start_index >= m_db_blocks.size())
   {
     LOG_PRINT_L0("Wrong starter index set: " << start_index << ", expected max index " << m_db_blocks.size() - 1);
@@ -1737,7 +1923,7 @@ void blockchain_storage::print_blockchain(uint64_t start_index, uint64_t end_ind
   for (size_t i = start_index; i != m_db_blocks.size() && i != end_index; i++)
   {
     ss << "height " << i << ", timestamp " << m_db_blocks[i]->bl.timestamp << ", cumul_dif " << m_db_blocks[i]->cumulative_difficulty << ", cumul_size " << m_db_blocks[i]->block_cumulative_size
-      << "\nid\t\t" << get_block_hash(m_db_blocks[i]->bl)
+      << "\nid\t\t" << m_db_blocks[i]->get_id()
       << "\ndifficulty\t\t" << block_difficulty(i) << ", nonce " << m_db_blocks[i]->bl.nonce << ", tx_count " << m_db_blocks[i]->bl.tx_hashes.size() << ENDL;
   }
   LOG_PRINT_L1("Current blockchain:" << ENDL << ss.str());
@@ -1781,20 +1967,20 @@ void blockchain_storage::print_blockchain_outs(const std::string& file)
 //------------------------------------------------------------------
 bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   if (!find_blockchain_supplement(qblock_ids, resp.start_height))
     return false;
 
   resp.total_height = get_current_blockchain_height();
   size_t count = 0;
   for (size_t i = resp.start_height; i != m_db_blocks.size() && count < BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT; i++, count++)
-    resp.m_block_ids.push_back(get_block_hash(m_db_blocks[i]->bl));
+    resp.m_block_ids.push_back(m_db_blocks[i]->get_id());
   return true;
 }
 //------------------------------------------------------------------
 bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<std::pair<block, std::list<transaction> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   PROF_L2_START(find_blockchain_supplement_time);
   if (!find_blockchain_supplement(qblock_ids, start_height))
     return false;
@@ -1818,10 +2004,36 @@ bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash
   return true;
 }
 //------------------------------------------------------------------
+bool blockchain_storage::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<block_complete_entry>& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count)
+{
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
+  PROF_L2_START(find_blockchain_supplement_time);
+  if (!find_blockchain_supplement(qblock_ids, start_height))
+    return false;
+  PROF_L2_FINISH(find_blockchain_supplement_time);
+
+  PROF_L2_START(get_blobs_time);
+  total_height = get_current_blockchain_height();
+  size_t count = 0;
+  size_t txs_count = 0;
+  for (size_t i = start_height; i != total_height && count < max_count; i++, count++)
+  {
+    blocks.push_back(block_complete_entry());
+    std::list<crypto::hash> mis;
+    bool r = get_block_complete_entry(i, blocks.back(), mis);
+    CHECK_AND_ASSERT_MES(r && !mis.size(), false, "internal error, block or transaction blob not found for height " << i);
+    txs_count += blocks.back().txs.size();
+  }
+  PROF_L2_FINISH(get_blobs_time);
+  PROF_L2_LOG_PRINT("find_blockchain_supplement(blobs): " << blocks.size() << " blocks, " << txs_count << " txs, timings: " << print_mcsec_as_ms(find_blockchain_supplement_time) << " / " << print_mcsec_as_ms(get_blobs_time), LOG_LEVEL_1);
+  return true;
+}
+//------------------------------------------------------------------
 bool blockchain_storage::add_block_as_invalid(const block& bl, const crypto::hash& h)
 {
   block_extended_info bei = AUTO_VAL_INIT(bei);
   bei.bl = bl;
+  bei.id = h;
   return add_block_as_invalid(bei, h);
 }
 //------------------------------------------------------------------
@@ -1836,7 +2048,7 @@ bool blockchain_storage::add_block_as_invalid(const block_extended_info& bei, co
 //------------------------------------------------------------------
 bool blockchain_storage::have_block(const crypto::hash& id)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   if (m_db_blocks_index.find(id))
     return true;
   if (m_alternative_chains.count(id))
@@ -1858,7 +2070,7 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, block_verif
   return handle_block_to_main_chain(bl, id, bvc);
 }
 //------------------------------------------------------------------
-bool blockchain_storage::push_transaction_to_global_outs_index(const transaction& tx, const crypto::hash& tx_id, std::vector<uint64_t>& global_indexes)
+bool blockchain_storage::push_transaction_to_global_outs_index(const transaction& tx, const crypto::hash& tx_id, uint64_t keeper_block_height, std::vector<uint64_t>& global_indexes)
 {
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   size_t i = 0;
@@ -1866,8 +2078,17 @@ bool blockchain_storage::push_transaction_to_global_outs_index(const transaction
   {
     if (ot.target.type() == typeid(txout_to_key))
     {
+      const txout_to_key& otk = boost::get<txout_to_key>(ot.target);
       m_db_outputs.push_back_item(ot.amount, std::pair<crypto::hash, size_t>(tx_id, i));
+      output_key_entry oke = AUTO_VAL_INIT(oke);
+      oke.key = otk.key;
+      oke.unlock_time = tx.unlock_time;
+      oke.keeper_block_height = keeper_block_height;
+      oke.mix_attr = otk.mix_attr;
+      m_db_output_keys.push_back_item(ot.amount, oke);
       global_indexes.push_back(m_db_outputs.get_item_size(ot.amount) - 1);
+      if (otk.mix_attr != CURRENCY_TO_KEY_OUT_FORCED_NO_MIX)
+        add_mixable_output(ot.amount, global_indexes.back());
     }
     ++i;
   }
@@ -1876,27 +2097,23 @@ bool blockchain_storage::push_transaction_to_global_outs_index(const transaction
 //------------------------------------------------------------------
 size_t blockchain_storage::get_total_transactions()
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   return m_db_transactions.size();
 }
 //------------------------------------------------------------------
 bool blockchain_storage::get_outs(uint64_t amount, std::list<crypto::public_key>& pkeys)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  uint64_t sz = m_db_outputs.get_item_size(amount);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
+  uint64_t sz = m_db_output_keys.get_item_size(amount);
 
   if (!sz)
     return true;
 
   for (uint64_t i = 0; i != sz; i++)
   {
-    auto out_entry_ptr = m_db_outputs.get_subitem(amount, i);
-
-    auto tx_ptr = m_db_transactions.find(out_entry_ptr->first);
-    CHECK_AND_ASSERT_MES(tx_ptr, false, "transactions outs global index consistency broken: wrong tx id in index");
-    CHECK_AND_ASSERT_MES(tx_ptr->tx.vout.size() > out_entry_ptr->second, false, "transactions outs global index consistency broken: index in tx_outx more then size");
-    CHECK_AND_ASSERT_MES(tx_ptr->tx.vout[out_entry_ptr->second].target.type() == typeid(txout_to_key), false, "transactions outs global index consistency broken: index in tx_outx more then size");
-    pkeys.push_back(boost::get<txout_to_key>(tx_ptr->tx.vout[out_entry_ptr->second].target).key);
+    output_key_entry out_entry = AUTO_VAL_INIT(out_entry);
+    CHECK_AND_ASSERT_MES(m_db_output_keys.get_subitem(amount, i, out_entry), false, "transactions outs global index consistency broken: failed to get output key entry");
+    pkeys.push_back(out_entry.key);
   }
 
   return true;
@@ -1912,10 +2129,13 @@ bool blockchain_storage::pop_transaction_from_global_index(const transaction& tx
     {
       uint64_t sz = m_db_outputs.get_item_size(ot.amount);
       CHECK_AND_ASSERT_MES(sz, false, "transactions outs global index: empty index for amount: " << ot.amount);
-      auto back_item = m_db_outputs.get_subitem(ot.amount, sz - 1);
-      CHECK_AND_ASSERT_MES(back_item->first == tx_id, false, "transactions outs global index consistency broken: tx id missmatch");
-      CHECK_AND_ASSERT_MES(back_item->second == i, false, "transactions outs global index consistency broken: in transaction index missmatch");
+      outputs_container::t_value_type back_item = AUTO_VAL_INIT(back_item);
+      CHECK_AND_ASSERT_MES(m_db_outputs.get_subitem(ot.amount, sz - 1, back_item), false, "transactions outs global index consistency broken: failed to get back item");
+      CHECK_AND_ASSERT_MES(back_item.first == tx_id, false, "transactions outs global index consistency broken: tx id missmatch");
+      CHECK_AND_ASSERT_MES(back_item.second == i, false, "transactions outs global index consistency broken: in transaction index missmatch");
+      CHECK_AND_ASSERT_MES(remove_mixable_output(ot.amount, sz - 1), false, "mixable outputs index consistency broken: failed to remove output for amount: " << ot.amount);
       m_db_outputs.pop_back_item(ot.amount);
+      m_db_output_keys.pop_back_item(ot.amount);
       //do not let to exist empty m_outputs entries - this will broke scratchpad selector
       //if (!it->second.size())
       //  m_db_outputs.erase(it);
@@ -1943,7 +2163,7 @@ bool blockchain_storage::unprocess_blockchain_tx_extra(const transaction& tx)
 //------------------------------------------------------------------
 bool blockchain_storage::get_alias_info(const std::string& alias, alias_info_base& info)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   auto al_ptr = m_db_aliases.find(alias);
   if (al_ptr)
   {
@@ -1958,19 +2178,19 @@ bool blockchain_storage::get_alias_info(const std::string& alias, alias_info_bas
 //------------------------------------------------------------------
 uint64_t blockchain_storage::get_aliases_count()
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   return m_db_aliases.size();
 }
 //------------------------------------------------------------------
 uint64_t blockchain_storage::get_scratchpad_size()
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   return m_scratchpad_wr.get_scratchpad().size() * 32;
 }
 //------------------------------------------------------------------
 bool blockchain_storage::get_all_aliases(std::list<alias_info>& aliases)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
 
   m_db_aliases.enumerate_items([&](uint64_t i, const std::string& alias, const std::list<alias_info_base>& elias_entries)
   {
@@ -2169,8 +2389,7 @@ bool blockchain_storage::add_transaction_from_block(const transaction& tx, const
     {
       const crypto::key_image& ki = in.k_image;
 
-      auto ki_ptr = m_db_spent_keys.get(ki);
-      if (ki_ptr)
+      if (m_db_spent_keys.count(ki))
       {
         //double spend detected
         LOG_PRINT_RED_L0("tx with id: " << m_tx_id << " in block id: " << m_bl_id << " have input marked as spent with key image: " << ki << ", block declined");
@@ -2229,13 +2448,14 @@ bool blockchain_storage::add_transaction_from_block(const transaction& tx, const
     return false;
   }
 
-  r = push_transaction_to_global_outs_index(tx, tx_id, ch_e.m_global_output_indexes);
+  r = push_transaction_to_global_outs_index(tx, tx_id, bl_height, ch_e.m_global_output_indexes);
   CHECK_AND_ASSERT_MES(r, false, "failed to return push_transaction_to_global_outs_index tx id " << tx_id);
   PROF_L2_FINISH(push_tx_to_global_index_time_2);
 
   //store everything to db
   PROF_L2_START(store_to_db_time);
   m_db_transactions.set(tx_id, ch_e);
+  m_db_transaction_blobs.set_blob(tx_id, tx_to_blob(tx));
   PROF_L2_FINISH(store_to_db_time);
   LOG_PRINT_L2("Added transaction to blockchain history:" << ENDL
     << "tx_id: " << tx_id << ENDL
@@ -2255,7 +2475,7 @@ bool blockchain_storage::add_transaction_from_block(const transaction& tx, const
 //------------------------------------------------------------------
 bool blockchain_storage::get_tx_outputs_gindexs(const crypto::hash& tx_id, std::vector<uint64_t>& indexs)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   auto tx_ptr = m_db_transactions.find(tx_id);
   if (!tx_ptr)
   {
@@ -2270,11 +2490,16 @@ bool blockchain_storage::get_tx_outputs_gindexs(const crypto::hash& tx_id, std::
 //------------------------------------------------------------------
 bool blockchain_storage::check_tx_inputs(const transaction& tx, uint64_t& max_used_block_height, crypto::hash& max_used_block_id)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  bool res = check_tx_inputs(tx, &max_used_block_height);
+  return check_tx_inputs(tx, get_transaction_prefix_hash(tx), max_used_block_height, max_used_block_id);
+}
+//------------------------------------------------------------------
+bool blockchain_storage::check_tx_inputs(const transaction& tx, const crypto::hash& tx_prefix_hash, uint64_t& max_used_block_height, crypto::hash& max_used_block_id)
+{
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
+  bool res = check_tx_inputs(tx, tx_prefix_hash, &max_used_block_height);
   if (!res) return false;
   CHECK_AND_ASSERT_MES(max_used_block_height < m_db_blocks.size(), false, "internal error: max used block index=" << max_used_block_height << " is not less then blockchain size = " << m_db_blocks.size());
-  get_block_hash(m_db_blocks[max_used_block_height]->bl, max_used_block_id);
+  max_used_block_id = m_db_blocks[max_used_block_height]->get_id();
   return true;
 }
 //------------------------------------------------------------------
@@ -2295,8 +2520,12 @@ bool blockchain_storage::check_tx_inputs(const transaction& tx, uint64_t* pmax_u
   return check_tx_inputs(tx, tx_prefix_hash, pmax_used_block_height);
 }
 //------------------------------------------------------------------
-bool blockchain_storage::check_tx_inputs(const transaction& tx, const crypto::hash& tx_prefix_hash, uint64_t* pmax_used_block_height)
+bool blockchain_storage::check_tx_inputs(const transaction& tx, const crypto::hash& tx_prefix_hash, uint64_t* pmax_used_block_height, ring_signature_checks* pdeferred_sig_checks)
 {
+  //ring members are resolved here, while signatures of all inputs are checked together (and in parallel) after that,
+  //or by the caller if it wants to join them with other transactions' ones
+  ring_signature_checks local_sig_checks;
+  ring_signature_checks* psig_checks = pdeferred_sig_checks ? pdeferred_sig_checks : &local_sig_checks;
   size_t sig_index = 0;
   if (pmax_used_block_height)
     *pmax_used_block_height = 0;
@@ -2321,7 +2550,7 @@ bool blockchain_storage::check_tx_inputs(const transaction& tx, const crypto::ha
       CHECK_AND_ASSERT_MES(sig_index < tx.signatures.size(), false, "wrong transaction: not signature entry for input with index= " << sig_index);
       psig = &tx.signatures[sig_index];
     }
-    if (!check_tx_input(in_to_key, tx_prefix_hash, *psig, pmax_used_block_height))
+    if (!check_tx_input(in_to_key, tx_prefix_hash, *psig, pmax_used_block_height, psig_checks))
     {
       LOG_PRINT_L0("Failed to check input #" << sig_index << " for tx " << get_transaction_hash(tx));
       return false;
@@ -2334,9 +2563,58 @@ bool blockchain_storage::check_tx_inputs(const transaction& tx, const crypto::ha
     CHECK_AND_ASSERT_MES(tx.signatures.size() == sig_index, false, "tx signatures count differs from inputs");
   }
 
+  if (!pdeferred_sig_checks && !check_ring_signatures(local_sig_checks))
+  {
+    LOG_PRINT_L0("Failed to check ring signatures for tx " << get_transaction_hash(tx));
+    return false;
+  }
+
   return true;
 }
 //------------------------------------------------------------------
+bool blockchain_storage::check_ring_signatures(const ring_signature_checks& checks)
+{
+  if (checks.empty())
+    return true;
+
+  size_t threads_count = std::min<size_t>(tools::thread_pool::instance().get_threads_count(), checks.size());
+  //each thread gets one contiguous range and checks it as a single batch, so ring members shared by inputs are unpacked once
+  size_t range_size = (checks.size() + threads_count - 1) / threads_count;
+  std::atomic<bool> failed(false);
+  auto worker = [&](size_t range_begin)
+  {
+    size_t range_end = std::min(range_begin + range_size, checks.size());
+    std::vector<std::vector<const crypto::public_key*>> pubs(range_end - range_begin);
+    std::vector<crypto::ring_signature_batch_entry> batch(range_end - range_begin);
+    for (size_t i = range_begin; i != range_end; ++i)
+    {
+      const ring_signature_check_entry& ce = checks[i];
+      std::vector<const crypto::public_key*>& ce_pubs = pubs[i - range_begin];
+      for (const auto& k : ce.output_keys)
+        ce_pubs.push_back(&k);
+      crypto::ring_signature_batch_entry& be = batch[i - range_begin];
+      be.prefix_hash = &ce.prefix_hash;
+      be.image = &ce.k_image;
+      be.pubs = ce_pubs.data();
+      be.pubs_count = ce_pubs.size();
+      be.sig = ce.signatures.data();
+    }
+    std::unique_ptr<bool[]> results(new bool[batch.size()]);
+    if (!crypto::check_ring_signatures_batch(batch.data(), batch.size(), results.get()))
+    {
+      for (size_t i = 0; i != batch.size(); ++i)
+        if (!results[i])
+          LOG_PRINT_L0("Ring signature check failed for key image " << *batch[i].image << ", prefix hash " << *batch[i].prefix_hash);
+      failed = true;
+    }
+  };
+
+  size_t ranges_count = (checks.size() + range_size - 1) / range_size;
+  tools::thread_pool::instance().parallel_for(ranges_count, [&](size_t i){ worker(i * range_size); });
+
+  return !failed;
+}
+//------------------------------------------------------------------
 bool blockchain_storage::is_tx_spendtime_unlocked(uint64_t unlock_time)
 {
   if (unlock_time < CURRENCY_MAX_BLOCK_NUMBER)
@@ -2359,9 +2637,9 @@ bool blockchain_storage::is_tx_spendtime_unlocked(uint64_t unlock_time)
   return false;
 }
 //------------------------------------------------------------------
-bool blockchain_storage::check_tx_input(const txin_to_key& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, uint64_t* pmax_related_block_height)
+bool blockchain_storage::check_tx_input(const txin_to_key& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, uint64_t* pmax_related_block_height, ring_signature_checks* pdeferred_sig_checks)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
 
   struct outputs_visitor
   {
@@ -2369,22 +2647,16 @@ bool blockchain_storage::check_tx_input(const txin_to_key& txin, const crypto::h
     blockchain_storage& m_bch;
     outputs_visitor(std::vector<crypto::public_key>& results_collector, blockchain_storage& bch) :m_results_collector(results_collector), m_bch(bch)
     {}
-    bool handle_output(const transaction& tx, const tx_out& out)
+    bool handle_output(const output_key_entry& out)
     {
       //check tx unlock time
-      if (!m_bch.is_tx_spendtime_unlocked(tx.unlock_time))
-      {
-        LOG_PRINT_L0("One of outputs for one of inputs have wrong tx.unlock_time = " << tx.unlock_time);
-        return false;
-      }
-
-      if (out.target.type() != typeid(txout_to_key))
+      if (!m_bch.is_tx_spendtime_unlocked(out.unlock_time))
       {
-        LOG_PRINT_L0("Output have wrong type id, which=" << out.target.which());
+        LOG_PRINT_L0("One of outputs for one of inputs have wrong tx.unlock_time = " << out.unlock_time);
         return false;
       }
 
-      m_results_collector.push_back(boost::get<txout_to_key>(out.target).key);
+      m_results_collector.push_back(out.key);
       return true;
     }
   };
@@ -2407,6 +2679,15 @@ bool blockchain_storage::check_tx_input(const txin_to_key& txin, const crypto::h
     return true;
 
   CHECK_AND_ASSERT_MES(sig.size() == output_keys.size(), false, "internal error: tx signatures count=" << sig.size() << " mismatch with outputs keys count for inputs=" << output_keys.size());
+  if (pdeferred_sig_checks)
+  {
+    ring_signature_check_entry& ce = *pdeferred_sig_checks->insert(pdeferred_sig_checks->end(), ring_signature_check_entry());
+    ce.prefix_hash = tx_prefix_hash;
+    ce.k_image = txin.k_image;
+    ce.output_keys.swap(output_keys);
+    ce.signatures = sig;
+    return true;
+  }
   return crypto::check_ring_signature(tx_prefix_hash, txin.k_image, output_keys, sig.data());
 }
 //------------------------------------------------------------------
@@ -2451,7 +2732,7 @@ bool blockchain_storage::check_block_timestamp(std::vector<uint64_t> timestamps,
 //------------------------------------------------------------------
 bool blockchain_storage::get_block_for_scratchpad_alt(uint64_t connection_height, uint64_t block_index, std::list<blockchain_storage::blocks_ext_by_hash::iterator>& alt_chain, block & b)
 {
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  BLOCKCHAIN_SHARED_REGION_LOCAL();
   if (block_index >= connection_height)
   {
     //take it from alt chain
@@ -2560,10 +2841,12 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
   PROF_L2_FINISH(prevalidate_miner_tx_time);
 
   PROF_L2_START(add_miner_tx_time);
-  size_t coinbase_blob_size = get_object_blobsize(bl.miner_tx);
+  crypto::hash miner_tx_id = null_hash;
+  size_t coinbase_blob_size = 0;
+  get_transaction_hash(bl.miner_tx, miner_tx_id, coinbase_blob_size);
   size_t cumulative_block_size = coinbase_blob_size;
   //process transactions
-  if (!add_transaction_from_block(bl.miner_tx, get_transaction_hash(bl.miner_tx), id, get_current_blockchain_height()))
+  if (!add_transaction_from_block(bl.miner_tx, miner_tx_id, id, get_current_blockchain_height()))
   {
     LOG_PRINT_L0("Block with id: " << id << " failed to add transaction to blockchain storage");
     bvc.m_verifivation_failed = true;
@@ -2575,6 +2858,7 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
   PROF_L2_START(process_transactions_time);
   size_t tx_processed_count = 0;
   uint64_t fee_summary = 0;
+  ring_signature_checks block_sig_checks;
   BOOST_FOREACH(const crypto::hash& tx_id, bl.tx_hashes)
   {
     transaction tx;
@@ -2595,11 +2879,12 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
       tx.signatures.clear();
     }
 
-    if (!check_tx_inputs(tx))
+    //tx id is the hash of its prefix
+    if (!check_tx_inputs(tx, tx_id, NULL, &block_sig_checks))
     {
       LOG_PRINT_L0("Block with id: " << id << "have at least one transaction (id: " << tx_id << ") with wrong inputs.");
       currency::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-      bool add_res = m_tx_pool.add_tx(tx, tvc, true);
+      bool add_res = m_tx_pool.add_tx(tx, tx_id, blob_size, tvc, true);
       CHECK_AND_ASSERT_MES2(add_res, "handle_block_to_main_chain: failed to add transaction back to transaction pool");
       purge_block_data_from_blockchain(bl, tx_processed_count);
       add_block_as_invalid(bl, id);
@@ -2612,7 +2897,7 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
     {
       LOG_PRINT_L0("Block with id: " << id << " failed to add transaction to blockchain storage");
       currency::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-      bool add_res = m_tx_pool.add_tx(tx, tvc, true);
+      bool add_res = m_tx_pool.add_tx(tx, tx_id, blob_size, tvc, true);
       CHECK_AND_ASSERT_MES2(add_res, "handle_block_to_main_chain: failed to add transaction back to transaction pool");
       purge_block_data_from_blockchain(bl, tx_processed_count);
       bvc.m_verifivation_failed = true;
@@ -2624,6 +2909,19 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
   }
   PROF_L2_FINISH(process_transactions_time);
 
+  PROF_L2_START(check_ring_signatures_time);
+  //ring members are already resolved, so signatures of the whole block are checked at once on all cores
+  if (!check_ring_signatures(block_sig_checks))
+  {
+    LOG_PRINT_L0("Block with id: " << id << " have at least one transaction with wrong ring signature");
+    purge_block_data_from_blockchain(bl, tx_processed_count);
+    add_block_as_invalid(bl, id);
+    LOG_PRINT_L0("Block with id " << id << " added as invalid becouse of wrong inputs in transactions");
+    bvc.m_verifivation_failed = true;
+    return false;
+  }
+  PROF_L2_FINISH(check_ring_signatures_time);
+
 
   PROF_L2_START(validate_miner_tx_time);
   uint64_t base_reward = 0;
@@ -2644,6 +2942,7 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
   PROF_L2_START(update_blocks_table_time1);
   block_extended_info bei = boost::value_initialized<block_extended_info>();
   bei.bl = bl;
+  bei.id = id;
   bei.scratch_offset = m_scratchpad_wr.get_scratchpad().size();
   bei.block_cumulative_size = cumulative_block_size;
   bei.cumulative_difficulty = current_diffic;
@@ -2681,7 +2980,12 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
 
   PROF_L2_START(update_blocks_table_time2);
   m_db_blocks.push_back(bei);
+  block_blob_entry bbe = AUTO_VAL_INIT(bbe);
+  bbe.blob = block_to_blob(bl);
+  bbe.tx_hashes = bl.tx_hashes;
+  m_db_block_blobs.set(bei.height, bbe);
   update_next_comulative_size_limit();
+  push_addendum_cache_entry(bl, id, bei.height);
   PROF_L2_FINISH(update_blocks_table_time2);
 
   PROF_L1_FINISH(block_processing_time);
@@ -2701,6 +3005,7 @@ bool blockchain_storage::handle_block_to_main_chain(const block& bl, const crypt
     << PROF_L2_STR_MS(ENDL << "  prevalidate_miner_tx_time:  ", prevalidate_miner_tx_time)
     << PROF_L2_STR_MS(ENDL << "  add_miner_tx_time:          ", add_miner_tx_time)
     << PROF_L2_STR_MS(ENDL << "  process_transactions_time:  ", process_transactions_time)
+    << PROF_L2_STR_MS(ENDL << "  check_ring_signatures_time: ", check_ring_signatures_time)
     << PROF_L2_STR_MS(ENDL << "  validate_miner_tx_time:     ", validate_miner_tx_time)
     << PROF_L2_STR_MS(ENDL << "  update_blocks_table_time1:  ", update_blocks_table_time1)
     << PROF_L2_STR_MS(ENDL << "  update_scratchpad_time:     ", update_scratchpad_time)
@@ -2729,11 +3034,15 @@ bool blockchain_storage::update_next_comulative_size_limit()
 }
 //------------------------------------------------------------------
 bool blockchain_storage::add_new_block(const block& bl_, block_verification_context& bvc)
+{
+  return add_new_block(bl_, get_block_hash(bl_), bvc);
+}
+//------------------------------------------------------------------
+bool blockchain_storage::add_new_block(const block& bl_, const crypto::hash& id, block_verification_context& bvc)
 {
   try
   {
     block bl = bl_;
-    crypto::hash id = get_block_hash(bl);
     CRITICAL_REGION_LOCAL(m_tx_pool);//to avoid deadlock lets lock tx_pool for whole add/reorganize process
     CRITICAL_REGION_LOCAL1(m_blockchain_lock);
     PROF_L2_START(time_have_block_check);
@@ -2784,6 +3093,8 @@ bool blockchain_storage::add_new_block(const block& bl_, block_verification_cont
     bvc.m_verifivation_failed = true;
     bvc.m_added_to_main_chain = false;
     m_db.abort_transaction();
+    //may have entries of blocks that are rolled back now
+    m_addendum_cache.clear();
     LOG_ERROR("UNKNOWN EXCEPTION WHILE ADDINIG NEW BLOCK: " << ex.what());
     return false;
   }
@@ -2792,6 +3103,8 @@ bool blockchain_storage::add_new_block(const block& bl_, block_verification_cont
     bvc.m_verifivation_failed = true;
     bvc.m_added_to_main_chain = false;
     m_db.abort_transaction();
+    //may have entries of blocks that are rolled back now
+    m_addendum_cache.clear();
     LOG_ERROR("UNKNOWN EXCEPTION WHILE ADDINIG NEW BLOCK.");
     return false;
   }
@@ -10,6 +10,8 @@
 
 #include <boost/foreach.hpp>
 #include <atomic>
+#include <deque>
+#include <memory>
 
 
 #include "serialization/serialization.h"
@@ -39,6 +41,12 @@ MAKE_POD_C11(macro_alias_1);
 
 POD_MAKE_HASHABLE(currency, account_public_address);
 
+// read-only paths: shared lock on m_blockchain_lock plus one lmdb read-only transaction for the whole call
+// (write paths take CRITICAL_REGION_LOCAL(m_blockchain_lock) which is exclusive)
+#define BLOCKCHAIN_SHARED_REGION_LOCAL() SHARED_RECURSIVE_CRITICAL_REGION_LOCAL(m_blockchain_lock); \
+                                         db::read_only_transaction_scope blockchain_ro_tx_scope(m_db)
+#define BLOCKCHAIN_SHARED_REGION_BEGIN() { BLOCKCHAIN_SHARED_REGION_LOCAL()
+
 namespace currency
 {
 
@@ -68,6 +76,21 @@ namespace currency
       END_SERIALIZE()
     };
 
+    //canonical block blob as it goes over the wire, with ids of its transactions to find their blobs without parsing the block
+    struct block_blob_entry
+    {
+      blobdata blob;
+      std::vector<crypto::hash> tx_hashes;
+
+      BEGIN_SERIALIZE_OBJECT()
+        FIELD(blob)
+        FIELD(tx_hashes)
+      END_SERIALIZE()
+    };
+
+    typedef currency::block_addendum_entry block_addendum_entry;
+    typedef currency::block_addendum_entry_ptr block_addendum_entry_ptr;
+
     struct block_extended_info
     {
       block   bl;
@@ -77,10 +100,11 @@ namespace currency
       uint64_t already_generated_coins;
       uint64_t already_donated_coins;
       uint64_t scratch_offset;
+      crypto::hash id;             //cached get_block_hash(bl), null for entries stored by version 1
 
       uint32_t version;
 
-      DEFINE_SERIALIZATION_VERSION(1)
+      DEFINE_SERIALIZATION_VERSION(2)
       BEGIN_SERIALIZE_OBJECT()
         VERSION_ENTRY(version)
         FIELDS(bl)
@@ -90,10 +114,42 @@ namespace currency
         FIELD(already_generated_coins)
         FIELD(already_donated_coins)
         FIELD(scratch_offset)
+        if (version < 2)
+          return true;
+        FIELD(id)
       END_SERIALIZE()
+
+      crypto::hash get_id() const
+      {
+        return id != null_hash ? id : get_block_hash(bl);
+      }
+    };
+
+#pragma pack(push, 1)
+    // compact copy of txout_to_key data needed to resolve ring members without decoding the whole transaction
+    struct output_key_entry
+    {
+      crypto::public_key key;
+      uint64_t unlock_time;
+      uint64_t keeper_block_height;
+      uint8_t mix_attr;
+    };
+#pragma pack(pop)
+
+    // ring signature with already resolved ring members, checked later (and in parallel with others) by check_ring_signatures()
+    struct ring_signature_check_entry
+    {
+      crypto::hash prefix_hash;
+      crypto::key_image k_image;
+      std::vector<crypto::public_key> output_keys;
+      std::vector<crypto::signature> signatures;
     };
+    typedef std::vector<ring_signature_check_entry> ring_signature_checks;
 
     typedef db::key_to_array_accessor_base<uint64_t, std::pair<crypto::hash, uint64_t>, false>  outputs_container;
+    typedef db::key_to_array_accessor_base<uint64_t, output_key_entry, false>  output_keys_container; // amount -> [global index] -> output_key_entry
+    typedef db::key_to_array_accessor_base<uint64_t, uint64_t, false>  mixable_outputs_container; // amount -> unordered array of global indexes of outputs usable as mixins
+    typedef db::key_value_accessor_base<db::complex_key<uint64_t, uint64_t>, uint64_t, false>  mixable_outputs_positions_container; // (amount, global index) -> position in mixable_outputs_container
 
     blockchain_storage(tx_memory_pool& tx_pool);
 
@@ -132,6 +188,7 @@ namespace currency
     bool get_top_block(block& b);
     wide_difficulty_type get_difficulty_for_next_block();
     bool add_new_block(const block& bl_, block_verification_context& bvc);
+    bool add_new_block(const block& bl_, const crypto::hash& id, block_verification_context& bvc);
     bool reset_and_set_genesis_block(const block& b);
     bool create_block_template(block& b, const account_public_address& miner_address, wide_difficulty_type& di, uint64_t& height, const blobdata& ex_nonce, bool vote_for_donation, const alias_info& ai);
     bool have_block(const crypto::hash& id);
@@ -141,6 +198,7 @@ namespace currency
     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp);
     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, uint64_t& starter_offset);
     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<std::pair<block, std::list<transaction> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count);
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<block_complete_entry>& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count);
     bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp);
     bool handle_get_objects(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& req, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& res);
     bool get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& req, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& res);
@@ -152,10 +210,12 @@ namespace currency
     uint64_t get_aliases_count();
     uint64_t get_scratchpad_size();
     //bool store_blockchain();
-    bool check_tx_input(const txin_to_key& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, uint64_t* pmax_related_block_height = NULL);
-    bool check_tx_inputs(const transaction& tx, const crypto::hash& tx_prefix_hash, uint64_t* pmax_used_block_height = NULL);
+    bool check_tx_input(const txin_to_key& txin, const crypto::hash& tx_prefix_hash, const std::vector<crypto::signature>& sig, uint64_t* pmax_related_block_height = NULL, ring_signature_checks* pdeferred_sig_checks = NULL);
+    bool check_tx_inputs(const transaction& tx, const crypto::hash& tx_prefix_hash, uint64_t* pmax_used_block_height = NULL, ring_signature_checks* pdeferred_sig_checks = NULL);
     bool check_tx_inputs(const transaction& tx, uint64_t* pmax_used_block_height = NULL);
     bool check_tx_inputs(const transaction& tx, uint64_t& pmax_used_block_height, crypto::hash& max_used_block_id);
+    bool check_tx_inputs(const transaction& tx, const crypto::hash& tx_prefix_hash, uint64_t& pmax_used_block_height, crypto::hash& max_used_block_id);
+    static bool check_ring_signatures(const ring_signature_checks& checks);
     uint64_t get_current_comulative_blocksize_limit();
     uint64_t get_already_generated_coins(crypto::hash &hash, uint64_t &count);
     uint64_t get_already_donated_coins(crypto::hash &hash, uint64_t &count);
@@ -169,7 +229,11 @@ namespace currency
     bool is_storing_blockchain(){ return m_is_blockchain_storing; }
     wide_difficulty_type block_difficulty(size_t i);
     bool copy_scratchpad(std::vector<crypto::hash>& dst);//TODO: not the best way, add later update method instead of full copy    
+    bool copy_scratchpad(scratchpad_vector& dst, crypto::hash& top_id, uint64_t& top_height);
     bool copy_scratchpad_as_blob(std::string& dst);
+    bool get_addendums_since(uint64_t height, const crypto::hash& id, std::list<block_addendum_entry_ptr>& res);
+    //top_id/top_height: top block the result ends with
+    bool get_addendums_since(uint64_t height, const crypto::hash& id, std::list<block_addendum_entry_ptr>& res, crypto::hash& top_id, uint64_t& top_height);
     bool prune_aged_alt_blocks();
     bool get_transactions_daily_stat(uint64_t& daily_cnt, uint64_t& daily_volume);
     bool check_keyimages(const std::list<crypto::key_image>& images, std::list<bool>& images_stat);//true - unspent, false - spent
@@ -181,18 +245,18 @@ namespace currency
     template<class t_ids_container, class t_blocks_container, class t_missed_container>
     bool get_blocks(const t_ids_container& block_ids, t_blocks_container& blocks, t_missed_container& missed_bs)
     {
-      CRITICAL_REGION_LOCAL(m_blockchain_lock);
+      BLOCKCHAIN_SHARED_REGION_LOCAL();
 
       BOOST_FOREACH(const auto& bl_id, block_ids)
       {
-        auto block_ind_ptr = m_db_blocks_index.find(bl_id);
-        if (!block_ind_ptr)
+        uint64_t block_ind = 0;
+        if (!m_db_blocks_index.get(bl_id, block_ind))
           missed_bs.push_back(bl_id);
         else
         {
-          CHECK_AND_ASSERT_MES(*block_ind_ptr < m_db_blocks.size(), false, "Internal error: bl_id=" << string_tools::pod_to_hex(bl_id)
-            << " have index record with offset=" << *block_ind_ptr << ", bigger then m_blocks.size()=" << m_db_blocks.size());
-          blocks.push_back(m_db_blocks[*block_ind_ptr]->bl);
+          CHECK_AND_ASSERT_MES(block_ind < m_db_blocks.size(), false, "Internal error: bl_id=" << string_tools::pod_to_hex(bl_id)
+            << " have index record with offset=" << block_ind << ", bigger then m_blocks.size()=" << m_db_blocks.size());
+          blocks.push_back(m_db_blocks[block_ind]->bl);
         }
       }
       return true;
@@ -201,7 +265,7 @@ namespace currency
     template<class t_ids_container, class t_tx_container, class t_missed_container>
     bool get_transactions(const t_ids_container& txs_ids, t_tx_container& txs, t_missed_container& missed_txs)const
     {
-      CRITICAL_REGION_LOCAL(m_blockchain_lock);
+      BLOCKCHAIN_SHARED_REGION_LOCAL();
 
       BOOST_FOREACH(const auto& tx_id, txs_ids)
       {
@@ -228,6 +292,8 @@ namespace currency
     //-------------- DB containers --------------
     typedef db::key_value_accessor_base<crypto::hash, uint64_t, false> blocks_by_id_index; //typedef std::unordered_map<crypto::hash, size_t> blocks_by_id_index;
     typedef db::key_value_accessor_base<crypto::hash, transaction_chain_entry, true> transactions_container; //typedef std::unordered_map<crypto::hash, transaction_chain_entry> transactions_container;
+    typedef db::key_value_accessor_base<uint64_t, block_blob_entry, true> block_blobs_container; //by height
+    typedef db::key_to_blob_accessor<crypto::hash> transaction_blobs_container;
 
     typedef db::key_value_accessor_base<crypto::key_image, bool, false> key_images_container; //typedef std::unordered_set<crypto::key_image> key_images_container;
     typedef db::array_accessor<block_extended_info, true> blocks_container;
@@ -251,6 +317,8 @@ namespace currency
     blocks_container m_db_blocks;
     blocks_by_id_index m_db_blocks_index;
     transactions_container m_db_transactions;
+    block_blobs_container m_db_block_blobs;
+    transaction_blobs_container m_db_transaction_blobs;
     key_images_container m_db_spent_keys;
     solo_options_container m_db_solo_options;
     db::single_value<uint64_t, uint64_t, solo_options_container> m_db_current_block_cumul_sz_limit;
@@ -258,11 +326,15 @@ namespace currency
     db::single_value<uint64_t, std::string, solo_options_container, true> m_db_last_worked_version;
     db::single_value<uint64_t, uint64_t, solo_options_container> m_db_storage_major_compability_version;
     outputs_container m_db_outputs;
+    output_keys_container m_db_output_keys;
+    mixable_outputs_container m_db_mixable_outputs;
+    mixable_outputs_positions_container m_db_mixable_outputs_positions;
     aliases_container m_db_aliases;
     address_to_aliases_container m_db_addr_to_alias;
     
     scratchpad_wrapper::scratchpad_container m_db_scratchpad_internal;
     scratchpad_wrapper m_scratchpad_wr;
+    block_addendum_cache m_addendum_cache; //last CURRENCY_ADDENDUM_CACHE_SIZE main chain blocks, guarded by m_blockchain_lock
 
 
     // state members 
@@ -283,10 +355,11 @@ namespace currency
     epee::file_io_utils::native_filesystem_handle m_locker_file;
 
     // mutable members
-    mutable critical_section m_blockchain_lock; // TODO: add here reader/writer lock
+    mutable epee::recursive_shared_critical_section m_blockchain_lock;
 
     bool switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::iterator>& alt_chain);
     bool pop_block_from_blockchain();
+    bool get_block_complete_entry(uint64_t height, block_complete_entry& bce, std::list<crypto::hash>& missed_txs);
     bool purge_block_data_from_blockchain(const block& b, size_t processed_tx_count);
     bool purge_transaction_from_blockchain(const crypto::hash& tx_id);
     bool purge_transaction_keyimages_from_blockchain(const transaction& tx, bool strict_check);
@@ -300,10 +373,12 @@ namespace currency
     bool validate_transaction(const block& b, uint64_t height, const transaction& tx);
     bool rollback_blockchain_switching(std::list<block>& original_chain, size_t rollback_height);
     bool add_transaction_from_block(const transaction& tx, const crypto::hash& tx_id, const crypto::hash& bl_id, uint64_t bl_height);
-    bool push_transaction_to_global_outs_index(const transaction& tx, const crypto::hash& tx_id, std::vector<uint64_t>& global_indexes);
+    bool push_transaction_to_global_outs_index(const transaction& tx, const crypto::hash& tx_id, uint64_t keeper_block_height, std::vector<uint64_t>& global_indexes);
     bool pop_transaction_from_global_index(const transaction& tx, const crypto::hash& tx_id);
     bool get_last_n_blocks_sizes(std::vector<size_t>& sz, size_t count);
     bool add_out_to_get_random_outs(COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, uint64_t amount, size_t i, uint64_t mix_count, bool use_only_forced_to_mix = false);
+    bool add_mixable_output(uint64_t amount, uint64_t global_index);
+    bool remove_mixable_output(uint64_t amount, uint64_t global_index);
     bool is_tx_spendtime_unlocked(uint64_t unlock_time);
     bool add_block_as_invalid(const block& bl, const crypto::hash& h);
     bool add_block_as_invalid(const block_extended_info& bei, const crypto::hash& h);
@@ -313,6 +388,8 @@ namespace currency
     uint64_t get_adjusted_time();
     bool complete_timestamps_vector(uint64_t start_height, std::vector<uint64_t>& timestamps);
     bool update_next_comulative_size_limit();
+    bool make_addendum_entry(const block& b, const crypto::hash& id, uint64_t height, block_addendum_entry_ptr& res);
+    bool push_addendum_cache_entry(const block& b, const crypto::hash& id, uint64_t height);
     bool get_block_for_scratchpad_alt(uint64_t connection_height, uint64_t block_index, std::list<blockchain_storage::blocks_ext_by_hash::iterator>& alt_chain, block & b);
     bool process_blockchain_tx_extra(const transaction& tx);
     bool unprocess_blockchain_tx_extra(const transaction& tx);
@@ -340,53 +417,43 @@ namespace currency
   template<class visitor_t>
   bool blockchain_storage::scan_outputkeys_for_indexes(const txin_to_key& tx_in_to_key, visitor_t& vis, uint64_t* pmax_related_block_height)
   {
-    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    BLOCKCHAIN_SHARED_REGION_LOCAL();
 
-    uint64_t outs_count_for_amount = m_db_outputs.get_item_size(tx_in_to_key.amount);
+    uint64_t outs_count_for_amount = m_db_output_keys.get_item_size(tx_in_to_key.amount);
 
     if (!outs_count_for_amount)
       return false;
 
     std::vector<uint64_t> absolute_offsets = relative_output_offsets_to_absolute(tx_in_to_key.key_offsets);
 
-    //std::vector<std::pair<crypto::hash, size_t> >& amount_outs_vec = it->second;
-
     size_t count = 0;
     BOOST_FOREACH(uint64_t i, absolute_offsets)
     {
-      crypto::hash tx_id = null_hash;
-      size_t n = 0;
       if (i >= outs_count_for_amount)
       {
         LOG_ERROR("Wrong index in transaction inputs: " << i << ", expected maximum " << outs_count_for_amount - 1);
         return false;
       }
-      tx_id = m_db_outputs.get_subitem(tx_in_to_key.amount, i)->first;
-      n = m_db_outputs.get_subitem(tx_in_to_key.amount, i)->second;
+      output_key_entry out_entry = AUTO_VAL_INIT(out_entry);
+      CHECK_AND_ASSERT_MES(m_db_output_keys.get_subitem(tx_in_to_key.amount, i, out_entry), false, "Failed to get output key entry for amount " << tx_in_to_key.amount << ", index " << i);
 
-
-      auto tx_ptr = m_db_transactions.find(tx_id);
-      CHECK_AND_ASSERT_MES(tx_ptr, false, "Wrong transaction id in output indexes: " << string_tools::pod_to_hex(tx_id));
-      CHECK_AND_ASSERT_MES(n < tx_ptr->tx.vout.size(), false,
-        "Wrong index in transaction outputs: " << n << ", expected less then " << tx_ptr->tx.vout.size());
       //check mix_attr
-
-      CHECKED_GET_SPECIFIC_VARIANT(tx_ptr->tx.vout[n].target, const txout_to_key, outtk, false);
-      if (outtk.mix_attr > 1)
-        CHECK_AND_ASSERT_MES(tx_in_to_key.key_offsets.size() >= outtk.mix_attr, false, "transaction out[" << count << "] is marked to be used minimum with " << static_cast<uint32_t>(outtk.mix_attr) << "parts in ring signature, but input used only " << tx_in_to_key.key_offsets.size());
-      else if (outtk.mix_attr == CURRENCY_TO_KEY_OUT_FORCED_NO_MIX)
+      if (out_entry.mix_attr > 1)
+        CHECK_AND_ASSERT_MES(tx_in_to_key.key_offsets.size() >= out_entry.mix_attr, false, "transaction out[" << count << "] is marked to be used minimum with " << static_cast<uint32_t>(out_entry.mix_attr) << "parts in ring signature, but input used only " << tx_in_to_key.key_offsets.size());
+      else if (out_entry.mix_attr == CURRENCY_TO_KEY_OUT_FORCED_NO_MIX)
         CHECK_AND_ASSERT_MES(tx_in_to_key.key_offsets.size() == 1, false, "transaction out[" << count << "] is marked to be used without mixins in ring signature, but input used is " << tx_in_to_key.key_offsets.size());
 
-      if (!vis.handle_output(tx_ptr->tx, tx_ptr->tx.vout[n]))
+      if (!vis.handle_output(out_entry))
       {
-        LOG_PRINT_L0("Failed to handle_output for output id = " << tx_id << ", no " << n);
+        LOG_PRINT_L0("Failed to handle_output for amount = " << tx_in_to_key.amount << ", global index = " << i);
         return false;
       }
       if (pmax_related_block_height)
       {
-        if (*pmax_related_block_height < tx_ptr->m_keeper_block_height)
-          *pmax_related_block_height = tx_ptr->m_keeper_block_height;
+        if (*pmax_related_block_height < out_entry.keeper_block_height)
+          *pmax_related_block_height = out_entry.keeper_block_height;
       }
+      ++count;
     }
 
     return true;
@@ -22,8 +22,14 @@ namespace currency
       state_normal
     };
 
+    currency_connection_context(): m_state(state_befor_handshake), m_needed_objects_height(0), m_sync_waiting(false),
+      m_remote_blockchain_height(0), m_last_response_height(0)
+    {}
+
     state m_state;
     std::list<crypto::hash> m_needed_objects;
+    uint64_t m_needed_objects_height;          //height of m_needed_objects.front()
+    bool m_sync_waiting;                       //nothing to request now, on_idle will wake connection up
     std::unordered_set<crypto::hash> m_requested_objects;
     uint64_t m_remote_blockchain_height;
     uint64_t m_last_response_height;
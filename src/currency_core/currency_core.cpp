@@ -8,9 +8,11 @@
 using namespace epee;
 
 #include <boost/foreach.hpp>
+#include <atomic>
 #include <unordered_set>
 #include "currency_core.h"
 #include "common/command_line.h"
+#include "common/thread_pool.h"
 #include "common/util.h"
 #include "warnings.h"
 #include "crypto/crypto.h"
@@ -49,6 +51,7 @@ namespace currency
   void core::init_options(boost::program_options::options_description& desc)
   {
     blockchain_storage::init_options(desc);
+    tx_memory_pool::init_options(desc);
   }
   //-----------------------------------------------------------------------------------------------
   std::string core::get_config_folder()
@@ -126,12 +129,15 @@ namespace currency
   {
     bool r = handle_command_line(vm);
 
-    r = m_mempool.init(m_config_folder);
+    r = m_mempool.init(vm, m_config_folder);
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize memory pool");
 
     r = m_blockchain_storage.init(vm, m_config_folder);
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize blockchain storage");
 
+    r = m_mempool.remove_spent_in_blockchain();
+    CHECK_AND_ASSERT_MES(r, false, "Failed to remove spent transactions from memory pool");
+
     r = m_miner.init(vm);
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize blockchain storage");
 
@@ -161,9 +167,6 @@ namespace currency
   bool core::handle_incoming_tx(const blobdata& tx_blob, tx_verification_context& tvc, bool keeped_by_block)
   {
     tvc = boost::value_initialized<tx_verification_context>();
-    //want to process all transactions sequentially
-    CRITICAL_REGION_LOCAL(m_incoming_tx_lock);
-
     if(tx_blob.size() > get_max_tx_size())
     {
       LOG_PRINT_L0("WRONG TRANSACTION BLOB, too big size " << tx_blob.size() << ", rejected");
@@ -173,15 +176,29 @@ namespace currency
 
     crypto::hash tx_hash = null_hash;
     crypto::hash tx_prefixt_hash = null_hash;
+    size_t blob_size = 0;
     transaction tx;
 
-    if(!parse_tx_from_blob(tx, tx_hash, tx_prefixt_hash, tx_blob))
+    if(!parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash, tx_prefixt_hash, blob_size))
     {
       LOG_PRINT_L0("WRONG TRANSACTION BLOB, Failed to parse, rejected");
       tvc.m_verifivation_failed = true;
       return false;
     }
-    //std::cout << "!"<< tx.vin.size() << std::endl;
+    return handle_incoming_tx(tx, tx_hash, tx_prefixt_hash, blob_size, tvc, keeped_by_block);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::handle_incoming_tx(const transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prefixt_hash, size_t blob_size, tx_verification_context& tvc, bool keeped_by_block)
+  {
+    tvc = boost::value_initialized<tx_verification_context>();
+    //no lock here: checks below don't touch shared state, and pool resolves conflicts between concurrently added transactions itself
+
+    if(blob_size > get_max_tx_size())
+    {
+      LOG_PRINT_L0("WRONG TRANSACTION BLOB, too big size " << blob_size << ", rejected");
+      tvc.m_verifivation_failed = true;
+      return false;
+    }
 
     if(!check_tx_syntax(tx))
     {
@@ -190,14 +207,14 @@ namespace currency
       return false;
     }
 
-    if(!check_tx_semantic(tx, keeped_by_block))
+    if(!check_tx_semantic(tx, blob_size, keeped_by_block))
     {
       LOG_PRINT_L0("WRONG TRANSACTION BLOB, Failed to check tx " << tx_hash << " semantic, rejected");
       tvc.m_verifivation_failed = true;
       return false;
     }
 
-    bool r = add_new_tx(tx, tx_hash, tx_prefixt_hash, tvc, keeped_by_block);
+    bool r = add_new_tx(tx, tx_hash, tx_prefixt_hash, blob_size, tvc, keeped_by_block);
     if(tvc.m_verifivation_failed)
     {LOG_PRINT_RED_L0("Transaction verification failed: " << tx_hash);}
     else if(tvc.m_verifivation_impossible)
@@ -208,6 +225,33 @@ namespace currency
     return r;
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::handle_incoming_txs(const std::list<blobdata>& tx_blobs, std::vector<tx_verification_context>& tvcs, bool keeped_by_block)
+  {
+    if (tx_blobs.size() == 1)
+    {
+      //usual relay message, not worth handing over to other threads
+      tvcs.resize(1);
+      return handle_incoming_tx(tx_blobs.front(), tvcs[0], keeped_by_block);
+    }
+
+    std::vector<const blobdata*> blobs;
+    blobs.reserve(tx_blobs.size());
+    for (const auto& b : tx_blobs)
+      blobs.push_back(&b);
+    tvcs.resize(blobs.size());
+    if (blobs.empty())
+      return true;
+
+    //parsing, semantic and ring signature checks of independent transactions go in parallel (single tx stays on this thread)
+    std::atomic<bool> ok(true);
+    tools::thread_pool::instance().parallel_for(blobs.size(), [&](size_t i)
+    {
+      if (!handle_incoming_tx(*blobs[i], tvcs[i], keeped_by_block))
+        ok = false;
+    });
+    return ok;
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::get_stat_info(core_stat_info& st_inf)
   {
     st_inf.mining_speed = m_miner.get_speed();
@@ -219,7 +263,7 @@ namespace currency
   }
 
   //-----------------------------------------------------------------------------------------------
-  bool core::check_tx_semantic(const transaction& tx, bool keeped_by_block)
+  bool core::check_tx_semantic(const transaction& tx, size_t blob_size, bool keeped_by_block)
   {
     if(!tx.vin.size())
     {
@@ -255,9 +299,9 @@ namespace currency
       return false;
     }
 
-    if(!keeped_by_block && get_object_blobsize(tx) >= m_blockchain_storage.get_current_comulative_blocksize_limit() - CURRENCY_COINBASE_BLOB_RESERVED_SIZE)
+    if(!keeped_by_block && blob_size >= m_blockchain_storage.get_current_comulative_blocksize_limit() - CURRENCY_COINBASE_BLOB_RESERVED_SIZE)
     {
-      LOG_PRINT_RED_L0("tx have to big size " << get_object_blobsize(tx) << ", expected not bigger than " << m_blockchain_storage.get_current_comulative_blocksize_limit() - CURRENCY_COINBASE_BLOB_RESERVED_SIZE);
+      LOG_PRINT_RED_L0("tx have to big size " << blob_size << ", expected not bigger than " << m_blockchain_storage.get_current_comulative_blocksize_limit() - CURRENCY_COINBASE_BLOB_RESERVED_SIZE);
       return false;
     }
 
@@ -300,11 +344,11 @@ namespace currency
   //-----------------------------------------------------------------------------------------------
   bool core::add_new_tx(const transaction& tx, tx_verification_context& tvc, bool keeped_by_block)
   {
-    crypto::hash tx_hash = get_transaction_hash(tx);
-    crypto::hash tx_prefix_hash = get_transaction_prefix_hash(tx);
-    blobdata bl;
-    t_serializable_object_to_blob(tx, bl);
-    return add_new_tx(tx, tx_hash, tx_prefix_hash, tvc, keeped_by_block);
+    crypto::hash tx_hash = null_hash;
+    size_t blob_size = 0;
+    get_transaction_hash(tx, tx_hash, blob_size);
+    //tx hash is the hash of its prefix
+    return add_new_tx(tx, tx_hash, tx_hash, blob_size, tvc, keeped_by_block);
   }
   //-----------------------------------------------------------------------------------------------
   size_t core::get_blockchain_total_transactions()
@@ -317,7 +361,7 @@ namespace currency
     return m_blockchain_storage.get_outs(amount, pkeys);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::add_new_tx(const transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prefix_hash, tx_verification_context& tvc, bool keeped_by_block)
+  bool core::add_new_tx(const transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prefix_hash, size_t blob_size, tx_verification_context& tvc, bool keeped_by_block)
   {
     if(m_mempool.have_tx(tx_hash))
     {
@@ -331,7 +375,7 @@ namespace currency
       return true;
     }
 
-    return m_mempool.add_tx(tx, tx_hash, tvc, keeped_by_block);
+    return m_mempool.add_tx(tx, tx_hash, blob_size, tvc, keeped_by_block);
   }
   //-----------------------------------------------------------------------------------------------
   bool core::get_block_template(block& b, const account_public_address& adr, wide_difficulty_type& diffic, uint64_t& height, const blobdata& ex_nonce, bool vote_for_donation, const alias_info& ai)
@@ -349,6 +393,11 @@ namespace currency
     return m_blockchain_storage.find_blockchain_supplement(qblock_ids, blocks, total_height, start_height, max_count);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<block_complete_entry>& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count)
+  {
+    return m_blockchain_storage.find_blockchain_supplement(qblock_ids, blocks, total_height, start_height, max_count);
+  }
+  //-----------------------------------------------------------------------------------------------
   void core::print_blockchain(uint64_t start_index, uint64_t end_index)
   {
     m_blockchain_storage.print_blockchain(start_index, end_index);
@@ -454,7 +503,19 @@ namespace currency
       bvc.m_verifivation_failed = true;
       return false;
     }
-    add_new_block(b, bvc);
+    return handle_incoming_block(b, get_block_hash(b), block_blob.size(), bvc, update_miner_blocktemplate);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::handle_incoming_block(const block& b, const crypto::hash& id, size_t blob_size, block_verification_context& bvc, bool update_miner_blocktemplate)
+  {
+    bvc = boost::value_initialized<block_verification_context>();
+    if(blob_size > get_max_block_size())
+    {
+      LOG_PRINT_L0("WRONG BLOCK BLOB, too big size " << blob_size << ", rejected");
+      bvc.m_verifivation_failed = true;
+      return false;
+    }
+    m_blockchain_storage.add_new_block(b, id, bvc);
     if(update_miner_blocktemplate && bvc.m_added_to_main_chain)
        update_miner_block_template();
     return true;
@@ -34,7 +34,12 @@ namespace currency
      bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, currency_connection_context& context);
      bool on_idle();
      bool handle_incoming_tx(const blobdata& tx_blob, tx_verification_context& tvc, bool keeped_by_block);
+     //handles several transactions concurrently, tvcs[i] is result for i-th blob
+     bool handle_incoming_txs(const std::list<blobdata>& tx_blobs, std::vector<tx_verification_context>& tvcs, bool keeped_by_block);
      bool handle_incoming_block(const blobdata& block_blob, block_verification_context& bvc, bool update_miner_blocktemplate = true);
+     //same as above, for objects that caller already parsed (and hashed) from blobs of given size (for tx - get_object_blobsize(tx))
+     bool handle_incoming_tx(const transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prefix_hash, size_t blob_size, tx_verification_context& tvc, bool keeped_by_block);
+     bool handle_incoming_block(const block& b, const crypto::hash& id, size_t blob_size, block_verification_context& bvc, bool update_miner_blocktemplate = true);
      i_currency_protocol* get_protocol(){return m_pprotocol;}
      tx_memory_pool& get_tx_pool(){ return m_mempool; };
 
@@ -79,6 +84,7 @@ namespace currency
      bool get_short_chain_history(std::list<crypto::hash>& ids);
      bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp);
      bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<std::pair<block, std::list<transaction> > >& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count);
+     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, std::list<block_complete_entry>& blocks, uint64_t& total_height, uint64_t& start_height, size_t max_count);
      bool get_stat_info(core_stat_info& st_inf);
      bool get_backward_blocks_sizes(uint64_t from_height, std::vector<size_t>& sizes, size_t count);
      bool get_tx_outputs_gindexs(const crypto::hash& tx_id, std::vector<uint64_t>& indexs);
@@ -95,7 +101,7 @@ namespace currency
      void on_synchronized();
 
    private:
-     bool add_new_tx(const transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prefix_hash, tx_verification_context& tvc, bool keeped_by_block);
+     bool add_new_tx(const transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prefix_hash, size_t blob_size, tx_verification_context& tvc, bool keeped_by_block);
      bool add_new_tx(const transaction& tx, tx_verification_context& tvc, bool keeped_by_block);
      bool add_new_block(const block& b, block_verification_context& bvc);
      bool load_state_data();
@@ -104,7 +110,7 @@ namespace currency
 
      bool check_tx_syntax(const transaction& tx);
      //check correct values, amounts and all lightweight checks not related with database
-     bool check_tx_semantic(const transaction& tx, bool keeped_by_block);
+     bool check_tx_semantic(const transaction& tx, size_t blob_size, bool keeped_by_block);
      //check if tx already in memory pool or in main blockchain
 
      bool is_key_image_spent(const crypto::key_image& key_im);
@@ -120,7 +126,6 @@ namespace currency
      tx_memory_pool m_mempool;
      blockchain_storage m_blockchain_storage;
      i_currency_protocol* m_pprotocol;
-     critical_section m_incoming_tx_lock;
      //m_miner and m_miner_addres are probably temporary here
      miner m_miner;
      account_public_address m_miner_address;
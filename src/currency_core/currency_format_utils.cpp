@@ -18,10 +18,11 @@ namespace currency
   //---------------------------------------------------------------
   void get_transaction_prefix_hash(const transaction_prefix& tx, crypto::hash& h)
   {
-    std::ostringstream s;
-    binary_archive<true> a(s);
+    blobdata blob;
+    binary_buffer_ostream s(blob);
+    binary_buffer_archive<true> a(s);
     ::serialization::serialize(a, const_cast<transaction_prefix&>(tx));
-    crypto::cn_fast_hash(s.str().data(), s.str().size(), h);
+    crypto::cn_fast_hash(blob.data(), blob.size(), h);
   }
   //---------------------------------------------------------------
   crypto::hash get_transaction_prefix_hash(const transaction_prefix& tx)
@@ -38,13 +39,32 @@ namespace currency
   //---------------------------------------------------------------
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash, crypto::hash& tx_prefix_hash)
   {
-
-    bool r = t_unserializable_object_from_blob(tx, tx_blob);
+    size_t blob_size = 0;
+    return parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash, tx_prefix_hash, blob_size);
+  }
+  //---------------------------------------------------------------
+  bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash, crypto::hash& tx_prefix_hash, size_t& blob_size)
+  {
+    binary_buffer_istream bs(tx_blob.data(), tx_blob.size());
+    binary_buffer_archive<false> ba(bs);
+    bool r = ::serialization::serialize(ba, tx);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
     //TODO: validate tx
 
-    //crypto::cn_fast_hash(tx_blob.data(), tx_blob.size(), tx_hash);
-    get_transaction_prefix_hash(tx, tx_prefix_hash);
+    if (ba.is_canonical())
+    {
+      //blob is exactly what serializing tx gives, so prefix is hashed right from it, without serializing tx again
+      size_t signatures_size = tools::get_varint_packed_size(tx.signatures.size());
+      for (const auto& s : tx.signatures)
+        signatures_size += tools::get_varint_packed_size(s.size()) + s.size() * sizeof(crypto::signature);
+      CHECK_AND_ASSERT_MES(signatures_size <= tx_blob.size(), false, "Internal error: wrong signatures size " << signatures_size << " for tx blob of size " << tx_blob.size());
+      crypto::cn_fast_hash(tx_blob.data(), tx_blob.size() - signatures_size, tx_prefix_hash);
+      blob_size = tx_blob.size() - signatures_size + get_signatures_blobsize(tx);
+    }
+    else
+    {
+      get_transaction_hash(tx, tx_prefix_hash, blob_size);
+    }
     tx_hash = tx_prefix_hash;
     return true;
   }
@@ -187,8 +207,12 @@ namespace currency
     crypto::key_derivation recv_derivation = AUTO_VAL_INIT(recv_derivation);
     bool r = crypto::generate_key_derivation(tx_public_key, ack.m_view_secret_key, recv_derivation);
     CHECK_AND_ASSERT_MES(r, false, "key image helper: failed to generate_key_derivation(" << tx_public_key << ", " << ack.m_view_secret_key << ")");
-
-    r = crypto::derive_public_key(recv_derivation, real_output_index, ack.m_account_address.m_spend_public_key, in_ephemeral.pub);
+    return generate_key_image_helper(ack, recv_derivation, real_output_index, in_ephemeral, ki);
+  }
+  //---------------------------------------------------------------
+  bool generate_key_image_helper(const account_keys& ack, const crypto::key_derivation& recv_derivation, size_t real_output_index, keypair& in_ephemeral, crypto::key_image& ki)
+  {
+    bool r = crypto::derive_public_key(recv_derivation, real_output_index, ack.m_account_address.m_spend_public_key, in_ephemeral.pub);
     CHECK_AND_ASSERT_MES(r, false, "key image helper: failed to derive_public_key(" << recv_derivation << ", " << real_output_index <<  ", " << ack.m_account_address.m_spend_public_key << ")");
 
     crypto::derive_secret_key(recv_derivation, real_output_index, ack.m_spend_secret_key, in_ephemeral.sec);
@@ -721,9 +745,16 @@ namespace currency
   bool is_out_to_acc(const account_keys& acc, const txout_to_key& out_key, const crypto::public_key& tx_pub_key, size_t output_index)
   {
     crypto::key_derivation derivation;
-    generate_key_derivation(tx_pub_key, acc.m_view_secret_key, derivation);
+    if (!generate_key_derivation(tx_pub_key, acc.m_view_secret_key, derivation))
+      return false;
+    return is_out_to_acc(acc, out_key, derivation, output_index);
+  }
+  //---------------------------------------------------------------
+  bool is_out_to_acc(const account_keys& acc, const txout_to_key& out_key, const crypto::key_derivation& derivation, size_t output_index)
+  {
     crypto::public_key pk;
-    derive_public_key(derivation, output_index, acc.m_account_address.m_spend_public_key, pk);
+    if (!derive_public_key(derivation, output_index, acc.m_account_address.m_spend_public_key, pk))
+      return false;
     return pk == out_key.key;
   }
   //---------------------------------------------------------------
@@ -732,17 +763,29 @@ namespace currency
     crypto::public_key tx_pub_key = get_tx_pub_key_from_extra(tx);
     if(null_pkey == tx_pub_key)
       return false;
-    return lookup_acc_outs(acc, tx, get_tx_pub_key_from_extra(tx), outs, money_transfered);
+    return lookup_acc_outs(acc, tx, tx_pub_key, outs, money_transfered);
   }
   //---------------------------------------------------------------
   bool lookup_acc_outs(const account_keys& acc, const transaction& tx, const crypto::public_key& tx_pub_key, std::vector<size_t>& outs, uint64_t& money_transfered)
+  {
+    crypto::key_derivation derivation = AUTO_VAL_INIT(derivation);
+    return lookup_acc_outs(acc, tx, tx_pub_key, derivation, outs, money_transfered);
+  }
+  //---------------------------------------------------------------
+  bool lookup_acc_outs(const account_keys& acc, const transaction& tx, const crypto::public_key& tx_pub_key, crypto::key_derivation& derivation, std::vector<size_t>& outs, uint64_t& money_transfered)
   {
     money_transfered = 0;
+    BOOST_FOREACH(const tx_out& o,  tx.vout)
+      CHECK_AND_ASSERT_MES(o.target.type() ==  typeid(txout_to_key), false, "wrong type id in transaction out" );
+
+    //tx_pub_key that is not a valid point can't be ours
+    if (tx.vout.empty() || !generate_key_derivation(tx_pub_key, acc.m_view_secret_key, derivation))
+      return true;
+
     size_t i = 0;
     BOOST_FOREACH(const tx_out& o,  tx.vout)
     {
-      CHECK_AND_ASSERT_MES(o.target.type() ==  typeid(txout_to_key), false, "wrong type id in transaction out" );
-      if(is_out_to_acc(acc, boost::get<txout_to_key>(o.target), tx_pub_key, i))
+      if(is_out_to_acc(acc, boost::get<txout_to_key>(o.target), derivation, i))
       {
         outs.push_back(i);
         money_transfered += o.amount;
@@ -752,6 +795,15 @@ namespace currency
     return true;
   }
   //---------------------------------------------------------------
+  void lookup_acc_outs(const account_keys& acc, std::vector<acc_outs_lookup_entry>& entries)
+  {
+    BOOST_FOREACH(acc_outs_lookup_entry& e, entries)
+    {
+      e.outs.clear();
+      e.r = lookup_acc_outs(acc, *e.tx, e.tx_pub_key, e.derivation, e.outs, e.money_transfered);
+    }
+  }
+  //---------------------------------------------------------------
   bool set_payment_id_to_tx_extra(std::vector<uint8_t>& extra, const payment_id_t& payment_id)
   {
     if(!payment_id.size() || payment_id.size() >= TX_MAX_PAYMENT_ID_SIZE)
@@ -832,12 +884,14 @@ namespace currency
     return get_object_hash(static_cast<const transaction_prefix&>(t), res, blob_size);
   }
   //---------------------------------------------------------------
-  /*bool get_transaction_hash(const transaction& t, crypto::hash& res, size_t& blob_size)
+  bool get_transaction_hash(const transaction& t, crypto::hash& res, size_t& blob_size)
   {
-
-
-    return get_object_hash(t, res, blob_size);
-  }*/
+    //hash and get_object_blobsize(t) from single serialization of prefix
+    size_t prefix_blob_size = 0;
+    bool r = get_object_hash(static_cast<const transaction_prefix&>(t), res, prefix_blob_size);
+    blob_size = prefix_blob_size + get_signatures_blobsize(t);
+    return r;
+  }
   //------------------------------------------------------------------
   crypto::hash get_blob_longhash(const blobdata& bd, uint64_t height, const std::vector<crypto::hash>& scratchpad)
   {
@@ -853,8 +907,13 @@ namespace currency
   {
     if(!scratchpad.size())
       return get_blob_longhash(blob, 0, scratchpad);
+    return get_blob_longhash_opt(blob, &scratchpad[0], scratchpad.size());
+  }
+  //---------------------------------------------------------------
+  crypto::hash get_blob_longhash_opt(const std::string& blob, const crypto::hash* scratchpad, size_t scratchpad_size)
+  {
     crypto::hash h2 = null_hash;
-    crypto::wild_keccak_dbl_opt(reinterpret_cast<const uint8_t*>(&blob[0]), blob.size(), reinterpret_cast<uint8_t*>(&h2), sizeof(h2), (const UINT64*)&scratchpad[0], scratchpad.size()*4);
+    crypto::wild_keccak_dbl_opt(reinterpret_cast<const uint8_t*>(&blob[0]), blob.size(), reinterpret_cast<uint8_t*>(&h2), sizeof(h2), (const UINT64*)scratchpad, scratchpad_size*4);
     return h2;
   }
 
@@ -880,16 +939,6 @@ namespace currency
     return true;
   }
 
-  //------------------------------------------------------------------
-  std::string dump_scratchpad(const std::vector<crypto::hash>& scr)
-  {
-    std::stringstream ss;
-    for(size_t i = 0; i!=scr.size(); i++)
-    {
-      ss << "[" << i << "]" << scr[i] << ENDL;
-    }
-    return ss.str();
-  }
   //------------------------------------------------------------------
   bool addendum_to_hexstr(const std::vector<crypto::hash>& add, std::string& hex_buff)
   {
@@ -1064,29 +1113,32 @@ namespace currency
   //---------------------------------------------------------------
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b)
   {
-    std::stringstream ss;
-    ss << b_blob;
-    binary_archive<false> ba(ss);
+    binary_buffer_istream bs(b_blob.data(), b_blob.size());
+    binary_buffer_archive<false> ba(bs);
     bool r = ::serialization::serialize(ba, b);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse block from blob");
     return true;
   }
   //---------------------------------------------------------------
-  size_t get_object_blobsize(const transaction& t)
+  size_t get_signatures_blobsize(const transaction& t)
   {
-    size_t prefix_blob = get_object_blobsize(static_cast<const transaction_prefix&>(t));
-
-    if(is_coinbase(t))    
-      return prefix_blob;    
+    if(is_coinbase(t))
+      return 0;
 
+    size_t sz = 0;
     for(const auto& in: t.vin)
     {
       size_t sig_count = transaction::get_signature_size(in);
-      prefix_blob += 64*sig_count;
-      prefix_blob += tools::get_varint_packed_size(sig_count);
+      sz += 64*sig_count;
+      sz += tools::get_varint_packed_size(sig_count);
     }
-    prefix_blob += tools::get_varint_packed_size(t.vin.size());
-    return prefix_blob;
+    sz += tools::get_varint_packed_size(t.vin.size());
+    return sz;
+  }
+  //---------------------------------------------------------------
+  size_t get_object_blobsize(const transaction& t)
+  {
+    return get_object_blobsize(static_cast<const transaction_prefix&>(t)) + get_signatures_blobsize(t);
   }
   //---------------------------------------------------------------
   blobdata block_to_blob(const block& b)
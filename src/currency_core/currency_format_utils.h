@@ -81,6 +81,17 @@ namespace currency
     std::string m_user_data_blob;
   };
 
+  //one transaction for batched lookup_acc_outs: tx and tx_pub_key are input, the rest is filled by lookup
+  struct acc_outs_lookup_entry
+  {
+    const transaction* tx;
+    crypto::public_key tx_pub_key;
+    bool r;                             //false if tx has outputs of unknown type
+    crypto::key_derivation derivation;  //valid only if outs is not empty
+    std::vector<size_t> outs;
+    uint64_t money_transfered;
+  };
+
   struct create_tx_arg
   {
     crypto::public_key spend_pub_key;  //for validations
@@ -132,6 +143,8 @@ namespace currency
   void get_transaction_prefix_hash(const transaction_prefix& tx, crypto::hash& h);
   crypto::hash get_transaction_prefix_hash(const transaction_prefix& tx);
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash, crypto::hash& tx_prefix_hash);
+  //blob_size is get_object_blobsize(tx), obtained from tx_blob without serializing tx again
+  bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash, crypto::hash& tx_prefix_hash, size_t& blob_size);
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx);  
   bool get_donation_accounts(account_keys &donation_acc, account_keys &royalty_acc);
   bool construct_miner_tx(size_t height, size_t median_size, uint64_t already_generated_coins,
@@ -172,9 +185,14 @@ namespace currency
   bool is_out_to_acc(const account_keys& acc, const txout_to_key& out_key, const crypto::public_key& tx_pub_key, size_t output_index);
   bool lookup_acc_outs(const account_keys& acc, const transaction& tx, const crypto::public_key& tx_pub_key, std::vector<size_t>& outs, uint64_t& money_transfered);
   bool lookup_acc_outs(const account_keys& acc, const transaction& tx, std::vector<size_t>& outs, uint64_t& money_transfered);
+  //key derivation depends only on tx_pub_key, so it is computed once per transaction and then used for every output
+  bool is_out_to_acc(const account_keys& acc, const txout_to_key& out_key, const crypto::key_derivation& derivation, size_t output_index);
+  bool lookup_acc_outs(const account_keys& acc, const transaction& tx, const crypto::public_key& tx_pub_key, crypto::key_derivation& derivation, std::vector<size_t>& outs, uint64_t& money_transfered);
+  void lookup_acc_outs(const account_keys& acc, std::vector<acc_outs_lookup_entry>& entries);
   bool get_tx_fee(const transaction& tx, uint64_t & fee);
   uint64_t get_tx_fee(const transaction& tx);
   bool generate_key_image_helper(const account_keys& ack, const crypto::public_key& tx_public_key, size_t real_output_index, keypair& in_ephemeral, crypto::key_image& ki);
+  bool generate_key_image_helper(const account_keys& ack, const crypto::key_derivation& recv_derivation, size_t real_output_index, keypair& in_ephemeral, crypto::key_image& ki);
   void get_blob_hash(const blobdata& blob, crypto::hash& res);
   crypto::hash get_blob_hash(const blobdata& blob);
   std::string short_hash_str(const crypto::hash& h);
@@ -190,7 +208,7 @@ namespace currency
 
   crypto::hash get_transaction_hash(const transaction& t);
   bool get_transaction_hash(const transaction& t, crypto::hash& res);
-  //bool get_transaction_hash(const transaction& t, crypto::hash& res, size_t& blob_size);
+  bool get_transaction_hash(const transaction& t, crypto::hash& res, size_t& blob_size);
   blobdata get_block_hashing_blob(const block& b);
   bool get_block_hash(const block& b, crypto::hash& res);
   crypto::hash get_block_hash(const block& b);
@@ -211,7 +229,16 @@ namespace currency
   std::vector<uint64_t> relative_output_offsets_to_absolute(const std::vector<uint64_t>& off);
   std::vector<uint64_t> absolute_output_offsets_to_relative(const std::vector<uint64_t>& off);
   std::string print_money(uint64_t amount);
-  std::string dump_scratchpad(const std::vector<crypto::hash>& scr);
+  template<class t_container>
+  std::string dump_scratchpad(const t_container& scr)
+  {
+    std::stringstream ss;
+    for(size_t i = 0; i!=scr.size(); i++)
+    {
+      ss << "[" << i << "]" << scr[i] << ENDL;
+    }
+    return ss.str();
+  }
   std::string dump_patch(const std::map<uint64_t, crypto::hash>& patch);
   
   bool addendum_to_hexstr(const std::vector<crypto::hash>& add, std::string& hex_buff);
@@ -220,6 +247,7 @@ namespace currency
   bool get_payment_id_from_tx_extra(const transaction& tx, payment_id_t& payment_id);
   crypto::hash get_blob_longhash(const blobdata& bd, uint64_t height, const std::vector<crypto::hash>& scratchpad);
   crypto::hash get_blob_longhash_opt(const blobdata& bd, const std::vector<crypto::hash>& scratchpad);
+  crypto::hash get_blob_longhash_opt(const blobdata& bd, const crypto::hash* scratchpad, size_t scratchpad_size);
 
   void print_currency_details();
     
@@ -295,19 +323,17 @@ namespace currency
   template<class t_object>
   bool t_serializable_object_to_blob(const t_object& to, blobdata& b_blob)
   {
-    std::stringstream ss;
-    binary_archive<true> ba(ss);
-    bool r = ::serialization::serialize(ba, const_cast<t_object&>(to));
-    b_blob = ss.str();
-    return r;
+    b_blob.clear();
+    binary_buffer_ostream bs(b_blob);
+    binary_buffer_archive<true> ba(bs);
+    return ::serialization::serialize(ba, const_cast<t_object&>(to));
   }
   //---------------------------------------------------------------
   template<class t_object>
   bool t_unserializable_object_from_blob(t_object& to, const blobdata& b_blob)
   {
-    std::stringstream ss;
-    ss << b_blob;
-    binary_archive<false> ba(ss);
+    binary_buffer_istream bs(b_blob.data(), b_blob.size());
+    binary_buffer_archive<false> ba(bs);
     bool r = ::serialization::serialize(ba, to);
     CHECK_AND_ASSERT_MES(r, false, "Failed to unserialize object from blob: " << typeid(to).name());
 
@@ -346,6 +372,7 @@ namespace currency
   }
   //---------------------------------------------------------------
   size_t get_object_blobsize(const transaction& t);
+  size_t get_signatures_blobsize(const transaction& t); //part of get_object_blobsize(t) that is not prefix
   //---------------------------------------------------------------
   template<class t_object>
   bool get_object_hash(const t_object& o, crypto::hash& res, size_t& blob_size)
@@ -35,6 +35,7 @@ namespace currency
     const command_line::arg_descriptor<std::string>   arg_start_mining =       {"start-mining", "Specify wallet address to mining for", "", true};
     const command_line::arg_descriptor<uint32_t>      arg_mining_threads =     {"mining-threads", "Specify mining threads count", 0, true};
     const command_line::arg_descriptor<std::string>   arg_set_donation_mode =  {"donation-vote", "Select one of two options for donations vote: \"true\"(to vote fore donation) or \"false\"(to vote against)", "", true};
+    const command_line::arg_descriptor<bool>          arg_mining_numa_local_scratchpad = {"mining-numa-local-scratchpad", "Keep a separate scratchpad copy on each NUMA node that runs mining threads", false, true};
   }
 
 
@@ -55,7 +56,10 @@ namespace currency
     m_last_hr_merge_time(0),
     m_hashes(0),
     m_alias_to_apply_in_block(boost::value_initialized<alias_info>()),
-    m_config(AUTO_VAL_INIT(m_config))
+    m_config(AUTO_VAL_INIT(m_config)),
+    m_scratchpad_top_id(null_hash),
+    m_scratchpad_height(0),
+    m_numa_local_scratchpad(false)
   {
   }
   //-----------------------------------------------------------------------------------------------------
@@ -90,8 +94,84 @@ namespace currency
   //-----------------------------------------------------------------------------------------------------
   bool miner::update_scratchpad()
   {
-    EXCLUSIVE_CRITICAL_REGION_LOCAL(m_scratchpad_access);
-    return m_bc.copy_scratchpad(m_scratchpad);
+    CRITICAL_REGION_LOCAL(m_scratchpad_update_lock);
+    scratchpad_snapshot_ptr current = m_scratchpads.get_current();
+    uint64_t top_height = 0;
+    crypto::hash top_id = m_bc.get_top_block_id(top_height);
+    if (current && top_id == m_scratchpad_top_id)
+      return true; //nothing changed
+
+    std::shared_ptr<scratchpad_vector> next;
+    std::list<block> blocks;
+    crypto::hash next_top_id = m_scratchpad_top_id;
+    uint64_t next_height = m_scratchpad_height;
+    if (current && m_scratchpad_height < top_height && m_bc.get_block_id_by_height(m_scratchpad_height) == m_scratchpad_top_id)
+    {
+      //chain just grew: apply new blocks' addendums and patches to a buffer that is not published
+      m_bc.get_blocks(m_scratchpad_height + 1, static_cast<size_t>(top_height - m_scratchpad_height), blocks);
+      //previous snapshot isn't used by workers anymore: bring it up to date instead of copying the current one
+      std::list<block> spare_lag;
+      next = m_scratchpads.take_spare(spare_lag);
+      BOOST_FOREACH(const block& b, spare_lag)
+      {
+        if (!next || !push_block_scratchpad_data(b, *next))
+        {
+          next.reset();
+          break;
+        }
+      }
+      if (!next)
+        next = std::make_shared<scratchpad_vector>(*current);
+
+      BOOST_FOREACH(const block& b, blocks)
+      {
+        if (b.prev_id != next_top_id || !push_block_scratchpad_data(b, *next))
+        {
+          next.reset();
+          blocks.clear();
+          break;
+        }
+        next_top_id = get_block_hash(b);
+        ++next_height;
+      }
+    }
+
+    if (!next)
+    {
+      //reorganize or first call: full copy
+      next = std::make_shared<scratchpad_vector>();
+      next_top_id = m_scratchpad_top_id;
+      next_height = m_scratchpad_height;
+      if (!m_bc.copy_scratchpad(*next, next_top_id, next_height))
+        return false;
+    }
+
+    m_scratchpad_top_id = next_top_id;
+    m_scratchpad_height = next_height;
+    //snapshot that is being replaced lags behind exactly by these blocks, it is reused on next update
+    m_scratchpads.publish(next, blocks);
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------------
+  miner::scratchpad_snapshot_ptr miner::get_local_scratchpad(uint32_t ver, const scratchpad_snapshot_ptr& global_scratchpad)
+  {
+    if (!m_numa_local_scratchpad || !global_scratchpad)
+      return global_scratchpad;
+
+    unsigned node = tools::get_current_numa_node();
+    CRITICAL_REGION_BEGIN(m_numa_scratchpads_lock);
+    auto it = m_numa_scratchpads.find(node);
+    if (it != m_numa_scratchpads.end() && it->second.first == ver)
+      return it->second.second;
+    CRITICAL_REGION_END();
+
+    //copy is made (and first touched) by this thread, so os places its pages on this node
+    scratchpad_snapshot_ptr local_copy = std::make_shared<scratchpad_vector>(*global_scratchpad);
+    CRITICAL_REGION_LOCAL(m_numa_scratchpads_lock);
+    std::pair<uint32_t, scratchpad_snapshot_ptr>& entry = m_numa_scratchpads[node];
+    if (entry.first != ver || !entry.second)
+      entry = std::make_pair(ver, local_copy);
+    return entry.second;
   }
   //-----------------------------------------------------------------------------------------------------
   bool miner::on_block_chain_update()
@@ -170,6 +250,7 @@ namespace currency
     command_line::add_arg(desc, arg_start_mining);
     command_line::add_arg(desc, arg_mining_threads);
     command_line::add_arg(desc, arg_set_donation_mode);    
+    command_line::add_arg(desc, arg_mining_numa_local_scratchpad);
   }
   //-----------------------------------------------------------------------------------------------------
   bool miner::init(const boost::program_options::variables_map& vm)
@@ -189,6 +270,8 @@ namespace currency
         m_config.donation_decision = false;
     }
 
+    m_numa_local_scratchpad = command_line::get_arg(vm, arg_mining_numa_local_scratchpad);
+
     if(command_line::has_arg(vm, arg_extra_messages))
     {
       std::string buff;
@@ -292,6 +375,7 @@ namespace currency
 
     boost::interprocess::ipcdetail::atomic_write32(&m_stop, 0);
     boost::interprocess::ipcdetail::atomic_write32(&m_thread_index, 0);
+    m_scratchpads.set_readers_count(threads_count);
 
     for(size_t i = 0; i != threads_count; i++)
       m_threads.push_back(boost::thread(boost::bind(&miner::worker_thread, this)));
@@ -381,10 +465,14 @@ namespace currency
     uint32_t local_template_ver = 0;
     block b;
     blobdata block_blob;
+    //nonces are hashed in batches, one per simd lane
+    const size_t lanes = crypto::wild_keccak_multi_lanes();
+    std::vector<blobdata> lane_blobs(lanes);
+    std::vector<const uint8_t*> lane_inputs(lanes);
+    std::vector<crypto::hash> lane_hashes(lanes);
+    scratchpad_snapshot_ptr local_scratchpad;
+    uint32_t local_scratchpad_ver = 0;
 
-    //for now have a copy of scratchpad for every thread
-    //temporary solution(to avoid slow synchronization while mining), will be changed in few weeks to use one 
-    //std::vector<crypto::hash> local_scratch_pad;
     while(!m_stop)
     {
       if(m_pausers_count)//anti split workaround
@@ -403,6 +491,11 @@ namespace currency
         CRITICAL_REGION_END();
         local_template_ver = m_template_no;
         nonce = m_starter_nonce + th_local_index;
+        for (size_t l = 0; l != lanes; l++)
+        {
+          lane_blobs[l] = block_blob;
+          lane_inputs[l] = reinterpret_cast<const uint8_t*>(lane_blobs[l].data());
+        }
       }
 
       if(!local_template_ver)//no any set_block_template call
@@ -412,60 +505,68 @@ namespace currency
         continue;
       }
 
-      *reinterpret_cast<uint64_t*>(&block_blob[1]) = nonce;
-      crypto::hash h;
-      SHARED_CRITICAL_REGION_BEGIN(m_scratchpad_access);
-#if defined(WIN32)
-      h = get_blob_longhash_opt(block_blob, m_scratchpad);
-#else
-      get_blob_longhash(block_blob, h, height, [&](uint64_t index) -> crypto::hash&
+      if (local_scratchpad_ver != m_scratchpads.get_version())
       {
-        return m_scratchpad[index%m_scratchpad.size()];
-      });
-#endif
+        m_scratchpads.acquire(th_local_index, local_scratchpad, local_scratchpad_ver);
+        local_scratchpad = get_local_scratchpad(local_scratchpad_ver, local_scratchpad);
+      }
+      if (!local_scratchpad || local_scratchpad->empty())
+      {
+        LOG_PRINT_L2("Scratchpad not set yet");
+        epee::misc_utils::sleep_no_w(1000);
+        continue;
+      }
+      const scratchpad_vector& scratchpad = *local_scratchpad;
 
-      CRITICAL_REGION_END();
+      for (size_t l = 0; l != lanes; l++)
+        *reinterpret_cast<uint64_t*>(&lane_blobs[l][1]) = nonce + l * m_threads_total;
+      crypto::wild_keccak_dbl_multi(&lane_inputs[0], block_blob.size(), &lane_hashes[0], lanes, &scratchpad[0], height ? scratchpad.size() : 0);
 
-      if(check_hash(h, local_diff))
+      for (size_t l = 0; l != lanes; l++)
       {
-        //we lucky!
-        b.nonce = nonce;
-        //move alias info to temp var 
-        alias_info ai_local = AUTO_VAL_INIT(ai_local);
-        CRITICAL_REGION_BEGIN(m_aliace_to_apply_in_block_lock);
-        if(m_alias_to_apply_in_block.m_alias.size())
+        if(check_hash(lane_hashes[l], local_diff))
         {
-          ai_local = m_alias_to_apply_in_block;
-          m_alias_to_apply_in_block = AUTO_VAL_INIT(m_alias_to_apply_in_block);
-        }
-        CRITICAL_REGION_END();
+          //we lucky!
+          b.nonce = nonce + l * m_threads_total;
+          //move alias info to temp var 
+          alias_info ai_local = AUTO_VAL_INIT(ai_local);
+          CRITICAL_REGION_BEGIN(m_aliace_to_apply_in_block_lock);
+          if(m_alias_to_apply_in_block.m_alias.size())
+          {
+            ai_local = m_alias_to_apply_in_block;
+            m_alias_to_apply_in_block = AUTO_VAL_INIT(m_alias_to_apply_in_block);
+          }
+          CRITICAL_REGION_END();
 
-        ++m_config.current_extra_message_index;
-        LOG_PRINT_GREEN("Found block for difficulty: " << local_diff, LOG_LEVEL_0);
-        if(!m_phandler->handle_block_found(b))
-        {
-          --m_config.current_extra_message_index;
-          CRITICAL_REGION_LOCAL(m_aliace_to_apply_in_block_lock);
-          if(ai_local.m_alias.size())
-            m_alias_to_apply_in_block = ai_local;
-        }else
-        {
-          //success, let's update config
-          epee::serialization::store_t_to_json_file(m_config, m_config_folder + "/" + MINER_CONFIG_FILENAME);
-          if(ai_local.m_alias.size())
+          ++m_config.current_extra_message_index;
+          LOG_PRINT_GREEN("Found block for difficulty: " << local_diff, LOG_LEVEL_0);
+          if(!m_phandler->handle_block_found(b))
+          {
+            --m_config.current_extra_message_index;
+            CRITICAL_REGION_LOCAL(m_aliace_to_apply_in_block_lock);
+            if(ai_local.m_alias.size())
+              m_alias_to_apply_in_block = ai_local;
+          }else
           {
-            tx_extra_info tei = AUTO_VAL_INIT(tei);
-            parse_and_validate_tx_extra(b.miner_tx, tei);
-            if(tei.m_alias.m_alias == ai_local.m_alias)
-            {LOG_PRINT_GREEN("Alias \"" << ai_local.m_alias << "\" successfully committed to blockchain", LOG_LEVEL_0);}
-            else
-            {LOG_ERROR("Alias \"" << ai_local.m_alias << "\" was not committed to blockchain");}
+            //success, let's update config
+            epee::serialization::store_t_to_json_file(m_config, m_config_folder + "/" + MINER_CONFIG_FILENAME);
+            if(ai_local.m_alias.size())
+            {
+              tx_extra_info tei = AUTO_VAL_INIT(tei);
+              parse_and_validate_tx_extra(b.miner_tx, tei);
+              if(tei.m_alias.m_alias == ai_local.m_alias)
+              {LOG_PRINT_GREEN("Alias \"" << ai_local.m_alias << "\" successfully committed to blockchain", LOG_LEVEL_0);}
+              else
+              {LOG_ERROR("Alias \"" << ai_local.m_alias << "\" was not committed to blockchain");}
+            }
           }
+          break; //one block per template
         }
       }
-      nonce+=m_threads_total;
-      ++m_hashes;
+      nonce += m_threads_total * lanes;
+      m_hashes += lanes;
     }
+    m_scratchpads.release(th_local_index, local_scratchpad);
     LOG_PRINT_L0("Miner thread stopped ["<< th_local_index << "]");
     return true;
   }
@@ -8,6 +8,7 @@
 #include <boost/atomic.hpp>
 #include <boost/program_options.hpp>
 #include <atomic>
+#include <memory>
 #include "currency_basic.h"
 #include "difficulty.h"
 #include "math_helper.h"
@@ -124,8 +125,17 @@ namespace currency
     alias_info m_alias_to_apply_in_block;
     critical_section m_aliace_to_apply_in_block_lock;
     
-    boost::shared_mutex m_scratchpad_access;
-    std::vector<crypto::hash> m_scratchpad;
+    typedef scratchpad_snapshots::snapshot_ptr scratchpad_snapshot_ptr;
+    scratchpad_snapshots m_scratchpads;            // workers reload snapshot only when its version changes
+    crypto::hash m_scratchpad_top_id;              // last block applied to published snapshot
+    uint64_t m_scratchpad_height;                  // and its height
+    ::critical_section m_scratchpad_update_lock;
+    
+    bool m_numa_local_scratchpad;                  // keep one copy of snapshot per numa node, made by a worker running on that node
+    ::critical_section m_numa_scratchpads_lock;
+    std::map<unsigned, std::pair<uint32_t, scratchpad_snapshot_ptr> > m_numa_scratchpads; // node -> (snapshot version, copy)
+
+    scratchpad_snapshot_ptr get_local_scratchpad(uint32_t ver, const scratchpad_snapshot_ptr& global_scratchpad);
   };
 }
 
@@ -51,7 +51,7 @@ namespace currency
   bool scratchpad_wrapper::deinit()
   {
 #ifdef SELF_VALIDATE_SCRATCHPAD
-    std::vector<crypto::hash> scratchpad_cache;
+    scratchpad_vector scratchpad_cache;
     load_scratchpad_from_db(m_rdb_scratchpad, scratchpad_cache);
     if (scratchpad_cache != m_scratchpad_cache)
     {
@@ -72,7 +72,7 @@ namespace currency
     m_rdb_scratchpad.clear();
   }
 
-  const std::vector<crypto::hash>& scratchpad_wrapper::get_scratchpad()
+  const scratchpad_vector& scratchpad_wrapper::get_scratchpad()
   {
     return m_scratchpad_cache;
   }
@@ -89,7 +89,7 @@ namespace currency
     bool res = currency::push_block_scratchpad_data(b, m_scratchpad_cache);
     res &= currency::push_block_scratchpad_data(b, m_rdb_scratchpad);
 #ifdef SELF_VALIDATE_SCRATCHPAD
-    std::vector<crypto::hash> scratchpad_cache;
+    scratchpad_vector scratchpad_cache;
     load_scratchpad_from_db(m_rdb_scratchpad, scratchpad_cache);
     if (scratchpad_cache != m_scratchpad_cache)
     {
@@ -109,4 +109,105 @@ namespace currency
     return res;
   }
 
+  block_addendum_cache::block_addendum_cache(size_t max_size) : m_max_size(max_size)
+  {}
+
+  void block_addendum_cache::push(const block_addendum_entry_ptr& e)
+  {
+    if (m_entries.size() && (m_entries.back()->height + 1 != e->height || m_entries.back()->id != e->prev_id))
+      m_entries.clear(); //lost track of main chain, start over
+    m_entries.push_back(e);
+    while (m_entries.size() > m_max_size)
+      m_entries.pop_front();
+  }
+
+  void block_addendum_cache::pop(uint64_t height)
+  {
+    if (m_entries.size() && m_entries.back()->height == height)
+      m_entries.pop_back();
+    else
+      m_entries.clear();
+  }
+
+  void block_addendum_cache::clear()
+  {
+    m_entries.clear();
+  }
+
+  bool block_addendum_cache::get_since(uint64_t start_height, const crypto::hash& top_id, std::list<block_addendum_entry_ptr>& res) const
+  {
+    if (!m_entries.size() || m_entries.back()->id != top_id || m_entries.front()->height > start_height || m_entries.back()->height < start_height)
+      return false;
+    auto it = m_entries.begin() + static_cast<size_t>(start_height - m_entries.front()->height);
+    res.insert(res.end(), it, m_entries.end());
+    return true;
+  }
+
+  scratchpad_snapshots::scratchpad_snapshots() : m_version(0), m_spare_version(0), m_readers_count(0)
+  {}
+
+  void scratchpad_snapshots::set_readers_count(size_t count)
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_readers.reset(count ? new std::atomic<uint32_t>[count] : nullptr);
+    for (size_t i = 0; i != count; i++)
+      m_readers[i] = 0;
+    m_readers_count = count;
+  }
+
+  void scratchpad_snapshots::acquire(size_t reader, snapshot_ptr& sp, uint32_t& version)
+  {
+    sp.reset();
+    //busy mark is visible to writer before the snapshot is read, so spare can't be taken while it is being picked up
+    m_readers[reader] = reader_busy;
+    {
+      std::lock_guard<std::mutex> lk(m_lock);
+      sp = m_current;
+      version = m_version;
+    }
+    m_readers[reader] = version;
+  }
+
+  void scratchpad_snapshots::release(size_t reader, snapshot_ptr& sp)
+  {
+    sp.reset();
+    m_readers[reader] = 0;
+  }
+
+  scratchpad_snapshots::snapshot_ptr scratchpad_snapshots::get_current()
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    return m_current;
+  }
+
+  std::shared_ptr<scratchpad_vector> scratchpad_snapshots::take_spare(std::list<block>& lag)
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    if (!m_spare)
+      return nullptr;
+    for (size_t i = 0; i != m_readers_count; i++)
+    {
+      uint32_t v = m_readers[i];
+      if (v == m_spare_version || v == reader_busy)
+        return nullptr;
+    }
+    lag.swap(m_spare_lag);
+    m_spare_lag.clear();
+    return std::move(m_spare);
+  }
+
+  void scratchpad_snapshots::publish(const std::shared_ptr<scratchpad_vector>& next, std::list<block>& lag)
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    m_spare.reset();
+    m_spare_lag.clear();
+    if (m_current && !lag.empty())
+    {
+      m_spare = std::const_pointer_cast<scratchpad_vector>(m_current);
+      m_spare_version = m_version;
+      m_spare_lag.swap(lag);
+    }
+    m_current = next;
+    ++m_version;
+  }
 }
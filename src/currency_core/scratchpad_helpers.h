@@ -4,15 +4,22 @@
 
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
 #include "currency_basic.h"
 #include "common/util.h"
 #include "currency_core/currency_format_utils.h"
 #include "crypto/hash.h"
 #include "common/db_bridge.h"
+#include "common/huge_page_allocator.h"
 
 
 namespace currency
 {
+  typedef std::vector<crypto::hash, tools::huge_page_allocator<crypto::hash>> scratchpad_vector;
 
   class scratchpad_wrapper
   {
@@ -23,16 +30,91 @@ namespace currency
     bool init(const std::string& config_folder);
     bool deinit();
     void clear();
-    const std::vector<crypto::hash>& get_scratchpad();
+    const scratchpad_vector& get_scratchpad();
     void set_scratchpad(const std::vector<crypto::hash>& sc);
     bool push_block_scratchpad_data(const block& b);
     bool pop_block_scratchpad_data(const block& b);
 
   private:
-    std::vector<crypto::hash> m_scratchpad_cache;
+    scratchpad_vector m_scratchpad_cache;
     scratchpad_container& m_rdb_scratchpad;
     std::string m_config_folder;
   };
+
+  struct block_addendum_entry
+  {
+    uint64_t height;
+    crypto::hash id;
+    crypto::hash prev_id;
+    std::vector<crypto::hash> addendum;
+    std::string addendum_hex; //prebuilt for json mining rpc
+  };
+  typedef std::shared_ptr<const block_addendum_entry> block_addendum_entry_ptr;
+
+  /************************************************************************/
+  /* Addendums of last main chain blocks, built once when block is added  */
+  /* so miners polling for them don't make daemon read blocks from db.    */
+  /* Not thread safe, owner guards it.                                    */
+  /************************************************************************/
+  class block_addendum_cache
+  {
+  public:
+    block_addendum_cache(size_t max_size);
+
+    //entry that doesn't follow the last one makes cache start over
+    void push(const block_addendum_entry_ptr& e);
+    //top block with given height was popped from main chain
+    void pop(uint64_t height);
+    void clear();
+    size_t size() const { return m_entries.size(); }
+    //entries from start_height to top; false if cache doesn't have them all or its top is not top_id
+    bool get_since(uint64_t start_height, const crypto::hash& top_id, std::list<block_addendum_entry_ptr>& res) const;
+
+  private:
+    std::deque<block_addendum_entry_ptr> m_entries;
+    size_t m_max_size;
+  };
+
+  /************************************************************************/
+  /* Immutable scratchpad copies published to miner threads. Replaced    */
+  /* snapshot is kept as spare and brought up to date by next update     */
+  /* instead of copying, once every reader has confirmed it moved on.    */
+  /************************************************************************/
+  class scratchpad_snapshots
+  {
+  public:
+    typedef std::shared_ptr<const scratchpad_vector> snapshot_ptr;
+
+    scratchpad_snapshots();
+
+    //only while no reader runs; readers are numbered [0, count)
+    void set_readers_count(size_t count);
+    //0 until first publish
+    uint32_t get_version() const { return m_version; }
+    //drops snapshot held in sp and replaces it with current one
+    void acquire(size_t reader, snapshot_ptr& sp, uint32_t& version);
+    //reader dropped its snapshot
+    void release(size_t reader, snapshot_ptr& sp);
+
+    //writer side, one thread at a time
+    snapshot_ptr get_current();
+    //snapshot replaced by last publish() and blocks it lags behind; null if a reader may still use it
+    std::shared_ptr<scratchpad_vector> take_spare(std::list<block>& lag);
+    //lag: blocks next has over current snapshot, which becomes spare; empty if next is not based on it
+    void publish(const std::shared_ptr<scratchpad_vector>& next, std::list<block>& lag);
+
+  private:
+    static const uint32_t reader_busy = UINT32_MAX;
+
+    std::mutex m_lock;
+    snapshot_ptr m_current;
+    std::atomic<uint32_t> m_version;
+    std::shared_ptr<scratchpad_vector> m_spare;
+    uint32_t m_spare_version;
+    std::list<block> m_spare_lag;
+    std::unique_ptr<std::atomic<uint32_t>[]> m_readers;       //version each reader holds, 0 - none
+    size_t m_readers_count;
+  };
   //------------------------------------------------------------------
   template<typename pod_operand_a, typename pod_operand_b>
   crypto::hash hash_together(const pod_operand_a& a, const pod_operand_b& b)
@@ -93,7 +175,8 @@ namespace currency
     return true;
   }
   //------------------------------------------------------------------
-  inline void update_container_item(std::vector<crypto::hash>& cont, uint64_t i, const crypto::hash& h)
+  template<class t_allocator>
+  void update_container_item(std::vector<crypto::hash, t_allocator>& cont, uint64_t i, const crypto::hash& h)
   {
     cont[i] = h;
   }
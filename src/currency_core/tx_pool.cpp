@@ -3,18 +3,26 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <algorithm>
+#include <fstream>
 #include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <unordered_set>
 #include <vector>
 
 #include "tx_pool.h"
+#include "tx_pool_snapshot.h"
 #include "currency_format_utils.h"
 #include "currency_boost_serialization.h"
 #include "currency_config.h"
 #include "blockchain_storage.h"
 #include "common/boost_serialization_helper.h"
+#include "common/command_line.h"
 #include "common/int-util.h"
+#include "common/thread_pool.h"
+#include "file_io_utils.h"
 #include "misc_language.h"
+#include "profile_tools.h"
 #include "warnings.h"
 #include "crypto/hash.h"
 
@@ -22,15 +30,65 @@ DISABLE_VS_WARNINGS(4244 4345 4503) //'boost::foreach_detail_::or_' : decorated
 
 namespace currency
 {
+  namespace
+  {
+    const command_line::arg_descriptor<uint64_t> arg_tx_pool_max_memory = { "tx-pool-max-memory", "Max memory used by transaction pool entries (bytes), lowest fee per byte transactions are evicted above it", CURRENCY_MEMPOOL_DEFAULT_MAX_MEMORY };
+    const command_line::arg_descriptor<uint64_t> arg_tx_pool_max_count = { "tx-pool-max-count", "Max number of transactions in pool, lowest fee per byte transactions are evicted above it", CURRENCY_MEMPOOL_DEFAULT_MAX_COUNT };
+
+    //heap footprint of pool entry: hash map nodes and containers of transaction
+    size_t get_tx_details_memory_usage(const transaction& tx, const std::string& decline_reason)
+    {
+      size_t usage = sizeof(std::pair<crypto::hash, tx_memory_pool::tx_details>) + 2 * sizeof(void*);
+      usage += tx.vin.capacity() * sizeof(txin_v);
+      BOOST_FOREACH(const auto& in, tx.vin)
+      {
+        if (in.type() != typeid(txin_to_key))
+          continue;
+        usage += boost::get<txin_to_key>(in).key_offsets.capacity() * sizeof(uint64_t);
+        //m_spent_key_images entry
+        usage += sizeof(std::pair<crypto::key_image, std::unordered_set<crypto::hash> >) + sizeof(crypto::hash) + 4 * sizeof(void*);
+      }
+      usage += tx.vout.capacity() * sizeof(tx_out);
+      usage += tx.extra.capacity();
+      usage += tx.signatures.capacity() * sizeof(std::vector<crypto::signature>);
+      BOOST_FOREACH(const auto& s, tx.signatures)
+        usage += s.capacity() * sizeof(crypto::signature);
+      usage += decline_reason.capacity();
+      return usage;
+    }
+
+    //pool transactions have txin_to_key inputs only, add_tx() doesn't accept other ones
+    void get_tx_key_images(const transaction& tx, std::vector<crypto::key_image>& key_images)
+    {
+      key_images.reserve(tx.vin.size());
+      BOOST_FOREACH(const auto& in, tx.vin)
+      {
+        if (in.type() == typeid(txin_to_key))
+          key_images.push_back(boost::get<txin_to_key>(in).k_image);
+      }
+    }
+  }
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(blockchain_storage& bchs): m_blockchain(bchs)
+  tx_memory_pool::tx_memory_pool(blockchain_storage& bchs): m_blockchain(bchs), m_ready_to_go_cache_generation(0),
+    m_max_memory_usage(CURRENCY_MEMPOOL_DEFAULT_MAX_MEMORY), m_max_count(CURRENCY_MEMPOOL_DEFAULT_MAX_COUNT), m_memory_usage(0),
+    m_blobs_size(0), m_evicted_count(0), m_fee_floor_active(false), m_fee_floor(), m_blockchain_generation(0), m_blockchain_updates(0), m_revalidator_stop(false),
+    m_snapshot_file_size(0), m_snapshot_invalid(true)
   {
 
+  }
+  //---------------------------------------------------------------------------------
+  tx_memory_pool::~tx_memory_pool()
+  {
+    stop_revalidator();
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::add_tx(const transaction &tx, const crypto::hash &id, tx_verification_context& tvc, bool kept_by_block)
-  {    
-    size_t blob_size = get_object_blobsize(tx);
+  {
+    return add_tx(tx, id, get_object_blobsize(tx), tvc, kept_by_block);
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::add_tx(const transaction &tx, const crypto::hash &id, size_t blob_size, tx_verification_context& tvc, bool kept_by_block)
+  {
     //#9Protection from big transaction flood
     if(!kept_by_block && blob_size > CURRENCY_MAX_TRANSACTION_BLOB_SIZE)
     {
@@ -78,12 +136,33 @@ namespace currency
         tvc.m_verifivation_failed = true;
         return false;
       }
+
+      //pool is full: fee that is fine for other nodes may be too small for us, so tx is just not accepted
+      if (!is_fee_above_floor(inputs_amount - outputs_amount, blob_size))
+      {
+        LOG_PRINT_L1("Transaction with id= " << id << " rejected: pool is full and fee " << print_money(inputs_amount - outputs_amount) << " for " << blob_size << " bytes is below eviction floor");
+        return false;
+      }
     }
 
     crypto::hash max_used_block_id = null_hash;
     uint64_t max_used_block_height = 0;
-    bool ch_inp_res = m_blockchain.check_tx_inputs(tx, max_used_block_height, max_used_block_id);
+    //tx id is the hash of its prefix
+    bool ch_inp_res = m_blockchain.check_tx_inputs(tx, id, max_used_block_height, max_used_block_id);
     CRITICAL_REGION_LOCAL(m_transactions_lock);
+    //everything above runs concurrently for different transactions, so the same tx or one spending
+    //the same key images may have been admitted meanwhile: resolve it here, together with insertion
+    if(m_transactions.count(id))
+    {
+      LOG_PRINT_L2("tx " << id << " already added to pool by concurrent request");
+      return true;
+    }
+    if(!kept_by_block && have_tx_keyimges_as_spent(tx))
+    {
+      LOG_ERROR("Transaction with id= "<< id << " used key images spent by concurrently added transaction");
+      tvc.m_verifivation_failed = true;
+      return false;
+    }
     if(!ch_inp_res)
     {
       if(kept_by_block)
@@ -125,6 +204,7 @@ namespace currency
       if(txd_p.first->second.fee > 0)
         tvc.m_should_be_relayed = true;
     }
+    add_to_indexes(id, m_transactions[id]);
 
     tvc.m_verifivation_failed = true;
     //update image_keys container, here should everything goes ok.
@@ -140,6 +220,13 @@ namespace currency
     }
 
     tvc.m_verifivation_failed = false;
+    evict_transactions_over_limits();
+    if (!m_transactions.count(id))
+    {
+      //tx itself turned out to be the cheapest one
+      tvc.m_added_to_pool = false;
+      tvc.m_should_be_relayed = false;
+    }
     //succeed
     return true;
   }
@@ -147,8 +234,9 @@ namespace currency
   bool tx_memory_pool::add_tx(const transaction &tx, tx_verification_context& tvc, bool keeped_by_block)
   {
     crypto::hash h = null_hash;
-    get_transaction_hash(tx, h);
-    return add_tx(tx, h, tvc, keeped_by_block);
+    size_t blob_size = 0;
+    get_transaction_hash(tx, h, blob_size);
+    return add_tx(tx, h, blob_size, tvc, keeped_by_block);
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::remove_transaction_keyimages(const transaction& tx)
@@ -189,6 +277,7 @@ namespace currency
     blob_size = it->second.blob_size;
     fee = it->second.fee;
     remove_transaction_keyimages(it->second.tx);
+    remove_from_indexes(id, it->second);
     m_transactions.erase(it);
     return true;
   }
@@ -210,6 +299,7 @@ namespace currency
       {
         LOG_PRINT_L0("Tx " << it->first << " removed from tx pool due to outdated, age: " << tx_age );
         remove_transaction_keyimages(it->second.tx);
+        remove_from_indexes(it->first, it->second);
         m_transactions.erase(it++);
       }else
         ++it;
@@ -217,6 +307,28 @@ namespace currency
     return true;
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::remove_spent_in_blockchain()
+  {
+    //snapshot outlives crash, so it may have entries that were mined in blocks stored after last snapshot write
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    size_t removed_count = 0;
+    for(auto it = m_transactions.begin(); it!= m_transactions.end();)
+    {
+      if(m_blockchain.have_tx(it->first) || m_blockchain.have_tx_keyimges_as_spent(it->second.tx))
+      {
+        LOG_PRINT_L1("Tx " << it->first << " removed from tx pool: it or its key images are already in blockchain");
+        remove_transaction_keyimages(it->second.tx);
+        remove_from_indexes(it->first, it->second);
+        m_transactions.erase(it++);
+        ++removed_count;
+      }else
+        ++it;
+    }
+    if(removed_count)
+      LOG_PRINT_L0(removed_count << " transactions already spent in blockchain removed from tx pool");
+    return true;
+  }
+  //---------------------------------------------------------------------------------
   size_t tx_memory_pool::get_transactions_count()
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
@@ -244,11 +356,16 @@ namespace currency
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::on_blockchain_inc(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
+    //called under blockchain lock, so pool lock is not taken here: cache is dropped on next use
+    ++m_blockchain_generation;
+    m_revalidator_cv.notify_one();
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::on_blockchain_dec(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
+    ++m_blockchain_generation;
+    m_revalidator_cv.notify_one();
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -281,11 +398,14 @@ namespace currency
   void tx_memory_pool::lock()
   {
     m_transactions_lock.lock();
+    ++m_blockchain_updates;
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::unlock()
   {
+    --m_blockchain_updates;
     m_transactions_lock.unlock();
+    m_revalidator_cv.notify_one();
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::purge_transactions()
@@ -293,63 +413,362 @@ namespace currency
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     m_transactions.clear();
     m_spent_key_images.clear();
+    m_fee_rate_index.clear();
+    m_ready_to_go_cache.clear();
+    m_memory_usage = 0;
+    m_blobs_size = 0;
+    m_fee_floor_active = false;
+    m_snapshot_dirty.clear();
+    m_snapshot_invalid = true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::is_transaction_ready_to_go(tx_details& txd)
+  {
+    tx_check_state st = AUTO_VAL_INIT(st);
+    st.max_used_block_id = txd.max_used_block_id;
+    st.max_used_block_height = txd.max_used_block_height;
+    st.last_failed_height = txd.last_failed_height;
+    st.last_failed_id = txd.last_failed_id;
+    std::vector<crypto::key_image> key_images;
+    get_tx_key_images(txd.tx, key_images);
+    bool ready = is_transaction_ready_to_go(st, key_images, [&](){ return &txd.tx; });
+    txd.max_used_block_id = st.max_used_block_id;
+    txd.max_used_block_height = st.max_used_block_height;
+    txd.last_failed_height = st.last_failed_height;
+    txd.last_failed_id = st.last_failed_id;
+    if (!ready)
+      txd.decline_reason = st.decline_reason;
+    return ready;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::is_transaction_ready_to_go(tx_check_state& st, const std::vector<crypto::key_image>& key_images, const tx_body_getter& get_tx_body)
   {
     //not the best implementation at this time, sorry :(
     //check is ring_signature already checked ?
-    if(txd.max_used_block_id == null_hash)
+    if(st.max_used_block_id == null_hash)
     {//not checked, lets try to check
 
-      if (txd.last_failed_id != null_hash && m_blockchain.get_current_blockchain_height() > txd.last_failed_height && txd.last_failed_id == m_blockchain.get_block_id_by_height(txd.last_failed_height))
+      if (st.last_failed_id != null_hash && m_blockchain.get_current_blockchain_height() > st.last_failed_height && st.last_failed_id == m_blockchain.get_block_id_by_height(st.last_failed_height))
       {
-        txd.decline_reason = "tx is broken for this height";
+        st.decline_reason = "tx is broken for this height";
         return false;//we already sure that this tx is broken for this height
       }
 
-      if(!m_blockchain.check_tx_inputs(txd.tx, txd.max_used_block_height, txd.max_used_block_id))
+      const transaction* ptx = get_tx_body();
+      if (!ptx)
+      {
+        st.decline_reason = "tx is not in pool";
+        return false;
+      }
+      if(!m_blockchain.check_tx_inputs(*ptx, st.max_used_block_height, st.max_used_block_id))
       {
-        txd.last_failed_height = m_blockchain.get_current_blockchain_height()-1;
-        txd.last_failed_id = m_blockchain.get_block_id_by_height(txd.last_failed_height);
-        txd.decline_reason = "check_tx_inputs() validation failed";
+        st.last_failed_height = m_blockchain.get_current_blockchain_height()-1;
+        st.last_failed_id = m_blockchain.get_block_id_by_height(st.last_failed_height);
+        st.decline_reason = "check_tx_inputs() validation failed";
         return false;
       }
     }else
     {
-      if (txd.max_used_block_height >= m_blockchain.get_current_blockchain_height())
+      if (st.max_used_block_height >= m_blockchain.get_current_blockchain_height())
       {
-        txd.decline_reason = "max_used_block_height > current_height";
+        st.decline_reason = "max_used_block_height > current_height";
         return false;
       }
-      if(m_blockchain.get_block_id_by_height(txd.max_used_block_height) != txd.max_used_block_id)
+      if(m_blockchain.get_block_id_by_height(st.max_used_block_height) != st.max_used_block_id)
       {
         //if we already failed on this height and id, skip actual ring signature check
-        if (txd.last_failed_id == m_blockchain.get_block_id_by_height(txd.last_failed_height))
+        if (st.last_failed_id == m_blockchain.get_block_id_by_height(st.last_failed_height))
         {
-          txd.decline_reason = "last_failed_id is still actual";
+          st.decline_reason = "last_failed_id is still actual";
           return false;
         }
         //check ring signature again, it is possible (with very small chance) that this transaction become again valid
-        if(!m_blockchain.check_tx_inputs(txd.tx, txd.max_used_block_height, txd.max_used_block_id))
+        const transaction* ptx = get_tx_body();
+        if (!ptx)
         {
-          txd.last_failed_height = m_blockchain.get_current_blockchain_height()-1;
-          txd.last_failed_id = m_blockchain.get_block_id_by_height(txd.last_failed_height);
-          txd.decline_reason = "check_tx_inputs() failed(2)";
+          st.decline_reason = "tx is not in pool";
+          return false;
+        }
+        if(!m_blockchain.check_tx_inputs(*ptx, st.max_used_block_height, st.max_used_block_id))
+        {
+          st.last_failed_height = m_blockchain.get_current_blockchain_height()-1;
+          st.last_failed_id = m_blockchain.get_block_id_by_height(st.last_failed_height);
+          st.decline_reason = "check_tx_inputs() failed(2)";
           return false;
         }
       }
     }
     //if we here, transaction seems valid, but, anyway, check for key_images collisions with blockchain, just to be sure
-    if (m_blockchain.have_tx_keyimges_as_spent(txd.tx))
+    for (const auto& ki : key_images)
     {
-      txd.decline_reason = "have_tx_keyimges_as_spent";
-      return false;
+      if (m_blockchain.have_tx_keyimg_as_spent(ki))
+      {
+        st.decline_reason = "have_tx_keyimges_as_spent";
+        return false;
+      }
     }
     //transaction is ok.
     return true;
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::is_transaction_ready_to_go_cached(const crypto::hash& id, tx_details& txd)
+  {
+    auto it = m_ready_to_go_cache.find(id);
+    if (it != m_ready_to_go_cache.end())
+      return it->second;
+    crypto::hash max_used_block_id = txd.max_used_block_id;
+    crypto::hash last_failed_id = txd.last_failed_id;
+    bool ready = is_transaction_ready_to_go(txd);
+    if (txd.max_used_block_id != max_used_block_id || txd.last_failed_id != last_failed_id)
+      m_snapshot_dirty.insert(id);
+    m_ready_to_go_cache[id] = ready;
+    return ready;
+  }
+  //---------------------------------------------------------------------------------
+  uint64_t tx_memory_pool::actualize_ready_to_go_cache()
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    uint64_t blockchain_generation = m_blockchain_generation;
+    if (m_ready_to_go_cache_generation != blockchain_generation)
+    {
+      //blockchain changed since cache was filled, transactions have to be checked again
+      m_ready_to_go_cache.clear();
+      m_ready_to_go_cache_generation = blockchain_generation;
+    }
+    return blockchain_generation;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::revalidator_thread()
+  {
+    log_space::log_singletone::set_thread_log_prefix("[mempool]");
+    uint64_t revalidated_generation = m_blockchain_generation;
+    while (!m_revalidator_stop)
+    {
+      {
+        std::unique_lock<std::mutex> lk(m_revalidator_lock);
+        m_revalidator_cv.wait_for(lk, std::chrono::seconds(1), [&](){
+          return m_revalidator_stop || (revalidated_generation != m_blockchain_generation && !m_blockchain_updates);
+        });
+      }
+      if (m_revalidator_stop)
+        continue;
+      m_snapshot_interval.do_call([this](){return store_snapshot();});
+      if (revalidated_generation == m_blockchain_generation || m_blockchain_updates)
+        continue;
+      uint64_t generation = actualize_ready_to_go_cache();
+      //pass interrupted by block is started over once blockchain lets pool go
+      if (revalidate_transactions(generation))
+        revalidated_generation = generation;
+    }
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::is_revalidation_actual(uint64_t generation) const
+  {
+    //block being added holds blockchain lock and needs thread pool for its own ring signatures, background checks give way to it
+    return !m_revalidator_stop && !m_blockchain_updates && generation == m_blockchain_generation;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::revalidate_transactions(uint64_t generation)
+  {
+    //checks run on copies of check state without pool lock, results are put back only if blockchain is still the same
+    struct revalidation_entry
+    {
+      crypto::hash id;
+      tx_check_state st;
+      std::vector<crypto::key_image> key_images;
+    };
+    std::vector<revalidation_entry> entries;
+    {
+      CRITICAL_REGION_LOCAL(m_transactions_lock);
+      entries.reserve(m_fee_rate_index.size());
+      for (const auto& e : m_fee_rate_index)
+      {
+        if (m_ready_to_go_cache.count(e.id))
+          continue;
+        auto it = m_transactions.find(e.id);
+        if (it == m_transactions.end())
+          continue;
+        entries.push_back(revalidation_entry());
+        revalidation_entry& re = entries.back();
+        re.id = e.id;
+        re.st.max_used_block_id = it->second.max_used_block_id;
+        re.st.max_used_block_height = it->second.max_used_block_height;
+        re.st.last_failed_height = it->second.last_failed_height;
+        re.st.last_failed_id = it->second.last_failed_id;
+        get_tx_key_images(it->second.tx, re.key_images);
+      }
+    }
+    if (entries.empty())
+      return true;
+
+    TIME_MEASURE_START_MS(revalidate_time);
+    //every chunk is separate thread pool job, so jobs queued meanwhile don't wait for the whole pass
+    size_t chunk_size = tools::thread_pool::instance().get_threads_count() * 2;
+    std::atomic<bool> interrupted(false);
+    for (size_t chunk_start = 0; chunk_start < entries.size() && !interrupted; chunk_start += chunk_size)
+    {
+      size_t chunk_end = std::min(chunk_start + chunk_size, entries.size());
+      tools::thread_pool::instance().parallel_for(chunk_end - chunk_start, [&](size_t i)
+      {
+        revalidation_entry& re = entries[chunk_start + i];
+        if (!is_revalidation_actual(generation))
+        {
+          interrupted = true;
+          return;
+        }
+        //body is copied only for ring signature check
+        transaction tx;
+        bool ready = is_transaction_ready_to_go(re.st, re.key_images, [&]() -> const transaction*
+        {
+          return get_transaction(re.id, tx) ? &tx : nullptr;
+        });
+        if (!is_revalidation_actual(generation))
+        {
+          interrupted = true;
+          return;
+        }
+
+        CRITICAL_REGION_LOCAL(m_transactions_lock);
+        if (m_ready_to_go_cache_generation != generation || m_ready_to_go_cache.count(re.id))
+          return;
+        auto it = m_transactions.find(re.id);
+        if (it == m_transactions.end())
+          return;
+        if (it->second.max_used_block_id != re.st.max_used_block_id || it->second.last_failed_id != re.st.last_failed_id)
+          m_snapshot_dirty.insert(re.id);
+        it->second.max_used_block_id = re.st.max_used_block_id;
+        it->second.max_used_block_height = re.st.max_used_block_height;
+        it->second.last_failed_height = re.st.last_failed_height;
+        it->second.last_failed_id = re.st.last_failed_id;
+        if (!ready)
+          it->second.decline_reason = re.st.decline_reason;
+        m_ready_to_go_cache[re.id] = ready;
+      });
+    }
+    TIME_MEASURE_FINISH_MS(revalidate_time);
+    if (interrupted)
+    {
+      LOG_PRINT_L2("Revalidation of " << entries.size() << " pool transactions interrupted by blockchain update after " << revalidate_time << " ms");
+      return false;
+    }
+    LOG_PRINT_L2("Revalidated " << entries.size() << " pool transactions in " << revalidate_time << " ms");
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::stop_revalidator()
+  {
+    m_revalidator_stop = true;
+    m_revalidator_cv.notify_one();
+    if (m_revalidator.joinable())
+      m_revalidator.join();
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::fee_rate_less::operator()(const fee_rate_entry& a, const fee_rate_entry& b) const
+  {
+    //a.fee / a.blob_size > b.fee / b.blob_size, without precision loss
+    uint64_t a_hi, a_lo = mul128(a.fee, b.blob_size, &a_hi);
+    uint64_t b_hi, b_lo = mul128(b.fee, a.blob_size, &b_hi);
+    if (a_hi != b_hi || a_lo != b_lo)
+      return a_hi > b_hi || (a_hi == b_hi && a_lo > b_lo);
+    return memcmp(&a.id, &b.id, sizeof(a.id)) < 0;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::add_to_indexes(const crypto::hash& id, tx_details& txd)
+  {
+    txd.memory_usage = get_tx_details_memory_usage(txd.tx, txd.decline_reason) + sizeof(fee_rate_entry) + 4 * sizeof(void*);
+    m_fee_rate_index.insert(fee_rate_entry{txd.fee, txd.blob_size, id});
+    m_memory_usage += txd.memory_usage;
+    m_blobs_size += txd.blob_size;
+    m_snapshot_dirty.insert(id);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::remove_from_indexes(const crypto::hash& id, const tx_details& txd)
+  {
+    m_fee_rate_index.erase(fee_rate_entry{txd.fee, txd.blob_size, id});
+    m_ready_to_go_cache.erase(id);
+    m_memory_usage -= txd.memory_usage;
+    m_blobs_size -= txd.blob_size;
+    m_snapshot_dirty.insert(id);
+    //entry is erased from m_transactions by caller after this
+    if (m_fee_floor_active && !is_over_limits(CURRENCY_MEMPOOL_FEE_FLOOR_RELEASE_PERCENT, m_transactions.size() - 1))
+    {
+      LOG_PRINT_L1("Transaction pool is below " << CURRENCY_MEMPOOL_FEE_FLOOR_RELEASE_PERCENT << "% of its limits, eviction fee floor released");
+      m_fee_floor_active = false;
+    }
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::rebuild_indexes()
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    m_fee_rate_index.clear();
+    m_ready_to_go_cache.clear();
+    m_memory_usage = 0;
+    m_blobs_size = 0;
+    BOOST_FOREACH(auto& txe, m_transactions)
+      add_to_indexes(txe.first, txe.second);
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::is_over_limits(uint64_t percent, size_t tx_count) const
+  {
+    return m_memory_usage * 100 > m_max_memory_usage * percent || tx_count * 100 > m_max_count * percent;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::evict_transactions_over_limits()
+  {
+    //cheapest per byte go first; transactions kept by block stay, as they may be needed to switch to alternative chain
+    auto it = m_fee_rate_index.end();
+    while (is_over_limits(100, m_transactions.size()) && it != m_fee_rate_index.begin())
+    {
+      auto cur = std::prev(it);
+      auto tx_it = m_transactions.find(cur->id);
+      if (tx_it == m_transactions.end() || tx_it->second.kept_by_block)
+      {
+        it = cur;
+        continue;
+      }
+      fee_rate_entry evicted = *cur;
+      LOG_PRINT_L1("Tx " << evicted.id << " evicted from full pool, fee " << print_money(evicted.fee) << " for " << evicted.blob_size << " bytes");
+      remove_transaction_keyimages(tx_it->second.tx);
+      remove_from_indexes(tx_it->first, tx_it->second);
+      m_transactions.erase(tx_it);
+      ++m_evicted_count;
+      m_fee_floor = evicted;
+      m_fee_floor_active = true;
+    }
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::is_fee_above_floor(uint64_t fee, size_t blob_size)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    if (!m_fee_floor_active)
+      return true;
+    uint64_t tx_hi, tx_lo = mul128(fee, m_fee_floor.blob_size, &tx_hi);
+    uint64_t floor_hi, floor_lo = mul128(m_fee_floor.fee, blob_size, &floor_hi);
+    return tx_hi > floor_hi || (tx_hi == floor_hi && tx_lo > floor_lo);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::get_stats(pool_stats& st)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    st = pool_stats();
+    st.tx_count = m_transactions.size();
+    BOOST_FOREACH(const auto& txe, m_transactions)
+      if (txe.second.kept_by_block)
+        ++st.kept_by_block_count;
+    st.blobs_size = m_blobs_size;
+    st.memory_usage = m_memory_usage;
+    st.max_memory_usage = m_max_memory_usage;
+    st.max_count = m_max_count;
+    st.evicted_count = m_evicted_count;
+    if (m_fee_floor_active && m_fee_floor.blob_size)
+    {
+      uint64_t hi, lo = mul128(m_fee_floor.fee, 1024, &hi);
+      uint64_t q_hi = 0, q_lo = 0;
+      div128_32(hi, lo, static_cast<uint32_t>(m_fee_floor.blob_size), &q_hi, &q_lo);
+      st.fee_floor_per_kb = q_hi ? std::numeric_limits<uint64_t>::max() : q_lo + 1;
+    }
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_key_images(const std::unordered_set<crypto::key_image>& k_images, const transaction& tx)
   {
     for(size_t i = 0; i!= tx.vin.size(); i++)
@@ -416,16 +835,8 @@ namespace currency
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::fill_block_template(block &bl, size_t median_size, uint64_t already_generated_coins, uint64_t already_donated_coins, size_t &total_size, uint64_t &fee) 
   {
-    typedef transactions_container::value_type txv;
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-
-    std::vector<txv *> txs(m_transactions.size());
-    std::transform(m_transactions.begin(), m_transactions.end(), txs.begin(), [](txv &a) -> txv * { return &a; });
-    std::sort(txs.begin(), txs.end(), [](txv *a, txv *b) -> bool {
-      uint64_t a_hi, a_lo = mul128(a->second.fee, b->second.blob_size, &a_hi);
-      uint64_t b_hi, b_lo = mul128(b->second.fee, a->second.blob_size, &b_hi);
-      return a_hi > b_hi || (a_hi == b_hi && a_lo > b_lo);
-    });
+    actualize_ready_to_go_cache();
 
     size_t current_size = 0;
     uint64_t current_fee = 0;
@@ -435,28 +846,26 @@ namespace currency
       LOG_ERROR("Block with just a miner transaction is already too large!");
       return false;
     }
-    size_t best_position = 0;
+    size_t best_count = 0;
     total_size = 0;
     fee = 0;
-    size_t tx_count = 0;
 
+    std::vector<crypto::hash> selected;
     std::unordered_set<crypto::key_image> k_images;
 
-    for (size_t i = 0; i < txs.size(); i++) 
+    for (auto it = m_fee_rate_index.begin(); it != m_fee_rate_index.end() && selected.size() <= 124; ++it)
     {
-      txv &tx(*txs[i]);
+      auto tx_it = m_transactions.find(it->id);
+      CHECK_AND_ASSERT_MES(tx_it != m_transactions.end(), false, "internal error: transaction " << it->id << " from fee rate index not found in pool");
+      tx_details& txd = tx_it->second;
 
-      if (tx_count > 124 || !is_transaction_ready_to_go(tx.second) || have_key_images(k_images, tx.second.tx))
-      {
-        txs[i] = NULL;
+      if (!is_transaction_ready_to_go_cached(it->id, txd) || have_key_images(k_images, txd.tx))
         continue;
-      }
-      ++tx_count;
-      append_key_images(k_images, tx.second.tx);
-     
+      selected.push_back(it->id);
+      append_key_images(k_images, txd.tx);
 
-      current_size += tx.second.blob_size;
-      current_fee += tx.second.fee;
+      current_size += txd.blob_size;
+      current_fee += txd.fee;
 
       uint64_t current_reward;
       if (!get_block_reward(median_size, current_size + CURRENCY_COINBASE_BLOB_RESERVED_SIZE, already_generated_coins, already_donated_coins, current_reward, max_donation)) 
@@ -467,61 +876,311 @@ namespace currency
       if (best_money < current_reward + current_fee)
       {
         best_money = current_reward + current_fee;
-        best_position = i + 1;
+        best_count = selected.size();
         total_size = current_size;
         fee = current_fee;
       }
     }
 
-    for (size_t i = 0; i < best_position; i++) 
+    bl.tx_hashes.insert(bl.tx_hashes.end(), selected.begin(), selected.begin() + best_count);
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::init_options(boost::program_options::options_description& desc)
+  {
+    command_line::add_arg(desc, arg_tx_pool_max_memory);
+    command_line::add_arg(desc, arg_tx_pool_max_count);
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::init(const boost::program_options::variables_map& vm, const std::string& config_folder)
+  {
+    m_config_folder = config_folder;
+    m_max_memory_usage = command_line::get_arg(vm, arg_tx_pool_max_memory);
+    m_max_count = command_line::get_arg(vm, arg_tx_pool_max_count);
+    LOG_PRINT_L0("Transaction pool limits: " << m_max_memory_usage << " bytes, " << m_max_count << " transactions");
+
+    bool res = true;
+    std::string snapshot_file_path = config_folder + "/" + CURRENCY_POOLDATA_SNAPSHOT_FILENAME;
+    std::string state_file_path = config_folder + "/" + CURRENCY_POOLDATA_FILENAME;
+    boost::system::error_code ec;
+    if (boost::filesystem::exists(snapshot_file_path, ec))
     {
-      if (txs[i]) 
+      //broken snapshot is not fatal: pool starts empty and file is rewritten
+      if (!load_snapshot(snapshot_file_path))
+        LOG_ERROR("Failed to load memory pool snapshot from file " << snapshot_file_path);
+    }
+    else if (boost::filesystem::exists(state_file_path, ec))
+    {
+      //pool stored by previous version, it is converted to snapshot on first store
+      res = tools::unserialize_obj_from_file(*this, state_file_path);
+      rebuild_indexes();
+      if (res)
       {
-        bl.tx_hashes.push_back(txs[i]->first);
+        // mem pool has just been successfully loaded from file
+        // delete pool file to avoid loading outdated data on the next load (in case a crash happen for ex.)
+        if (!boost::filesystem::remove_all(state_file_path))
+        {
+          LOG_ERROR("failed to remove pool file " << state_file_path << " after a successful load");
+        }
+      }
+      else
+      {
+        LOG_ERROR("Failed to load memory pool from file " << state_file_path);
       }
     }
 
+    if (!m_revalidator.joinable())
+    {
+      m_revalidator_stop = false;
+      m_revalidator = std::thread(boost::bind(&tx_memory_pool::revalidator_thread, this));
+    }
+    return res;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::load_snapshot(const std::string& path)
+  {
+    TIME_MEASURE_START_MS(load_time);
+    //last state of every entry; blob stays in mapped file until entry is known to be still in pool
+    struct snapshot_entry
+    {
+      pool_snapshot_record rec;
+      const char* blob;
+    };
+    std::unordered_map<crypto::hash, snapshot_entry> entries;
+    std::vector<std::pair<crypto::hash, tx_details> > txs;
+    std::vector<char> parsed;
+    size_t offset = 0;
+    size_t file_size = 0;
+    size_t records_count = 0;
+    try
+    {
+      boost::interprocess::file_mapping fm(path.c_str(), boost::interprocess::read_only);
+      boost::interprocess::mapped_region region(fm, boost::interprocess::read_only);
+      const char* data = static_cast<const char*>(region.get_address());
+      file_size = region.get_size();
+
+      pool_snapshot_header hdr = AUTO_VAL_INIT(hdr);
+      CHECK_AND_ASSERT_MES(file_size >= sizeof(hdr), false, "Pool snapshot " << path << " is too small: " << file_size << " bytes");
+      memcpy(&hdr, data, sizeof(hdr));
+      CHECK_AND_ASSERT_MES(hdr.signature == POOL_SNAPSHOT_SIGNATURE && hdr.version == POOL_SNAPSHOT_VERSION, false,
+        "Pool snapshot " << path << " has unknown format, version " << hdr.version);
+
+      //broken tail (interrupted write) is dropped
+      offset = sizeof(hdr);
+      while (file_size - offset >= sizeof(pool_snapshot_record))
+      {
+        snapshot_entry e = AUTO_VAL_INIT(e);
+        memcpy(&e.rec, data + offset, sizeof(e.rec));
+        if (file_size - offset - sizeof(e.rec) < e.rec.blob_size)
+          break;
+        crypto::hash h = crypto::cn_fast_hash(data + offset + sizeof(crypto::hash), sizeof(e.rec) - sizeof(crypto::hash) + e.rec.blob_size);
+        if (h != e.rec.checksum)
+          break;
+        e.blob = data + offset + sizeof(e.rec);
+
+        if (e.rec.type == pool_snapshot_record_add)
+        {
+          entries[e.rec.id] = e;
+        }
+        else if (e.rec.type == pool_snapshot_record_update)
+        {
+          auto it = entries.find(e.rec.id);
+          if (it != entries.end())
+          {
+            it->second.rec.max_used_block_height = e.rec.max_used_block_height;
+            it->second.rec.max_used_block_id = e.rec.max_used_block_id;
+            it->second.rec.last_failed_height = e.rec.last_failed_height;
+            it->second.rec.last_failed_id = e.rec.last_failed_id;
+          }
+        }
+        else if (e.rec.type == pool_snapshot_record_remove)
+        {
+          entries.erase(e.rec.id);
+        }
+        else
+        {
+          break;
+        }
+        offset += sizeof(e.rec) + e.rec.blob_size;
+        ++records_count;
+      }
+
+      //ids, fees and sizes are taken from snapshot, so blobs are only parsed, not hashed or checked
+      txs.resize(entries.size());
+      parsed.resize(entries.size(), 0);
+      std::vector<const snapshot_entry*> items;
+      items.reserve(entries.size());
+      for (const auto& e : entries)
+        items.push_back(&e.second);
+
+      tools::thread_pool::instance().parallel_for(items.size(), [&](size_t i)
+      {
+        const pool_snapshot_record& rec = items[i]->rec;
+        tx_details& txd = txs[i].second;
+        txs[i].first = rec.id;
+        if (!parse_and_validate_tx_from_blob(blobdata(items[i]->blob, rec.blob_size), txd.tx))
+          return;
+        txd.blob_size = static_cast<size_t>(rec.tx_blob_size);
+        txd.fee = rec.fee;
+        txd.kept_by_block = rec.kept_by_block != 0;
+        txd.receive_time = static_cast<time_t>(rec.receive_time);
+        apply_snapshot_validation_state(rec, txd);
+        parsed[i] = 1;
+      });
+    }
+    catch (const std::exception& ex)
+    {
+      LOG_ERROR("Failed to read pool snapshot " << path << ": " << ex.what());
+      return false;
+    }
+
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    m_transactions.clear();
+    m_spent_key_images.clear();
+    m_snapshot_stored.clear();
+    bool invalid = false;
+    for (size_t i = 0; i != txs.size(); ++i)
+    {
+      if (!parsed[i])
+      {
+        LOG_ERROR("Failed to parse transaction " << txs[i].first << " from pool snapshot, skipped");
+        invalid = true;
+        continue;
+      }
+      bool inputs_to_key = true;
+      BOOST_FOREACH(const auto& in, txs[i].second.tx.vin)
+        inputs_to_key = inputs_to_key && in.type() == typeid(txin_to_key);
+      if (!inputs_to_key)
+      {
+        LOG_ERROR("Transaction " << txs[i].first << " from pool snapshot has unexpected input type, skipped");
+        invalid = true;
+        continue;
+      }
+      BOOST_FOREACH(const auto& in, txs[i].second.tx.vin)
+        m_spent_key_images[boost::get<txin_to_key>(in).k_image].insert(txs[i].first);
+      m_snapshot_stored.insert(txs[i].first);
+      m_transactions[txs[i].first] = std::move(txs[i].second);
+    }
+    rebuild_indexes();
+    m_snapshot_dirty.clear();
+
+    if (offset != file_size)
+    {
+      LOG_PRINT_L0("Pool snapshot " << path << " is broken at offset " << offset << ", the rest " << file_size - offset << " bytes dropped");
+      boost::system::error_code ec;
+      boost::filesystem::resize_file(path, offset, ec);
+      if (ec)
+        invalid = true;
+    }
+    m_snapshot_file_size = offset;
+    m_snapshot_invalid = invalid;
+    //limits may be lower than in previous run
+    evict_transactions_over_limits();
+    TIME_MEASURE_FINISH_MS(load_time);
+    LOG_PRINT_L0("Loaded " << m_transactions.size() << " pool transactions from " << records_count << " snapshot records in " << load_time << " ms");
     return true;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::init(const std::string& config_folder)
+  bool tx_memory_pool::store_snapshot()
   {
-    m_config_folder = config_folder;
-    std::string state_file_path = config_folder + "/" + CURRENCY_POOLDATA_FILENAME;
-    boost::system::error_code ec;
-    if(!boost::filesystem::exists(state_file_path, ec))
-      return true;
-    bool res = tools::unserialize_obj_from_file(*this, state_file_path);
-    if (res)
+    std::lock_guard<std::mutex> lk(m_snapshot_lock);
+    std::string path = m_config_folder + "/" + CURRENCY_POOLDATA_SNAPSHOT_FILENAME;
+    std::string buff;
+    bool full = false;
     {
-      // mem pool has just been successfully loaded from file
-      // delete pool file to avoid loading outdated data on the next load (in case a crash happen for ex.)
-      if (!boost::filesystem::remove_all(state_file_path))
+      CRITICAL_REGION_LOCAL(m_transactions_lock);
+      if (!m_snapshot_invalid && m_snapshot_dirty.empty())
+        return true;
+      //whole pool is rewritten when appended records outgrow actual pool data
+      uint64_t live_size = sizeof(pool_snapshot_header) + m_transactions.size() * sizeof(pool_snapshot_record) + m_blobs_size;
+      full = m_snapshot_invalid || !m_snapshot_file_size ||
+        m_snapshot_file_size > std::max<uint64_t>(live_size, 1024 * 1024) * CURRENCY_MEMPOOL_SNAPSHOT_COMPACTION_RATIO;
+      if (full)
       {
-        LOG_ERROR("failed to remove pool file " << state_file_path << " after a successful load");
+        append_snapshot_header(buff);
+        m_snapshot_stored.clear();
+        BOOST_FOREACH(const auto& txe, m_transactions)
+        {
+          append_snapshot_record(buff, pool_snapshot_record_add, txe.first, &txe.second);
+          m_snapshot_stored.insert(txe.first);
+        }
       }
+      else
+      {
+        BOOST_FOREACH(const auto& id, m_snapshot_dirty)
+        {
+          auto it = m_transactions.find(id);
+          if (it != m_transactions.end())
+          {
+            bool stored = !m_snapshot_stored.insert(id).second;
+            append_snapshot_record(buff, stored ? pool_snapshot_record_update : pool_snapshot_record_add, id, &it->second);
+          }
+          else if (m_snapshot_stored.erase(id))
+          {
+            append_snapshot_record(buff, pool_snapshot_record_remove, id, nullptr);
+          }
+        }
+      }
+      m_snapshot_dirty.clear();
+      m_snapshot_invalid = false;
+    }
+
+    bool res = false;
+    if (full)
+    {
+      //written aside and renamed, so crash in the middle leaves previous snapshot
+      std::string tmp_path = path + ".tmp";
+      res = epee::file_io_utils::save_string_to_file(tmp_path, buff);
+      if (res)
+      {
+        boost::system::error_code ec;
+        boost::filesystem::rename(tmp_path, path, ec);
+        res = !ec;
+      }
+      if (res)
+        m_snapshot_file_size = buff.size();
+    }
+    else if (!buff.empty())
+    {
+      std::fstream f(path, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+      if (!f.fail())
+      {
+        f.seekp(m_snapshot_file_size);
+        f.write(buff.data(), buff.size());
+        f.flush();
+      }
+      res = !f.fail();
+      if (res)
+        m_snapshot_file_size += buff.size();
     }
     else
     {
-      LOG_ERROR("Failed to load memory pool from file " << state_file_path);
+      res = true;
     }
-    return res;
-  }
 
+    if (!res)
+    {
+      LOG_ERROR("Failed to write pool snapshot " << path);
+      CRITICAL_REGION_LOCAL(m_transactions_lock);
+      m_snapshot_invalid = true;
+      return false;
+    }
+    LOG_PRINT_L2("Pool snapshot " << (full ? "rewritten" : "appended") << ": " << buff.size() << " bytes, file size " << m_snapshot_file_size);
+    return true;
+  }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::deinit()
   {
+    stop_revalidator();
     if (!tools::create_directories_if_necessary(m_config_folder))
     {
       LOG_PRINT_L0("Failed to create data directory: " << m_config_folder);
       return false;
     }
 
-    std::string state_file_path = m_config_folder + "/" + CURRENCY_POOLDATA_FILENAME;
-    bool res = tools::serialize_obj_to_file(*this, state_file_path);
-    if(!res)
+    if (!store_snapshot())
     {
-      LOG_PRINT_L0("Failed to serialize memory pool to file " << state_file_path);
+      LOG_PRINT_L0("Failed to store memory pool to " << m_config_folder);
     }
     return true;
   }
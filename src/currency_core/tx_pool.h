@@ -7,11 +7,18 @@
 using namespace epee;
 
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <set>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <boost/serialization/version.hpp>
 #include <boost/utility.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
 
 #include "string_tools.h"
 #include "syncobj.h"
@@ -33,6 +40,8 @@ namespace currency
   {
   public:
     tx_memory_pool(blockchain_storage& bchs);
+    ~tx_memory_pool();
+    bool add_tx(const transaction &tx, const crypto::hash &id, size_t blob_size, tx_verification_context& tvc, bool keeped_by_block);
     bool add_tx(const transaction &tx, const crypto::hash &id, tx_verification_context& tvc, bool keeped_by_block);
     bool add_tx(const transaction &tx, tx_verification_context& tvc, bool keeped_by_block);
     //gets tx and remove it from pool
@@ -50,9 +59,25 @@ namespace currency
     void lock();
     void unlock();
     void purge_transactions();
+    //drops entries mined or double spent in blockchain, called once blockchain is loaded
+    bool remove_spent_in_blockchain();
+
+    struct pool_stats
+    {
+      uint64_t tx_count;
+      uint64_t kept_by_block_count;
+      uint64_t blobs_size;
+      uint64_t memory_usage;
+      uint64_t max_memory_usage;
+      uint64_t max_count;
+      uint64_t evicted_count;
+      uint64_t fee_floor_per_kb;                               //minimal fee per 1024 bytes for new transactions while pool is full, 0 otherwise
+    };
+    void get_stats(pool_stats& st);
 
     // load/store operations
-    bool init(const std::string& config_folder);
+    static void init_options(boost::program_options::options_description& desc);
+    bool init(const boost::program_options::variables_map& vm, const std::string& config_folder);
     bool deinit();
     bool fill_block_template(block &bl, size_t median_size, uint64_t already_generated_coins, uint64_t already_donated_coins, size_t &total_size, uint64_t &fee);
     bool get_transactions(std::list<transaction>& txs);
@@ -94,17 +119,84 @@ namespace currency
       crypto::hash last_failed_id;
       time_t receive_time;
       std::string decline_reason;
+      size_t memory_usage;                                     //estimated, not stored
     };
 
   private:
+    //order of transactions in block template: higher fee per byte goes first
+    struct fee_rate_entry
+    {
+      uint64_t fee;
+      size_t blob_size;
+      crypto::hash id;
+    };
+    struct fee_rate_less
+    {
+      bool operator()(const fee_rate_entry& a, const fee_rate_entry& b) const;
+    };
+    //fields of tx_details that is_transaction_ready_to_go() reads and updates, background checks work on copy of them
+    struct tx_check_state
+    {
+      crypto::hash max_used_block_id;
+      uint64_t max_used_block_height;
+      uint64_t last_failed_height;
+      crypto::hash last_failed_id;
+      std::string decline_reason;
+    };
+    //gives transaction body when ring signatures have to be checked, nullptr if it has gone from pool
+    typedef std::function<const transaction*()> tx_body_getter;
+
     bool remove_stuck_transactions();
     bool is_transaction_ready_to_go(tx_details& txd);
+    bool is_transaction_ready_to_go(tx_check_state& st, const std::vector<crypto::key_image>& key_images, const tx_body_getter& get_tx_body);
+    bool is_transaction_ready_to_go_cached(const crypto::hash& id, tx_details& txd);
+    uint64_t actualize_ready_to_go_cache();
+    void revalidator_thread();
+    bool is_revalidation_actual(uint64_t generation) const;
+    bool revalidate_transactions(uint64_t generation);
+    void stop_revalidator();
+    void add_to_indexes(const crypto::hash& id, tx_details& txd);
+    void remove_from_indexes(const crypto::hash& id, const tx_details& txd);
+    void rebuild_indexes();
+    bool load_snapshot(const std::string& path);
+    bool store_snapshot();
+    bool is_over_limits(uint64_t percent, size_t tx_count) const;
+    void evict_transactions_over_limits();
+    bool is_fee_above_floor(uint64_t fee, size_t blob_size);
     typedef std::unordered_map<crypto::hash, tx_details > transactions_container;
     typedef std::unordered_map<crypto::key_image, std::unordered_set<crypto::hash> > key_images_container;
+    typedef std::set<fee_rate_entry, fee_rate_less> fee_rate_index;
 
     epee::critical_section m_transactions_lock;
     transactions_container m_transactions;
     key_images_container m_spent_key_images;
+    fee_rate_index m_fee_rate_index;                           //all of m_transactions
+    std::unordered_map<crypto::hash, bool> m_ready_to_go_cache; //is_transaction_ready_to_go() results for blockchain m_ready_to_go_cache_generation
+    uint64_t m_ready_to_go_cache_generation;
+    uint64_t m_max_memory_usage;
+    uint64_t m_max_count;
+    uint64_t m_memory_usage;                                   //sum of tx_details::memory_usage
+    uint64_t m_blobs_size;
+    uint64_t m_evicted_count;
+    bool m_fee_floor_active;
+    fee_rate_entry m_fee_floor;                                //last evicted one, new transactions have to pay more while pool is nearly full
+    std::atomic<uint64_t> m_blockchain_generation;            //incremented on every blockchain top change
+    std::atomic<size_t> m_blockchain_updates;                  //lock() calls not unlocked yet: blockchain_storage holds pool while it adds block
+
+    //fills m_ready_to_go_cache in background after every blockchain change, so block template doesn't wait for input checks
+    std::thread m_revalidator;
+    std::mutex m_revalidator_lock;
+    std::condition_variable m_revalidator_cv;
+    std::atomic<bool> m_revalidator_stop;
+
+    //pool is kept in CURRENCY_POOLDATA_SNAPSHOT_FILENAME: changes are appended to it every CURRENCY_MEMPOOL_SNAPSHOT_FLUSH_INTERVAL
+    //seconds by revalidator thread and on deinit, so restart doesn't have to write and read whole pool at once
+    std::mutex m_snapshot_lock;                                //one writer of snapshot file at a time
+    std::unordered_set<crypto::hash> m_snapshot_dirty;         //added, removed or revalidated since last store_snapshot()
+    std::unordered_set<crypto::hash> m_snapshot_stored;        //present in snapshot file
+    uint64_t m_snapshot_file_size;
+    bool m_snapshot_invalid;                                   //file has to be rewritten in full
+    epee::math_helper::once_a_time_seconds<CURRENCY_MEMPOOL_SNAPSHOT_FLUSH_INTERVAL, false> m_snapshot_interval;
     
     epee::math_helper::once_a_time_seconds<30> m_remove_stuck_tx_interval;
 
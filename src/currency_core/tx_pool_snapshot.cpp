@@ -0,0 +1,54 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "tx_pool_snapshot.h"
+#include "currency_format_utils.h"
+#include "crypto/hash.h"
+
+namespace currency
+{
+  //---------------------------------------------------------------------------------
+  void append_snapshot_header(std::string& buff)
+  {
+    pool_snapshot_header hdr = AUTO_VAL_INIT(hdr);
+    hdr.signature = POOL_SNAPSHOT_SIGNATURE;
+    hdr.version = POOL_SNAPSHOT_VERSION;
+    buff.append(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+  }
+  //---------------------------------------------------------------------------------
+  void append_snapshot_record(std::string& buff, uint32_t type, const crypto::hash& id, const tx_memory_pool::tx_details* txd)
+  {
+    pool_snapshot_record rec = AUTO_VAL_INIT(rec);
+    rec.type = type;
+    rec.id = id;
+    blobdata blob;
+    if (txd)
+    {
+      rec.tx_blob_size = txd->blob_size;
+      rec.fee = txd->fee;
+      rec.max_used_block_height = txd->max_used_block_height;
+      rec.max_used_block_id = txd->max_used_block_id;
+      rec.last_failed_height = txd->last_failed_height;
+      rec.last_failed_id = txd->last_failed_id;
+      rec.receive_time = txd->receive_time;
+      rec.kept_by_block = txd->kept_by_block ? 1 : 0;
+      if (type == pool_snapshot_record_add)
+        blob = t_serializable_object_to_blob(txd->tx);
+    }
+    rec.blob_size = static_cast<uint32_t>(blob.size());
+    size_t offset = buff.size();
+    buff.append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+    buff += blob;
+    crypto::hash h = crypto::cn_fast_hash(buff.data() + offset + sizeof(crypto::hash), buff.size() - offset - sizeof(crypto::hash));
+    memcpy(&buff[offset], &h, sizeof(h));
+  }
+  //---------------------------------------------------------------------------------
+  void apply_snapshot_validation_state(const pool_snapshot_record& rec, tx_memory_pool::tx_details& txd)
+  {
+    txd.max_used_block_height = rec.max_used_block_height;
+    txd.max_used_block_id = rec.max_used_block_id;
+    txd.last_failed_height = rec.last_failed_height;
+    txd.last_failed_id = rec.last_failed_id;
+  }
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <string>
+#include "tx_pool.h"
+
+namespace currency
+{
+  //snapshot file: header, then records. Record is fixed size part followed by tx blob (for add records only),
+  //so file is read through memory mapping and only blobs of entries that are still in pool are parsed
+  const uint64_t POOL_SNAPSHOT_SIGNATURE = 0x544f4853504c4f4fULL;
+  const uint32_t POOL_SNAPSHOT_VERSION = 1;
+
+  enum pool_snapshot_record_type
+  {
+    pool_snapshot_record_add = 1,                              //entry with its tx blob
+    pool_snapshot_record_update = 2,                           //cached validation state of entry changed
+    pool_snapshot_record_remove = 3
+  };
+
+#pragma pack(push, 1)
+  struct pool_snapshot_header
+  {
+    uint64_t signature;
+    uint32_t version;
+    uint32_t reserved;
+  };
+
+  struct pool_snapshot_record
+  {
+    crypto::hash checksum;                                     //cn_fast_hash of the rest of record and blob
+    uint32_t type;
+    uint32_t blob_size;                                        //of blob that follows
+    crypto::hash id;
+    uint64_t tx_blob_size;                                     //tx_details::blob_size
+    uint64_t fee;
+    uint64_t max_used_block_height;
+    crypto::hash max_used_block_id;
+    uint64_t last_failed_height;
+    crypto::hash last_failed_id;
+    uint64_t receive_time;
+    uint8_t kept_by_block;
+  };
+#pragma pack(pop)
+
+  void append_snapshot_header(std::string& buff);
+  //txd may be null for remove record
+  void append_snapshot_record(std::string& buff, uint32_t type, const crypto::hash& id, const tx_memory_pool::tx_details* txd);
+  void apply_snapshot_validation_state(const pool_snapshot_record& rec, tx_memory_pool::tx_details& txd);
+}
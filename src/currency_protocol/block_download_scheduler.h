@@ -0,0 +1,252 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <list>
+#include <map>
+#include <vector>
+#include <boost/uuid/uuid.hpp>
+
+#include "syncobj.h"
+#include "misc_os_dependent.h"
+#include "net/net_utils_base.h"
+#include "currency_config.h"
+#include "currency_protocol_defs.h"
+
+namespace currency
+{
+  /************************************************************************/
+  /* Spreads block downloading during synchronization over all            */
+  /* synchronizing connections: every connection gets its own span of     */
+  /* heights, so spans are downloaded in parallel. Spans that arrive out  */
+  /* of order are kept here until all spans below them arrive, and then   */
+  /* handed to the core strictly in height order.                         */
+  /************************************************************************/
+  class block_download_scheduler
+  {
+  public:
+    //blobs are parsed and hashed right on receiving, validator gets ready objects
+    struct parsed_tx
+    {
+      transaction tx;
+      crypto::hash id;
+      crypto::hash prefix_hash;
+      size_t blob_size;                                    //get_object_blobsize(tx)
+    };
+
+    struct parsed_block
+    {
+      block b;
+      crypto::hash id;
+      size_t blob_size;
+      std::vector<parsed_tx> txs;
+    };
+
+    struct span
+    {
+      uint64_t start_height;
+      std::list<crypto::hash> ids;
+      epee::net_utils::connection_context_base connection; //peer the span was requested from
+      uint64_t request_time;                               //ms
+      bool received;
+      std::vector<parsed_block> blocks;
+    };
+
+    //picks span of heights for connection from ids it can give us (needed.front() is at needed_height):
+    //heights that already requested from other connections are skipped, except spans that other peer failed
+    //to deliver in BLOCKS_SYNCHRONIZING_SPAN_TIMEOUT. Returns false if there is nothing to request now.
+    bool reserve_span(const epee::net_utils::connection_context_base& context, uint64_t core_height, uint64_t needed_height,
+      const std::list<crypto::hash>& needed, uint64_t& span_height, std::list<crypto::hash>& ids)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      peer_info& peer = m_peers[context.m_connection_id];
+      uint64_t now = epee::misc_utils::get_tick_count();
+      uint64_t limit = core_height + BLOCKS_SYNCHRONIZING_MAX_AHEAD;
+
+      uint64_t h = needed_height;
+      auto it = needed.begin();
+      while (it != needed.end() && h < limit)
+      {
+        auto sp_it = find_span(h);
+        if (sp_it == m_spans.end())
+          break;
+        span& sp = sp_it->second;
+        if (!sp.received && sp.connection.m_connection_id != context.m_connection_id && now - sp.request_time > BLOCKS_SYNCHRONIZING_SPAN_TIMEOUT)
+        {
+          //peer is too slow with this span, take it over
+          LOG_PRINT_L1("Span " << sp.start_height << "(" << sp.ids.size() << " blocks) reassigned from "
+            << epee::net_utils::print_connection_context_short(sp.connection) << " to " << epee::net_utils::print_connection_context_short(context));
+          auto prev_owner_it = m_peers.find(sp.connection.m_connection_id);
+          if (prev_owner_it != m_peers.end())
+            prev_owner_it->second.has_span = false;
+          sp.connection = context;
+          sp.request_time = now;
+          peer.span_height = sp.start_height;
+          peer.has_span = true;
+          span_height = sp.start_height;
+          ids = sp.ids;
+          return true;
+        }
+        //requested from other peer (or already delivered), skip it
+        uint64_t span_end = sp.start_height + sp.ids.size();
+        for (; it != needed.end() && h < span_end; ++it, ++h);
+      }
+      if (it == needed.end() || h >= limit)
+        return false;
+
+      auto next_it = m_spans.upper_bound(h);
+      uint64_t stop_height = next_it == m_spans.end() ? limit : std::min(next_it->first, limit);
+      ids.clear();
+      for (; it != needed.end() && ids.size() < peer.span_size && h + ids.size() < stop_height; ++it)
+        ids.push_back(*it);
+
+      span& sp = m_spans[h];
+      sp.start_height = h;
+      sp.ids = ids;
+      sp.connection = context;
+      sp.request_time = now;
+      sp.received = false;
+      peer.span_height = h;
+      peer.has_span = true;
+      span_height = h;
+      return true;
+    }
+
+    //stores blocks of span requested from connection and updates its measured throughput.
+    //Returns false if span was handed to other connection meanwhile (blocks are ignored then).
+    bool add_blocks(const epee::net_utils::connection_context_base& context, std::vector<parsed_block>& blocks)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      auto peer_it = m_peers.find(context.m_connection_id);
+      if (peer_it == m_peers.end() || !peer_it->second.has_span)
+        return false;
+      peer_info& peer = peer_it->second;
+      peer.has_span = false;
+      auto sp_it = m_spans.find(peer.span_height);
+      if (sp_it == m_spans.end() || sp_it->second.connection.m_connection_id != context.m_connection_id || sp_it->second.received)
+        return false;
+
+      span& sp = sp_it->second;
+      sp.received = true;
+      sp.blocks.swap(blocks);
+
+      //adjust span size so that this peer delivers it in about BLOCKS_SYNCHRONIZING_SPAN_TARGET_TIME
+      uint64_t elapsed = std::max<uint64_t>(epee::misc_utils::get_tick_count() - sp.request_time, 1);
+      double rate = sp.blocks.size() * 1000.0 / elapsed;
+      peer.blocks_per_second = peer.blocks_per_second > 0 ? (peer.blocks_per_second * 3 + rate) / 4 : rate;
+      uint64_t span_size = static_cast<uint64_t>(peer.blocks_per_second * BLOCKS_SYNCHRONIZING_SPAN_TARGET_TIME / 1000);
+      peer.span_size = static_cast<size_t>(std::min<uint64_t>(std::max<uint64_t>(span_size, BLOCKS_SYNCHRONIZING_MIN_SPAN), BLOCKS_SYNCHRONIZING_DEFAULT_COUNT));
+      LOG_PRINT_L2("[" << epee::net_utils::print_connection_context_short(context) << "] span " << sp.start_height << " received: "
+        << sp.blocks.size() << " blocks in " << elapsed << " ms, next span size " << peer.span_size);
+      return true;
+    }
+
+    //takes lowest downloaded span that starts at or below core_height (next block that core expects)
+    bool pop_ready_span(uint64_t core_height, span& sp)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      for (auto it = m_spans.begin(); it != m_spans.end() && it->first <= core_height; ++it)
+      {
+        if (!it->second.received)
+          continue;
+        sp = std::move(it->second);
+        m_spans.erase(it);
+        return true;
+      }
+      return false;
+    }
+
+    bool has_ready_span(uint64_t core_height)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      for (auto it = m_spans.begin(); it != m_spans.end() && it->first <= core_height; ++it)
+        if (it->second.received)
+          return true;
+      return false;
+    }
+
+    //connection closed: spans it didn't deliver become free for other peers
+    void on_connection_close(const epee::net_utils::connection_context_base& context)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      release_peer_span(context.m_connection_id);
+      m_peers.erase(context.m_connection_id);
+    }
+
+    //peer delivered invalid blocks: forget everything downloaded from it
+    void drop_connection_spans(const epee::net_utils::connection_context_base& context)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      for (auto it = m_spans.begin(); it != m_spans.end();)
+      {
+        if (it->second.connection.m_connection_id == context.m_connection_id)
+          m_spans.erase(it++);
+        else
+          ++it;
+      }
+      m_peers.erase(context.m_connection_id);
+    }
+
+    //true if some span (requested or downloaded) covers height
+    bool has_span_at(uint64_t height)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      return find_span(height) != m_spans.end();
+    }
+
+    size_t get_spans_count()
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      return m_spans.size();
+    }
+
+    size_t get_buffered_blocks_count()
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      size_t count = 0;
+      for (const auto& s : m_spans)
+        count += s.second.blocks.size();
+      return count;
+    }
+
+  private:
+    struct peer_info
+    {
+      peer_info() : blocks_per_second(0), span_size(BLOCKS_SYNCHRONIZING_DEFAULT_COUNT / 4), has_span(false), span_height(0)
+      {}
+      double blocks_per_second;
+      size_t span_size;
+      bool has_span;
+      uint64_t span_height;
+    };
+
+    //span that covers height h, or m_spans.end()
+    std::map<uint64_t, span>::iterator find_span(uint64_t h)
+    {
+      auto it = m_spans.upper_bound(h);
+      if (it == m_spans.begin())
+        return m_spans.end();
+      --it;
+      if (it->first + it->second.ids.size() <= h)
+        return m_spans.end();
+      return it;
+    }
+
+    void release_peer_span(const boost::uuids::uuid& connection_id)
+    {
+      auto peer_it = m_peers.find(connection_id);
+      if (peer_it == m_peers.end() || !peer_it->second.has_span)
+        return;
+      peer_it->second.has_span = false;
+      auto sp_it = m_spans.find(peer_it->second.span_height);
+      if (sp_it != m_spans.end() && !sp_it->second.received && sp_it->second.connection.m_connection_id == connection_id)
+        m_spans.erase(sp_it);
+    }
+
+    epee::critical_section m_lock;
+    std::map<uint64_t, span> m_spans;                  //by start height
+    std::map<boost::uuids::uuid, peer_info> m_peers;
+  };
+}
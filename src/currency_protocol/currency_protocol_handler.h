@@ -4,12 +4,16 @@
 
 #pragma once
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <boost/program_options/variables_map.hpp>
 
 #include "storages/levin_abstract_invoke2.h"
 #include "warnings.h"
 #include "currency_protocol_defs.h"
 #include "currency_protocol_handler_common.h"
+#include "block_download_scheduler.h"
 #include "currency_core/connection_context.h"
 #include "currency_core/currency_stat_info.h"
 #include "currency_core/verification_context.h"
@@ -30,6 +34,7 @@ namespace currency
     typedef CORE_SYNC_DATA payload_type;
 
     t_currency_protocol_handler(t_core& rcore, nodetool::i_p2p_endpoint<connection_context>* p_net_layout);
+    ~t_currency_protocol_handler();
 
     BEGIN_INVOKE_MAP2(currency_protocol_handler)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_BLOCK, &currency_protocol_handler::handle_notify_new_block)
@@ -42,6 +47,7 @@ namespace currency
 
     bool on_idle();
     bool init(const boost::program_options::variables_map& vm);
+    bool start();                                                  //starts block validator thread, call after core init
     bool deinit();
     void set_p2p_endpoint(nodetool::i_p2p_endpoint<connection_context>* p2p);
     //bool process_handshake_data(const blobdata& data, currency_connection_context& context);
@@ -50,6 +56,7 @@ namespace currency
     bool get_payload_sync_data(CORE_SYNC_DATA& hshd);
     bool get_stat_info(core_stat_info& stat_inf);
     bool on_callback(currency_connection_context& context);
+    void on_connection_close(currency_connection_context& context);
     t_core& get_core(){return m_core;}
     bool is_synchronized(){return m_synchronized;}
     void log_connections();
@@ -73,6 +80,13 @@ namespace currency
     bool request_missing_objects(currency_connection_context& context, bool check_having_blocks);
     size_t get_synchronizing_connections_count();
     bool on_connection_synchronized();  
+    //sync pipeline: network threads receive and parse blocks, single validator thread passes them to core in order
+    bool parse_block_entry(const block_complete_entry& entry, block_download_scheduler::parsed_block& pb, std::string& err);
+    bool parse_block_entries(const std::list<block_complete_entry>& entries, std::vector<block_download_scheduler::parsed_block>& blocks, std::string& err);
+    void validator_thread();
+    void stop_validator();
+    void handle_downloaded_spans();
+    bool handle_span_blocks(const block_download_scheduler::span& sp);
     bool check_stop_flag_and_exit(currency_connection_context& context);
     t_core& m_core;
 
@@ -83,6 +97,10 @@ namespace currency
     std::atomic<uint64_t> m_max_height_seen;
     std::atomic<uint64_t> m_core_inital_height;
     std::atomic<bool> m_want_stop;
+    block_download_scheduler m_download_scheduler;
+    std::thread m_validator;
+    std::mutex m_validator_lock;
+    std::condition_variable m_validator_cv;
 
     template<class t_parametr>
       bool post_notify(typename t_parametr::request& arg, currency_connection_context& context)
@@ -4,6 +4,7 @@
 
 #include <boost/interprocess/detail/atomic.hpp>
 #include "currency_core/currency_format_utils.h"
+#include "common/thread_pool.h"
 #include "profile_tools.h"
 namespace currency
 {
@@ -23,6 +24,12 @@ namespace currency
       m_p2p = &m_p2p_stub;
   }
   //-----------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  t_currency_protocol_handler<t_core>::~t_currency_protocol_handler()
+  {
+    stop_validator();
+  }
+  //-----------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
   bool t_currency_protocol_handler<t_core>::init(const boost::program_options::variables_map& vm)
   {
@@ -30,14 +37,34 @@ namespace currency
   }
   //------------------------------------------------------------------------------------------------------------------------  
   template<class t_core> 
+  bool t_currency_protocol_handler<t_core>::start()
+  {
+    //validator works with core, so it is started only when core is initialized
+    if(!m_validator.joinable())
+    {
+      m_want_stop = false;
+      m_validator = std::thread(boost::bind(&t_currency_protocol_handler<t_core>::validator_thread, this));
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------  
+  template<class t_core> 
   bool t_currency_protocol_handler<t_core>::deinit()
   {
-    m_want_stop = true;
-
+    stop_validator();
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------  
   template<class t_core> 
+  void t_currency_protocol_handler<t_core>::stop_validator()
+  {
+    m_want_stop = true;
+    m_validator_cv.notify_one();
+    if(m_validator.joinable())
+      m_validator.join();
+  }
+  //------------------------------------------------------------------------------------------------------------------------  
+  template<class t_core> 
   void t_currency_protocol_handler<t_core>::set_p2p_endpoint(nodetool::i_p2p_endpoint<connection_context>* p2p)
   {
     if(p2p)
@@ -55,6 +82,13 @@ namespace currency
 
     if(context.m_state == currency_connection_context::state_synchronizing)
     {
+      if(context.m_sync_waiting)
+      {
+        //woken up by on_idle: maybe there is something to request now
+        context.m_sync_waiting = false;
+        request_missing_objects(context, true);
+        return true;
+      }
       NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
       m_core.get_short_chain_history(r.block_ids);
       LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size() );
@@ -64,6 +98,12 @@ namespace currency
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_currency_protocol_handler<t_core>::on_connection_close(currency_connection_context& context)
+  {
+    m_download_scheduler.on_connection_close(context);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
   bool t_currency_protocol_handler<t_core>::get_stat_info(core_stat_info& stat_inf)
   {
@@ -135,6 +175,7 @@ namespace currency
     }
 
     context.m_state = currency_connection_context::state_synchronizing;
+    context.m_sync_waiting = false;
     context.m_remote_blockchain_height = hshd.current_height;
     //let the socket to send response to handshake, but request callback, to let send request data after response
     LOG_PRINT_CCONTEXT_L2("requesting callback");
@@ -217,6 +258,7 @@ namespace currency
     }else if(bvc.m_marked_as_orphaned)
     {
       context.m_state = currency_connection_context::state_synchronizing;
+      context.m_sync_waiting = false;
       NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
       m_core.get_short_chain_history(r.block_ids);
       LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size() );
@@ -233,10 +275,12 @@ namespace currency
     if(context.m_state != currency_connection_context::state_normal)
       return 1;
 
-    for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end();)
+    std::vector<currency::tx_verification_context> tvcs;
+    m_core.handle_incoming_txs(arg.txs, tvcs, false);
+    size_t i = 0;
+    for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end(); ++i)
     {
-      currency::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-      m_core.handle_incoming_tx(*tx_blob_it, tvc, false);
+      const currency::tx_verification_context& tvc = tvcs[i];
       if(tvc.m_verifivation_failed)
       {
         LOG_PRINT_CCONTEXT_L0("Tx verification failed, dropping connection");
@@ -303,59 +347,34 @@ namespace currency
 
     context.m_remote_blockchain_height = arg.current_blockchain_height;
 
-    PROF_L2_DO(uint64_t syncing_conn_count_sum = get_synchronizing_connections_count(); uint64_t syncing_conn_count_count = 1);
+    CHECK_STOP_FLAG_EXIT_IF_SET(1, "Blocks processing interrupted, connection dropped");
 
+    //stage 2: parse and hash blobs on all cores
     PROF_L2_START(block_complete_entries_prevalidation_time);
-    size_t count = 0;
-    BOOST_FOREACH(const block_complete_entry& block_entry, arg.blocks)
+    std::vector<block_download_scheduler::parsed_block> blocks;
+    std::string parse_error;
+    if(!parse_block_entries(arg.blocks, blocks, parse_error))
     {
-      CHECK_STOP_FLAG_EXIT_IF_SET(1, "Blocks processing interrupted, connection dropped");
+      LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: " << parse_error << ", dropping connection");
+      m_p2p->drop_connection(context);
+      m_p2p->add_ip_fail(context.m_remote_ip);
+      return 1;
+    }
 
-      ++count;
-      block b;
-      if(!parse_and_validate_block_from_blob(block_entry.block, b))
-      {
-        LOG_ERROR_CCONTEXT("sent wrong block: failed to parse and validate block: \r\n" 
-          << string_tools::buff_to_hex_nodelimer(block_entry.block) << "\r\n dropping connection");
-        m_p2p->drop_connection(context);
-        m_p2p->add_ip_fail(context.m_remote_ip);
-        return 1;
-      }      
-      //to avoid concurrency in core between connections, suspend connections which delivered block later then first one
-      if(count == 2)
-      { 
-        if(m_core.have_block(get_block_hash(b)))
-        {
-          context.m_state = currency_connection_context::state_idle;
-          context.m_needed_objects.clear();
-          context.m_requested_objects.clear();
-          LOG_PRINT_CCONTEXT_L1("Connection set to idle state.");
-          return 1;
-        }
-      }
-      
-      auto req_it = context.m_requested_objects.find(get_block_hash(b));
+    BOOST_FOREACH(const auto& pb, blocks)
+    {
+      auto req_it = context.m_requested_objects.find(pb.id);
       if(req_it == context.m_requested_objects.end())
       {
-        LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: block with id=" << string_tools::pod_to_hex(get_blob_hash(block_entry.block)) 
+        LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: block with id=" << string_tools::pod_to_hex(pb.id) 
           << " wasn't requested, dropping connection");
         m_p2p->drop_connection(context);
         return 1;
       }
-      if(b.tx_hashes.size() != block_entry.txs.size()) 
-      {
-        LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: block with id=" << string_tools::pod_to_hex(get_blob_hash(block_entry.block)) 
-          << ", tx_hashes.size()=" << b.tx_hashes.size() << " mismatch with block_complete_entry.m_txs.size()=" << block_entry.txs.size() << ", dropping connection");
-        m_p2p->drop_connection(context);
-        return 1;
-      }
-
       context.m_requested_objects.erase(req_it);
     }
     PROF_L2_FINISH(block_complete_entries_prevalidation_time);
 
-    PROF_L2_DO(syncing_conn_count_sum += get_synchronizing_connections_count(); ++syncing_conn_count_count);
-
     if(context.m_requested_objects.size())
     {
       LOG_PRINT_CCONTEXT_RED("returned not all requested objects (context.m_requested_objects.size()=" 
@@ -364,82 +383,192 @@ namespace currency
       return 1;
     }
 
-    PROF_L2_START(blocks_handle_time);
+#if PROFILING_LEVEL >= 2
+    LOG_PRINT_CCONTEXT_YELLOW("NOTIFY_RESPONSE_GET_OBJECTS: " << blocks.size() << " blocks were parsed in " << block_complete_entries_prevalidation_time / 1000
+      << " ms, syncing conns: " << get_synchronizing_connections_count(), LOG_LEVEL_1);
+#endif
+
+    size_t count = blocks.size();
+    if(!m_download_scheduler.add_blocks(context, blocks))
+      LOG_PRINT_CCONTEXT_L1("Span was requested from other connection meanwhile, " << count << " blocks ignored");
+
+    //keep next request in flight while validator thread (stage 3) handles blocks
+    request_missing_objects(context, true);
+    m_validator_cv.notify_one();
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_currency_protocol_handler<t_core>::parse_block_entry(const block_complete_entry& entry, block_download_scheduler::parsed_block& pb, std::string& err)
+  {
+    if(!parse_and_validate_block_from_blob(entry.block, pb.b))
     {
-      m_core.pause_mine();
-      misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler(
-        boost::bind(&t_core::resume_mine, &m_core));
+      err = "failed to parse and validate block: \r\n" + string_tools::buff_to_hex_nodelimer(entry.block);
+      return false;
+    }
+    pb.id = get_block_hash(pb.b);
+    pb.blob_size = entry.block.size();
+    if(pb.b.tx_hashes.size() != entry.txs.size())
+    {
+      err = "block with id=" + string_tools::pod_to_hex(pb.id) + ", tx_hashes.size()=" + std::to_string(pb.b.tx_hashes.size()) 
+        + " mismatch with block_complete_entry.m_txs.size()=" + std::to_string(entry.txs.size());
+      return false;
+    }
 
-      BOOST_FOREACH(const block_complete_entry& block_entry, arg.blocks)
+    std::unordered_set<crypto::hash> block_tx_ids(pb.b.tx_hashes.begin(), pb.b.tx_hashes.end());
+    pb.txs.resize(entry.txs.size());
+    size_t i = 0;
+    BOOST_FOREACH(const auto& tx_blob, entry.txs)
+    {
+      block_download_scheduler::parsed_tx& ptx = pb.txs[i++];
+      if(!parse_and_validate_tx_from_blob(tx_blob, ptx.tx, ptx.id, ptx.prefix_hash, ptx.blob_size))
       {
-        CHECK_STOP_FLAG_EXIT_IF_SET(1, "Blocks processing interrupted, connection dropped");
-        //process transactions
-        PROF_L1_START(transactions_process_time);
-        BOOST_FOREACH(auto& tx_blob, block_entry.txs)
-        {
-          CHECK_STOP_FLAG_EXIT_IF_SET(1, "Blocks processing interrupted, connection dropped");
-          tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-          m_core.handle_incoming_tx(tx_blob, tvc, true);
-          if(tvc.m_verifivation_failed)
-          {
-            LOG_ERROR_CCONTEXT("transaction verification failed on NOTIFY_RESPONSE_GET_OBJECTS, \r\ntx_id = " 
-              << string_tools::pod_to_hex(get_blob_hash(tx_blob)) << ", dropping connection");
-            m_p2p->drop_connection(context);
-            return 1;
-          }
-        }
-        PROF_L1_FINISH(transactions_process_time);
+        err = "failed to parse transaction of block with id=" + string_tools::pod_to_hex(pb.id);
+        return false;
+      }
+      if(!block_tx_ids.count(ptx.id))
+      {
+        err = "transaction with id=" + string_tools::pod_to_hex(ptx.id) + " doesn't belong to block with id=" + string_tools::pod_to_hex(pb.id);
+        return false;
+      }
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_currency_protocol_handler<t_core>::parse_block_entries(const std::list<block_complete_entry>& entries, std::vector<block_download_scheduler::parsed_block>& blocks, std::string& err)
+  {
+    std::vector<const block_complete_entry*> src;
+    src.reserve(entries.size());
+    BOOST_FOREACH(const auto& e, entries)
+      src.push_back(&e);
+    blocks.resize(src.size());
+    std::vector<std::string> errors(src.size());
+    if(src.empty())
+      return true;
 
-        //process block
-        PROF_L1_START(block_process_time);
-        block_verification_context bvc = boost::value_initialized<block_verification_context>();
+    std::atomic<bool> failed(false);
+    tools::thread_pool::instance().parallel_for(src.size(), [&](size_t i)
+    {
+      if(!failed && !parse_block_entry(*src[i], blocks[i], errors[i]))
+        failed = true;
+    });
 
-        m_core.handle_incoming_block(block_entry.block, bvc, false);
+    if(!failed)
+      return true;
+    for(auto& e : errors)
+    {
+      if(e.size())
+      {
+        err = e;
+        break;
+      }
+    }
+    return false;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_currency_protocol_handler<t_core>::validator_thread()
+  {
+    log_space::log_singletone::set_thread_log_prefix("[validator]");
+    while(!m_want_stop && !m_p2p->is_stop_signal_sent())
+    {
+      {
+        std::unique_lock<std::mutex> lk(m_validator_lock);
+        m_validator_cv.wait_for(lk, std::chrono::seconds(1), [&](){
+          return m_want_stop || m_download_scheduler.has_ready_span(m_core.get_current_blockchain_height());
+        });
+      }
+      handle_downloaded_spans();
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_currency_protocol_handler<t_core>::handle_downloaded_spans()
+  {
+    block_download_scheduler::span sp = AUTO_VAL_INIT(sp);
+    while(m_download_scheduler.pop_ready_span(m_core.get_current_blockchain_height(), sp))
+    {
+      if(m_p2p->is_stop_signal_sent() || m_want_stop)
+      {
+        LOG_PRINT_YELLOW("Stop flag detected, blocks processing interrupted", LOG_LEVEL_0);
+        return;
+      }
+      if(!handle_span_blocks(sp))
+      {
+        //peer sent us wrong blocks: drop it, its spans will be downloaded again from other peers
+        m_download_scheduler.drop_connection_spans(sp.connection);
+        m_p2p->drop_connection(sp.connection);
+        m_p2p->add_ip_fail(sp.connection.m_remote_ip);
+        continue;
+      }
 
-        if(bvc.m_verifivation_failed)
-        {
-          LOG_PRINT_CCONTEXT_L0("Block verification failed, dropping connection");
-          m_p2p->drop_connection(context);
-          m_p2p->add_ip_fail(context.m_remote_ip);
-          return 1;
-        }
-        if(bvc.m_marked_as_orphaned)
+      uint64_t current_height = m_core.get_current_blockchain_height();
+      uint64_t max_height = std::max<uint64_t>(m_max_height_seen, current_height);
+      LOG_PRINT_YELLOW(">>>>>>>>> sync progress: " << sp.blocks.size() << " blocks added, now have "
+        << current_height << " of " << max_height
+        << " ( " << std::fixed << std::setprecision(2) << current_height * 100.0 / max_height << "% ) and "
+        << max_height - current_height << " blocks left, "
+        << m_download_scheduler.get_buffered_blocks_count() << " blocks buffered"
+        , LOG_LEVEL_0);
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_currency_protocol_handler<t_core>::handle_span_blocks(const block_download_scheduler::span& sp)
+  {
+    PROF_L2_START(blocks_handle_time);
+    m_core.pause_mine();
+    misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler(
+      boost::bind(&t_core::resume_mine, &m_core));
+
+    BOOST_FOREACH(const auto& pb, sp.blocks)
+    {
+      if(m_p2p->is_stop_signal_sent() || m_want_stop)
+        return true;
+      //process transactions
+      PROF_L1_START(transactions_process_time);
+      BOOST_FOREACH(const auto& ptx, pb.txs)
+      {
+        tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+        m_core.handle_incoming_tx(ptx.tx, ptx.id, ptx.prefix_hash, ptx.blob_size, tvc, true);
+        if(tvc.m_verifivation_failed)
         {
-          LOG_PRINT_CCONTEXT_L0("Block received at sync phase was marked as orphaned, dropping connection");
-          m_p2p->drop_connection(context);
-          m_p2p->add_ip_fail(context.m_remote_ip);
-          return 1;
+          LOG_ERROR("[" << net_utils::print_connection_context_short(sp.connection) << "] transaction verification failed on NOTIFY_RESPONSE_GET_OBJECTS, \r\ntx_id = "
+            << string_tools::pod_to_hex(ptx.id) << ", dropping connection");
+          return false;
         }
+      }
+      PROF_L1_FINISH(transactions_process_time);
 
-        PROF_L1_FINISH(block_process_time);
-        PROF_L1_DO(LOG_PRINT_CCONTEXT_L2("Block process time: " << print_mcsec_as_ms(block_process_time + transactions_process_time) << "(" << print_mcsec_as_ms(transactions_process_time) << "/" << print_mcsec_as_ms(block_process_time) << ") ms"));
+      //process block
+      PROF_L1_START(block_process_time);
+      block_verification_context bvc = boost::value_initialized<block_verification_context>();
 
-        PROF_L2_DO(syncing_conn_count_sum += get_synchronizing_connections_count(); ++syncing_conn_count_count);
+      m_core.handle_incoming_block(pb.b, pb.id, pb.blob_size, bvc, false);
+
+      if(bvc.m_verifivation_failed)
+      {
+        LOG_PRINT_L0("[" << net_utils::print_connection_context_short(sp.connection) << "] Block verification failed, dropping connection");
+        return false;
       }
+      if(bvc.m_marked_as_orphaned)
+      {
+        LOG_PRINT_L0("[" << net_utils::print_connection_context_short(sp.connection) << "] Block received at sync phase was marked as orphaned, dropping connection");
+        return false;
+      }
+
+      PROF_L1_FINISH(block_process_time);
+      PROF_L1_DO(LOG_PRINT_L2("[" << net_utils::print_connection_context_short(sp.connection) << "] Block process time: " << print_mcsec_as_ms(block_process_time + transactions_process_time) << "(" << print_mcsec_as_ms(transactions_process_time) << "/" << print_mcsec_as_ms(block_process_time) << ") ms"));
     }
     PROF_L2_FINISH(blocks_handle_time);
-    
-    uint64_t current_height = m_core.get_current_blockchain_height();
-    LOG_PRINT_CCONTEXT_YELLOW(">>>>>>>>> sync progress: " << arg.blocks.size() << " blocks added, now have "
-      << current_height << " of " << context.m_remote_blockchain_height
-      << " ( " << std::fixed << std::setprecision(2) << current_height * 100.0 / context.m_remote_blockchain_height << "% ) and "
-      << context.m_remote_blockchain_height - current_height << " blocks left"
-      , LOG_LEVEL_0);
-    
-    
 
 #if PROFILING_LEVEL >= 2
-    double syncing_conn_count_av = syncing_conn_count_sum / static_cast<double>(syncing_conn_count_count);
-    size_t blocks_count = arg.blocks.size();
-    LOG_PRINT_CCONTEXT_YELLOW("NOTIFY_RESPONSE_GET_OBJECTS: " << blocks_count << " blocks were prevalidated in " << block_complete_entries_prevalidation_time / 1000
-      << " ms (" << std::fixed << std::setprecision(2) << block_complete_entries_prevalidation_time / 1000.0f / blocks_count << " ms per block av) and handled in " << blocks_handle_time / 1000
-      << " ms (" << std::fixed << std::setprecision(2) << blocks_handle_time / 1000.0f / blocks_count << " ms per block av)"
-      << " syncing conns av: " << std::fixed << std::setprecision(2) << syncing_conn_count_av, LOG_LEVEL_1);
+    size_t blocks_count = sp.blocks.size();
+    LOG_PRINT_YELLOW("[" << net_utils::print_connection_context_short(sp.connection) << "] span " << sp.start_height << ": " << blocks_count << " blocks handled in " << blocks_handle_time / 1000
+      << " ms (" << std::fixed << std::setprecision(2) << blocks_handle_time / 1000.0f / std::max<size_t>(blocks_count, 1) << " ms per block av)", LOG_LEVEL_1);
 #endif
-
-
-    request_missing_objects(context, true);
-    return 1;
+    return true;
   }
 #undef CHECK_STOP_FLAG__DROP_AND_RETURN_IF_SET
   //------------------------------------------------------------------------------------------------------------------------
@@ -458,6 +587,19 @@ namespace currency
       return true;
     });
 
+    //wake up connections that had nothing to download
+    std::list<epee::net_utils::connection_context_base> waiting;
+    m_p2p->for_each_connection([&](currency_connection_context& context, nodetool::peerid_type peer_id)->bool{
+      if (context.m_state == currency_connection_context::state_synchronizing && context.m_sync_waiting)
+      {
+        ++context.m_callback_request_count;
+        waiting.push_back(context);
+      }
+      return true;
+    });
+    BOOST_FOREACH(const auto& context, waiting)
+      m_p2p->request_callback(context);
+
     if (count_total && count_synced && count_synced >= count_total / 2 && !m_synchronized)
     {
       on_connection_synchronized();
@@ -491,24 +633,30 @@ namespace currency
   template<class t_core> 
   bool t_currency_protocol_handler<t_core>::request_missing_objects(currency_connection_context& context, bool check_having_blocks)
   {
+    if(check_having_blocks)
+    {
+      while(context.m_needed_objects.size() && m_core.have_block(context.m_needed_objects.front()))
+      {
+        context.m_needed_objects.pop_front();
+        ++context.m_needed_objects_height;
+      }
+    }
+
     if(context.m_needed_objects.size())
     {
-      //we know objects that we need, request this objects
+      //we know objects that we need, request span of them that is not being downloaded from other peers
       NOTIFY_REQUEST_GET_OBJECTS::request req;
-      size_t count = 0;
-      auto it = context.m_needed_objects.begin();
-
-      while(it != context.m_needed_objects.end() && count < BLOCKS_SYNCHRONIZING_DEFAULT_COUNT)
+      uint64_t span_height = 0;
+      if(!m_download_scheduler.reserve_span(context, m_core.get_current_blockchain_height(), context.m_needed_objects_height, context.m_needed_objects, span_height, req.blocks))
       {
-        if( !(check_having_blocks && m_core.have_block(*it)))
-        {
-          req.blocks.push_back(*it);
-          ++count;
-          context.m_requested_objects.insert(*it);
-        }
-        context.m_needed_objects.erase(it++);
+        context.m_sync_waiting = true;
+        LOG_PRINT_CCONTEXT_L2("nothing to request now (" << context.m_needed_objects.size() << " needed objects are being downloaded from other peers or too far ahead), waiting");
+        return true;
       }
-      LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_GET_OBJECTS: blocks.size()=" << req.blocks.size() << ", txs.size()=" << req.txs.size());
+      //ids stay in m_needed_objects until their blocks are in blockchain: if span of other peer is dropped,
+      //this connection can reserve it later
+      context.m_requested_objects.insert(req.blocks.begin(), req.blocks.end());
+      LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_GET_OBJECTS: blocks.size()=" << req.blocks.size() << " from height " << span_height << ", txs.size()=" << req.txs.size());
       post_notify<NOTIFY_REQUEST_GET_OBJECTS>(req, context);    
     }else if(context.m_last_response_height < context.m_remote_blockchain_height-1)
     {//we have to fetch more objects ids, request blockchain entry
@@ -517,6 +665,21 @@ namespace currency
       m_core.get_short_chain_history(r.block_ids);
       LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size() );
       post_notify<NOTIFY_REQUEST_CHAIN>(r, context);
+    }else if(m_core.get_current_blockchain_height() < context.m_remote_blockchain_height && m_download_scheduler.get_spans_count())
+    {
+      uint64_t core_height = m_core.get_current_blockchain_height();
+      if(m_download_scheduler.has_span_at(core_height))
+      {
+        //everything this peer have is requested, but spans from other peers are not in blockchain yet
+        context.m_sync_waiting = true;
+      }else
+      {
+        //nobody downloads next block (its span was dropped), fetch ids again
+        NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
+        m_core.get_short_chain_history(r.block_ids);
+        LOG_PRINT_CCONTEXT_L2("no span covers height " << core_height << ", -->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size());
+        post_notify<NOTIFY_REQUEST_CHAIN>(r, context);
+      }
     }else
     { 
       CHECK_AND_ASSERT_MES(context.m_last_response_height == context.m_remote_blockchain_height-1 
@@ -599,11 +762,15 @@ namespace currency
       m_p2p->drop_connection(context);
     }
 
+    context.m_needed_objects.clear();
+    context.m_needed_objects_height = arg.start_height;
     BOOST_FOREACH(auto& bl_id, arg.m_block_ids)
     {
       if (check_stop_flag_and_exit(context))
         return true;
-      if(!m_core.have_block(bl_id))
+      if(context.m_needed_objects.empty() && m_core.have_block(bl_id))
+        ++context.m_needed_objects_height;
+      else
         context.m_needed_objects.push_back(bl_id);
     }
 
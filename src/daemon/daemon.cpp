@@ -172,6 +172,9 @@ int main(int argc, char* argv[])
   //setting checkpoints  here
   ccore.set_checkpoints(std::move(checkpoints));
 
+  res = cprotocol.start();
+  CHECK_AND_ASSERT_MES(res, 1, "Failed to start currency protocol.");
+
 
   // start components
   if (!command_line::has_arg(vm, command_line::arg_console))
@@ -199,12 +202,12 @@ int main(int argc, char* argv[])
   rpc_server.timed_wait_server_stop(5000);
 
   //deinitialize components
+  LOG_PRINT_L0("Deinitializing currency_protocol...");
+  cprotocol.deinit(); //stops block validator thread, which works with core
   LOG_PRINT_L0("Deinitializing core...");
   ccore.deinit();
   LOG_PRINT_L0("Deinitializing rpc server ...");
   rpc_server.deinit();
-  LOG_PRINT_L0("Deinitializing currency_protocol...");
-  cprotocol.deinit();
   LOG_PRINT_L0("Deinitializing p2p...");
   p2psrv.deinit();
 
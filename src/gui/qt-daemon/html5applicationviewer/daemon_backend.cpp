@@ -239,6 +239,9 @@ void daemon_backend::main_worker(const po::variables_map& vm)
   CHECK_AND_ASSERT_AND_SET_GUI(res, void(), "Failed to initialize checkpoints");
   m_ccore.set_checkpoints(std::move(checkpoints));
 
+  res = m_cprotocol.start();
+  CHECK_AND_ASSERT_AND_SET_GUI(res, void(), "Failed to start currency protocol.");
+
   LOG_PRINT_L0("Starting core rpc server...");
   dsi.text_state = "Starting core rpc server";
   m_pview->update_daemon_status(dsi);
@@ -284,6 +287,12 @@ void daemon_backend::main_worker(const po::variables_map& vm)
 
   //deinitialize components
 
+  LOG_PRINT_L0("Deinitializing currency_protocol...");
+  dsi.text_state = "Deinitializing currency_protocol";
+  m_pview->update_daemon_status(dsi);
+  m_cprotocol.deinit(); //stops block validator thread, which works with core
+
+
   LOG_PRINT_L0("Deinitializing core...");
   dsi.text_state = "Deinitializing core";
   m_pview->update_daemon_status(dsi);
@@ -296,12 +305,6 @@ void daemon_backend::main_worker(const po::variables_map& vm)
   m_rpc_server.deinit();
 
 
-  LOG_PRINT_L0("Deinitializing currency_protocol...");
-  dsi.text_state = "Deinitializing currency_protocol";
-  m_pview->update_daemon_status(dsi);
-  m_cprotocol.deinit();
-
-
   LOG_PRINT_L0("Deinitializing p2p...");
   dsi.text_state = "Deinitializing p2p";
   m_pview->update_daemon_status(dsi);
@@ -324,26 +324,33 @@ namespace mining
   //--------------------------------------------------------------------------------------------------------------------------------
   void simpleminer::worker_thread(uint64_t start_nonce, uint32_t nonce_offset, std::atomic<uint32_t> *result, std::atomic<bool> *do_reset, std::atomic<bool> *done) {
     // printf("Worker thread starting at %lu + %u\n", start_nonce, nonce_offset);
-    currency::blobdata blob = m_job.blob;
+    //nonces are hashed in batches, one per simd lane (attempts_per_loop is multiple of any lanes count)
+    const size_t lanes = crypto::wild_keccak_multi_lanes();
+    std::vector<currency::blobdata> blobs(lanes, m_job.blob);
+    std::vector<const uint8_t*> inputs(lanes);
+    std::vector<crypto::hash> hashes(lanes);
+    for (size_t l = 0; l != lanes; l++)
+      inputs[l] = reinterpret_cast<const uint8_t*>(blobs[l].data());
+
     while (!*do_reset) {
       m_hashes_done += attempts_per_loop;
-      for (int i = 0; i < attempts_per_loop; i++) {
-        (*reinterpret_cast<uint64_t*>(&blob[1])) = (start_nonce+nonce_offset);
-        crypto::hash h = currency::null_hash;
-        currency::get_blob_longhash(blob, h, m_job.prev_hi.height+1, [&](uint64_t index) -> crypto::hash&
-        {
-          return m_fast_scratchpad[index%m_scratchpad.size()];
-        });
+      for (int i = 0; i < attempts_per_loop; i += lanes) {
+        for (size_t l = 0; l != lanes; l++)
+          (*reinterpret_cast<uint64_t*>(&blobs[l][1])) = (start_nonce + nonce_offset + l);
+        crypto::wild_keccak_dbl_multi(&inputs[0], m_job.blob.size(), &hashes[0], lanes, m_fast_scratchpad, m_scratchpad.size());
 
-        if( currency::check_hash(h, m_job.difficulty))
+        for (size_t l = 0; l != lanes; l++)
         {
-          (*result) = nonce_offset;
-          (*done) = true;
-          (*do_reset) = true;
-          m_work_done_cond.notify_one();
-          return;
+          if( currency::check_hash(hashes[l], m_job.difficulty))
+          {
+            (*result) = nonce_offset + l;
+            (*done) = true;
+            (*do_reset) = true;
+            m_work_done_cond.notify_one();
+            return;
+          }
         }
-        nonce_offset++;
+        nonce_offset += lanes;
       }
       nonce_offset += ((m_threads_total-1) * attempts_per_loop);
     }
@@ -130,28 +130,14 @@ namespace currency
     CHECK_CORE_READY();
 
     PROF_L2_START(find_blockchain_supplement_time);
-    std::list<std::pair<block, std::list<transaction> > > bs;
-    if(!m_core.find_blockchain_supplement(req.block_ids, bs, res.current_height, res.start_height, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT))
+    //blobs go to response as they stored in db
+    if(!m_core.find_blockchain_supplement(req.block_ids, res.blocks, res.current_height, res.start_height, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT))
     {
       res.status = "Failed";
       return false;
     }
     PROF_L2_FINISH(find_blockchain_supplement_time);
-
-    PROF_L2_START(bs_to_res_time);
-    size_t txs_count = 0;
-    for (auto& b : bs)
-    {
-      res.blocks.resize(res.blocks.size()+1);
-      res.blocks.back().block = block_to_blob(b.first);
-      for(auto& t : b.second)
-      {
-        res.blocks.back().txs.push_back(tx_to_blob(t));
-        ++txs_count;
-      }
-    }
-    PROF_L2_FINISH(bs_to_res_time);
-    PROF_L2_LOG_PRINT("RPC: on_get_blocks: " << res.blocks.size() << " blocks, " << txs_count << " txs, timings: " << print_mcsec_as_ms(find_blockchain_supplement_time) << "/" << print_mcsec_as_ms(bs_to_res_time), LOG_LEVEL_1);
+    PROF_L2_LOG_PRINT("RPC: on_get_blocks: " << res.blocks.size() << " blocks, timings: " << print_mcsec_as_ms(find_blockchain_supplement_time), LOG_LEVEL_1);
 
     res.status = CORE_RPC_STATUS_OK;
     return true;
@@ -1153,31 +1139,17 @@ bool core_rpc_server::f_getMixin(const transaction& transaction, uint64_t& mixin
     crypto::hash h = null_hash;
     bool r = string_tools::hex_to_pod(hi.block_id, h);
     CHECK_AND_ASSERT_MES(r, false, "wrong block_id parameter passed: " << hi.block_id);
-        
-
-    crypto::hash block_chain_id = m_core.get_blockchain_storage().get_block_id_by_height(hi.height);
-    CHECK_AND_ASSERT_MES(block_chain_id != null_hash, false, "internal error: can't get block id by height: " << hi.height);
-    uint64_t height = hi.height;
-    if(block_chain_id != h)
-    {
-      //probably split
-      CHECK_AND_ASSERT_MES(hi.height > 0, false, "wrong height passed");
-      --height;
-    }
 
-    std::list<block> blocks;
-    r = m_core.get_blockchain_storage().get_blocks(height + 1, m_core.get_current_blockchain_height() - (height+1), blocks);
-    CHECK_AND_ASSERT_MES(r, false, "failed to get blocks");
-    for(auto it = blocks.begin(); it!= blocks.end(); it++)
+    std::list<blockchain_storage::block_addendum_entry_ptr> entries;
+    r = m_core.get_blockchain_storage().get_addendums_since(hi.height, h, entries);
+    CHECK_AND_ASSERT_MES(r, false, "failed to get addendums");
+    BOOST_FOREACH(const auto& e, entries)
     {
       res.push_back(mining::addendum());
-      res.back().hi.height = get_block_height(*it);
-      res.back().hi.block_id = string_tools::pod_to_hex(get_block_hash(*it));
-      res.back().prev_id = string_tools::pod_to_hex(it->prev_id);
-      std::vector<crypto::hash> ad;
-      r = get_block_scratchpad_addendum(*it, ad);
-      CHECK_AND_ASSERT_MES(r, false, "Failed to add block addendum");
-      addendum_to_hexstr(ad, res.back().addm);      
+      res.back().hi.height = e->height;
+      res.back().hi.block_id = string_tools::pod_to_hex(e->id);
+      res.back().prev_id = string_tools::pod_to_hex(e->prev_id);
+      res.back().addm = e->addendum_hex;
     }
     return true;
   }
@@ -1389,6 +1361,36 @@ bool core_rpc_server::f_getMixin(const transaction& transaction, uint64_t& mixin
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_addendums_bin(const mining::COMMAND_RPC_GET_ADDENDUMS_BIN::request& req, mining::COMMAND_RPC_GET_ADDENDUMS_BIN::response& res, connection_context& cntx)
+  {
+    if (!check_core_ready())
+    {
+      res.status = CORE_RPC_STATUS_BUSY;
+      return true;
+    }
+
+    std::list<blockchain_storage::block_addendum_entry_ptr> entries;
+    if (!req.height)
+    {
+      res.top_id = m_core.get_blockchain_storage().get_top_block_id(res.top_height);
+    }
+    else if (!m_core.get_blockchain_storage().get_addendums_since(req.height, req.block_id, entries, res.top_id, res.top_height))
+    {
+      res.status = "Fail at get_addendums_since, check daemon logs for details";
+      return true;
+    }
+    BOOST_FOREACH(const auto& e, entries)
+    {
+      res.addms.push_back(mining::addendum_bin());
+      res.addms.back().height = e->height;
+      res.addms.back().id = e->id;
+      res.addms.back().prev_id = e->prev_id;
+      res.addms.back().addm = e->addendum;
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_addendums(const COMMAND_RPC_GET_ADDENDUMS::request& req, COMMAND_RPC_GET_ADDENDUMS::response& res, epee::json_rpc::error& error_resp, connection_context& cntx)
   {
     if (!check_core_ready())
@@ -1413,6 +1415,22 @@ bool core_rpc_server::f_getMixin(const transaction& transaction, uint64_t& mixin
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_tx_pool_stats(const COMMAND_RPC_GET_TX_POOL_STATS::request& req, COMMAND_RPC_GET_TX_POOL_STATS::response& res, connection_context& cntx)
+  {
+    tx_memory_pool::pool_stats st = AUTO_VAL_INIT(st);
+    m_core.get_tx_pool().get_stats(st);
+    res.tx_count = st.tx_count;
+    res.kept_by_block_count = st.kept_by_block_count;
+    res.blobs_size = st.blobs_size;
+    res.memory_usage = st.memory_usage;
+    res.max_memory_usage = st.max_memory_usage;
+    res.max_count = st.max_count;
+    res.evicted_count = st.evicted_count;
+    res.fee_floor_per_kb = st.fee_floor_per_kb;
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_validate_signed_text(const COMMAND_RPC_VALIDATE_SIGNED_TEXT::request& req, COMMAND_RPC_VALIDATE_SIGNED_TEXT::response& res, connection_context& cntx)
   {
 
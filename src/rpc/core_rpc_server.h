@@ -64,6 +64,7 @@ namespace currency
     bool on_alias_by_address(const COMMAND_RPC_GET_ALIASES_BY_ADDRESS::request& req, COMMAND_RPC_GET_ALIASES_BY_ADDRESS::response& res, epee::json_rpc::error& error_resp, connection_context& cntx);
     bool on_get_addendums(const COMMAND_RPC_GET_ADDENDUMS::request& req, COMMAND_RPC_GET_ADDENDUMS::response& res, epee::json_rpc::error& error_resp, connection_context& cntx);
     bool on_reset_transaction_pool(const COMMAND_RPC_RESET_TX_POOL::request& req, COMMAND_RPC_RESET_TX_POOL::response& res, connection_context& cntx);
+    bool on_get_tx_pool_stats(const COMMAND_RPC_GET_TX_POOL_STATS::request& req, COMMAND_RPC_GET_TX_POOL_STATS::response& res, connection_context& cntx);
     bool on_validate_signed_text(const COMMAND_RPC_VALIDATE_SIGNED_TEXT::request& req, COMMAND_RPC_VALIDATE_SIGNED_TEXT::response& res, connection_context& cntx);
 
     
@@ -74,6 +75,7 @@ namespace currency
     bool on_submit(const mining::COMMAND_RPC_SUBMITSHARE::request& req, mining::COMMAND_RPC_SUBMITSHARE::response& res, connection_context& cntx);
     bool on_store_scratchpad(const mining::COMMAND_RPC_STORE_SCRATCHPAD::request& req, mining::COMMAND_RPC_STORE_SCRATCHPAD::response& res, connection_context& cntx);
     bool on_getfullscratchpad2(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response_info, connection_context& cntx);
+    bool on_get_addendums_bin(const mining::COMMAND_RPC_GET_ADDENDUMS_BIN::request& req, mining::COMMAND_RPC_GET_ADDENDUMS_BIN::response& res, connection_context& cntx);
 
     
 
@@ -96,6 +98,7 @@ namespace currency
       MAP_URI_AUTO_JON2("/getinfo", on_get_info, COMMAND_RPC_GET_INFO)
       MAP_URI_AUTO_JON2_IF("/stop_daemon", on_stop_daemon, COMMAND_RPC_STOP_DAEMON, !m_restricted)
       MAP_URI2("/getfullscratchpad2", on_getfullscratchpad2)
+      MAP_URI_AUTO_BIN2("/getaddendums.bin", on_get_addendums_bin, mining::COMMAND_RPC_GET_ADDENDUMS_BIN)
       BEGIN_JSON_RPC_MAP("/json_rpc")
         MAP_JON_RPC("getblockcount",             on_getblockcount,              COMMAND_RPC_GETBLOCKCOUNT)
         MAP_JON_RPC_WE("on_getblockhash",        on_getblockhash,               COMMAND_RPC_GETBLOCKHASH)
@@ -113,6 +116,7 @@ namespace currency
         MAP_JON_RPC_WE("f_transaction_json",     f_on_transaction_json,         F_COMMAND_RPC_GET_TRANSACTION_DETAILS)
         MAP_JON_RPC_WE("f_pool_json",            f_on_pool_json,                F_COMMAND_RPC_GET_POOL)
         MAP_JON_RPC_IF("reset_transaction_pool", on_reset_transaction_pool,     COMMAND_RPC_RESET_TX_POOL, !m_restricted)
+        MAP_JON_RPC("get_tx_pool_stats",         on_get_tx_pool_stats,          COMMAND_RPC_GET_TX_POOL_STATS)
         MAP_JON_RPC_WE("getblock",               on_getblock,                   COMMAND_RPC_GETBLOCK)
         MAP_JON_RPC("relay_txs",              on_relay_txs_to_net,           COMMAND_RPC_RELAY_TXS)
         MAP_JON_RPC("validate_signed_text",      on_validate_signed_text,       COMMAND_RPC_VALIDATE_SIGNED_TEXT)
@@ -704,6 +704,40 @@ struct EMPTY_STRUCT {
       END_KV_SERIALIZE_MAP()
     };
   };
+  struct COMMAND_RPC_GET_TX_POOL_STATS
+  {
+
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      uint64_t tx_count;
+      uint64_t kept_by_block_count;
+      uint64_t blobs_size;
+      uint64_t memory_usage;
+      uint64_t max_memory_usage;
+      uint64_t max_count;
+      uint64_t evicted_count;
+      uint64_t fee_floor_per_kb;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(tx_count)
+        KV_SERIALIZE(kept_by_block_count)
+        KV_SERIALIZE(blobs_size)
+        KV_SERIALIZE(memory_usage)
+        KV_SERIALIZE(max_memory_usage)
+        KV_SERIALIZE(max_count)
+        KV_SERIALIZE(evicted_count)
+        KV_SERIALIZE(fee_floor_per_kb)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
 struct F_COMMAND_RPC_GET_POOL
 {
   typedef std::vector<std::string> request;
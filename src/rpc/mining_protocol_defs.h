@@ -34,6 +34,22 @@ namespace mining
     END_KV_SERIALIZE_MAP()
   };
 
+  //compact form of addendum for binary rpc: raw hashes instead of hex strings
+  struct addendum_bin
+  {
+    uint64_t height;
+    crypto::hash id;
+    crypto::hash prev_id;
+    std::vector<crypto::hash> addm;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(height)
+      KV_SERIALIZE_VAL_POD_AS_BLOB(id)
+      KV_SERIALIZE_VAL_POD_AS_BLOB(prev_id)
+      KV_SERIALIZE_CONTAINER_POD_AS_BLOB(addm)
+    END_KV_SERIALIZE_MAP()
+  };
+
   struct job_details
   {
     std::string blob;
@@ -169,6 +185,36 @@ namespace mining
   };
 
 
+  struct COMMAND_RPC_GET_ADDENDUMS_BIN
+  {
+    struct request
+    {
+      uint64_t height;
+      crypto::hash block_id;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(height)
+        KV_SERIALIZE_VAL_POD_AS_BLOB(block_id)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      uint64_t top_height;
+      crypto::hash top_id;
+      std::list<addendum_bin> addms;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(top_height)
+        KV_SERIALIZE_VAL_POD_AS_BLOB(top_id)
+        KV_SERIALIZE(addms)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+
   struct COMMAND_RPC_STORE_SCRATCHPAD
   {
     RPC_METHOD_NAME("store_scratchpad");
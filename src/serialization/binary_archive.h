@@ -8,8 +8,11 @@
 #pragma once
 
 #include <cassert>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <iterator>
+#include <string>
 #include <boost/type_traits/make_unsigned.hpp>
 
 #include "common/varint.h"
@@ -168,4 +171,201 @@ struct binary_archive<true> : public binary_archive_base<std::ostream, true>
   }
 };
 
+/* binary_buffer_archive
+ *
+ * Same format as binary_archive, but reads from / writes to contiguous memory directly,
+ * without std::iostream machinery. Streams below implement only the part of std::ios
+ * state interface that serializers use (good/setstate/rdstate/clear/peek). */
+
+class binary_buffer_istream
+{
+public:
+  binary_buffer_istream(const char* data, size_t size) : cur_(data), end_(data + size), state_(std::ios_base::goodbit) { }
+
+  bool good() const { return state_ == std::ios_base::goodbit; }
+  std::ios_base::iostate rdstate() const { return state_; }
+  void setstate(std::ios_base::iostate s) { state_ |= s; }
+  void clear(std::ios_base::iostate s = std::ios_base::goodbit) { state_ = s; }
+
+  int peek()
+  {
+    if (cur_ == end_)
+    {
+      setstate(std::ios_base::eofbit);
+      return EOF;
+    }
+    return static_cast<unsigned char>(*cur_);
+  }
+
+  bool read(void *buf, size_t len)
+  {
+    if (static_cast<size_t>(end_ - cur_) < len)
+    {
+      cur_ = end_;
+      setstate(std::ios_base::eofbit | std::ios_base::failbit);
+      return false;
+    }
+    memcpy(buf, cur_, len);
+    cur_ += len;
+    return true;
+  }
+
+  size_t remaining_bytes() const { return good() ? end_ - cur_ : 0; }
+
+  const char *&cur() { return cur_; }
+  const char *end() const { return end_; }
+private:
+  const char *cur_;
+  const char *end_;
+  std::ios_base::iostate state_;
+};
+
+class binary_buffer_ostream
+{
+public:
+  explicit binary_buffer_ostream(std::string &buf) : buf_(buf), state_(std::ios_base::goodbit) { }
+
+  bool good() const { return state_ == std::ios_base::goodbit; }
+  std::ios_base::iostate rdstate() const { return state_; }
+  void setstate(std::ios_base::iostate s) { state_ |= s; }
+  void clear(std::ios_base::iostate s = std::ios_base::goodbit) { state_ = s; }
+
+  void put(char c) { buf_.push_back(c); }
+  void write(const void *buf, size_t len) { buf_.append(static_cast<const char *>(buf), len); }
+
+  std::string &buffer() { return buf_; }
+private:
+  std::string &buf_;
+  std::ios_base::iostate state_;
+};
+
+template <bool W>
+struct binary_buffer_archive;
+
+template <>
+struct binary_buffer_archive<false> : public binary_archive_base<binary_buffer_istream, false>
+{
+  explicit binary_buffer_archive(stream_type &s) : base_type(s), canonical_(true) { }
+
+  template <class T>
+  void serialize_int(T &v)
+  {
+    serialize_uint(*(typename boost::make_unsigned<T>::type *)&v);
+  }
+
+  template <class T>
+  void serialize_uint(T &v, size_t width = sizeof(T))
+  {
+    unsigned char buf[sizeof(T)];
+    assert(width <= sizeof(T));
+    T ret = 0;
+    if (stream_.read(buf, width))
+    {
+      for (size_t i = 0; i < width; i++)
+        ret |= static_cast<T>(buf[i]) << (i * 8);
+    }
+    v = ret;
+  }
+  void serialize_blob(void *buf, size_t len, const char *delimiter="") { stream_.read(buf, len); }
+
+  template <class T>
+  void serialize_varint(T &v)
+  {
+    serialize_uvarint(*(typename boost::make_unsigned<T>::type *)(&v));
+  }
+
+  template <class T>
+  void serialize_uvarint(T &v)
+  {
+    //failures are ignored exactly like in binary_archive<false>, so both archives accept the same blobs,
+    //but they are remembered: data with such varints is not what serializing the parsed object gives
+    const char *end = stream_.end();
+    int r = tools::read_varint<std::numeric_limits<T>::digits>(stream_.cur(), end, v);
+    if (r <= 0 || (static_cast<unsigned char>(stream_.cur()[-1]) & 0x80))
+      canonical_ = false;
+  }
+  void begin_array(size_t &s)
+  {
+    serialize_varint(s);
+  }
+  void begin_array() { }
+
+  void delimit_array() { }
+  void end_array() { }
+
+  void begin_string(const char *delimiter="\"") { }
+  void end_string(const char *delimiter="\"") { }
+
+  void read_variant_tag(variant_tag_type &t) {
+    serialize_int(t);
+  }
+
+  size_t remaining_bytes() { return stream_.remaining_bytes(); }
+
+  //true if all varints read so far were in canonical form
+  bool is_canonical() const { return canonical_; }
+private:
+  bool canonical_;
+};
+
+template <>
+struct binary_buffer_archive<true> : public binary_archive_base<binary_buffer_ostream, true>
+{
+  explicit binary_buffer_archive(stream_type &s) : base_type(s) { }
+
+  template <class T>
+  void serialize_int(T v)
+  {
+    serialize_uint(static_cast<typename boost::make_unsigned<T>::type>(v));
+  }
+  template <class T>
+  void serialize_uint(T v)
+  {
+    char buf[sizeof(T)];
+    for (size_t i = 0; i < sizeof(T); i++) {
+      buf[i] = (char)(v & 0xff);
+      if (1 < sizeof(T)) {
+        v >>= 8;
+      }
+    }
+    stream_.write(buf, sizeof(T));
+  }
+  void serialize_blob(void *buf, size_t len, const char *delimiter="") { stream_.write(buf, len); }
+
+  template <class T>
+  void serialize_varint(T &v)
+  {
+    serialize_uvarint(*(typename boost::make_unsigned<T>::type *)(&v));
+  }
+
+  template <class T>
+  void serialize_uvarint(T &v)
+  {
+    tools::write_varint(std::back_inserter(stream_.buffer()), v);
+  }
+  void begin_array(size_t s)
+  {
+    serialize_varint(s);
+  }
+  void begin_array() { }
+  void delimit_array() { }
+  void end_array() { }
+
+  void begin_string(const char *delimiter="\"") { }
+  void end_string(const char *delimiter="\"") { }
+
+  void write_variant_tag(variant_tag_type t) {
+    serialize_int(t);
+  }
+};
+
+//variant tags registered for binary_archive with VARIANT_TAG are valid for binary_buffer_archive as well
+template <class Archive, class T>
+struct variant_serialization_traits;
+
+template <bool W, class T>
+struct variant_serialization_traits<binary_buffer_archive<W>, T> : public variant_serialization_traits<binary_archive<W>, T>
+{
+};
+
 POP_WARNINGS
@@ -43,6 +43,7 @@ namespace
   const command_line::arg_descriptor<std::string> arg_password = {"password", "Wallet password", "", true};
   const command_line::arg_descriptor<std::string> arg_restore_seed = { "restore-seed", "Restore wallet from the 24-word seed", ""};
   const command_line::arg_descriptor<int> arg_daemon_port = { "daemon-port", "Use daemon instance at port <arg> instead of default", 0 };
+  const command_line::arg_descriptor<size_t> arg_refresh_threads = { "refresh-threads", "Number of threads that scan blocks on refresh, 0 - number of CPU cores", 0 };
   const command_line::arg_descriptor<uint32_t> arg_log_level = {"set_log", "", 0, true};
 
   const command_line::arg_descriptor< std::vector<std::string> > arg_command = {"command", ""};
@@ -167,6 +168,7 @@ bool simple_wallet::help(const std::vector<std::string> &args/* = std::vector<st
 
 simple_wallet::simple_wallet()
   : m_daemon_port(0)
+  , m_refresh_threads(0)
   , m_refresh_progress_reporter(*this)
 {
   m_cmd_binder.set_handler("start_mining", boost::bind(&simple_wallet::start_mining, this, _1), "start_mining <threads_count> - Start mining in daemon");
@@ -301,6 +303,7 @@ void simple_wallet::handle_command_line(const boost::program_options::variables_
   m_daemon_port    = command_line::get_arg(vm, arg_daemon_port);
   m_restore_wallet = command_line::get_arg(vm, arg_restore_wallet);
   m_restore_seed   = command_line::get_arg(vm, arg_restore_seed);
+  m_refresh_threads = command_line::get_arg(vm, arg_refresh_threads);
 }
 //----------------------------------------------------------------------------------------------------
 bool simple_wallet::try_connect_to_daemon()
@@ -334,6 +337,7 @@ bool simple_wallet::new_wallet(const string &wallet_file, const std::string& pas
   }
 
   m_wallet->init(m_daemon_address);
+  m_wallet->set_refresh_threads(m_refresh_threads);
 
   success_msg_writer() <<
     "**********************************************************************\n" <<
@@ -371,6 +375,7 @@ bool simple_wallet::restore_wallet(const std::string &wallet_file, const std::st
   }
 
   m_wallet->init(m_daemon_address);
+  m_wallet->set_refresh_threads(m_refresh_threads);
 
   success_msg_writer() <<
     "**********************************************************************\n" <<
@@ -403,6 +408,7 @@ bool simple_wallet::open_wallet(const string &wallet_file, const std::string& pa
   }
 
   m_wallet->init(m_daemon_address);
+  m_wallet->set_refresh_threads(m_refresh_threads);
 
   refresh(std::vector<std::string>());
   success_msg_writer() <<
@@ -1352,6 +1358,7 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_params, arg_daemon_address);
   command_line::add_arg(desc_params, arg_daemon_host);
   command_line::add_arg(desc_params, arg_daemon_port);
+  command_line::add_arg(desc_params, arg_refresh_threads);
   command_line::add_arg(desc_params, arg_command);
   command_line::add_arg(desc_params, arg_log_level);
   tools::wallet_rpc_server::init_options(desc_params);
@@ -1440,6 +1447,7 @@ int main(int argc, char* argv[])
       LOG_PRINT_L0("Loading wallet...");
       wal.load(wallet_file, wallet_password);
       wal.init(daemon_address);
+      wal.set_refresh_threads(command_line::get_arg(vm, arg_refresh_threads));
       wal.refresh();
       LOG_PRINT_GREEN("Loaded ok", LOG_LEVEL_0);
     }
@@ -144,6 +144,7 @@ namespace currency
     std::string m_daemon_address;
     std::string m_daemon_host;
     int m_daemon_port;
+    size_t m_refresh_threads;
 
     epee::console_handlers_binder m_cmd_binder;
 
@@ -67,6 +67,13 @@ namespace tools
     return epee::net_utils::invoke_http_json_rpc("/json_rpc", "relay_txs", req, rsp, m_http_client);
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  std::shared_ptr<i_core_proxy> default_http_core_proxy::make_concurrent_proxy()
+  {
+    std::shared_ptr<i_core_proxy> proxy(new default_http_core_proxy());
+    proxy->set_connection_addr(m_daemon_address);
+    return proxy;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool default_http_core_proxy::check_connection()
   {
     if (m_http_client.is_connected())
@@ -4,6 +4,7 @@
 
 
 #pragma once
+#include <memory>
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "currency_core/account.h"
 
@@ -28,6 +29,8 @@ namespace tools
     virtual bool call_COMMAND_RPC_COMMAND_RPC_CHECK_KEYIMAGES(const currency::COMMAND_RPC_CHECK_KEYIMAGES::request& req, currency::COMMAND_RPC_CHECK_KEYIMAGES::response& rsp) = 0;
     virtual bool call_COMMAND_RPC_VALIDATE_SIGNED_TEXT(const currency::COMMAND_RPC_VALIDATE_SIGNED_TEXT::request& req, currency::COMMAND_RPC_VALIDATE_SIGNED_TEXT::response& rsp) = 0;
     virtual bool call_COMMAND_RPC_RELAY_TXS(const currency::COMMAND_RPC_RELAY_TXS::request& req, currency::COMMAND_RPC_RELAY_TXS::response& rsp) = 0;
+    //proxy with its own connection, for requests made while this one is busy (blocks prefetching); empty if not supported
+    virtual std::shared_ptr<i_core_proxy> make_concurrent_proxy() { return std::shared_ptr<i_core_proxy>(); }
     
     
 
@@ -3,6 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 
+#include <thread>
+#include <fstream>
+#include <sstream>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 
@@ -16,6 +19,7 @@ using namespace epee;
 #include "misc_language.h"
 #include "currency_core/currency_basic_impl.h"
 #include "common/boost_serialization_helper.h"
+#include "common/thread_pool.h"
 #include "profile_tools.h"
 #include "crypto/crypto.h"
 #include "serialization/binary_utils.h"
@@ -56,18 +60,22 @@ std::shared_ptr<i_core_proxy> wallet2::get_core_proxy()
   return m_core_proxy;
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t height, const currency::block& b)
+void wallet2::prepare_acc_outs_lookup_entry(const currency::transaction& tx, currency::acc_outs_lookup_entry& entry) const
 {
+  entry.tx = &tx;
+  entry.tx_pub_key = null_pkey;
+  bool r = parse_and_validate_tx_extra(tx, entry.tx_pub_key);
+  CHECK_AND_THROW_WALLET_EX(!r, error::tx_extra_parse_error, tx);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::process_new_transaction(const currency::acc_outs_lookup_entry& entry, uint64_t height, const currency::block& b)
+{
+  const currency::transaction& tx = *entry.tx;
   std::string recipient, recipient_alias;
   process_unconfirmed(tx, recipient, recipient_alias);
-  std::vector<size_t> outs;
-  uint64_t tx_money_got_in_outs = 0;
-  crypto::public_key tx_pub_key = null_pkey;
-  bool r = parse_and_validate_tx_extra(tx, tx_pub_key);
-  CHECK_AND_THROW_WALLET_EX(!r, error::tx_extra_parse_error, tx);
-
-  r = lookup_acc_outs(m_account.get_keys(), tx, tx_pub_key, outs, tx_money_got_in_outs);
-  CHECK_AND_THROW_WALLET_EX(!r, error::acc_outs_lookup_error, tx, tx_pub_key, m_account.get_keys());
+  CHECK_AND_THROW_WALLET_EX(!entry.r, error::acc_outs_lookup_error, tx, entry.tx_pub_key, m_account.get_keys());
+  const std::vector<size_t>& outs = entry.outs;
+  uint64_t tx_money_got_in_outs = entry.money_transfered;
 
   money_transfer2_details mtd;
 
@@ -101,11 +109,12 @@ void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t
       td.m_tx = tx;
       td.m_spent = false;
       currency::keypair in_ephemeral;
-      currency::generate_key_image_helper(m_account.get_keys(), tx_pub_key, o, in_ephemeral, td.m_key_image);
+      currency::generate_key_image_helper(m_account.get_keys(), entry.derivation, o, in_ephemeral, td.m_key_image);
       CHECK_AND_THROW_WALLET_EX(in_ephemeral.pub != boost::get<currency::txout_to_key>(tx.vout[o].target).key,
         error::wallet_internal_error, "key_image generated ephemeral public key not matched with output_key");
 
       m_key_images[td.m_key_image] = m_transfers.size()-1;
+      index_transfer(m_transfers.size()-1);
       LOG_PRINT_L0("Received money: " << print_money(td.amount()) << ", with tx: " << get_transaction_hash(tx));
       if (0 != m_callback)
         m_callback->on_money_received(height, td.m_tx, td.m_internal_output_index);
@@ -125,7 +134,7 @@ void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t
       LOG_PRINT_L0("Spent money: " << print_money(boost::get<currency::txin_to_key>(in).amount) << ", with tx: " << get_transaction_hash(tx));
       tx_money_spent_in_ins += boost::get<currency::txin_to_key>(in).amount;
       transfer_details& td = m_transfers[it->second];
-      td.m_spent = true;
+      set_transfer_spent(it->second, true);
       
       mtd.spent_indices.push_back(i);
 
@@ -146,7 +155,8 @@ void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t
         payment.m_amount       = received;
         payment.m_block_height = height;
         payment.m_unlock_time  = tx.unlock_time;
-        m_payments.emplace(payment_id, payment);
+        index_payment(*m_payments.emplace(payment_id, payment));
+        m_store.new_payments.push_back(std::make_pair(payment_id, payment));
         LOG_PRINT_L2("Payment found: " << payment_id << " / " << payment.m_tx_hash << " / " << payment.m_amount);
       }
     }
@@ -193,6 +203,8 @@ void wallet2::handle_money_received2(const currency::block& b, const currency::t
   wallet_rpc::wallet_transfer_info& wti = m_transfer_history.back();
   prepare_wti(wti, get_block_height(b), b.timestamp, tx, amount, td);
   wti.is_income = true;
+  if (wti.height)
+    m_transfer_history_by_height.emplace(wti.height, m_transfer_history.size() - 1);
 
   if (m_callback)
     m_callback->on_transfer2(wti);
@@ -204,6 +216,8 @@ void wallet2::handle_money_spent2(const currency::block& b, const currency::tran
   wallet_rpc::wallet_transfer_info& wti = m_transfer_history.back();
   prepare_wti(wti, get_block_height(b), b.timestamp, in_tx, amount, td);
   wti.is_income = false;
+  if (wti.height)
+    m_transfer_history_by_height.emplace(wti.height, m_transfer_history.size() - 1);
   wti.destinations = recipient;
   wti.destination_alias = recipient_alias;
 
@@ -222,52 +236,113 @@ void wallet2::process_unconfirmed(const currency::transaction& tx, std::string&
   }
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::process_new_blockchain_entry(const currency::block& b, currency::block_complete_entry& bche, crypto::hash& bl_id, uint64_t height)
+void wallet2::scan_blockchain_entry(const currency::block_complete_entry& bche, scanned_block& sb) const
+{
+  bool r = currency::parse_and_validate_block_from_blob(bche.block, sb.bl);
+  CHECK_AND_THROW_WALLET_EX(!r, error::block_parse_error, bche.block);
+  sb.id = get_block_hash(sb.bl);
+
+  //optimization: seeking only for blocks that are not older then the wallet creation time plus 1 day. 1 day is for possible user incorrect time setup
+  sb.outs_looked_up = sb.bl.timestamp + 60*60*24 > m_account.get_createtime();
+  if(!sb.outs_looked_up)
+    return;
+
+  //outputs of all block's transactions are looked up in one batch, miner tx goes first
+  sb.txs.resize(bche.txs.size());
+  sb.lookup.resize(sb.txs.size() + 1);
+  prepare_acc_outs_lookup_entry(sb.bl.miner_tx, sb.lookup[0]);
+  size_t i = 0;
+  BOOST_FOREACH(auto& txblob, bche.txs)
+  {
+    r = parse_and_validate_tx_from_blob(txblob, sb.txs[i]);
+    CHECK_AND_THROW_WALLET_EX(!r, error::tx_parse_error, txblob);
+    prepare_acc_outs_lookup_entry(sb.txs[i], sb.lookup[i + 1]);
+    ++i;
+  }
+  lookup_acc_outs(m_account.get_keys(), sb.lookup);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::scan_blockchain_entries(const std::list<currency::block_complete_entry>& entries, std::vector<scanned_block>& blocks) const
+{
+  //blocks keep pointers to own transactions in lookup entries, so vector is not resized after this
+  blocks.clear();
+  blocks.resize(entries.size());
+  if(entries.empty())
+    return;
+  std::vector<const currency::block_complete_entry*> src;
+  src.reserve(entries.size());
+  BOOST_FOREACH(auto& bche, entries)
+    src.push_back(&bche);
+
+  //errors are kept with the block and thrown when wallet reaches it, like it would be without threads
+  std::atomic<size_t> next_index(0);
+  auto worker = [&]()
+  {
+    for(size_t i = next_index++; i < src.size(); i = next_index++)
+    {
+      try
+      {
+        scan_blockchain_entry(*src[i], blocks[i]);
+      }
+      catch (...)
+      {
+        blocks[i].error = std::current_exception();
+      }
+    }
+  };
+
+  //every pool item is one worker, so --refresh-threads limits how many blocks are scanned at once
+  size_t threads_count = m_refresh_threads ? m_refresh_threads : tools::thread_pool::instance().get_threads_count();
+  threads_count = std::min<size_t>(threads_count, src.size());
+  tools::thread_pool::instance().parallel_for(threads_count, [&](size_t){ worker(); });
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::process_new_blockchain_entry(const scanned_block& sb, uint64_t height)
 {
   //handle transactions from new block
   CHECK_AND_THROW_WALLET_EX(height != m_blockchain.size(), error::wallet_internal_error,
     "current_index=" + std::to_string(height) + ", m_blockchain.size()=" + std::to_string(m_blockchain.size()));
 
-  //optimization: seeking only for blocks that are not older then the wallet creation time plus 1 day. 1 day is for possible user incorrect time setup
-  if(b.timestamp + 60*60*24 > m_account.get_createtime())
+  if(sb.outs_looked_up)
   {
     TIME_MEASURE_START(miner_tx_handle_time);
-    process_new_transaction(b.miner_tx, height, b);
+    process_new_transaction(sb.lookup[0], height, sb.bl);
     TIME_MEASURE_FINISH(miner_tx_handle_time);
 
     TIME_MEASURE_START(txs_handle_time);
-    BOOST_FOREACH(auto& txblob, bche.txs)
-    {
-      currency::transaction tx;
-      bool r = parse_and_validate_tx_from_blob(txblob, tx);
-      CHECK_AND_THROW_WALLET_EX(!r, error::tx_parse_error, txblob);
-      process_new_transaction(tx, height, b);
-    }
+    for (size_t i = 1; i < sb.lookup.size(); ++i)
+      process_new_transaction(sb.lookup[i], height, sb.bl);
     TIME_MEASURE_FINISH(txs_handle_time);
-    LOG_PRINT_L2("Processed block: " << bl_id << ", height " << height << ", " <<  miner_tx_handle_time + txs_handle_time << "(" << miner_tx_handle_time << "/" << txs_handle_time <<")ms");
+    LOG_PRINT_L2("Processed block: " << sb.id << ", height " << height << ", " <<  miner_tx_handle_time + txs_handle_time << "(" << miner_tx_handle_time << "/" << txs_handle_time <<")ms");
   }else
   {
-    LOG_PRINT_L2( "Skipped block by timestamp, height: " << height << ", block time " << b.timestamp << ", account time " << m_account.get_createtime());
+    LOG_PRINT_L2( "Skipped block by timestamp, height: " << height << ", block time " << sb.bl.timestamp << ", account time " << m_account.get_createtime());
   }
-  m_blockchain.push_back(bl_id);
+  m_blockchain.push_back(sb.id);
   ++m_local_bc_height;
 
   if (0 != m_callback)
-    m_callback->on_new_block(height, b);
+    m_callback->on_new_block(height, sb.bl);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_short_chain_history(std::list<crypto::hash>& ids)
 {
+  get_short_chain_history(ids, m_blockchain.size(), std::vector<crypto::hash>());
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::get_short_chain_history(std::list<crypto::hash>& ids, size_t split_height, const std::vector<crypto::hash>& tail) const
+{
+  auto id_at = [&](size_t h) -> const crypto::hash& { return h < split_height ? m_blockchain[h] : tail[h - split_height]; };
   size_t i = 0;
   size_t current_multiplier = 1;
-  size_t sz = m_blockchain.size();
+  size_t sz = split_height + tail.size();
   if(!sz)
     return;
   size_t current_back_offset = 1;
   bool genesis_included = false;
   while(current_back_offset < sz)
   {
-    ids.push_back(m_blockchain[sz-current_back_offset]);
+    ids.push_back(id_at(sz-current_back_offset));
     if(sz-current_back_offset == 0)
       genesis_included = true;
     if(i < 10)
@@ -280,46 +355,64 @@ void wallet2::get_short_chain_history(std::list<crypto::hash>& ids)
     ++i;
   }
   if(!genesis_included)
-    ids.push_back(m_blockchain[0]);
+    ids.push_back(id_at(0));
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::pull_blocks(size_t& blocks_added)
+void wallet2::fetch_blocks(fetched_blocks& fb)
+{
+  std::list<crypto::hash> history;
+  get_short_chain_history(history);
+  fb.history_height = m_blockchain.size();
+  fb.history_top = m_blockchain.size() ? m_blockchain.back() : null_hash;
+  fetch_blocks(*m_core_proxy, history, fb);
+}
+//----------------------------------------------------------------------------------------------------
+//doesn't touch wallet state except account keys, so it is safe to call it from prefetching thread
+void wallet2::fetch_blocks(i_core_proxy& proxy, const std::list<crypto::hash>& history, fetched_blocks& fb) const
 {
-  blocks_added = 0;
   currency::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
   currency::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
-  get_short_chain_history(req.block_ids);
-  bool r = m_core_proxy->call_COMMAND_RPC_GET_BLOCKS_FAST(req, res);
+  req.block_ids = history;
+  bool r = proxy.call_COMMAND_RPC_GET_BLOCKS_FAST(req, res);
   CHECK_AND_THROW_WALLET_EX(!r, error::no_connection_to_daemon, "getblocks.bin");
   CHECK_AND_THROW_WALLET_EX(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "getblocks.bin");
   CHECK_AND_THROW_WALLET_EX(res.status != CORE_RPC_STATUS_OK, error::get_blocks_error, res.status);
-  CHECK_AND_THROW_WALLET_EX(m_blockchain.size() <= res.start_height, error::wallet_internal_error,
-    "wrong daemon response: m_start_height=" + std::to_string(res.start_height) +
+  fb.start_height = res.start_height;
+  fb.current_height = res.current_height;
+
+  //parsing and outputs lookup go in parallel, wallet state is changed strictly in blocks order
+  scan_blockchain_entries(res.blocks, fb.blocks);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::apply_fetched_blocks(const fetched_blocks& fb, size_t& blocks_added)
+{
+  blocks_added = 0;
+  CHECK_AND_THROW_WALLET_EX(m_blockchain.size() <= fb.start_height, error::wallet_internal_error,
+    "wrong daemon response: m_start_height=" + std::to_string(fb.start_height) +
     " not less than local blockchain size=" + std::to_string(m_blockchain.size()));
 
-  size_t current_index = res.start_height;
-  BOOST_FOREACH(auto& bl_entry, res.blocks)
+  size_t current_index = fb.start_height;
+  BOOST_FOREACH(auto& sb, fb.blocks)
   {
-    currency::block bl;
-    r = currency::parse_and_validate_block_from_blob(bl_entry.block, bl);
-    CHECK_AND_THROW_WALLET_EX(!r, error::block_parse_error, bl_entry.block);
+    if(sb.error)
+      std::rethrow_exception(sb.error);
 
-    crypto::hash bl_id = get_block_hash(bl);
+    const crypto::hash& bl_id = sb.id;
     if(current_index >= m_blockchain.size())
     {
-      process_new_blockchain_entry(bl, bl_entry, bl_id, current_index);
+      process_new_blockchain_entry(sb, current_index);
       ++blocks_added;
     }
     else if(bl_id != m_blockchain[current_index])
     {
       //split detected here !!!
-      CHECK_AND_THROW_WALLET_EX(current_index == res.start_height, error::wallet_internal_error,
+      CHECK_AND_THROW_WALLET_EX(current_index == fb.start_height, error::wallet_internal_error,
         "wrong daemon response: split starts from the first block in response " + string_tools::pod_to_hex(bl_id) + 
-        " (height " + std::to_string(res.start_height) + "), local block id at this height: " +
+        " (height " + std::to_string(fb.start_height) + "), local block id at this height: " +
         string_tools::pod_to_hex(m_blockchain[current_index]));
 
       detach_blockchain(current_index);
-      process_new_blockchain_entry(bl, bl_entry, bl_id, current_index);
+      process_new_blockchain_entry(sb, current_index);
     }
     else
     {
@@ -330,6 +423,14 @@ void wallet2::pull_blocks(size_t& blocks_added)
   }
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::pull_blocks(size_t& blocks_added)
+{
+  blocks_added = 0;
+  fetched_blocks fb = AUTO_VAL_INIT(fb);
+  fetch_blocks(fb);
+  apply_fetched_blocks(fb, blocks_added);
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::refresh()
 {
   size_t blocks_fetched = 0;
@@ -391,9 +492,13 @@ void wallet2::scan_tx_pool()
   
   std::unordered_map<crypto::hash, wallet_rpc::wallet_transfer_info> unconfirmed_in_transfers_local(std::move(m_unconfirmed_in_transfers));
   m_unconfirmed_balance = 0;
+  std::vector<currency::transaction> txs(res.txs.size());
+  std::vector<crypto::hash> tx_hashes;
+  std::vector<currency::acc_outs_lookup_entry> lookup;
+  size_t i = 0;
   for (const auto &tx_blob : res.txs)
   {
-    currency::transaction tx;
+    currency::transaction& tx = txs[i++];
     bool r = parse_and_validate_tx_from_blob(tx_blob, tx);
     CHECK_AND_THROW_WALLET_EX(!r, error::tx_parse_error, tx_blob);
     crypto::hash tx_hash = currency::get_transaction_hash(tx);
@@ -405,14 +510,19 @@ void wallet2::scan_tx_pool()
     }
 
     // read extra
-    std::vector<size_t> outs;
-    uint64_t tx_money_got_in_outs = 0;
-    crypto::public_key tx_pub_key = null_pkey;
-    r = parse_and_validate_tx_extra(tx, tx_pub_key);
-    CHECK_AND_THROW_WALLET_EX(!r, error::tx_extra_parse_error, tx);
-    //check if we have money
-    r = lookup_acc_outs(m_account.get_keys(), tx, tx_pub_key, outs, tx_money_got_in_outs);
-    CHECK_AND_THROW_WALLET_EX(!r, error::acc_outs_lookup_error, tx, tx_pub_key, m_account.get_keys());
+    lookup.resize(lookup.size() + 1);
+    prepare_acc_outs_lookup_entry(tx, lookup.back());
+    tx_hashes.push_back(tx_hash);
+  }
+
+  //check if we have money
+  lookup_acc_outs(m_account.get_keys(), lookup);
+  for (i = 0; i != lookup.size(); ++i)
+  {
+    const currency::transaction& tx = *lookup[i].tx;
+    const crypto::hash& tx_hash = tx_hashes[i];
+    CHECK_AND_THROW_WALLET_EX(!lookup[i].r, error::acc_outs_lookup_error, tx, lookup[i].tx_pub_key, m_account.get_keys());
+    uint64_t tx_money_got_in_outs = lookup[i].money_transfered;
     //check if we have spendings
     uint64_t tx_money_spent_in_ins = 0;
     // check all outputs for spending (compare key images)
@@ -448,11 +558,50 @@ void wallet2::refresh(size_t & blocks_fetched, bool& received_money)
   size_t try_count = 0;
   crypto::hash last_tx_hash_id = m_transfers.size() ? get_transaction_hash(m_transfers.back().m_tx) : null_hash;
 
+  //while one batch is applied, next one is requested over separate connection with history that wallet will have
+  //after this batch (if batch turns out to be applied differently, prefetched blocks are dropped and requested again)
+  std::shared_ptr<i_core_proxy> prefetch_proxy = m_core_proxy->make_concurrent_proxy();
+  std::future<fetched_blocks> prefetch;
+
   while(m_run.load(std::memory_order_relaxed))
   {
     try
     {
-      pull_blocks(added_blocks);
+      added_blocks = 0;
+      fetched_blocks fb = AUTO_VAL_INIT(fb);
+      bool have_blocks = false;
+      if(prefetch.valid())
+      {
+        fb = prefetch.get();
+        have_blocks = fb.history_height == m_blockchain.size() && fb.history_top == (m_blockchain.size() ? m_blockchain.back() : null_hash);
+        if(!have_blocks)
+          LOG_PRINT_L1("Prefetched blocks dropped: requested for height " << fb.history_height << ", wallet height " << m_blockchain.size());
+      }
+      if(!have_blocks)
+        fetch_blocks(fb);
+
+      if(prefetch_proxy && fb.blocks.size() && fb.start_height < m_blockchain.size() && fb.start_height + fb.blocks.size() < fb.current_height)
+      {
+        //history is built here, prefetching thread must not read m_blockchain while it is changed
+        std::vector<crypto::hash> tail;
+        tail.reserve(fb.blocks.size());
+        for(const auto& sb : fb.blocks)
+          tail.push_back(sb.id);
+        std::list<crypto::hash> history;
+        get_short_chain_history(history, static_cast<size_t>(fb.start_height), tail);
+        uint64_t history_height = fb.start_height + tail.size();
+        crypto::hash history_top = tail.back();
+        prefetch = std::async(std::launch::async, [this, prefetch_proxy, history, history_height, history_top]()
+        {
+          fetched_blocks next = AUTO_VAL_INIT(next);
+          next.history_height = history_height;
+          next.history_top = history_top;
+          fetch_blocks(*prefetch_proxy, history, next);
+          return next;
+        });
+      }
+
+      apply_fetched_blocks(fb, added_blocks);
       blocks_fetched += added_blocks;
       if(!added_blocks)
         break;
@@ -498,6 +647,8 @@ bool wallet2::refresh(size_t & blocks_fetched, bool& received_money, bool& ok)
 void wallet2::detach_blockchain(uint64_t height)
 {
   LOG_PRINT_L0("Detaching blockchain on height " << height);
+  //journal can only append, so wallet file has to be rewritten
+  m_store.invalid = true;
   size_t transfers_detached = 0;
 
   auto it = std::find_if(m_transfers.begin(), m_transfers.end(), [&](const transfer_details& td){return td.m_block_height >= height;});
@@ -523,6 +674,8 @@ void wallet2::detach_blockchain(uint64_t height)
     else
       ++it;
   }
+  //chain got shorter, so some transfers may be locked again
+  rebuild_indexes();
 
   LOG_PRINT_L0("Detached blockchain on height " << height << ", transfers detached " << transfers_detached << ", blocks detached " << blocks_detached);
 }
@@ -536,6 +689,8 @@ bool wallet2::clear()
 {
   m_blockchain.clear();
   m_transfers.clear();
+  m_store = store_state();
+  rebuild_indexes();
   currency::block b;
   currency::generate_genesis_block(b);
   m_blockchain.push_back(get_block_hash(b));
@@ -673,6 +828,7 @@ bool wallet2::prepare_file_names(const std::string& file_path)
   {//provided wallet file name
     m_keys_file += ".keys";
   }
+  m_journal_file = m_wallet_file + ".journal";
   return true;
 }
 //----------------------------------------------------------------------------------------------------
@@ -719,24 +875,225 @@ void wallet2::load(const std::string& wallet_, const std::string& password)
     currency::generate_genesis_block(b);
     m_blockchain.clear();
     m_blockchain.push_back(get_block_hash(b));
+    m_store.invalid = true;
+  }
+  else
+  {
+    load_journal();
   }
   m_local_bc_height = m_blockchain.size();
+  rebuild_indexes();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::load_journal()
+{
+  boost::system::error_code e;
+  m_store.file_size = boost::filesystem::file_size(m_wallet_file, e);
+  if (e)
+    m_store.file_size = 0;
+  mark_stored(0);
+  if (m_store.id == null_hash)
+  {
+    //wallet file of older version, next store() rewrites it with id
+    m_store.invalid = true;
+    return;
+  }
+  if (!boost::filesystem::exists(m_journal_file, e) || e)
+    return;
+
+  std::string buff;
+  if (!epee::file_io_utils::load_file_to_string(m_journal_file, buff))
+  {
+    LOG_ERROR("Failed to read wallet journal " << m_journal_file << ", wallet file will be stored in full");
+    m_store.invalid = true;
+    return;
+  }
+  if (buff.size() < sizeof(crypto::hash) || memcmp(buff.data(), &m_store.id, sizeof(crypto::hash)))
+  {
+    //left from before last full store
+    LOG_PRINT_L0("Wallet journal " << m_journal_file << " doesn't belong to wallet file, ignored");
+    return;
+  }
+
+  //record: blob size, blob hash, blob; broken tail (interrupted write) is dropped
+  const size_t record_header_size = sizeof(uint64_t) + sizeof(crypto::hash);
+  size_t offset = sizeof(crypto::hash);
+  size_t records_count = 0;
+  while (buff.size() - offset >= record_header_size)
+  {
+    uint64_t blob_size = 0;
+    memcpy(&blob_size, buff.data() + offset, sizeof(blob_size));
+    if (buff.size() - offset - record_header_size < blob_size)
+      break;
+    const char* blob = buff.data() + offset + record_header_size;
+    crypto::hash h = crypto::cn_fast_hash(blob, static_cast<size_t>(blob_size));
+    if (memcmp(&h, buff.data() + offset + sizeof(blob_size), sizeof(h)))
+      break;
+
+    journal_record rec = AUTO_VAL_INIT(rec);
+    try
+    {
+      std::istringstream ss(std::string(blob, static_cast<size_t>(blob_size)));
+      boost::archive::binary_iarchive a(ss);
+      a >> rec;
+    }
+    catch (const std::exception& ex)
+    {
+      LOG_ERROR("Failed to parse wallet journal record at offset " << offset << ": " << ex.what());
+      break;
+    }
+    if (!apply_journal_record(rec))
+      break;
+    offset += record_header_size + static_cast<size_t>(blob_size);
+    ++records_count;
+  }
+  if (offset != buff.size())
+  {
+    LOG_PRINT_L0("Wallet journal " << m_journal_file << " is broken at offset " << offset << ", the rest " << buff.size() - offset << " bytes dropped");
+    boost::filesystem::resize_file(m_journal_file, offset, e);
+  }
+  mark_stored(offset);
+  LOG_PRINT_L1("Loaded " << records_count << " wallet journal records, " << offset << " bytes");
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::apply_journal_record(const journal_record& rec)
+{
+  if (rec.blockchain_size != m_blockchain.size() || rec.transfers_size != m_transfers.size() || rec.transfer_history_size != m_transfer_history.size())
+  {
+    LOG_ERROR("Wallet journal record doesn't continue wallet state: blockchain " << rec.blockchain_size << "/" << m_blockchain.size()
+      << ", transfers " << rec.transfers_size << "/" << m_transfers.size() << ", history " << rec.transfer_history_size << "/" << m_transfer_history.size());
+    return false;
+  }
+  for (const auto& sc : rec.spent_changes)
+  {
+    if (sc.first >= m_transfers.size())
+    {
+      LOG_ERROR("Wallet journal record has wrong transfer index " << sc.first << ", transfers " << m_transfers.size());
+      return false;
+    }
+  }
+
+  m_blockchain.insert(m_blockchain.end(), rec.blocks.begin(), rec.blocks.end());
+  for (const auto& td : rec.transfers)
+  {
+    m_transfers.push_back(td);
+    m_key_images[td.m_key_image] = m_transfers.size() - 1;
+  }
+  for (const auto& sc : rec.spent_changes)
+    m_transfers[static_cast<size_t>(sc.first)].m_spent = sc.second;
+  m_transfer_history.insert(m_transfer_history.end(), rec.transfer_history.begin(), rec.transfer_history.end());
+  for (const auto& p : rec.payments)
+    m_payments.emplace(p.first, p.second);
+  m_tx_keys.insert(rec.tx_keys.begin(), rec.tx_keys.end());
+  m_unconfirmed_txs = rec.unconfirmed_txs;
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::mark_stored(uint64_t journal_size)
+{
+  m_store.journal_size = journal_size;
+  m_store.blockchain_size = m_blockchain.size();
+  m_store.transfers_size = m_transfers.size();
+  m_store.transfer_history_size = m_transfer_history.size();
+  m_store.spent_changed.clear();
+  m_store.new_payments.clear();
+  m_store.new_tx_keys.clear();
+  m_store.invalid = false;
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::store()
 {
+  //only changes since last store go to journal, whole wallet is rewritten when journal grows too big
+  uint64_t max_journal_size = std::max<uint64_t>(m_store.file_size / WALLET_JOURNAL_COMPACTION_RATIO, WALLET_JOURNAL_MIN_COMPACTION_SIZE);
+  if (!m_store.invalid && m_store.journal_size < max_journal_size && store_to_journal())
+    return;
+  store_full();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::store_full()
+{
+  //stays set if writing fails, so journal is not appended to wallet file of unknown state
+  m_store.invalid = true;
+  m_store.id = crypto::rand<crypto::hash>();
   bool r = tools::serialize_obj_to_file(*this, m_wallet_file);
   CHECK_AND_THROW_WALLET_EX(!r, error::file_save_error, m_wallet_file);
+
+  //journal records belong to previous id now, if it is not removed it is ignored on load
+  boost::system::error_code e;
+  boost::filesystem::remove(m_journal_file, e);
+  m_store.file_size = boost::filesystem::file_size(m_wallet_file, e);
+  if (e)
+    m_store.file_size = 0;
+  mark_stored(0);
 }
 //----------------------------------------------------------------------------------------------------
-uint64_t wallet2::unlocked_balance()
+bool wallet2::store_to_journal()
 {
-  uint64_t amount = 0;
-  BOOST_FOREACH(transfer_details& td, m_transfers)
-    if(!td.m_spent && is_transfer_unlocked(td))
-      amount += td.amount();
+  if (m_blockchain.size() < m_store.blockchain_size || m_transfers.size() < m_store.transfers_size || m_transfer_history.size() < m_store.transfer_history_size)
+    return false;
 
-  return amount;
+  journal_record rec = AUTO_VAL_INIT(rec);
+  rec.blockchain_size = m_store.blockchain_size;
+  rec.transfers_size = m_store.transfers_size;
+  rec.transfer_history_size = m_store.transfer_history_size;
+  rec.blocks.assign(m_blockchain.begin() + m_store.blockchain_size, m_blockchain.end());
+  rec.transfers.assign(m_transfers.begin() + m_store.transfers_size, m_transfers.end());
+  for (size_t i : m_store.spent_changed)
+    rec.spent_changes.push_back(std::make_pair(static_cast<uint64_t>(i), m_transfers[i].m_spent));
+  rec.transfer_history.assign(m_transfer_history.begin() + m_store.transfer_history_size, m_transfer_history.end());
+  rec.payments = m_store.new_payments;
+  rec.tx_keys = m_store.new_tx_keys;
+  rec.unconfirmed_txs = m_unconfirmed_txs;
+
+  std::string blob;
+  try
+  {
+    std::ostringstream ss;
+    boost::archive::binary_oarchive a(ss);
+    a << rec;
+    blob = ss.str();
+  }
+  catch (const std::exception& ex)
+  {
+    LOG_ERROR("Failed to serialize wallet journal record: " << ex.what());
+    return false;
+  }
+
+  std::string buff;
+  if (!m_store.journal_size)
+    buff.append(reinterpret_cast<const char*>(&m_store.id), sizeof(m_store.id));
+  uint64_t blob_size = blob.size();
+  crypto::hash h = crypto::cn_fast_hash(blob.data(), blob.size());
+  buff.append(reinterpret_cast<const char*>(&blob_size), sizeof(blob_size));
+  buff.append(reinterpret_cast<const char*>(&h), sizeof(h));
+  buff += blob;
+
+  std::fstream journal;
+  if (m_store.journal_size)
+    journal.open(m_journal_file, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+  else
+    journal.open(m_journal_file, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+  if (journal.fail())
+  {
+    LOG_ERROR("Failed to open wallet journal " << m_journal_file);
+    return false;
+  }
+  journal.seekp(m_store.journal_size);
+  journal.write(buff.data(), buff.size());
+  journal.flush();
+  if (journal.fail())
+  {
+    LOG_ERROR("Failed to write wallet journal " << m_journal_file);
+    return false;
+  }
+  mark_stored(m_store.journal_size + buff.size());
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+uint64_t wallet2::unlocked_balance()
+{
+  update_unlocked_transfers();
+  return m_unlocked_unspent_amount;
 }
 //----------------------------------------------------------------------------------------------------
 int64_t wallet2::unconfirmed_balance()
@@ -748,12 +1105,7 @@ int64_t wallet2::unconfirmed_balance()
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet2::balance()
 {
-  uint64_t amount = 0;
-  BOOST_FOREACH(auto& td, m_transfers)
-    if(!td.m_spent)
-      amount += td.amount();
-
-
+  uint64_t amount = m_unspent_amount;
   BOOST_FOREACH(auto& utx, m_unconfirmed_txs)
     amount+= utx.second.m_change;
 
@@ -767,38 +1119,32 @@ void wallet2::get_transfers(wallet2::transfer_container& incoming_transfers) con
 //----------------------------------------------------------------------------------------------------
 bool wallet2::get_transfers(const wallet_rpc::COMMAND_RPC_GET_TRANSFERS::request& req, wallet_rpc::COMMAND_RPC_GET_TRANSFERS::response& res) const 
 {
-  uint64_t tr_count = m_transfer_history.size();
-  if (!tr_count)
-    return true;
-  uint64_t i = tr_count;
-
-  do
+  if (req.filter_by_height)
   {
-    --i;
-    const wallet_rpc::wallet_transfer_info& thi = m_transfer_history[i];
-
-    // handle filter_by_height
-    if (req.filter_by_height)
+    //newest first, unconfirmed (zero height) entries are not indexed
+    uint64_t min_height = std::max<uint64_t>(req.min_height, 1);
+    auto it_end = m_transfer_history_by_height.lower_bound(min_height);
+    auto it = m_transfer_history_by_height.upper_bound(req.max_height);
+    while (min_height <= req.max_height && it != it_end)
     {
-      if (!thi.height) // unconfirmed
-        continue;
-
-      if (thi.height < req.min_height)
-      {
-        //no need to scan more
-        break;
-      }
-      if (thi.height > req.max_height)
-      {
-        continue;
-      }
+      --it;
+      const wallet_rpc::wallet_transfer_info& thi = m_transfer_history[it->second];
+      if (thi.is_income && req.in)
+        res.in.push_back(thi);
+      if (!thi.is_income && req.out)
+        res.out.push_back(thi);
+    }
+  }
+  else
+  {
+    for (auto it = m_transfer_history.rbegin(); it != m_transfer_history.rend(); ++it)
+    {
+      if (it->is_income && req.in)
+        res.in.push_back(*it);
+      if (!it->is_income && req.out)
+        res.out.push_back(*it);
     }
-    
-    if (thi.is_income && req.in)
-      res.in.push_back(thi);
-    if (!thi.is_income && req.out)
-      res.out.push_back(thi);   
-  } while (i != 0);
+  }
 
   if (req.pool)
   {
@@ -821,13 +1167,13 @@ bool wallet2::get_transfers(const wallet_rpc::COMMAND_RPC_GET_TRANSFERS::request
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_payments(const payment_id_t& payment_id, std::list<wallet2::payment_details>& payments, uint64_t min_height) const
 {
-  auto range = m_payments.equal_range(payment_id);
-  std::for_each(range.first, range.second, [&payments, &min_height](const payment_container::value_type& x) {
-    if (min_height < x.second.m_block_height)
-    {
-      payments.push_back(x.second);
-    }
-  });
+  auto it = m_payments_by_id.find(payment_id);
+  if (it == m_payments_by_id.end())
+    return;
+  const std::vector<const payment_details*>& by_height = it->second;
+  auto it_pd = std::upper_bound(by_height.begin(), by_height.end(), min_height, [](uint64_t h, const payment_details* pd) { return h < pd->m_block_height; });
+  for (; it_pd != by_height.end(); ++it_pd)
+    payments.push_back(**it_pd);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::sign_transfer(const std::string& tx_sources_file, const std::string& signed_tx_file, currency::transaction& tx)
@@ -910,13 +1256,13 @@ void wallet2::finalize_transaction(const currency::create_tx_arg& create_tx_para
     {
       //unlock funds if transaction rejected
       for (auto& s : create_tx_param.sources)
-        m_transfers[s.transfer_index].m_spent = false;
+        set_transfer_spent(s.transfer_index, false);
     }
     else
     {
       //unlock funds if transaction rejected
       for (auto& s : create_tx_param.sources)
-        m_transfers[s.transfer_index].m_spent = true;
+        set_transfer_spent(s.transfer_index, true);
     }
     CHECK_AND_THROW_WALLET_EX(!r, error::no_connection_to_daemon, "sendrawtransaction");
     CHECK_AND_THROW_WALLET_EX(daemon_send_resp.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "sendrawtransaction");
@@ -926,7 +1272,7 @@ void wallet2::finalize_transaction(const currency::create_tx_arg& create_tx_para
   {
     //unlock funds if transaction rejected
     for (auto& s : create_tx_param.sources)
-      m_transfers[s.transfer_index].m_spent = true;
+      set_transfer_spent(s.transfer_index, true);
   }
 
   std::string recipient;
@@ -940,6 +1286,7 @@ void wallet2::finalize_transaction(const currency::create_tx_arg& create_tx_para
 
   crypto::hash txid = get_transaction_hash(tx);
   m_tx_keys.insert(std::make_pair(txid, create_tx_result.txkey.sec));
+  m_store.new_tx_keys.push_back(std::make_pair(txid, create_tx_result.txkey.sec));
 
   LOG_PRINT_L2("transaction " << get_transaction_hash(tx) << " generated ok and sent to daemon, key_images: [" << key_images << "]");
 
@@ -997,6 +1344,97 @@ bool wallet2::is_transfer_unlocked(const transfer_details& td) const
   return true;
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::rebuild_indexes()
+{
+  m_unlocked_unspent_by_amount.clear();
+  m_locked_unspent.clear();
+  m_unspent_amount = 0;
+  m_unlocked_unspent_amount = 0;
+  for (size_t i = 0; i != m_transfers.size(); i++)
+    index_transfer(i);
+
+  m_payments_by_id.clear();
+  for (const auto& p : m_payments)
+    m_payments_by_id[p.first].push_back(&p.second);
+  for (auto& p : m_payments_by_id)
+    std::stable_sort(p.second.begin(), p.second.end(), [](const payment_details* a, const payment_details* b) { return a->m_block_height < b->m_block_height; });
+
+  m_transfer_history_by_height.clear();
+  for (size_t i = 0; i != m_transfer_history.size(); i++)
+    if (m_transfer_history[i].height)
+      m_transfer_history_by_height.emplace(m_transfer_history[i].height, i);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::index_transfer(size_t i)
+{
+  const transfer_details& td = m_transfers[i];
+  if (td.m_spent)
+    return;
+  m_unspent_amount += td.amount();
+  if (is_transfer_unlocked(td))
+  {
+    m_unlocked_unspent_by_amount[td.amount()].insert(i);
+    m_unlocked_unspent_amount += td.amount();
+  }
+  else
+  {
+    m_locked_unspent.insert(i);
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::set_transfer_spent(size_t i, bool spent)
+{
+  transfer_details& td = m_transfers[i];
+  if (td.m_spent == spent)
+    return;
+  //newer transfers go to journal whole
+  if (i < m_store.transfers_size)
+    m_store.spent_changed.insert(i);
+  if (!spent)
+  {
+    td.m_spent = false;
+    index_transfer(i);
+    return;
+  }
+
+  td.m_spent = true;
+  m_unspent_amount -= td.amount();
+  if (m_locked_unspent.erase(i))
+    return;
+  auto it = m_unlocked_unspent_by_amount.find(td.amount());
+  if (it != m_unlocked_unspent_by_amount.end() && it->second.erase(i))
+  {
+    m_unlocked_unspent_amount -= td.amount();
+    if (it->second.empty())
+      m_unlocked_unspent_by_amount.erase(it);
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::update_unlocked_transfers()
+{
+  //chain only grows between rebuilds, so transfers can only get unlocked here
+  for (auto it = m_locked_unspent.begin(); it != m_locked_unspent.end(); )
+  {
+    const transfer_details& td = m_transfers[*it];
+    if (is_transfer_unlocked(td))
+    {
+      m_unlocked_unspent_by_amount[td.amount()].insert(*it);
+      m_unlocked_unspent_amount += td.amount();
+      it = m_locked_unspent.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::index_payment(const payment_container::value_type& p)
+{
+  //payments come in block order, so vector stays sorted by height
+  m_payments_by_id[p.first].push_back(&p.second);
+}
+//----------------------------------------------------------------------------------------------------
 bool wallet2::is_tx_spendtime_unlocked(uint64_t unlock_time) const
 {
   if(unlock_time < CURRENCY_MAX_BLOCK_NUMBER)
@@ -1088,13 +1526,14 @@ uint64_t wallet2::select_transfers(uint64_t needed_money, size_t fake_outputs_co
 {
   std::map<uint64_t, std::list<size_t> > found_free_amounts;
 
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  update_unlocked_transfers();
+  for (const auto& by_amount : m_unlocked_unspent_by_amount)
   {
-    const transfer_details& td = m_transfers[i];
-    if (!td.m_spent && is_transfer_unlocked(td) && 
-      currency::is_mixattr_applicable_for_fake_outs_counter(boost::get<currency::txout_to_key>(td.m_tx.vout[td.m_internal_output_index].target).mix_attr, fake_outputs_count))
+    for (size_t i : by_amount.second)
     {
-      found_free_amounts[td.m_tx.vout[td.m_internal_output_index].amount].push_back(i);
+      const transfer_details& td = m_transfers[i];
+      if (currency::is_mixattr_applicable_for_fake_outs_counter(boost::get<currency::txout_to_key>(td.m_tx.vout[td.m_internal_output_index].target).mix_attr, fake_outputs_count))
+        found_free_amounts[by_amount.first].push_back(i);
     }
   }
 
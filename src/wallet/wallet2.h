@@ -5,9 +5,14 @@
 #pragma once
 
 #include <memory>
+#include <map>
+#include <set>
 #include <boost/serialization/list.hpp>
 #include <boost/serialization/vector.hpp>
+#include <boost/serialization/utility.hpp>
 #include <atomic>
+#include <exception>
+#include <future>
 
 #include "include_base_utils.h"
 
@@ -24,6 +29,8 @@
 #include "wallet_errors.h"
 
 #define DEFAULT_TX_SPENDABLE_AGE                               10
+#define WALLET_JOURNAL_COMPACTION_RATIO                        4        //journal is merged into wallet file when it gets bigger than 1/4 of wallet file
+#define WALLET_JOURNAL_MIN_COMPACTION_SIZE                     1024*1024
 
 namespace tools
 {
@@ -62,9 +69,9 @@ namespace tools
 
   class wallet2
   {
-    wallet2(const wallet2&) : m_run(true), m_is_view_only(false), m_callback(0), m_unconfirmed_balance(0) {};
+    wallet2(const wallet2&) : m_run(true), m_is_view_only(false), m_callback(0), m_unconfirmed_balance(0), m_refresh_threads(0), m_unspent_amount(0), m_unlocked_unspent_amount(0) {};
   public:
-    wallet2() : m_run(true), m_callback(0), m_is_view_only(false), m_core_proxy(new default_http_core_proxy()), m_unconfirmed_balance(0)
+    wallet2() : m_run(true), m_callback(0), m_is_view_only(false), m_core_proxy(new default_http_core_proxy()), m_unconfirmed_balance(0), m_refresh_threads(0), m_unspent_amount(0), m_unlocked_unspent_amount(0)
     {};
     struct transfer_details
     {
@@ -123,6 +130,8 @@ namespace tools
     bool deinit();
 
     void stop() { m_run.store(false, std::memory_order_relaxed); }
+    //threads that parse fetched blocks and look up our outputs on refresh, 0 - number of CPU cores, 1 - refresh thread only
+    void set_refresh_threads(size_t count) { m_refresh_threads = count; }
 
     i_wallet2_callback* callback() const { return m_callback; }
     void callback(i_wallet2_callback* callback) { m_callback = callback; }
@@ -186,18 +195,107 @@ namespace tools
       if (ver < 9)
           return;
       a & m_tx_keys;
-
+      if (ver < 11)
+        return;
+      a & m_store.id;
     }
     static uint64_t select_indices_for_transfer(std::list<size_t>& ind, std::map<uint64_t, std::list<size_t> >& found_free_amounts, uint64_t needed_money);
   private:
 
+    //block from COMMAND_RPC_GET_BLOCKS_FAST response with our outputs already looked up: this part doesn't depend
+    //on wallet state, so fetched blocks are scanned in parallel and only applied to wallet in order
+    struct scanned_block
+    {
+      currency::block bl;
+      crypto::hash id;
+      bool outs_looked_up;                                //false for blocks older than account
+      std::vector<currency::transaction> txs;
+      std::vector<currency::acc_outs_lookup_entry> lookup; //miner tx goes first
+      std::exception_ptr error;                           //rethrown when block is applied
+    };
+
+    //COMMAND_RPC_GET_BLOCKS_FAST response for chain of history_height blocks with top history_top, already scanned
+    struct fetched_blocks
+    {
+      uint64_t history_height;
+      crypto::hash history_top;
+      uint64_t start_height;
+      uint64_t current_height;
+      std::vector<scanned_block> blocks;
+    };
+
+    //changes since last store(), appended to journal file instead of rewriting whole wallet file
+    struct journal_record
+    {
+      uint64_t blockchain_size;                           //sizes of containers this record continues
+      uint64_t transfers_size;
+      uint64_t transfer_history_size;
+      std::vector<crypto::hash> blocks;
+      std::vector<transfer_details> transfers;
+      std::vector<std::pair<uint64_t, bool> > spent_changes; //transfer index, m_spent
+      std::vector<wallet_rpc::wallet_transfer_info> transfer_history;
+      std::vector<std::pair<currency::payment_id_t, payment_details> > payments;
+      std::vector<std::pair<crypto::hash, crypto::secret_key> > tx_keys;
+      std::unordered_map<crypto::hash, unconfirmed_transfer_details> unconfirmed_txs;
+
+      template <class t_archive>
+      inline void serialize(t_archive &a, const unsigned int ver)
+      {
+        a & blockchain_size;
+        a & transfers_size;
+        a & transfer_history_size;
+        a & blocks;
+        a & transfers;
+        a & spent_changes;
+        a & transfer_history;
+        a & payments;
+        a & tx_keys;
+        a & unconfirmed_txs;
+      }
+    };
+
+    //what is already saved in wallet file and journal
+    struct store_state
+    {
+      store_state() : id(currency::null_hash), file_size(0), journal_size(0), blockchain_size(0), transfers_size(0), transfer_history_size(0), invalid(true)
+      {}
+      crypto::hash id;                                    //random id of last full store, journal is valid only with the same id
+      uint64_t file_size;
+      uint64_t journal_size;
+      size_t blockchain_size;
+      size_t transfers_size;
+      size_t transfer_history_size;
+      std::set<size_t> spent_changed;                     //transfers below transfers_size with m_spent changed since store
+      std::vector<std::pair<currency::payment_id_t, payment_details> > new_payments;
+      std::vector<std::pair<crypto::hash, crypto::secret_key> > new_tx_keys;
+      bool invalid;                                       //wallet changed not only by appending (blockchain detached), full store needed
+    };
+
     void load_keys(const std::string& keys_file_name, const std::string& password);
-    void process_new_transaction(const currency::transaction& tx, uint64_t height, const currency::block& b);
-    void process_new_blockchain_entry(const currency::block& b, currency::block_complete_entry& bche, crypto::hash& bl_id, uint64_t height);
+    void store_full();
+    bool store_to_journal();
+    void load_journal();
+    bool apply_journal_record(const journal_record& rec);
+    void mark_stored(uint64_t journal_size);
+    void prepare_acc_outs_lookup_entry(const currency::transaction& tx, currency::acc_outs_lookup_entry& entry) const;
+    void scan_blockchain_entry(const currency::block_complete_entry& bche, scanned_block& sb) const;
+    void scan_blockchain_entries(const std::list<currency::block_complete_entry>& entries, std::vector<scanned_block>& blocks) const;
+    void process_new_transaction(const currency::acc_outs_lookup_entry& entry, uint64_t height, const currency::block& b);
+    void process_new_blockchain_entry(const scanned_block& sb, uint64_t height);
     void detach_blockchain(uint64_t height);
     void get_short_chain_history(std::list<crypto::hash>& ids);
+    //history of chain that is m_blockchain[0, split_height) followed by tail
+    void get_short_chain_history(std::list<crypto::hash>& ids, size_t split_height, const std::vector<crypto::hash>& tail) const;
+    void fetch_blocks(fetched_blocks& fb);
+    void fetch_blocks(i_core_proxy& proxy, const std::list<crypto::hash>& history, fetched_blocks& fb) const;
+    void apply_fetched_blocks(const fetched_blocks& fb, size_t& blocks_added);
     bool is_tx_spendtime_unlocked(uint64_t unlock_time) const;
     bool is_transfer_unlocked(const transfer_details& td) const;
+    void rebuild_indexes();
+    void index_transfer(size_t i);
+    void set_transfer_spent(size_t i, bool spent);
+    void update_unlocked_transfers();
+    void index_payment(const payment_container::value_type& p);
     bool clear();
     void pull_blocks(size_t& blocks_added);
     uint64_t select_transfers(uint64_t needed_money, size_t fake_outputs_count, uint64_t dust, std::list<transfer_container::iterator>& selected_transfers);
@@ -217,6 +315,8 @@ namespace tools
     bool m_is_view_only;
     std::string m_wallet_file;
     std::string m_keys_file;
+    std::string m_journal_file;
+    store_state m_store;
     std::vector<crypto::hash> m_blockchain;
     std::atomic<uint64_t> m_local_bc_height; //temporary workaround 
     std::unordered_map<crypto::hash, unconfirmed_transfer_details> m_unconfirmed_txs;
@@ -234,11 +334,20 @@ namespace tools
     std::shared_ptr<i_core_proxy> m_core_proxy;
     i_wallet2_callback* m_callback;
     std::unordered_map<crypto::hash, crypto::secret_key> m_tx_keys;
+    size_t m_refresh_threads;
+
+    //secondary indexes, not stored: rebuilt on load and after blockchain detach, kept up to date on every other change
+    std::map<uint64_t, std::set<size_t> > m_unlocked_unspent_by_amount; //amount -> indexes in m_transfers
+    std::set<size_t> m_locked_unspent;                                   //unspent transfers that were locked at last check
+    uint64_t m_unspent_amount;
+    uint64_t m_unlocked_unspent_amount;
+    std::unordered_map<currency::payment_id_t, std::vector<const payment_details*> > m_payments_by_id; //points to m_payments, sorted by height
+    std::multimap<uint64_t, size_t> m_transfer_history_by_height;       //height -> index in m_transfer_history, confirmed only
   };
 }
 
 
-BOOST_CLASS_VERSION(tools::wallet2, 10)
+BOOST_CLASS_VERSION(tools::wallet2, 11)
 BOOST_CLASS_VERSION(tools::wallet2::unconfirmed_transfer_details, 3)
 BOOST_CLASS_VERSION(tools::wallet_rpc::wallet_transfer_info, 3)
 
@@ -530,7 +639,7 @@ namespace tools
     {
       //mark outputs as spent 
       BOOST_FOREACH(transfer_container::iterator it, selected_transfers)
-        it->m_spent = true;
+        set_transfer_spent(it - m_transfers.begin(), true);
       //do offline sig
       blobdata bl = t_serializable_object_to_blob(create_tx_param);
       crypto::do_chacha_crypt(bl, m_account.get_keys().m_view_secret_key);
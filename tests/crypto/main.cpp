@@ -240,6 +240,12 @@ int main(int argc, char *argv[]) {
       if (expected != actual) {
         goto error;
       }
+      ring_signature_batch_entry batch_entry = { &prefix_hash, &image, pubs.data(), pubs_count, sigs.data() };
+      bool batch_result = !expected;
+      actual = check_ring_signatures_batch(&batch_entry, 1, &batch_result);
+      if (expected != actual || expected != batch_result) {
+        goto error;
+      }
     } else {
       throw ios_base::failure("Unknown function: " + cmd);
     }
@@ -55,3 +55,61 @@ private:
   currency::transaction m_tx;
   crypto::hash m_tx_prefix_hash;
 };
+
+// batch_size signatures over the same ring, checked with a single check_ring_signatures_batch() call
+template<size_t a_ring_size, size_t a_batch_size>
+class test_check_ring_signature_batch : private multi_tx_test_base<a_ring_size>
+{
+  static_assert(0 < a_ring_size, "ring_size must be greater than 0");
+  static_assert(0 < a_batch_size, "batch_size must be greater than 0");
+
+public:
+  static const size_t loop_count = a_ring_size < 100 ? 100 : 10;
+  static const size_t ring_size = a_ring_size;
+  static const size_t batch_size = a_batch_size;
+
+  typedef multi_tx_test_base<a_ring_size> base_class;
+
+  bool init()
+  {
+    using namespace currency;
+
+    if (!base_class::init())
+      return false;
+
+    m_alice.generate();
+
+    std::vector<tx_destination_entry> destinations;
+    destinations.push_back(tx_destination_entry(this->m_source_amount, m_alice.get_keys().m_account_address));
+
+    for (size_t i = 0; i < batch_size; ++i)
+    {
+      keypair txkey = AUTO_VAL_INIT(txkey);
+      if (!construct_tx(this->m_miners[this->real_source_idx].get_keys(), this->m_sources, destinations, m_txs[i], txkey, 0))
+        return false;
+
+      get_transaction_prefix_hash(m_txs[i], m_tx_prefix_hashes[i]);
+
+      const txin_to_key& txin = boost::get<txin_to_key>(m_txs[i].vin[0]);
+      crypto::ring_signature_batch_entry& entry = m_entries[i];
+      entry.prefix_hash = &m_tx_prefix_hashes[i];
+      entry.image = &txin.k_image;
+      entry.pubs = this->m_public_key_ptrs;
+      entry.pubs_count = ring_size;
+      entry.sig = m_txs[i].signatures[0].data();
+    }
+
+    return true;
+  }
+
+  bool test()
+  {
+    return crypto::check_ring_signatures_batch(m_entries, batch_size, nullptr);
+  }
+
+private:
+  currency::account_base m_alice;
+  currency::transaction m_txs[batch_size];
+  crypto::hash m_tx_prefix_hashes[batch_size];
+  crypto::ring_signature_batch_entry m_entries[batch_size];
+};
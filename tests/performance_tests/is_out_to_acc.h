@@ -21,3 +21,17 @@ public:
     return currency::is_out_to_acc(m_bob.get_keys(), tx_out, m_tx_pub_key, 0);
   }
 };
+
+//all outputs of the transaction with single key derivation
+class test_lookup_acc_outs : public single_tx_test_base
+{
+public:
+  static const size_t loop_count = 1000;
+
+  bool test()
+  {
+    std::vector<size_t> outs;
+    uint64_t money = 0;
+    return currency::lookup_acc_outs(m_bob.get_keys(), m_tx, m_tx_pub_key, outs, money) && !outs.empty();
+  }
+};
@@ -15,6 +15,7 @@ extern "C" {
 
 
 #include "crypto/wild_keccak.h"
+#include "common/huge_page_allocator.h"
 
 
 
@@ -145,6 +146,75 @@ class test_wild_keccak2: public test_keccak_base
     std::vector<crypto::hash> m_scratchpad_vec;
   };
 
+//same as test_wild_keccak, but hashes batch of nonces in simd lanes (one test() call is one batch)
+template<int scratchpad_size>
+class test_wild_keccak_multi: public test_wild_keccak<scratchpad_size>
+{
+public:
+  static const size_t loop_count = test_keccak_base::loop_count / 8;
+
+  bool init()
+  {
+    if (!test_wild_keccak<scratchpad_size>::init())
+      return false;
+    m_lanes = crypto::wild_keccak_multi_lanes();
+    m_blobs.assign(m_lanes, this->m_buff);
+    m_hashes.resize(m_lanes);
+    for (auto& b : m_blobs)
+      m_inputs.push_back(reinterpret_cast<const uint8_t*>(b.data()));
+    return true;
+  }
+
+  bool test()
+  {
+    for (size_t l = 0; l != m_lanes; l++)
+      ++m_blobs[l][l % m_blobs[l].size()];
+    crypto::wild_keccak_dbl_multi(&m_inputs[0], this->m_buff.size(), &m_hashes[0], m_lanes, &this->m_scratchpad_vec[0], this->m_scratchpad_vec.size());
+    return true;
+  }
+private:
+  size_t m_lanes;
+  std::vector<std::string> m_blobs;
+  std::vector<const uint8_t*> m_inputs;
+  std::vector<crypto::hash> m_hashes;
+};
+
+//same as test_wild_keccak, but scratchpad is allocated in given tools::huge_pages_mode
+template<int scratchpad_size, int hp_mode>
+class test_wild_keccak_huge_pages: public test_keccak_base
+{
+public:
+  bool init()
+  {
+    tools::huge_pages_mode prev_mode = tools::get_huge_pages_mode();
+    tools::set_huge_pages_mode(static_cast<tools::huge_pages_mode>(hp_mode));
+    m_scratchpad_vec.resize(scratchpad_size/sizeof(crypto::hash));
+    tools::set_huge_pages_mode(prev_mode);
+    for(auto& h: m_scratchpad_vec)
+      h = crypto::rand<crypto::hash>();
+
+    return test_keccak_base::init();
+  }
+
+  bool test()
+  {
+    pretest();
+
+    crypto::hash h;
+    crypto::wild_keccak_dbl<crypto::mul_f>(reinterpret_cast<const uint8_t*>(&m_buff[0]), m_buff.size(), reinterpret_cast<uint8_t*>(&h), sizeof(h), [&](crypto::state_t_m& st, crypto::mixin_t& mix)
+    {
+      for(size_t i = 0; i!=6; i++)
+      {
+        *(crypto::hash*)&mix[i*4]  = XOR_4(SCR_I(i*4), SCR_I(i*4+1), SCR_I(i*4+2), SCR_I(i*4+3)); 
+      }
+    });
+
+    return true;
+  }
+ protected:
+  std::vector<crypto::hash, tools::huge_page_allocator<crypto::hash> > m_scratchpad_vec;
+};
+
 #define max_measere_scratchpad 1000000000
 #define measere_rounds 100000
 void measure_keccak_over_scratchpad()
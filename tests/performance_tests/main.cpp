@@ -41,6 +41,12 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE1(test_wild_keccak2, 40000000);
   TEST_PERFORMANCE1(test_wild_keccak, 100000000);
   TEST_PERFORMANCE1(test_wild_keccak2, 100000000);
+  TEST_PERFORMANCE1(test_wild_keccak_multi, 4000000);
+  TEST_PERFORMANCE1(test_wild_keccak_multi, 100000000);
+
+  TEST_PERFORMANCE2(test_wild_keccak_huge_pages, 100000000, 0);
+  TEST_PERFORMANCE2(test_wild_keccak_huge_pages, 100000000, 1);
+  TEST_PERFORMANCE2(test_wild_keccak_huge_pages, 100000000, 2);
 
   measure_keccak_over_scratchpad();
   /*
@@ -70,7 +76,12 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE1(test_check_ring_signature, 10);
   TEST_PERFORMANCE1(test_check_ring_signature, 100);
 
+  TEST_PERFORMANCE2(test_check_ring_signature_batch, 10, 1);
+  TEST_PERFORMANCE2(test_check_ring_signature_batch, 10, 10);
+  TEST_PERFORMANCE2(test_check_ring_signature_batch, 100, 10);
+
   TEST_PERFORMANCE0(test_is_out_to_acc);
+  TEST_PERFORMANCE0(test_lookup_acc_outs);
   TEST_PERFORMANCE0(test_generate_key_image_helper);
   TEST_PERFORMANCE0(test_generate_key_derivation);
   TEST_PERFORMANCE0(test_generate_key_image);
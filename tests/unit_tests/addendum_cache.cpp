@@ -0,0 +1,122 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "currency_core/scratchpad_helpers.h"
+
+using namespace currency;
+
+namespace
+{
+  crypto::hash make_id(uint64_t height, uint64_t branch)
+  {
+    uint64_t data[2] = {height, branch};
+    return crypto::cn_fast_hash(data, sizeof(data));
+  }
+
+  block_addendum_entry_ptr make_entry(uint64_t height, uint64_t branch, uint64_t prev_branch)
+  {
+    std::shared_ptr<block_addendum_entry> e = std::make_shared<block_addendum_entry>();
+    e->height = height;
+    e->id = make_id(height, branch);
+    e->prev_id = height ? make_id(height - 1, prev_branch) : null_hash;
+    e->addendum.push_back(e->id);
+    return e;
+  }
+
+  std::vector<uint64_t> heights(const std::list<block_addendum_entry_ptr>& entries)
+  {
+    std::vector<uint64_t> res;
+    for (const auto& e : entries)
+      res.push_back(e->height);
+    return res;
+  }
+}
+
+TEST(addendum_cache, answers_from_cache_or_falls_back)
+{
+  block_addendum_cache cache(10);
+  std::list<block_addendum_entry_ptr> res;
+  ASSERT_FALSE(cache.get_since(0, make_id(0, 0), res));
+
+  for (uint64_t h = 5; h <= 9; h++)
+    cache.push(make_entry(h, 0, 0));
+  ASSERT_EQ(5, cache.size());
+
+  ASSERT_TRUE(cache.get_since(7, make_id(9, 0), res));
+  ASSERT_EQ(std::vector<uint64_t>({7, 8, 9}), heights(res));
+  res.clear();
+  ASSERT_TRUE(cache.get_since(5, make_id(9, 0), res));
+  ASSERT_EQ(5, res.size());
+  res.clear();
+
+  //older than cache, beyond its top, or cache is not at blockchain top: answered from db
+  ASSERT_FALSE(cache.get_since(4, make_id(9, 0), res));
+  ASSERT_FALSE(cache.get_since(10, make_id(9, 0), res));
+  ASSERT_FALSE(cache.get_since(7, make_id(10, 0), res));
+  ASSERT_TRUE(res.empty());
+}
+
+TEST(addendum_cache, reorganize)
+{
+  block_addendum_cache cache(10);
+  for (uint64_t h = 0; h <= 5; h++)
+    cache.push(make_entry(h, 0, 0));
+
+  //blocks 4 and 5 replaced by alternative chain 4', 5', 6'
+  cache.pop(5);
+  cache.pop(4);
+  ASSERT_EQ(4, cache.size());
+  cache.push(make_entry(4, 1, 0));
+  cache.push(make_entry(5, 1, 1));
+  cache.push(make_entry(6, 1, 1));
+
+  std::list<block_addendum_entry_ptr> res;
+  ASSERT_FALSE(cache.get_since(3, make_id(5, 0), res));
+  ASSERT_TRUE(cache.get_since(3, make_id(6, 1), res));
+  ASSERT_EQ(std::vector<uint64_t>({3, 4, 5, 6}), heights(res));
+  ASSERT_EQ(make_id(3, 0), res.front()->id);
+  ASSERT_EQ(make_id(4, 1), (*std::next(res.begin()))->id);
+
+  //pop of block that isn't cache top means cache lost track of chain
+  cache.pop(3);
+  ASSERT_EQ(0, cache.size());
+}
+
+TEST(addendum_cache, starts_over_on_gap)
+{
+  block_addendum_cache cache(10);
+  for (uint64_t h = 0; h <= 3; h++)
+    cache.push(make_entry(h, 0, 0));
+
+  //wrong previous block
+  cache.push(make_entry(4, 1, 1));
+  ASSERT_EQ(1, cache.size());
+  //missed heights
+  cache.push(make_entry(7, 0, 0));
+  ASSERT_EQ(1, cache.size());
+
+  std::list<block_addendum_entry_ptr> res;
+  ASSERT_TRUE(cache.get_since(7, make_id(7, 0), res));
+  ASSERT_EQ(1, res.size());
+
+  cache.clear();
+  ASSERT_EQ(0, cache.size());
+  ASSERT_FALSE(cache.get_since(7, make_id(7, 0), res));
+}
+
+TEST(addendum_cache, keeps_last_entries)
+{
+  block_addendum_cache cache(3);
+  for (uint64_t h = 0; h <= 9; h++)
+    cache.push(make_entry(h, 0, 0));
+  ASSERT_EQ(3, cache.size());
+
+  std::list<block_addendum_entry_ptr> res;
+  ASSERT_FALSE(cache.get_since(6, make_id(9, 0), res));
+  ASSERT_TRUE(cache.get_since(7, make_id(9, 0), res));
+  ASSERT_EQ(std::vector<uint64_t>({7, 8, 9}), heights(res));
+}
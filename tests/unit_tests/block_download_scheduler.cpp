@@ -0,0 +1,170 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <list>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "currency_core/currency_format_utils.h"
+#include "currency_protocol/block_download_scheduler.h"
+
+using namespace currency;
+
+namespace
+{
+  const uint64_t start_height = 10;
+
+  epee::net_utils::connection_context_base make_context(uint8_t n)
+  {
+    boost::uuids::uuid id = boost::uuids::uuid();
+    id.data[0] = n;
+    return epee::net_utils::connection_context_base(id, 0, 0, false);
+  }
+
+  std::list<crypto::hash> make_ids(uint64_t from, size_t count)
+  {
+    std::list<crypto::hash> ids;
+    for (uint64_t h = from; h != from + count; h++)
+      ids.push_back(crypto::cn_fast_hash(&h, sizeof(h)));
+    return ids;
+  }
+
+  std::vector<block_download_scheduler::parsed_block> make_blocks(size_t count)
+  {
+    return std::vector<block_download_scheduler::parsed_block>(count);
+  }
+}
+
+TEST(block_download_scheduler, spans_do_not_overlap)
+{
+  block_download_scheduler s;
+  std::list<crypto::hash> needed = make_ids(start_height, 1000);
+  epee::net_utils::connection_context_base a = make_context(1), b = make_context(2);
+
+  uint64_t a_height = 0, b_height = 0;
+  std::list<crypto::hash> a_ids, b_ids;
+  ASSERT_TRUE(s.reserve_span(a, start_height, start_height, needed, a_height, a_ids));
+  ASSERT_TRUE(s.reserve_span(b, start_height, start_height, needed, b_height, b_ids));
+
+  ASSERT_EQ(start_height, a_height);
+  ASSERT_FALSE(a_ids.empty());
+  ASSERT_EQ(a_height + a_ids.size(), b_height);
+  ASSERT_FALSE(b_ids.empty());
+  ASSERT_EQ(*std::next(needed.begin(), a_ids.size()), b_ids.front());
+  ASSERT_EQ(2, s.get_spans_count());
+  ASSERT_TRUE(s.has_span_at(start_height));
+  ASSERT_TRUE(s.has_span_at(b_height + b_ids.size() - 1));
+  ASSERT_FALSE(s.has_span_at(b_height + b_ids.size()));
+  ASSERT_FALSE(s.has_span_at(start_height - 1));
+}
+
+TEST(block_download_scheduler, nothing_beyond_max_ahead)
+{
+  block_download_scheduler s;
+  std::list<crypto::hash> needed = make_ids(start_height, BLOCKS_SYNCHRONIZING_MAX_AHEAD * 2);
+
+  uint64_t top = start_height;
+  for (uint8_t n = 1; ; n++)
+  {
+    uint64_t height = 0;
+    std::list<crypto::hash> ids;
+    if (!s.reserve_span(make_context(n), start_height, start_height, needed, height, ids))
+      break;
+    ASSERT_EQ(top, height);
+    top = height + ids.size();
+    ASSERT_LE(top, start_height + BLOCKS_SYNCHRONIZING_MAX_AHEAD);
+  }
+  ASSERT_EQ(start_height + BLOCKS_SYNCHRONIZING_MAX_AHEAD, top);
+}
+
+TEST(block_download_scheduler, closed_connection_span_is_reserved_again)
+{
+  block_download_scheduler s;
+  std::list<crypto::hash> needed = make_ids(start_height, 1000);
+  epee::net_utils::connection_context_base a = make_context(1), b = make_context(2);
+
+  uint64_t a_height = 0, b_height = 0;
+  std::list<crypto::hash> a_ids, b_ids;
+  ASSERT_TRUE(s.reserve_span(a, start_height, start_height, needed, a_height, a_ids));
+  ASSERT_TRUE(s.reserve_span(b, start_height, start_height, needed, b_height, b_ids));
+  std::vector<block_download_scheduler::parsed_block> blocks = make_blocks(b_ids.size());
+  ASSERT_TRUE(s.add_blocks(b, blocks));
+
+  //a disconnects without delivering, its heights must become available to b again
+  s.on_connection_close(a);
+  ASSERT_FALSE(s.has_span_at(start_height));
+  ASSERT_TRUE(s.has_span_at(b_height));
+
+  uint64_t height = 0;
+  std::list<crypto::hash> ids;
+  ASSERT_TRUE(s.reserve_span(b, start_height, start_height, needed, height, ids));
+  ASSERT_EQ(start_height, height);
+  ASSERT_TRUE(ids == a_ids);
+}
+
+TEST(block_download_scheduler, spans_are_popped_in_height_order)
+{
+  block_download_scheduler s;
+  std::list<crypto::hash> needed = make_ids(start_height, 1000);
+  epee::net_utils::connection_context_base a = make_context(1), b = make_context(2);
+
+  uint64_t a_height = 0, b_height = 0;
+  std::list<crypto::hash> a_ids, b_ids;
+  ASSERT_TRUE(s.reserve_span(a, start_height, start_height, needed, a_height, a_ids));
+  ASSERT_TRUE(s.reserve_span(b, start_height, start_height, needed, b_height, b_ids));
+
+  //upper span arrives first and waits for lower one
+  std::vector<block_download_scheduler::parsed_block> blocks = make_blocks(b_ids.size());
+  ASSERT_TRUE(s.add_blocks(b, blocks));
+  ASSERT_EQ(b_ids.size(), s.get_buffered_blocks_count());
+  ASSERT_FALSE(s.has_ready_span(start_height));
+  block_download_scheduler::span sp;
+  ASSERT_FALSE(s.pop_ready_span(start_height, sp));
+
+  blocks = make_blocks(a_ids.size());
+  ASSERT_TRUE(s.add_blocks(a, blocks));
+  ASSERT_FALSE(s.add_blocks(a, blocks));
+  ASSERT_TRUE(s.has_ready_span(start_height));
+  ASSERT_TRUE(s.pop_ready_span(start_height, sp));
+  ASSERT_EQ(start_height, sp.start_height);
+  ASSERT_EQ(a_ids.size(), sp.blocks.size());
+  ASSERT_FALSE(s.pop_ready_span(start_height, sp));
+
+  ASSERT_TRUE(s.pop_ready_span(b_height, sp));
+  ASSERT_EQ(b_height, sp.start_height);
+  ASSERT_EQ(b_ids.size(), sp.blocks.size());
+  ASSERT_EQ(0, s.get_spans_count());
+  ASSERT_EQ(0, s.get_buffered_blocks_count());
+}
+
+TEST(block_download_scheduler, dropped_spans_are_reserved_again)
+{
+  block_download_scheduler s;
+  std::list<crypto::hash> needed = make_ids(start_height, 1000);
+  epee::net_utils::connection_context_base a = make_context(1), b = make_context(2), c = make_context(3);
+
+  uint64_t a_height = 0, b_height = 0;
+  std::list<crypto::hash> a_ids, b_ids;
+  ASSERT_TRUE(s.reserve_span(a, start_height, start_height, needed, a_height, a_ids));
+  ASSERT_TRUE(s.reserve_span(b, start_height, start_height, needed, b_height, b_ids));
+  std::vector<block_download_scheduler::parsed_block> blocks = make_blocks(b_ids.size());
+  ASSERT_TRUE(s.add_blocks(b, blocks));
+
+  //b delivered invalid blocks: its received span is forgotten
+  s.drop_connection_spans(b);
+  ASSERT_EQ(1, s.get_spans_count());
+  ASSERT_EQ(0, s.get_buffered_blocks_count());
+  ASSERT_FALSE(s.has_span_at(b_height));
+  ASSERT_TRUE(s.has_span_at(a_height));
+
+  uint64_t height = 0;
+  std::list<crypto::hash> ids;
+  ASSERT_TRUE(s.reserve_span(c, start_height, start_height, needed, height, ids));
+  ASSERT_EQ(b_height, height);
+  ASSERT_EQ(b_ids.front(), ids.front());
+
+  //late blocks from dropped peer are ignored
+  blocks = make_blocks(b_ids.size());
+  ASSERT_FALSE(s.add_blocks(b, blocks));
+}
@@ -676,6 +676,71 @@ namespace lmdb_test
     ASSERT_TRUE(dbb.close());
   }
 
+  //////////////////////////////////////////////////////////////////////////////
+  // view_read_test
+  //////////////////////////////////////////////////////////////////////////////
+  TEST(lmdb, view_read_test)
+  {
+    const std::string array_table_name("test_pod_array");
+
+    std::shared_ptr<db::lmdb_adapter> lmdb_ptr = std::make_shared<db::lmdb_adapter>();
+    db::db_bridge_base dbb(lmdb_ptr);
+
+    db::key_to_array_accessor_base<uint64_t, simple_pod_t, false> db_array(dbb);
+
+    ASSERT_TRUE(dbb.open("view_read_test"));
+
+    db::table_id tid;
+    ASSERT_TRUE(lmdb_ptr->open_table(array_table_name, tid));
+    ASSERT_TRUE(dbb.begin_transaction());
+    ASSERT_TRUE(dbb.clear(tid));
+    dbb.commit_transaction();
+
+    ASSERT_TRUE(db_array.init(array_table_name));
+
+    simple_pod_t p1 = { 'a', 0x0102030405060708ull, 1.5f };
+    simple_pod_t p2 = { 'b', 0xf7f7f7f7d3d3d3d3ull, -2.25f };
+    ASSERT_TRUE(dbb.begin_transaction());
+    db_array.push_back_item(7, p1);
+    db_array.push_back_item(7, p2);
+    dbb.commit_transaction();
+
+    // no active transaction: local one should be used transparently
+    simple_pod_t v = AUTO_VAL_INIT(v);
+    ASSERT_TRUE(db_array.get_subitem(7, 1, v));
+    ASSERT_EQ(p2, v);
+    ASSERT_EQ(db_array.count(db::complex_key<uint64_t, size_t>{ 7, 0 }), 1);
+    ASSERT_EQ(db_array.count(db::complex_key<uint64_t, size_t>{ 7, 5 }), 0);
+
+    // raw views require an active transaction
+    const char* value_data = nullptr;
+    size_t value_size = 0;
+    db::complex_key<uint64_t, size_t> ck = { 7, 0 };
+    ASSERT_FALSE(dbb.get_view(tid, ck, value_data, value_size));
+
+    ASSERT_TRUE(dbb.begin_transaction(true));
+    ASSERT_TRUE(dbb.get_view(tid, ck, value_data, value_size));
+    ASSERT_EQ(value_size, sizeof(simple_pod_t));
+    ASSERT_EQ(0, std::memcmp(value_data, &p1, sizeof p1));
+
+    ASSERT_TRUE(db_array.get_subitem(7, 0, v));
+    ASSERT_EQ(p1, v);
+
+    bool visited = dbb.visit_value(tid, ck, [&](const char* data, size_t size) { return size == sizeof p1 && std::memcmp(data, &p1, size) == 0; });
+    ASSERT_TRUE(visited);
+    dbb.commit_transaction();
+
+    // in-place overwrite keeps the array size
+    ASSERT_TRUE(dbb.begin_transaction());
+    db_array.set_subitem(7, 0, p2);
+    dbb.commit_transaction();
+    ASSERT_EQ(db_array.get_item_size(7), 2);
+    ASSERT_TRUE(db_array.get_subitem(7, 0, v));
+    ASSERT_EQ(p2, v);
+
+    ASSERT_TRUE(dbb.close());
+  }
+
   //////////////////////////////////////////////////////////////////////////////
   // array_accessor_test
   //////////////////////////////////////////////////////////////////////////////
@@ -158,5 +158,25 @@ TEST(pow_tests, test_reference_func)
     return get_blob_longhash_opt(blob, scratchpad);
   });
   ASSERT_TRUE(r);
+
+  r = check_hash([](const std::string& blob, std::vector<crypto::hash>& scratchpad){
+    //every lane hashes its own nonce (bytes 1..8, as in block hashing blob), one more lane exercises partial batch;
+    //each result must match reference function for that lane's input, lane 0 keeps blob unchanged
+    std::vector<std::string> blobs(crypto::wild_keccak_multi_lanes() + 1, blob);
+    std::vector<const uint8_t*> inputs(blobs.size());
+    for (size_t i = 0; i != blobs.size(); i++)
+    {
+      if (blob.size() > sizeof(uint64_t))
+        *reinterpret_cast<uint64_t*>(&blobs[i][1]) ^= i;
+      inputs[i] = reinterpret_cast<const uint8_t*>(blobs[i].data());
+    }
+    std::vector<crypto::hash> res(inputs.size());
+    crypto::wild_keccak_dbl_multi(&inputs[0], blob.size(), &res[0], inputs.size(), &scratchpad[0], scratchpad.size());
+    for (size_t i = 0; i != res.size(); i++)
+      if (res[i] != get_blob_longhash(blobs[i], 1, scratchpad))
+        return null_hash;
+    return res[0];
+  });
+  ASSERT_TRUE(r);
 }
 
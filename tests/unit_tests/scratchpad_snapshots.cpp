@@ -0,0 +1,155 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <atomic>
+#include <thread>
+#include "gtest/gtest.h"
+
+#include "currency_core/scratchpad_helpers.h"
+
+using namespace currency;
+
+namespace
+{
+  crypto::hash make_entry(uint64_t v)
+  {
+    crypto::hash h = null_hash;
+    *reinterpret_cast<uint64_t*>(&h) = v;
+    return h;
+  }
+
+  std::shared_ptr<scratchpad_vector> make_scratchpad(uint64_t v)
+  {
+    return std::make_shared<scratchpad_vector>(16, make_entry(v));
+  }
+
+  std::list<block> make_lag(size_t count)
+  {
+    return std::list<block>(count, block());
+  }
+}
+
+TEST(scratchpad_snapshots, publish_and_recycle)
+{
+  scratchpad_snapshots sn;
+  sn.set_readers_count(1);
+  std::list<block> lag;
+  ASSERT_EQ(0, sn.get_version());
+  ASSERT_FALSE(sn.take_spare(lag));
+
+  //full copy: nothing to recycle
+  std::shared_ptr<scratchpad_vector> first = make_scratchpad(1);
+  sn.publish(first, lag);
+  ASSERT_EQ(1, sn.get_version());
+  ASSERT_EQ(first, sn.get_current());
+  ASSERT_FALSE(sn.take_spare(lag));
+
+  std::shared_ptr<scratchpad_vector> second = make_scratchpad(2);
+  lag = make_lag(2);
+  sn.publish(second, lag);
+  ASSERT_EQ(2, sn.get_version());
+  ASSERT_EQ(second, sn.get_current());
+
+  //reader never acquired anything: previous snapshot is free, with blocks it lags behind
+  std::list<block> spare_lag;
+  std::shared_ptr<scratchpad_vector> spare = sn.take_spare(spare_lag);
+  ASSERT_EQ(first, spare);
+  ASSERT_EQ(2, spare_lag.size());
+  //taken only once
+  ASSERT_FALSE(sn.take_spare(spare_lag));
+
+  //full copy after reorganize drops spare
+  lag = make_lag(1);
+  sn.publish(make_scratchpad(3), lag);
+  std::list<block> no_lag;
+  sn.publish(make_scratchpad(4), no_lag);
+  ASSERT_FALSE(sn.take_spare(spare_lag));
+}
+
+TEST(scratchpad_snapshots, reader_holds_spare)
+{
+  scratchpad_snapshots sn;
+  sn.set_readers_count(2);
+  std::list<block> lag;
+  std::shared_ptr<scratchpad_vector> first = make_scratchpad(1);
+  sn.publish(first, lag);
+
+  scratchpad_snapshots::snapshot_ptr r0, r1;
+  uint32_t v0 = 0, v1 = 0;
+  sn.acquire(0, r0, v0);
+  sn.acquire(1, r1, v1);
+  ASSERT_EQ(1, v0);
+  ASSERT_EQ(first, r0);
+
+  lag = make_lag(1);
+  sn.publish(make_scratchpad(2), lag);
+  ASSERT_FALSE(sn.take_spare(lag));
+
+  //one reader moved on, other one still uses the previous snapshot
+  sn.acquire(0, r0, v0);
+  ASSERT_EQ(2, v0);
+  ASSERT_FALSE(sn.take_spare(lag));
+
+  //stopped reader holds nothing
+  sn.release(1, r1);
+  ASSERT_FALSE(r1);
+  ASSERT_EQ(first, sn.take_spare(lag));
+  ASSERT_EQ(1, lag.size());
+}
+
+TEST(scratchpad_snapshots, recycled_snapshot_is_not_in_use)
+{
+  //writer refills every recycled snapshot; readers check that snapshot they hold never changes
+  const size_t readers_count = 4;
+  scratchpad_snapshots sn;
+  sn.set_readers_count(readers_count);
+  std::list<block> lag;
+  sn.publish(make_scratchpad(1), lag);
+
+  std::atomic<bool> stop(false);
+  std::atomic<size_t> failures(0);
+  std::vector<std::thread> readers;
+  for (size_t i = 0; i != readers_count; i++)
+  {
+    readers.push_back(std::thread([&, i]()
+    {
+      scratchpad_snapshots::snapshot_ptr sp;
+      uint32_t ver = 0;
+      while (!stop)
+      {
+        if (ver != sn.get_version())
+          sn.acquire(i, sp, ver);
+        crypto::hash first = (*sp)[0];
+        for (const auto& h : *sp)
+          if (h != first)
+            ++failures;
+      }
+      sn.release(i, sp);
+    }));
+  }
+
+  size_t recycled = 0;
+  for (uint64_t v = 2; v != 20000; v++)
+  {
+    std::list<block> spare_lag;
+    std::shared_ptr<scratchpad_vector> next = sn.take_spare(spare_lag);
+    if (next)
+    {
+      ++recycled;
+      for (auto& h : *next)
+        h = make_entry(v);
+    }
+    else
+    {
+      next = make_scratchpad(v);
+    }
+    lag = make_lag(1);
+    sn.publish(next, lag);
+  }
+  stop = true;
+  for (auto& th : readers)
+    th.join();
+  ASSERT_EQ(0, failures);
+  ASSERT_LT(0, recycled);
+}
@@ -127,6 +127,46 @@ TEST(Serialization, BinaryArchiveVarInts) {
   ASSERT_EQ(x, x1);
 }
 
+TEST(Serialization, BinaryBufferArchiveInts) {
+  uint64_t x = 0xff00000000, x1;
+
+  string buf;
+  binary_buffer_ostream os(buf);
+  binary_buffer_archive<true> oar(os);
+  oar.serialize_int(x);
+  ASSERT_TRUE(os.good());
+  ASSERT_EQ(string("\0\0\0\0\xff\0\0\0", 8), buf);
+
+  binary_buffer_istream is(buf.data(), buf.size());
+  binary_buffer_archive<false> iar(is);
+  iar.serialize_int(x1);
+  ASSERT_TRUE(is.good());
+  ASSERT_EQ(0, iar.remaining_bytes());
+  ASSERT_EQ(x, x1);
+
+  //reading past the end fails instead of reading garbage
+  iar.serialize_int(x1);
+  ASSERT_FALSE(is.good());
+  ASSERT_EQ(0, x1);
+}
+
+TEST(Serialization, BinaryBufferArchiveVarInts) {
+  uint64_t x = 0xff00000000, x1;
+
+  string buf;
+  binary_buffer_ostream os(buf);
+  binary_buffer_archive<true> oar(os);
+  oar.serialize_varint(x);
+  ASSERT_TRUE(os.good());
+  ASSERT_EQ(string("\x80\x80\x80\x80\xF0\x1F", 6), buf);
+
+  binary_buffer_istream is(buf.data(), buf.size());
+  binary_buffer_archive<false> iar(is);
+  iar.serialize_varint(x1);
+  ASSERT_TRUE(is.good());
+  ASSERT_EQ(x, x1);
+}
+
 TEST(Serialization, Test1) {
   ostringstream str;
   binary_archive<true> ar(str);
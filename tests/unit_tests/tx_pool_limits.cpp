@@ -0,0 +1,236 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "tx_pool_tests_utils.h"
+
+using namespace currency;
+
+namespace
+{
+  const std::string test_folder = "test_pool_limits";
+  const uint64_t fee_unit = TX_POOL_MINIMUM_FEE;
+
+  //pool is filled through snapshot: limits are applied on load the same way as on add_tx
+  std::vector<tx_memory_pool::tx_details> make_limits_txs()
+  {
+    std::vector<tx_memory_pool::tx_details> txs;
+    txs.push_back(unit_test::make_pool_tx_details(1, fee_unit * 1, 1000));     //1 per 1000 bytes
+    txs.push_back(unit_test::make_pool_tx_details(2, fee_unit * 3, 1000));     //3
+    txs.push_back(unit_test::make_pool_tx_details(3, fee_unit * 4, 2000));     //2
+    txs.push_back(unit_test::make_pool_tx_details(4, fee_unit * 5, 1000));     //5
+    txs.push_back(unit_test::make_pool_tx_details(5, fee_unit * 1, 4000, true)); //0.25, kept by block
+    txs.push_back(unit_test::make_pool_tx_details(6, fee_unit * 8, 2000));     //4
+    return txs;
+  }
+
+  bool take(tx_memory_pool& pool, const tx_memory_pool::tx_details& txd)
+  {
+    transaction tx;
+    size_t blob_size = 0;
+    uint64_t fee = 0;
+    return pool.take_tx(get_transaction_hash(txd.tx), tx, blob_size, fee);
+  }
+}
+
+TEST(tx_pool_limits, evicts_lowest_fee_per_byte)
+{
+  std::vector<tx_memory_pool::tx_details> txs = make_limits_txs();
+  ASSERT_TRUE(unit_test::write_pool_snapshot(test_folder, txs));
+  unit_test::tx_pool_env env;
+  ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder, 0, 3));
+
+  ASSERT_EQ(3, env.pool.get_transactions_count());
+  ASSERT_TRUE(env.pool.have_tx(get_transaction_hash(txs[3].tx)));
+  ASSERT_TRUE(env.pool.have_tx(get_transaction_hash(txs[5].tx)));
+  ASSERT_TRUE(env.pool.have_tx(get_transaction_hash(txs[4].tx)));
+  ASSERT_FALSE(env.pool.have_tx(get_transaction_hash(txs[0].tx)));
+  ASSERT_FALSE(env.pool.have_tx(get_transaction_hash(txs[1].tx)));
+  ASSERT_FALSE(env.pool.have_tx(get_transaction_hash(txs[2].tx)));
+  //key images of evicted ones are free again
+  ASSERT_FALSE(env.pool.have_tx_keyimg_as_spent(unit_test::make_key_image(1)));
+
+  tx_memory_pool::pool_stats st = AUTO_VAL_INIT(st);
+  env.pool.get_stats(st);
+  ASSERT_EQ(3, st.tx_count);
+  ASSERT_EQ(1, st.kept_by_block_count);
+  ASSERT_EQ(3, st.evicted_count);
+  ASSERT_EQ(1000 + 2000 + 4000, st.blobs_size);
+}
+
+TEST(tx_pool_limits, kept_by_block_are_not_evicted)
+{
+  std::vector<tx_memory_pool::tx_details> txs;
+  for (uint64_t i = 1; i <= 3; ++i)
+    txs.push_back(unit_test::make_pool_tx_details(i, fee_unit * i, 1000, true));
+  ASSERT_TRUE(unit_test::write_pool_snapshot(test_folder, txs));
+  unit_test::tx_pool_env env;
+  ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder, 0, 2));
+
+  ASSERT_EQ(3, env.pool.get_transactions_count());
+  tx_memory_pool::pool_stats st = AUTO_VAL_INIT(st);
+  env.pool.get_stats(st);
+  ASSERT_EQ(0, st.evicted_count);
+  ASSERT_EQ(0, st.fee_floor_per_kb);
+}
+
+TEST(tx_pool_limits, memory_limit)
+{
+  std::vector<tx_memory_pool::tx_details> txs;
+  for (uint64_t i = 1; i <= 4; ++i)
+    txs.push_back(unit_test::make_pool_tx_details(i, fee_unit * i, 1000));
+  ASSERT_TRUE(unit_test::write_pool_snapshot(test_folder, txs));
+  uint64_t entry_memory = 0;
+  {
+    unit_test::tx_pool_env env;
+    ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder));
+    tx_memory_pool::pool_stats st = AUTO_VAL_INIT(st);
+    env.pool.get_stats(st);
+    ASSERT_EQ(4, st.tx_count);
+    ASSERT_EQ(4000, st.blobs_size);
+    //all entries have the same shape
+    ASSERT_EQ(0, st.memory_usage % 4);
+    entry_memory = st.memory_usage / 4;
+    ASSERT_LT(0, entry_memory);
+  }
+
+  unit_test::tx_pool_env env;
+  ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder, entry_memory * 2 + entry_memory / 2));
+  ASSERT_EQ(2, env.pool.get_transactions_count());
+  ASSERT_TRUE(env.pool.have_tx(get_transaction_hash(txs[3].tx)));
+  ASSERT_TRUE(env.pool.have_tx(get_transaction_hash(txs[2].tx)));
+  tx_memory_pool::pool_stats st = AUTO_VAL_INIT(st);
+  env.pool.get_stats(st);
+  ASSERT_EQ(entry_memory * 2, st.memory_usage);
+  ASSERT_EQ(2, st.evicted_count);
+}
+
+TEST(tx_pool_limits, fee_floor)
+{
+  std::vector<tx_memory_pool::tx_details> txs = make_limits_txs();
+  ASSERT_TRUE(unit_test::write_pool_snapshot(test_folder, txs));
+  unit_test::tx_pool_env env;
+  ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder, 0, 3));
+
+  //last evicted one sets the floor: fee_unit * 3 per 1000 bytes
+  tx_memory_pool::pool_stats st = AUTO_VAL_INIT(st);
+  env.pool.get_stats(st);
+  ASSERT_EQ(fee_unit * 3 * 1024 / 1000 + 1, st.fee_floor_per_kb);
+
+  //same fee per byte as floor is not enough, checks before blockchain ones reject it
+  transaction tx = unit_test::make_pool_tx(10, fee_unit * 3);
+  tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+  ASSERT_FALSE(env.pool.add_tx(tx, get_transaction_hash(tx), 1000, tvc, false));
+  ASSERT_FALSE(tvc.m_verifivation_failed);
+  ASSERT_FALSE(env.pool.have_tx(get_transaction_hash(tx)));
+
+  //floor stays above 75% of limits (3 of 3 transactions), released below it (2 of 3)
+  ASSERT_TRUE(take(env.pool, txs[3]));
+  env.pool.get_stats(st);
+  ASSERT_EQ(0, st.fee_floor_per_kb);
+}
+
+TEST(tx_pool_limits, memory_usage_returns_to_zero)
+{
+  std::vector<tx_memory_pool::tx_details> txs = make_limits_txs();
+  ASSERT_TRUE(unit_test::write_pool_snapshot(test_folder, txs));
+  unit_test::tx_pool_env env;
+  ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder, 0, 4));
+
+  tx_memory_pool::pool_stats st = AUTO_VAL_INIT(st);
+  env.pool.get_stats(st);
+  ASSERT_EQ(4, st.tx_count);
+  ASSERT_LT(0, st.memory_usage);
+  size_t taken = 0;
+  for (const auto& txd : txs)
+    taken += take(env.pool, txd) ? 1 : 0;
+  ASSERT_EQ(4, taken);
+
+  env.pool.get_stats(st);
+  ASSERT_EQ(0, st.tx_count);
+  ASSERT_EQ(0, st.memory_usage);
+  ASSERT_EQ(0, st.blobs_size);
+  ASSERT_EQ(0, st.fee_floor_per_kb);
+}
+
+TEST(tx_pool_limits, add_tx_evicts_cheapest)
+{
+  std::vector<tx_memory_pool::tx_details> txs;
+  txs.push_back(unit_test::make_pool_tx_details(1, fee_unit * 2, 1000));     //2 per 1000 bytes
+  txs.push_back(unit_test::make_pool_tx_details(2, fee_unit * 1, 1000));     //1
+  txs.push_back(unit_test::make_pool_tx_details(3, fee_unit * 3, 1000));     //3
+  ASSERT_TRUE(unit_test::write_pool_snapshot(test_folder, txs));
+  unit_test::tx_pool_env env;
+  ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder, 0, 3));
+  ASSERT_EQ(3, env.pool.get_transactions_count());
+
+  //transaction of block can't be checked against blockchain, it is added anyway and pushes cheapest one out
+  transaction tx = unit_test::make_pool_tx(10, fee_unit);
+  crypto::hash id = get_transaction_hash(tx);
+  tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+  ASSERT_TRUE(env.pool.add_tx(tx, id, 2000, tvc, true));
+  ASSERT_FALSE(tvc.m_verifivation_failed);
+  ASSERT_TRUE(tvc.m_verifivation_impossible);
+  ASSERT_TRUE(tvc.m_added_to_pool);
+  ASSERT_FALSE(tvc.m_should_be_relayed);
+
+  ASSERT_EQ(3, env.pool.get_transactions_count());
+  ASSERT_TRUE(env.pool.have_tx(id));
+  ASSERT_FALSE(env.pool.have_tx(get_transaction_hash(txs[1].tx)));
+  ASSERT_FALSE(env.pool.have_tx_keyimg_as_spent(unit_test::make_key_image(2)));
+  ASSERT_TRUE(env.pool.have_tx_keyimg_as_spent(unit_test::make_key_image(10)));
+  tx_memory_pool::pool_stats st = AUTO_VAL_INIT(st);
+  env.pool.get_stats(st);
+  ASSERT_EQ(1, st.evicted_count);
+  ASSERT_EQ(1, st.kept_by_block_count);
+  ASSERT_EQ(fee_unit * 1024 / 1000 + 1, st.fee_floor_per_kb);
+}
+
+TEST(tx_pool_limits, added_tx_itself_is_evicted)
+{
+  unit_test::tx_pool_env env;
+  ASSERT_TRUE(unit_test::init_blockchain(env.bcs, test_folder + "/chain"));
+  currency::account_base acc;
+  acc.generate();
+  ASSERT_TRUE(unit_test::mine_blocks(env.bcs, acc.get_keys().m_account_address, CURRENCY_MINED_MONEY_UNLOCK_WINDOW + 1));
+  transaction tx;
+  ASSERT_TRUE(unit_test::make_miner_output_spend(env.bcs, acc, 1, fee_unit, tx));
+  crypto::hash id = get_transaction_hash(tx);
+
+  //pool is at its limit with transactions that pay more per byte than tx
+  std::vector<tx_memory_pool::tx_details> txs;
+  for (uint64_t i = 1; i <= 3; ++i)
+    txs.push_back(unit_test::make_pool_tx_details(i, fee_unit * 10 * i, 200));
+  ASSERT_TRUE(unit_test::write_pool_snapshot(test_folder + "/pool", txs));
+  ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder + "/pool", 0, 3));
+  tx_memory_pool::pool_stats st = AUTO_VAL_INIT(st);
+  env.pool.get_stats(st);
+  ASSERT_EQ(0, st.fee_floor_per_kb);
+
+  //valid transaction is accepted, but goes out at once: nothing is added and nothing is to be relayed
+  tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+  ASSERT_TRUE(env.pool.add_tx(tx, tvc, false));
+  ASSERT_FALSE(tvc.m_verifivation_failed);
+  ASSERT_FALSE(tvc.m_verifivation_impossible);
+  ASSERT_FALSE(tvc.m_added_to_pool);
+  ASSERT_FALSE(tvc.m_should_be_relayed);
+  ASSERT_FALSE(env.pool.have_tx(id));
+  ASSERT_FALSE(env.pool.have_tx_keyimges_as_spent(tx));
+  ASSERT_EQ(3, env.pool.get_transactions_count());
+  env.pool.get_stats(st);
+  ASSERT_EQ(1, st.evicted_count);
+  ASSERT_LT(0, st.fee_floor_per_kb);
+
+  //it set the floor, so the same transaction is turned away before blockchain checks now
+  tvc = AUTO_VAL_INIT(tvc);
+  ASSERT_FALSE(env.pool.add_tx(tx, tvc, false));
+  ASSERT_FALSE(tvc.m_verifivation_failed);
+  ASSERT_FALSE(tvc.m_added_to_pool);
+  ASSERT_FALSE(env.pool.have_tx(id));
+
+  env.pool.deinit();
+  env.bcs.deinit();
+}
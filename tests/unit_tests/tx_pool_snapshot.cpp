@@ -0,0 +1,212 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "tx_pool_tests_utils.h"
+
+using namespace currency;
+
+namespace
+{
+  const std::string test_folder = "test_pool_snapshot";
+
+  std::vector<tx_memory_pool::tx_details> make_snapshot_txs(size_t count)
+  {
+    std::vector<tx_memory_pool::tx_details> txs;
+    for (size_t i = 0; i != count; ++i)
+    {
+      txs.push_back(unit_test::make_pool_tx_details(i + 1, TX_POOL_MINIMUM_FEE * (i + 1), 0, i % 2 == 1));
+      txs.back().max_used_block_height = 100 + i;
+      txs.back().max_used_block_id = crypto::cn_fast_hash(&i, sizeof(i));
+    }
+    return txs;
+  }
+
+  std::string read_snapshot()
+  {
+    std::string buff;
+    epee::file_io_utils::load_file_to_string(unit_test::get_pool_snapshot_path(test_folder), buff);
+    return buff;
+  }
+
+  void write_snapshot(const std::string& buff)
+  {
+    epee::file_io_utils::save_string_to_file(unit_test::get_pool_snapshot_path(test_folder), buff);
+  }
+
+  size_t add_record_size(const tx_memory_pool::tx_details& txd)
+  {
+    return sizeof(pool_snapshot_record) + t_serializable_object_to_blob(txd.tx).size();
+  }
+
+  bool has_line(tx_memory_pool& pool, const std::string& line)
+  {
+    return pool.print_pool(true).find(line + "\n") != std::string::npos;
+  }
+}
+
+TEST(tx_pool_snapshot, round_trip)
+{
+  std::vector<tx_memory_pool::tx_details> txs = make_snapshot_txs(5);
+  ASSERT_TRUE(unit_test::write_pool_snapshot(test_folder, txs));
+  {
+    unit_test::tx_pool_env env;
+    ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder));
+    ASSERT_EQ(txs.size(), env.pool.get_transactions_count());
+    for (const auto& txd : txs)
+    {
+      crypto::hash id = get_transaction_hash(txd.tx);
+      transaction tx;
+      ASSERT_TRUE(env.pool.get_transaction(id, tx));
+      ASSERT_EQ(t_serializable_object_to_blob(txd.tx), t_serializable_object_to_blob(tx));
+      ASSERT_TRUE(env.pool.have_tx_keyimg_as_spent(boost::get<txin_to_key>(txd.tx.vin[0]).k_image));
+      ASSERT_TRUE(has_line(env.pool, "max_used_block_height: " + std::to_string(txd.max_used_block_height)));
+    }
+    tx_memory_pool::pool_stats st = AUTO_VAL_INIT(st);
+    env.pool.get_stats(st);
+    ASSERT_EQ(2, st.kept_by_block_count);
+
+    //unchanged pool is not written again
+    ASSERT_TRUE(env.pool.deinit());
+  }
+  std::string buff;
+  append_snapshot_header(buff);
+  for (const auto& txd : txs)
+    append_snapshot_record(buff, pool_snapshot_record_add, get_transaction_hash(txd.tx), &txd);
+  ASSERT_EQ(buff, read_snapshot());
+
+  //removal is appended and replayed on next load
+  crypto::hash removed_id = get_transaction_hash(txs[2].tx);
+  {
+    unit_test::tx_pool_env env;
+    ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder));
+    transaction tx;
+    size_t blob_size = 0;
+    uint64_t fee = 0;
+    ASSERT_TRUE(env.pool.take_tx(removed_id, tx, blob_size, fee));
+    ASSERT_TRUE(env.pool.deinit());
+  }
+  ASSERT_EQ(buff.size() + sizeof(pool_snapshot_record), read_snapshot().size());
+  {
+    unit_test::tx_pool_env env;
+    ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder));
+    ASSERT_EQ(txs.size() - 1, env.pool.get_transactions_count());
+    ASSERT_FALSE(env.pool.have_tx(removed_id));
+    ASSERT_FALSE(env.pool.have_tx_keyimg_as_spent(boost::get<txin_to_key>(txs[2].tx.vin[0]).k_image));
+  }
+}
+
+TEST(tx_pool_snapshot, update_and_remove_replay)
+{
+  std::vector<tx_memory_pool::tx_details> txs = make_snapshot_txs(3);
+  ASSERT_TRUE(unit_test::write_pool_snapshot(test_folder, txs));
+  std::string buff = read_snapshot();
+
+  tx_memory_pool::tx_details updated = txs[0];
+  updated.max_used_block_height = 777;
+  updated.last_failed_height = 555;
+  append_snapshot_record(buff, pool_snapshot_record_update, get_transaction_hash(txs[0].tx), &updated);
+  append_snapshot_record(buff, pool_snapshot_record_remove, get_transaction_hash(txs[1].tx), nullptr);
+  //update of removed entry is ignored, removed entry may be added again
+  append_snapshot_record(buff, pool_snapshot_record_update, get_transaction_hash(txs[1].tx), &updated);
+  append_snapshot_record(buff, pool_snapshot_record_remove, get_transaction_hash(txs[2].tx), nullptr);
+  append_snapshot_record(buff, pool_snapshot_record_add, get_transaction_hash(txs[2].tx), &txs[2]);
+  write_snapshot(buff);
+
+  unit_test::tx_pool_env env;
+  ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder));
+  ASSERT_EQ(2, env.pool.get_transactions_count());
+  ASSERT_TRUE(env.pool.have_tx(get_transaction_hash(txs[0].tx)));
+  ASSERT_FALSE(env.pool.have_tx(get_transaction_hash(txs[1].tx)));
+  ASSERT_TRUE(env.pool.have_tx(get_transaction_hash(txs[2].tx)));
+  ASSERT_TRUE(has_line(env.pool, "max_used_block_height: 777"));
+  ASSERT_TRUE(has_line(env.pool, "last_failed_height: 555"));
+  ASSERT_FALSE(has_line(env.pool, "max_used_block_height: " + std::to_string(txs[0].max_used_block_height)));
+  ASSERT_EQ(buff.size(), read_snapshot().size());
+}
+
+TEST(tx_pool_snapshot, torn_tail_is_truncated)
+{
+  std::vector<tx_memory_pool::tx_details> txs = make_snapshot_txs(3);
+  ASSERT_TRUE(unit_test::write_pool_snapshot(test_folder, txs));
+  std::string buff = read_snapshot();
+  size_t good_size = buff.size() - add_record_size(txs[2]);
+  //last record is cut in the middle of blob, then in the middle of fixed part
+  write_snapshot(buff.substr(0, buff.size() - 10));
+  {
+    unit_test::tx_pool_env env;
+    ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder));
+    ASSERT_EQ(2, env.pool.get_transactions_count());
+    ASSERT_FALSE(env.pool.have_tx(get_transaction_hash(txs[2].tx)));
+  }
+  ASSERT_EQ(good_size, read_snapshot().size());
+
+  write_snapshot(buff.substr(0, good_size + sizeof(pool_snapshot_record) / 2));
+  {
+    unit_test::tx_pool_env env;
+    ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder));
+    ASSERT_EQ(2, env.pool.get_transactions_count());
+
+    //records appended after truncation are readable
+    transaction tx;
+    size_t blob_size = 0;
+    uint64_t fee = 0;
+    ASSERT_TRUE(env.pool.take_tx(get_transaction_hash(txs[0].tx), tx, blob_size, fee));
+    ASSERT_TRUE(env.pool.deinit());
+  }
+  ASSERT_EQ(good_size + sizeof(pool_snapshot_record), read_snapshot().size());
+  {
+    unit_test::tx_pool_env env;
+    ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder));
+    ASSERT_EQ(1, env.pool.get_transactions_count());
+    ASSERT_TRUE(env.pool.have_tx(get_transaction_hash(txs[1].tx)));
+  }
+}
+
+TEST(tx_pool_snapshot, checksum_mismatch)
+{
+  std::vector<tx_memory_pool::tx_details> txs = make_snapshot_txs(3);
+  ASSERT_TRUE(unit_test::write_pool_snapshot(test_folder, txs));
+  std::string buff = read_snapshot();
+  //last byte of second record's blob: everything from that record on is dropped
+  size_t broken_offset = sizeof(pool_snapshot_header) + add_record_size(txs[0]);
+  buff[broken_offset + add_record_size(txs[1]) - 1] ^= 1;
+  write_snapshot(buff);
+
+  unit_test::tx_pool_env env;
+  ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder));
+  ASSERT_EQ(1, env.pool.get_transactions_count());
+  ASSERT_TRUE(env.pool.have_tx(get_transaction_hash(txs[0].tx)));
+  ASSERT_EQ(broken_offset, read_snapshot().size());
+}
+
+TEST(tx_pool_snapshot, unknown_header)
+{
+  std::vector<tx_memory_pool::tx_details> txs = make_snapshot_txs(2);
+  ASSERT_TRUE(unit_test::write_pool_snapshot(test_folder, txs));
+  std::string buff = read_snapshot();
+  pool_snapshot_header hdr = AUTO_VAL_INIT(hdr);
+  memcpy(&hdr, buff.data(), sizeof(hdr));
+  hdr.version = POOL_SNAPSHOT_VERSION + 1;
+  memcpy(&buff[0], &hdr, sizeof(hdr));
+  write_snapshot(buff);
+
+  //broken snapshot is not fatal: pool starts empty and file is rewritten on store
+  {
+    unit_test::tx_pool_env env;
+    ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder));
+    ASSERT_EQ(0, env.pool.get_transactions_count());
+    ASSERT_TRUE(env.pool.deinit());
+  }
+  std::string rewritten;
+  append_snapshot_header(rewritten);
+  ASSERT_EQ(rewritten, read_snapshot());
+
+  write_snapshot("not a snapshot");
+  unit_test::tx_pool_env env;
+  ASSERT_TRUE(unit_test::init_pool(env.pool, test_folder));
+  ASSERT_EQ(0, env.pool.get_transactions_count());
+}
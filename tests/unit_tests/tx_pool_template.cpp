@@ -0,0 +1,142 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <algorithm>
+#include "gtest/gtest.h"
+
+#include "tx_pool_tests_utils.h"
+#include "common/int-util.h"
+
+using namespace unit_test;
+
+namespace
+{
+  const std::string test_folder = "test_pool_template";
+  const uint64_t fee_unit = TX_POOL_MINIMUM_FEE;
+
+  std::string chain_folder() { return test_folder + "/chain"; }
+  std::string pool_folder() { return test_folder + "/pool"; }
+
+  //comparator of block template sort used before fee rate index: higher fee per byte first, ties unordered
+  bool old_template_less(const currency::tx_memory_pool::tx_details& a, const currency::tx_memory_pool::tx_details& b)
+  {
+    uint64_t a_hi, a_lo = mul128(a.fee, b.blob_size, &a_hi);
+    uint64_t b_hi, b_lo = mul128(b.fee, a.blob_size, &b_hi);
+    return a_hi > b_hi || (a_hi == b_hi && a_lo > b_lo);
+  }
+
+  //transaction that is ready to go on top of block with given height and id without ring signature check
+  currency::tx_memory_pool::tx_details make_checked_tx_details(uint64_t seed, uint64_t fee, size_t blob_size, uint64_t block_height, const crypto::hash& block_id)
+  {
+    currency::tx_memory_pool::tx_details txd = make_pool_tx_details(seed, fee, blob_size);
+    txd.max_used_block_height = block_height;
+    txd.max_used_block_id = block_id;
+    return txd;
+  }
+}
+
+TEST(tx_pool_template, order_matches_fee_rate_sort)
+{
+  tx_pool_env env;
+  ASSERT_TRUE(init_blockchain(env.bcs, chain_folder()));
+  crypto::hash genesis_id = env.bcs.get_block_id_by_height(0);
+
+  //fee rates repeat both with equal and with proportional fee and size
+  std::vector<currency::tx_memory_pool::tx_details> txs;
+  for (uint64_t seed = 1; seed != 41; ++seed)
+    txs.push_back(make_checked_tx_details(seed, fee_unit * (seed % 4 + 1), 200 * (seed % 3 + 1), 0, genesis_id));
+  ASSERT_TRUE(write_pool_snapshot(pool_folder(), txs));
+  ASSERT_TRUE(init_pool(env.pool, pool_folder()));
+  ASSERT_EQ(txs.size(), env.pool.get_transactions_count());
+
+  currency::block bl = AUTO_VAL_INIT(bl);
+  size_t total_size = 0;
+  uint64_t fee = 0;
+  ASSERT_TRUE(env.pool.fill_block_template(bl, CURRENCY_BLOCK_GRANTED_FULL_REWARD_ZONE, 0, 0, total_size, fee));
+  ASSERT_EQ(txs.size(), bl.tx_hashes.size());
+
+  //old sort gives the same order, transactions with equal fee rate go by id
+  std::sort(txs.begin(), txs.end(), [](const currency::tx_memory_pool::tx_details& a, const currency::tx_memory_pool::tx_details& b)
+  {
+    crypto::hash a_id = currency::get_transaction_hash(a.tx), b_id = currency::get_transaction_hash(b.tx);
+    return memcmp(&a_id, &b_id, sizeof(a_id)) < 0;
+  });
+  std::stable_sort(txs.begin(), txs.end(), old_template_less);
+  uint64_t expected_fee = 0;
+  size_t expected_size = 0;
+  for (size_t i = 0; i != txs.size(); ++i)
+  {
+    ASSERT_EQ(currency::get_transaction_hash(txs[i].tx), bl.tx_hashes[i]);
+    expected_fee += txs[i].fee;
+    expected_size += txs[i].blob_size;
+  }
+  ASSERT_EQ(expected_fee, fee);
+  ASSERT_EQ(expected_size, total_size);
+
+  //order is kept when transactions leave pool
+  currency::transaction tx;
+  size_t blob_size = 0;
+  uint64_t tx_fee = 0;
+  ASSERT_TRUE(env.pool.take_tx(bl.tx_hashes[3], tx, blob_size, tx_fee));
+  ASSERT_TRUE(env.pool.take_tx(bl.tx_hashes[20], tx, blob_size, tx_fee));
+  currency::block bl2 = AUTO_VAL_INIT(bl2);
+  ASSERT_TRUE(env.pool.fill_block_template(bl2, CURRENCY_BLOCK_GRANTED_FULL_REWARD_ZONE, 0, 0, total_size, fee));
+  std::vector<crypto::hash> expected = bl.tx_hashes;
+  expected.erase(expected.begin() + 20);
+  expected.erase(expected.begin() + 3);
+  ASSERT_EQ(expected, bl2.tx_hashes);
+
+  env.pool.deinit();
+  env.bcs.deinit();
+}
+
+TEST(tx_pool_template, new_block_drops_cached_readiness)
+{
+  tx_pool_env env;
+  ASSERT_TRUE(init_blockchain(env.bcs, chain_folder()));
+  crypto::hash genesis_id = env.bcs.get_block_id_by_height(0);
+  currency::account_base miner;
+  miner.generate();
+
+  currency::block b = AUTO_VAL_INIT(b);
+  currency::wide_difficulty_type diff = 0;
+  uint64_t height = 0;
+  ASSERT_TRUE(env.bcs.create_block_template(b, miner.get_keys().m_account_address, diff, height, currency::blobdata(), false, currency::alias_info()));
+  ASSERT_EQ(1, height);
+  crypto::hash block_id = currency::get_block_hash(b);
+
+  //first transaction is ready now, second one was checked against block that is not in chain yet
+  std::vector<currency::tx_memory_pool::tx_details> txs;
+  txs.push_back(make_checked_tx_details(1, fee_unit, 200, 0, genesis_id));
+  txs.push_back(make_checked_tx_details(2, fee_unit * 2, 200, 1, block_id));
+  ASSERT_TRUE(write_pool_snapshot(pool_folder(), txs));
+  ASSERT_TRUE(init_pool(env.pool, pool_folder()));
+  crypto::hash ready_id = currency::get_transaction_hash(txs[0].tx);
+  crypto::hash waiting_id = currency::get_transaction_hash(txs[1].tx);
+
+  size_t total_size = 0;
+  uint64_t fee = 0;
+  for (size_t i = 0; i != 2; ++i)
+  {
+    currency::block bl = AUTO_VAL_INIT(bl);
+    ASSERT_TRUE(env.pool.fill_block_template(bl, CURRENCY_BLOCK_GRANTED_FULL_REWARD_ZONE, 0, 0, total_size, fee));
+    ASSERT_EQ(std::vector<crypto::hash>(1, ready_id), bl.tx_hashes);
+  }
+
+  //block bumps blockchain generation, readiness cached for previous top is checked again
+  currency::block_verification_context bvc = AUTO_VAL_INIT(bvc);
+  ASSERT_TRUE(env.bcs.add_new_block(b, bvc));
+  ASSERT_TRUE(bvc.m_added_to_main_chain);
+  ASSERT_EQ(2, env.bcs.get_current_blockchain_height());
+
+  currency::block bl = AUTO_VAL_INIT(bl);
+  ASSERT_TRUE(env.pool.fill_block_template(bl, CURRENCY_BLOCK_GRANTED_FULL_REWARD_ZONE, 0, 0, total_size, fee));
+  std::vector<crypto::hash> expected;
+  expected.push_back(waiting_id);
+  expected.push_back(ready_id);
+  ASSERT_EQ(expected, bl.tx_hashes);
+
+  env.pool.deinit();
+  env.bcs.deinit();
+}
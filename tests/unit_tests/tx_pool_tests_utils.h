@@ -0,0 +1,150 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "currency_core/blockchain_storage.h"
+#include "currency_core/currency_format_utils.h"
+#include "currency_core/tx_pool.h"
+#include "currency_core/tx_pool_snapshot.h"
+#include "file_io_utils.h"
+
+namespace unit_test
+{
+  //pool bound to blockchain storage; unless init_blockchain() is called, only code paths that don't touch blockchain can be used
+  struct tx_pool_env
+  {
+    tx_pool_env() : pool(bcs), bcs(pool)
+    {}
+    currency::tx_memory_pool pool;
+    currency::blockchain_storage bcs;
+  };
+
+  inline crypto::key_image make_key_image(uint64_t seed)
+  {
+    crypto::hash h = crypto::cn_fast_hash(&seed, sizeof(seed));
+    return *reinterpret_cast<const crypto::key_image*>(&h);
+  }
+
+  //one input transaction that pays given fee, key image is unique for seed
+  inline currency::transaction make_pool_tx(uint64_t seed, uint64_t fee)
+  {
+    currency::transaction tx = AUTO_VAL_INIT(tx);
+    tx.version = CURRENT_TRANSACTION_VERSION;
+    currency::txin_to_key in = AUTO_VAL_INIT(in);
+    in.amount = fee + 1000;
+    in.key_offsets.push_back(seed);
+    in.k_image = make_key_image(seed);
+    tx.vin.push_back(in);
+    currency::tx_out out = AUTO_VAL_INIT(out);
+    out.amount = 1000;
+    tx.vout.push_back(out);
+    tx.signatures.resize(1);
+    return tx;
+  }
+
+  //blob_size 0 means actual size of tx blob
+  inline currency::tx_memory_pool::tx_details make_pool_tx_details(uint64_t seed, uint64_t fee, size_t blob_size = 0, bool kept_by_block = false)
+  {
+    currency::tx_memory_pool::tx_details txd = AUTO_VAL_INIT(txd);
+    txd.tx = make_pool_tx(seed, fee);
+    txd.blob_size = blob_size ? blob_size : currency::get_object_blobsize(txd.tx);
+    txd.fee = fee;
+    txd.kept_by_block = kept_by_block;
+    txd.receive_time = time(nullptr);
+    return txd;
+  }
+
+  inline bool init_pool(currency::tx_memory_pool& pool, const std::string& folder, uint64_t max_memory = 0, uint64_t max_count = 0)
+  {
+    boost::program_options::options_description desc;
+    currency::tx_memory_pool::init_options(desc);
+    std::vector<std::string> args;
+    if (max_memory)
+      args.push_back("--tx-pool-max-memory=" + std::to_string(max_memory));
+    if (max_count)
+      args.push_back("--tx-pool-max-count=" + std::to_string(max_count));
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::command_line_parser(args).options(desc).run(), vm);
+    boost::program_options::notify(vm);
+    return pool.init(vm, folder);
+  }
+
+  //blockchain with genesis block only in empty folder
+  inline bool init_blockchain(currency::blockchain_storage& bcs, const std::string& folder)
+  {
+    boost::filesystem::remove_all(folder);
+    boost::program_options::options_description desc;
+    currency::blockchain_storage::init_options(desc);
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::command_line_parser(std::vector<std::string>()).options(desc).run(), vm);
+    boost::program_options::notify(vm);
+    return bcs.init(vm, folder);
+  }
+
+  //blocks mined to addr; timestamps are one difficulty target apart, so difficulty stays 1 and any nonce fits
+  inline bool mine_blocks(currency::blockchain_storage& bcs, const currency::account_public_address& addr, size_t count)
+  {
+    for (size_t i = 0; i != count; ++i)
+    {
+      currency::block top = AUTO_VAL_INIT(top);
+      CHECK_AND_ASSERT_MES(bcs.get_top_block(top), false, "no top block");
+      currency::block b = AUTO_VAL_INIT(b);
+      currency::wide_difficulty_type diff = 0;
+      uint64_t height = 0;
+      CHECK_AND_ASSERT_MES(bcs.create_block_template(b, addr, diff, height, currency::blobdata(), false, currency::alias_info()), false, "failed to create block template");
+      CHECK_AND_ASSERT_MES(diff == 1, false, "unexpected difficulty " << diff << " at height " << height);
+      b.timestamp = top.timestamp + DIFFICULTY_TARGET;
+      currency::block_verification_context bvc = AUTO_VAL_INIT(bvc);
+      CHECK_AND_ASSERT_MES(bcs.add_new_block(b, bvc) && bvc.m_added_to_main_chain, false, "block at height " << height << " not added");
+    }
+    return true;
+  }
+
+  //sends biggest output of miner tx at height back to account, without mixins
+  inline bool make_miner_output_spend(currency::blockchain_storage& bcs, const currency::account_base& acc, uint64_t height, uint64_t fee, currency::transaction& tx)
+  {
+    currency::block b = AUTO_VAL_INIT(b);
+    CHECK_AND_ASSERT_MES(bcs.get_block_by_height(height, b), false, "no block at height " << height);
+    std::vector<uint64_t> gindexes;
+    CHECK_AND_ASSERT_MES(bcs.get_tx_outputs_gindexs(currency::get_transaction_hash(b.miner_tx), gindexes) && gindexes.size() == b.miner_tx.vout.size(), false, "no global indexes of miner tx");
+    size_t i = std::max_element(b.miner_tx.vout.begin(), b.miner_tx.vout.end(), [](const currency::tx_out& l, const currency::tx_out& r) { return l.amount < r.amount; }) - b.miner_tx.vout.begin();
+    const currency::tx_out& out = b.miner_tx.vout[i];
+    CHECK_AND_ASSERT_MES(out.amount > fee, false, "miner output is too small");
+
+    currency::tx_source_entry src = AUTO_VAL_INIT(src);
+    src.outputs.push_back(currency::tx_source_entry::output_entry(gindexes[i], boost::get<currency::txout_to_key>(out.target).key));
+    src.real_output = 0;
+    src.real_out_tx_key = currency::get_tx_pub_key_from_extra(b.miner_tx);
+    src.real_output_in_tx_index = i;
+    src.amount = out.amount;
+    std::vector<currency::tx_source_entry> sources(1, src);
+    std::vector<currency::tx_destination_entry> dsts(1, currency::tx_destination_entry(out.amount - fee, acc.get_keys().m_account_address));
+    currency::keypair txkey = AUTO_VAL_INIT(txkey);
+    return currency::construct_tx(acc.get_keys(), sources, dsts, tx, txkey, 0);
+  }
+
+  inline std::string get_pool_snapshot_path(const std::string& folder)
+  {
+    return folder + "/" + CURRENCY_POOLDATA_SNAPSHOT_FILENAME;
+  }
+
+  //writes snapshot with add records for all entries to empty folder
+  inline bool write_pool_snapshot(const std::string& folder, const std::vector<currency::tx_memory_pool::tx_details>& txs)
+  {
+    boost::filesystem::remove_all(folder);
+    boost::filesystem::create_directories(folder);
+    std::string buff;
+    currency::append_snapshot_header(buff);
+    for (const auto& txd : txs)
+      currency::append_snapshot_record(buff, currency::pool_snapshot_record_add, currency::get_transaction_hash(txd.tx), &txd);
+    return epee::file_io_utils::save_string_to_file(get_pool_snapshot_path(folder), buff);
+  }
+}
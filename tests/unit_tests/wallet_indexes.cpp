@@ -0,0 +1,249 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "wallet_tests_utils.h"
+
+using namespace unit_test;
+
+namespace
+{
+  const std::string test_folder = "test_wallet_indexes";
+  const uint64_t transfer_fee = DEFAULT_FEE;
+
+  //balances kept by wallet indexes are the same as found by scan of all transfers
+  void check_balances(tools::wallet2& w, uint64_t unconfirmed_change = 0)
+  {
+    tools::wallet2::transfer_container transfers;
+    w.get_transfers(transfers);
+    transfers_scan scan = scan_transfers(transfers, w.get_blockchain_current_height());
+    ASSERT_EQ(scan.unspent + unconfirmed_change, w.balance());
+    ASSERT_EQ(scan.unlocked_unspent, w.unlocked_balance());
+  }
+
+  //transfers that select_transfers picks for amount, if they were found by scan of all transfers
+  std::set<size_t> expected_selection(tools::wallet2& w, uint64_t amount)
+  {
+    tools::wallet2::transfer_container transfers;
+    w.get_transfers(transfers);
+    transfers_scan scan = scan_transfers(transfers, w.get_blockchain_current_height());
+    std::list<size_t> selected;
+    tools::wallet2::select_indices_for_transfer(selected, scan.free_amounts, amount + transfer_fee);
+    return std::set<size_t>(selected.begin(), selected.end());
+  }
+
+  std::set<size_t> selection_of(tools::wallet2& w, const currency::transaction& tx)
+  {
+    tools::wallet2::transfer_container transfers;
+    w.get_transfers(transfers);
+    return get_spent_transfers(transfers, tx);
+  }
+
+  void send(tools::wallet2& w, const currency::account_public_address& to, uint64_t amount, currency::transaction& tx)
+  {
+    std::vector<currency::tx_destination_entry> dsts(1, currency::tx_destination_entry(amount, to));
+    w.transfer(dsts, 0, 0, transfer_fee, std::vector<uint8_t>(), tx);
+  }
+
+  struct indexes_env
+  {
+    indexes_env() : proxy(std::make_shared<test_core_proxy>())
+    {
+      init_test_wallet(w, test_folder, proxy);
+      other.generate();
+    }
+
+    const currency::account_public_address& addr() { return w.get_account().get_keys().m_account_address; }
+
+    void add_blocks(const currency::account_public_address& to, size_t count, uint64_t amount)
+    {
+      for (size_t i = 0; i != count; ++i)
+        proxy->add_block(make_coinbase_tx(proxy->height(), to, amount));
+    }
+
+    std::shared_ptr<test_core_proxy> proxy;
+    tools::wallet2 w;
+    currency::account_base other;
+  };
+}
+
+TEST(wallet_indexes, receive)
+{
+  indexes_env env;
+  check_balances(env.w);
+
+  //amounts repeat, so several transfers share one amount bucket
+  for (uint64_t a : {3, 5, 3, 8, 5, 3})
+    env.add_blocks(env.addr(), 1, a * DEFAULT_FEE);
+  env.w.refresh();
+  check_balances(env.w);
+  ASSERT_EQ(27 * DEFAULT_FEE, env.w.balance());
+  ASSERT_EQ(0, env.w.unlocked_balance());
+
+  //transfers get unlocked one by one as chain grows
+  for (size_t i = 0; i != DEFAULT_TX_SPENDABLE_AGE - 6; ++i)
+  {
+    env.add_blocks(env.other.get_keys().m_account_address, 1, DEFAULT_FEE);
+    env.w.refresh();
+    check_balances(env.w);
+  }
+  ASSERT_EQ(3 * DEFAULT_FEE, env.w.unlocked_balance());
+  for (size_t i = 0; i != 4; ++i)
+  {
+    env.add_blocks(env.other.get_keys().m_account_address, 1, DEFAULT_FEE);
+    env.w.refresh();
+    check_balances(env.w);
+    ASSERT_GT(env.w.balance(), env.w.unlocked_balance());
+  }
+  env.add_blocks(env.other.get_keys().m_account_address, 1, DEFAULT_FEE);
+  env.w.refresh();
+  check_balances(env.w);
+  ASSERT_EQ(env.w.balance(), env.w.unlocked_balance());
+}
+
+TEST(wallet_indexes, spend_and_rejected_spend)
+{
+  indexes_env env;
+  for (uint64_t a : {3, 5, 3, 8, 5, 3, 2, 2})
+    env.add_blocks(env.addr(), 1, a * DEFAULT_FEE);
+  env.add_blocks(env.other.get_keys().m_account_address, DEFAULT_TX_SPENDABLE_AGE, DEFAULT_FEE);
+  env.w.refresh();
+  check_balances(env.w);
+  uint64_t balance = env.w.balance();
+
+  //rejected transaction returns its inputs back to indexes
+  for (uint64_t a : {1, 4, 9, 12})
+  {
+    std::set<size_t> expected = expected_selection(env.w, a * DEFAULT_FEE);
+    env.proxy->send_tx_status = "Failed";
+    currency::transaction tx;
+    ASSERT_THROW(send(env.w, env.other.get_keys().m_account_address, a * DEFAULT_FEE, tx), tools::error::tx_rejected);
+    ASSERT_EQ(expected, selection_of(env.w, tx));
+    check_balances(env.w);
+    ASSERT_EQ(balance, env.w.balance());
+  }
+
+  //accepted transaction spends inputs, change comes back as unconfirmed until it is in block
+  env.proxy->send_tx_status = CORE_RPC_STATUS_OK;
+  uint64_t amount = 9 * DEFAULT_FEE;
+  std::set<size_t> expected = expected_selection(env.w, amount);
+  currency::transaction tx;
+  send(env.w, env.other.get_keys().m_account_address, amount, tx);
+  std::set<size_t> selected = selection_of(env.w, tx);
+  ASSERT_EQ(expected, selected);
+  uint64_t spent = 0;
+  tools::wallet2::transfer_container transfers;
+  env.w.get_transfers(transfers);
+  for (size_t i : selected)
+  {
+    ASSERT_TRUE(transfers[i].m_spent);
+    spent += transfers[i].amount();
+  }
+  uint64_t change = spent - amount - transfer_fee;
+  check_balances(env.w, change);
+  ASSERT_EQ(balance - amount - transfer_fee, env.w.balance());
+
+  //next selection doesn't see spent transfers
+  for (uint64_t a : {1, 4, 9})
+  {
+    std::set<size_t> next = expected_selection(env.w, a * DEFAULT_FEE);
+    env.proxy->send_tx_status = "Failed";
+    currency::transaction rejected;
+    ASSERT_THROW(send(env.w, env.other.get_keys().m_account_address, a * DEFAULT_FEE, rejected), tools::error::tx_rejected);
+    ASSERT_EQ(next, selection_of(env.w, rejected));
+    for (size_t i : next)
+      ASSERT_EQ(0, selected.count(i));
+    check_balances(env.w, change);
+  }
+
+  //transaction gets into block
+  std::vector<currency::transaction> txs(1, tx);
+  env.proxy->add_block(make_coinbase_tx(env.proxy->height(), env.other.get_keys().m_account_address, DEFAULT_FEE), txs);
+  env.w.refresh();
+  check_balances(env.w);
+  ASSERT_EQ(balance - amount - transfer_fee, env.w.balance());
+}
+
+TEST(wallet_indexes, rejected_offline_spend)
+{
+  //view only wallet marks inputs spent when it prepares transaction, and returns them back if signed one is rejected
+  indexes_env env;
+  for (uint64_t a : {3, 5, 3, 8, 5})
+    env.add_blocks(env.addr(), 1, a * DEFAULT_FEE);
+  env.add_blocks(env.other.get_keys().m_account_address, DEFAULT_TX_SPENDABLE_AGE, DEFAULT_FEE);
+  ASSERT_TRUE(env.w.generate_view_wallet(test_folder + "/view.keys", ""));
+  tools::wallet2 view;
+  view.load(test_folder + "/view.keys", "");
+  std::shared_ptr<tools::i_core_proxy> proxy = env.proxy;
+  view.set_core_proxy(proxy);
+  ASSERT_TRUE(view.is_view_only());
+  view.refresh();
+  check_balances(view);
+  uint64_t balance = view.balance();
+  ASSERT_EQ(24 * DEFAULT_FEE, balance);
+  ASSERT_EQ(balance, view.unlocked_balance());
+
+  const std::string unsigned_file = "unsigned_boolberry_tx";
+  const std::string signed_file = test_folder + "/signed_tx";
+  for (uint64_t a : {4, 9, 12})
+  {
+    currency::transaction tx;
+    send(view, env.other.get_keys().m_account_address, a * DEFAULT_FEE, tx);
+    check_balances(view);
+    ASSERT_GT(balance, view.unlocked_balance());
+
+    env.w.sign_transfer(unsigned_file, signed_file, tx);
+    env.proxy->send_tx_status = "Failed";
+    ASSERT_THROW(view.submit_transfer(unsigned_file, signed_file, tx), tools::error::tx_rejected);
+    check_balances(view);
+    ASSERT_EQ(balance, view.balance());
+    ASSERT_EQ(balance, view.unlocked_balance());
+  }
+  boost::filesystem::remove(unsigned_file);
+}
+
+TEST(wallet_indexes, detach_blockchain)
+{
+  indexes_env env;
+  for (uint64_t a : {3, 5, 3, 8})
+    env.add_blocks(env.addr(), 1, a * DEFAULT_FEE);
+  env.add_blocks(env.other.get_keys().m_account_address, DEFAULT_TX_SPENDABLE_AGE, DEFAULT_FEE);
+  uint64_t split_height = env.proxy->height();
+  for (uint64_t a : {7, 3, 5})
+    env.add_blocks(env.addr(), 1, a * DEFAULT_FEE);
+  env.add_blocks(env.other.get_keys().m_account_address, DEFAULT_TX_SPENDABLE_AGE, DEFAULT_FEE);
+  env.w.refresh();
+  check_balances(env.w);
+  ASSERT_EQ(34 * DEFAULT_FEE, env.w.unlocked_balance());
+
+  //spending transaction gets into block above split
+  currency::transaction tx;
+  send(env.w, env.other.get_keys().m_account_address, 2 * DEFAULT_FEE, tx);
+  std::vector<currency::transaction> txs(1, tx);
+  env.proxy->add_block(make_coinbase_tx(env.proxy->height(), env.other.get_keys().m_account_address, DEFAULT_FEE), txs);
+  env.w.refresh();
+  check_balances(env.w);
+
+  //other chain: transfers above split are gone, new one is locked until new chain grows
+  env.proxy->pop_blocks(split_height);
+  env.add_blocks(env.addr(), 1, 4 * DEFAULT_FEE);
+  env.add_blocks(env.other.get_keys().m_account_address, 2, DEFAULT_FEE);
+  env.w.refresh();
+  ASSERT_EQ(split_height + 3, env.w.get_blockchain_current_height());
+  check_balances(env.w);
+  ASSERT_LT(env.w.unlocked_balance(), env.w.balance());
+
+  std::set<size_t> expected = expected_selection(env.w, 3 * DEFAULT_FEE);
+  env.proxy->send_tx_status = "Failed";
+  currency::transaction rejected;
+  ASSERT_THROW(send(env.w, env.other.get_keys().m_account_address, 3 * DEFAULT_FEE, rejected), tools::error::tx_rejected);
+  ASSERT_EQ(expected, selection_of(env.w, rejected));
+
+  env.proxy->send_tx_status = CORE_RPC_STATUS_OK;
+  env.add_blocks(env.other.get_keys().m_account_address, DEFAULT_TX_SPENDABLE_AGE, DEFAULT_FEE);
+  env.w.refresh();
+  check_balances(env.w);
+  ASSERT_EQ(env.w.balance(), env.w.unlocked_balance());
+}
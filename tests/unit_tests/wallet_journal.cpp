@@ -0,0 +1,197 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "wallet_tests_utils.h"
+
+using namespace unit_test;
+
+namespace
+{
+  const std::string test_folder = "test_wallet_journal";
+  const currency::payment_id_t test_payment_id = "journal-test";
+
+  std::string wallet_file() { return test_folder + "/wallet"; }
+  std::string journal_file() { return test_folder + "/wallet.journal"; }
+
+  uint64_t file_size(const std::string& path)
+  {
+    boost::system::error_code e;
+    uint64_t size = boost::filesystem::file_size(path, e);
+    return e ? 0 : size;
+  }
+
+  void add_blocks(test_core_proxy& proxy, const currency::account_public_address& addr, size_t count, uint64_t amount)
+  {
+    for (size_t i = 0; i != count; ++i)
+      proxy.add_block(make_coinbase_tx(proxy.height(), addr, amount));
+  }
+
+  void expect_same_wallets(tools::wallet2& a, tools::wallet2& b)
+  {
+    ASSERT_EQ(a.get_blockchain_current_height(), b.get_blockchain_current_height());
+    tools::wallet2::transfer_container ta, tb;
+    a.get_transfers(ta);
+    b.get_transfers(tb);
+    ASSERT_EQ(ta.size(), tb.size());
+    for (size_t i = 0; i != ta.size(); ++i)
+    {
+      ASSERT_EQ(ta[i].m_key_image, tb[i].m_key_image);
+      ASSERT_EQ(ta[i].m_spent, tb[i].m_spent);
+      ASSERT_EQ(ta[i].amount(), tb[i].amount());
+      ASSERT_EQ(ta[i].m_block_height, tb[i].m_block_height);
+    }
+    ASSERT_EQ(a.balance(), b.balance());
+    ASSERT_EQ(a.unlocked_balance(), b.unlocked_balance());
+
+    std::list<tools::wallet2::payment_details> pa, pb;
+    a.get_payments(test_payment_id, pa);
+    b.get_payments(test_payment_id, pb);
+    ASSERT_EQ(pa.size(), pb.size());
+    for (auto ia = pa.begin(), ib = pb.begin(); ia != pa.end(); ++ia, ++ib)
+    {
+      ASSERT_EQ(ia->m_tx_hash, ib->m_tx_hash);
+      ASSERT_EQ(ia->m_amount, ib->m_amount);
+    }
+
+    std::vector<tools::wallet_rpc::wallet_transfer_info> ua, ub;
+    a.get_unconfirmed_transfers(ua);
+    b.get_unconfirmed_transfers(ub);
+    ASSERT_EQ(ua.size(), ub.size());
+  }
+
+  //wallet gets coinbase outputs and one payment, then spends some of them; each part is stored to journal
+  struct journal_env
+  {
+    journal_env() : proxy(std::make_shared<test_core_proxy>())
+    {}
+
+    void init()
+    {
+      init_test_wallet(w, test_folder, proxy);
+      other.generate();
+      wallet_file_size = file_size(wallet_file());
+    }
+
+    void receive()
+    {
+      const currency::account_public_address& addr = w.get_account().get_keys().m_account_address;
+      add_blocks(*proxy, addr, 3, 5 * DEFAULT_FEE);
+      std::vector<currency::transaction> txs(1, make_coinbase_tx(proxy->height(), addr, 7 * DEFAULT_FEE, test_payment_id));
+      proxy->add_block(make_coinbase_tx(proxy->height(), other.get_keys().m_account_address, DEFAULT_FEE), txs);
+      w.refresh();
+    }
+
+    void spend()
+    {
+      add_blocks(*proxy, other.get_keys().m_account_address, DEFAULT_TX_SPENDABLE_AGE, DEFAULT_FEE);
+      w.refresh();
+      std::vector<currency::tx_destination_entry> dsts(1, currency::tx_destination_entry(3 * DEFAULT_FEE, other.get_keys().m_account_address));
+      currency::transaction tx;
+      w.transfer(dsts, 0, 0, DEFAULT_FEE, std::vector<uint8_t>(), tx);
+    }
+
+    std::shared_ptr<test_core_proxy> proxy;
+    tools::wallet2 w;
+    currency::account_base other;
+    uint64_t wallet_file_size;
+  };
+}
+
+TEST(wallet_journal, records_are_appended_and_replayed)
+{
+  journal_env env;
+  env.init();
+  ASSERT_FALSE(boost::filesystem::exists(journal_file()));
+
+  env.receive();
+  ASSERT_EQ(22 * DEFAULT_FEE, env.w.balance());
+  env.w.store();
+  uint64_t journal_size = file_size(journal_file());
+  ASSERT_LT(0, journal_size);
+  ASSERT_EQ(env.wallet_file_size, file_size(wallet_file()));
+
+  env.spend();
+  tools::wallet2::transfer_container transfers;
+  env.w.get_transfers(transfers);
+  ASSERT_TRUE(std::any_of(transfers.begin(), transfers.end(), [](const tools::wallet2::transfer_details& td) { return td.m_spent; }));
+  env.w.store();
+  ASSERT_LT(journal_size, file_size(journal_file()));
+  ASSERT_EQ(env.wallet_file_size, file_size(wallet_file()));
+
+  tools::wallet2 loaded;
+  load_test_wallet(loaded, test_folder, env.proxy);
+  expect_same_wallets(env.w, loaded);
+
+  //nothing changed, record is still appended and replayed fine
+  journal_size = file_size(journal_file());
+  loaded.store();
+  ASSERT_LT(journal_size, file_size(journal_file()));
+  tools::wallet2 reloaded;
+  load_test_wallet(reloaded, test_folder, env.proxy);
+  expect_same_wallets(env.w, reloaded);
+}
+
+TEST(wallet_journal, torn_tail_is_truncated)
+{
+  journal_env env;
+  env.init();
+  env.receive();
+  env.w.store();
+  uint64_t journal_size = file_size(journal_file());
+
+  tools::wallet2 before_spend;
+  load_test_wallet(before_spend, test_folder, env.proxy);
+
+  env.spend();
+  env.w.store();
+  uint64_t full_journal_size = file_size(journal_file());
+  ASSERT_LT(journal_size, full_journal_size);
+
+  //write of last record was interrupted
+  boost::filesystem::resize_file(journal_file(), full_journal_size - 5);
+  tools::wallet2 loaded;
+  load_test_wallet(loaded, test_folder, env.proxy);
+  expect_same_wallets(before_spend, loaded);
+  ASSERT_EQ(journal_size, file_size(journal_file()));
+
+  //next record continues right after the last complete one
+  loaded.refresh();
+  loaded.store();
+  tools::wallet2 reloaded;
+  load_test_wallet(reloaded, test_folder, env.proxy);
+  expect_same_wallets(loaded, reloaded);
+}
+
+TEST(wallet_journal, journal_of_other_store_is_ignored)
+{
+  journal_env env;
+  env.init();
+  tools::wallet2 empty;
+  load_test_wallet(empty, test_folder, env.proxy);
+
+  env.receive();
+  env.w.store();
+
+  //journal left from other full store of wallet file
+  std::string buff;
+  ASSERT_TRUE(epee::file_io_utils::load_file_to_string(journal_file(), buff));
+  crypto::hash other_id = crypto::rand<crypto::hash>();
+  buff.replace(0, sizeof(other_id), reinterpret_cast<const char*>(&other_id), sizeof(other_id));
+  ASSERT_TRUE(epee::file_io_utils::save_string_to_file(journal_file(), buff));
+
+  tools::wallet2 loaded;
+  load_test_wallet(loaded, test_folder, env.proxy);
+  expect_same_wallets(empty, loaded);
+  ASSERT_EQ(1, loaded.get_blockchain_current_height());
+
+  //journal is started over for wallet file that is there
+  loaded.refresh();
+  loaded.store();
+  ASSERT_EQ(env.wallet_file_size, file_size(wallet_file()));
+  tools::wallet2 reloaded;
+  load_test_wallet(reloaded, test_folder, env.proxy);
+  expect_same_wallets(env.w, reloaded);
+}
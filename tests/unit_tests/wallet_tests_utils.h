@@ -0,0 +1,215 @@
+// Copyright (c) 2012-2018 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+#include "currency_core/currency_format_utils.h"
+#include "wallet/wallet2.h"
+
+namespace unit_test
+{
+  //daemon emulation for wallet2: keeps chain of blocks in memory, outputs are numbered in order they appear
+  struct test_core_proxy : public tools::i_core_proxy
+  {
+    struct block_entry
+    {
+      currency::block b;
+      std::vector<currency::transaction> txs;
+    };
+
+    test_core_proxy() : global_outs_count(0), send_tx_status(CORE_RPC_STATUS_OK)
+    {
+      block_entry genesis = AUTO_VAL_INIT(genesis);
+      currency::generate_genesis_block(genesis.b);
+      add_tx_indexes(genesis.b.miner_tx);
+      chain.push_back(genesis);
+    }
+
+    uint64_t height() const { return chain.size(); }
+
+    void add_block(const currency::transaction& miner_tx, const std::vector<currency::transaction>& txs = std::vector<currency::transaction>())
+    {
+      block_entry be = AUTO_VAL_INIT(be);
+      be.b.major_version = CURRENT_BLOCK_MAJOR_VERSION;
+      be.b.timestamp = time(nullptr);
+      be.b.prev_id = currency::get_block_hash(chain.back().b);
+      be.b.miner_tx = miner_tx;
+      add_tx_indexes(miner_tx);
+      for (const auto& tx : txs)
+      {
+        be.b.tx_hashes.push_back(currency::get_transaction_hash(tx));
+        add_tx_indexes(tx);
+      }
+      be.txs = txs;
+      chain.push_back(be);
+    }
+
+    //chain switch: blocks from height are replaced by the ones added after this call
+    void pop_blocks(uint64_t height)
+    {
+      chain.resize(static_cast<size_t>(height));
+    }
+
+    virtual bool set_connection_addr(const std::string& url) { return true; }
+    virtual bool call_COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES(const currency::COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::request& rqt, currency::COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::response& rsp)
+    {
+      auto it = o_indexes.find(rqt.txid);
+      if (it == o_indexes.end())
+        return false;
+      rsp.o_indexes = it->second;
+      rsp.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
+    virtual bool call_COMMAND_RPC_GET_BLOCKS_FAST(const currency::COMMAND_RPC_GET_BLOCKS_FAST::request& rqt, currency::COMMAND_RPC_GET_BLOCKS_FAST::response& rsp)
+    {
+      //first id of history that is in chain is split point, response starts from it
+      size_t start = 0;
+      for (const auto& id : rqt.block_ids)
+      {
+        auto it = std::find_if(chain.begin(), chain.end(), [&](const block_entry& be) { return currency::get_block_hash(be.b) == id; });
+        if (it != chain.end())
+        {
+          start = it - chain.begin();
+          break;
+        }
+      }
+      for (size_t i = start; i != chain.size(); ++i)
+      {
+        currency::block_complete_entry bce;
+        bce.block = currency::block_to_blob(chain[i].b);
+        for (const auto& tx : chain[i].txs)
+          bce.txs.push_back(currency::tx_to_blob(tx));
+        rsp.blocks.push_back(bce);
+      }
+      rsp.start_height = start;
+      rsp.current_height = chain.size();
+      rsp.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
+    virtual bool call_COMMAND_RPC_GET_INFO(const currency::COMMAND_RPC_GET_INFO::request& rqt, currency::COMMAND_RPC_GET_INFO::response& rsp)
+    {
+      rsp.current_blocks_median = CURRENCY_BLOCK_GRANTED_FULL_REWARD_ZONE;
+      rsp.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
+    virtual bool call_COMMAND_RPC_GET_TX_POOL(const currency::COMMAND_RPC_GET_TX_POOL::request& rqt, currency::COMMAND_RPC_GET_TX_POOL::response& rsp)
+    {
+      rsp.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
+    virtual bool call_COMMAND_RPC_GET_ALIASES_BY_ADDRESS(const currency::COMMAND_RPC_GET_ALIASES_BY_ADDRESS::request& rqt, currency::COMMAND_RPC_GET_ALIASES_BY_ADDRESS::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS(const currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& rqt, currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_SEND_RAW_TX(const currency::COMMAND_RPC_SEND_RAW_TX::request& rqt, currency::COMMAND_RPC_SEND_RAW_TX::response& rsp)
+    {
+      rsp.status = send_tx_status;
+      return true;
+    }
+    virtual bool call_COMMAND_RPC_GET_ALL_ALIASES(currency::COMMAND_RPC_GET_ALL_ALIASES::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_GET_ALIAS_DETAILS(const currency::COMMAND_RPC_GET_ALIAS_DETAILS::request& req, currency::COMMAND_RPC_GET_ALIAS_DETAILS::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_GET_TRANSACTIONS(const currency::COMMAND_RPC_GET_TRANSACTIONS::request& req, currency::COMMAND_RPC_GET_TRANSACTIONS::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_COMMAND_RPC_CHECK_KEYIMAGES(const currency::COMMAND_RPC_CHECK_KEYIMAGES::request& req, currency::COMMAND_RPC_CHECK_KEYIMAGES::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_VALIDATE_SIGNED_TEXT(const currency::COMMAND_RPC_VALIDATE_SIGNED_TEXT::request& req, currency::COMMAND_RPC_VALIDATE_SIGNED_TEXT::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_RELAY_TXS(const currency::COMMAND_RPC_RELAY_TXS::request& req, currency::COMMAND_RPC_RELAY_TXS::response& rsp)
+    {
+      rsp.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
+    virtual bool check_connection() { return true; }
+    virtual bool get_transfer_address(const std::string& adr_str, currency::account_public_address& addr, currency::payment_id_t& payment_id) { return false; }
+
+    std::vector<block_entry> chain;
+    std::unordered_map<crypto::hash, std::vector<uint64_t> > o_indexes;
+    uint64_t global_outs_count;
+    std::string send_tx_status;                           //status returned for sent transactions
+
+  private:
+    void add_tx_indexes(const currency::transaction& tx)
+    {
+      std::vector<uint64_t>& indexes = o_indexes[currency::get_transaction_hash(tx)];
+      indexes.clear();
+      for (size_t i = 0; i != tx.vout.size(); ++i)
+        indexes.push_back(global_outs_count++);
+    }
+  };
+
+  //miner transaction with one output; with payment_id it is seen by wallet as payment
+  inline currency::transaction make_coinbase_tx(uint64_t height, const currency::account_public_address& addr, uint64_t amount,
+    const currency::payment_id_t& payment_id = currency::payment_id_t())
+  {
+    currency::transaction tx = AUTO_VAL_INIT(tx);
+    tx.version = CURRENT_TRANSACTION_VERSION;
+    currency::txin_gen in = AUTO_VAL_INIT(in);
+    in.height = static_cast<size_t>(height);
+    tx.vin.push_back(in);
+    currency::keypair txkey = currency::keypair::generate();
+    currency::add_tx_pub_key_to_extra(tx, txkey.pub);
+    if (payment_id.size())
+      currency::set_payment_id_to_tx_extra(tx.extra, payment_id);
+    currency::construct_tx_out(addr, txkey.sec, 0, amount, tx);
+    return tx;
+  }
+
+  //new wallet in empty folder, talking to proxy
+  inline void init_test_wallet(tools::wallet2& w, const std::string& folder, std::shared_ptr<tools::i_core_proxy> proxy)
+  {
+    boost::filesystem::remove_all(folder);
+    boost::filesystem::create_directories(folder);
+    w.generate(folder + "/wallet", "");
+    w.set_core_proxy(proxy);
+  }
+
+  inline void load_test_wallet(tools::wallet2& w, const std::string& folder, std::shared_ptr<tools::i_core_proxy> proxy)
+  {
+    w.load(folder + "/wallet", "");
+    w.set_core_proxy(proxy);
+  }
+
+  //what wallet indexes should give, found by plain scan of all transfers
+  struct transfers_scan
+  {
+    uint64_t unspent;
+    uint64_t unlocked_unspent;
+    std::map<uint64_t, std::list<size_t> > free_amounts;   //unlocked unspent transfers by amount, as select_transfers sees them
+  };
+
+  inline transfers_scan scan_transfers(const tools::wallet2::transfer_container& transfers, uint64_t wallet_height)
+  {
+    transfers_scan res = AUTO_VAL_INIT(res);
+    for (size_t i = 0; i != transfers.size(); ++i)
+    {
+      const tools::wallet2::transfer_details& td = transfers[i];
+      if (td.m_spent)
+        continue;
+      res.unspent += td.amount();
+      if (td.m_tx.unlock_time || td.m_block_height + DEFAULT_TX_SPENDABLE_AGE > wallet_height)
+        continue;
+      res.unlocked_unspent += td.amount();
+      res.free_amounts[td.amount()].push_back(i);
+    }
+    return res;
+  }
+
+  //transfer indexes spent by tx inputs
+  inline std::set<size_t> get_spent_transfers(const tools::wallet2::transfer_container& transfers, const currency::transaction& tx)
+  {
+    std::set<size_t> res;
+    for (const auto& in : tx.vin)
+    {
+      const crypto::key_image& ki = boost::get<currency::txin_to_key>(in).k_image;
+      for (size_t i = 0; i != transfers.size(); ++i)
+        if (transfers[i].m_key_image == ki)
+          res.insert(i);
+    }
+    return res;
+  }
+}